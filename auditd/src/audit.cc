@@ -447,36 +447,96 @@ bool Audit::add_to_filleventqueue(const uint32_t event_id,
     //       in the correct fields.. if not we should add an
     //       event to the audit trail saying it is one in an illegal
     //       format (or missing fields)
-    bool res;
-    Event* new_event = new Event(event_id, payload, length);
-    cb_mutex_enter(&producer_consumer_lock);
-    if (filleventqueue->size() < max_audit_queue) {
-        filleventqueue->push(new_event);
-        cb_cond_broadcast(&events_arrived);
-        res = true;
-    } else {
-        logger->log(EXTENSION_LOG_WARNING, NULL,
-                    "Audit: Dropping audit event %u: %s",
-                    new_event->id, new_event->payload.c_str());
-        dropped_events++;
-        delete new_event;
-        res = false;
+    std::unique_ptr<Event> new_event(new Event(event_id, payload, length));
+    return enqueue(new_event, true);
+}
+
+
+bool Audit::add_to_filleventqueue(const uint32_t event_id,
+                                  unique_cJSON_ptr& payload) {
+    std::unique_ptr<Event> new_event(new Event(event_id, std::move(payload)));
+    if (enqueue(new_event, true)) {
+        return true;
     }
-    cb_mutex_exit(&producer_consumer_lock);
-    return res;
+    // Hand the payload back so that the caller may log it
+    payload = std::move(new_event->json);
+    return false;
 }
 
 
 bool Audit::add_reconfigure_event(const char* configfile, const void *cookie) {
-    ConfigureEvent* new_event = new ConfigureEvent(configfile, cookie);
-    cb_mutex_enter(&producer_consumer_lock);
-    filleventqueue->push(new_event);
-    cb_cond_broadcast(&events_arrived);
-    cb_mutex_exit(&producer_consumer_lock);
+    std::unique_ptr<Event> new_event(new ConfigureEvent(configfile, cookie));
+    return enqueue(new_event, false);
+}
+
+
+bool Audit::enqueue(std::unique_ptr<Event>& event, bool bounded) {
+    if (queue_depth.fetch_add(1) >= max_audit_queue && bounded) {
+        queue_depth--;
+        if (event->json) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Audit: Dropping audit event %u: %s", event->id,
+                        to_string(event->json, false).c_str());
+        } else {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Audit: Dropping audit event %u: %s", event->id,
+                        event->payload.c_str());
+        }
+        dropped_events++;
+        return false;
+    }
+
+    event->queued = std::chrono::steady_clock::now();
+    Event* head = pending_events.load();
+    do {
+        event->next = head;
+    } while (!pending_events.compare_exchange_weak(head, event.get()));
+    event.release();
+
+    // Only the producer which made the queue non-empty needs to wake the
+    // consumer, and only if it is (about to start) waiting. The consumer
+    // sets consumer_waiting before it checks the queue for the last time,
+    // so either it sees our event or we see that it is waiting.
+    if (head == nullptr && consumer_waiting.load()) {
+        cb_mutex_enter(&producer_consumer_lock);
+        cb_cond_broadcast(&events_arrived);
+        cb_mutex_exit(&producer_consumer_lock);
+    }
     return true;
 }
 
 
+void Audit::drain_events(std::vector<std::unique_ptr<Event>>& batch) {
+    Event* event = pending_events.exchange(nullptr);
+    const auto first = batch.size();
+    while (event != nullptr) {
+        Event* next = event->next;
+        event->next = nullptr;
+        batch.emplace_back(event);
+        event = next;
+    }
+    // The stack holds the newest event first
+    std::reverse(batch.begin() + first, batch.end());
+    queue_depth -= batch.size() - first;
+}
+
+
+void Audit::record_latency(const std::vector<std::unique_ptr<Event>>& batch) {
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto& event : batch) {
+        const uint64_t usec =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now - event->queued).count();
+        total_latency += usec;
+        uint64_t max = max_latency.load();
+        while (usec > max && !max_latency.compare_exchange_weak(max, usec)) {
+            // max is updated with the current value
+        }
+    }
+    processed_events += batch.size();
+}
+
+
 void Audit::clear_events_map(void) {
     typedef std::map<uint32_t, EventDescriptor*>::iterator it_type;
     for(it_type iterator = events.begin(); iterator != events.end(); iterator++) {
@@ -487,16 +547,8 @@ void Audit::clear_events_map(void) {
 
 
 void Audit::clear_events_queues(void) {
-    while(!processeventqueue->empty()) {
-        Event *event = processeventqueue->front();
-        processeventqueue->pop();
-        delete event;
-    }
-    while(!filleventqueue->empty()) {
-        Event *event = filleventqueue->front();
-        filleventqueue->pop();
-        delete event;
-    }
+    std::vector<std::unique_ptr<Event>> batch;
+    drain_events(batch);
 }
 
 bool Audit::terminate_consumer_thread(void)
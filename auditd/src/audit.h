@@ -20,10 +20,11 @@
 #include <inttypes.h>
 #include <map>
 #include <memory>
-#include <queue>
+#include <vector>
 #include <atomic>
 
 #include <cJSON.h>
+#include <cJSON_utils.h>
 #include "memcached/audit_interface.h"
 #include "memcached/types.h"
 #include "auditconfig.h"
@@ -38,17 +39,18 @@ public:
     AuditConfig config;
     std::map<uint32_t,EventDescriptor*> events;
 
-    // We maintain two Event queues. At any one time one will be used to accept
-    // new events, and the other will be processed. The two queues are swapped
-    // periodically.
-    std::unique_ptr<std::queue<Event*>> processeventqueue;
-    std::unique_ptr<std::queue<Event*>> filleventqueue;
+    // The producers push new events onto a lock-free stack, and the
+    // consumer thread grabs the entire stack with a single exchange (and
+    // restores the order of the events). The producer_consumer_lock is
+    // only used to wake the consumer thread if it is waiting for events.
+    std::atomic<Event*> pending_events;
+    std::atomic<size_t> queue_depth;
 
     bool terminate_audit_daemon;
     std::string configfile;
     cb_thread_t consumer_tid;
     std::atomic_bool consumer_thread_running;
-    cb_cond_t processeventqueue_empty;
+    std::atomic_bool consumer_waiting;
     cb_cond_t events_arrived;
     cb_mutex_t producer_consumer_lock;
     static EXTENSION_LOGGER_DESCRIPTOR *logger;
@@ -58,21 +60,30 @@ public:
     AuditFile auditfile;
     std::atomic<uint32_t> dropped_events;
 
+    // The number of events processed by the consumer thread, and the
+    // total and max time (in usec) from they were queued until they were
+    // written to the audit trail
+    std::atomic<uint64_t> processed_events;
+    std::atomic<uint64_t> total_latency;
+    std::atomic<uint64_t> max_latency;
+
     Audit()
-        : processeventqueue(new std::queue<Event*>()),
-          filleventqueue(new std::queue<Event*>()),
+        : pending_events(nullptr),
+          queue_depth(0),
           terminate_audit_daemon(false),
           dropped_events(0),
+          processed_events(0),
+          total_latency(0),
+          max_latency(0),
           max_audit_queue(50000) {
         consumer_thread_running.store(false);
-        cb_cond_initialize(&processeventqueue_empty);
+        consumer_waiting.store(false);
         cb_cond_initialize(&events_arrived);
         cb_mutex_initialize(&producer_consumer_lock);
     }
 
     ~Audit(void) {
         clean_up();
-        cb_cond_destroy(&processeventqueue_empty);
         cb_cond_destroy(&events_arrived);
         cb_mutex_destroy(&producer_consumer_lock);
     }
@@ -89,8 +100,28 @@ public:
         return add_to_filleventqueue(event_id, payload.data(),
                                      payload.length());
     }
+    /**
+     * Add an event which is formatted by the consumer thread. The
+     * ownership of the payload is only transferred if the event was
+     * added to the queue.
+     */
+    bool add_to_filleventqueue(const uint32_t event_id,
+                               unique_cJSON_ptr& payload);
 
     bool add_reconfigure_event(const char *configfile, const void *cookie);
+
+    /**
+     * Move all of the pending events over to the provided vector (in
+     * the order they were added). Should only be called from the
+     * consumer thread.
+     */
+    void drain_events(std::vector<std::unique_ptr<Event>>& batch);
+
+    /**
+     * Record the time spent from the events were queued until they
+     * were written to the audit trail.
+     */
+    void record_latency(const std::vector<std::unique_ptr<Event>>& batch);
     bool create_audit_event(uint32_t event_id, cJSON *payload);
     bool terminate_consumer_thread(void);
     void clear_events_map(void);
@@ -118,6 +149,17 @@ protected:
     } event_state_listener;
 
 private:
+    /**
+     * Push the event onto the queue of pending events, and wake the
+     * consumer thread if it is waiting for events.
+     *
+     * @param event the event to add. It is released if it was added to
+     *              the queue (and left untouched if it was dropped)
+     * @param bounded if the event should be dropped if the queue is full
+     * @return true if the event was added to the queue
+     */
+    bool enqueue(std::unique_ptr<Event>& event, bool bounded);
+
     size_t max_audit_queue;
 };
 
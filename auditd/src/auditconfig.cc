@@ -84,6 +84,8 @@ AuditConfig::AuditConfig(const cJSON *json) : AuditConfig() {
     set_rotate_interval(getObject(json, "rotate_interval", cJSON_Number));
     set_auditd_enabled(getObject(json, "auditd_enabled", -1));
     set_buffered(cJSON_GetObjectItem(const_cast<cJSON*>(json), "buffered"));
+    set_fsync_interval(cJSON_GetObjectItem(const_cast<cJSON*>(json),
+                                           "fsync_interval"));
     set_log_directory(getObject(json, "log_path", cJSON_String));
     set_descriptors_path(getObject(json, "descriptors_path", cJSON_String));
     set_sync(getObject(json, "sync", cJSON_Array));
@@ -95,6 +97,7 @@ AuditConfig::AuditConfig(const cJSON *json) : AuditConfig() {
     tags["rotate_interval"] = 1;
     tags["auditd_enabled"] = 1;
     tags["buffered"] = 1;
+    tags["fsync_interval"] = 1;
     tags["log_path"] = 1;
     tags["descriptors_path"] = 1;
     tags["sync"] = 1;
@@ -159,6 +162,14 @@ bool AuditConfig::is_buffered(void) const {
     return buffered;
 }
 
+void AuditConfig::set_fsync_interval(uint32_t interval) {
+    fsync_interval = interval;
+}
+
+uint32_t AuditConfig::get_fsync_interval(void) const {
+    return fsync_interval;
+}
+
 void AuditConfig::set_log_directory(const std::string &directory) {
     std::lock_guard<std::mutex> guard(log_path_mutex);
     /* Sanitize path */
@@ -251,6 +262,18 @@ void AuditConfig::set_buffered(cJSON *obj) {
     }
 }
 
+void AuditConfig::set_fsync_interval(cJSON *obj) {
+    if (obj) {
+        if (obj->type != cJSON_Number || obj->valueint < 0) {
+            std::stringstream ss;
+            ss << "Incorrect value for \"fsync_interval\". Should be a "
+               << "positive number";
+            throw ss.str();
+        }
+        set_fsync_interval(static_cast<uint32_t>(obj->valueint));
+    }
+}
+
 void AuditConfig::set_log_directory(cJSON *obj) {
     set_log_directory(obj->valuestring);
 }
@@ -295,6 +318,7 @@ unique_cJSON_ptr AuditConfig::to_json() const {
     cJSON_AddNumberToObject(root, "rotate_size", get_rotate_size());
     cJSON_AddNumberToObject(root, "rotate_interval", get_rotate_interval());
     cJSON_AddBoolToObject(root, "buffered", is_buffered());
+    cJSON_AddNumberToObject(root, "fsync_interval", get_fsync_interval());
     cJSON_AddStringToObject(root, "log_path", get_log_directory().c_str());
     cJSON_AddStringToObject(root, "descriptors_path", get_descriptors_path().c_str());
 
@@ -320,6 +344,7 @@ void AuditConfig::initialize_config(const cJSON* json) {
     rotate_interval = other.rotate_interval;
     rotate_size = other.rotate_size;
     buffered = other.buffered;
+    fsync_interval = other.fsync_interval;
     {
         std::lock_guard<std::mutex> guard(log_path_mutex);
         log_path = other.log_path;
@@ -30,6 +30,24 @@
 #include "auditd_audit_events.h"
 #include "event.h"
 
+/**
+ * Process (and write) a batch of events and release them
+ *
+ * @param audit the audit daemon instance
+ * @param batch the events to process
+ */
+static void process_events(Audit& audit,
+                           std::vector<std::unique_ptr<Event>>& batch) {
+    for (auto& event : batch) {
+        if (!event->process(audit)) {
+            audit.dropped_events++;
+        }
+    }
+    audit.auditfile.flush();
+    audit.record_latency(batch);
+    batch.clear();
+}
+
 /**
  * The entry point for the thread used to drain the generated audit events
  *
@@ -43,37 +61,42 @@ static void consume_events(void* arg) {
     }
     Audit& audit = *reinterpret_cast<Audit*>(arg);
 
+    std::vector<std::unique_ptr<Event>> batch;
+
     cb_mutex_enter(&audit.producer_consumer_lock);
     while (!audit.terminate_audit_daemon) {
-        if (audit.filleventqueue->empty()) {
-            cb_cond_timedwait(&audit.events_arrived,
-                              &audit.producer_consumer_lock,
-                              audit.auditfile.get_seconds_to_rotation() * 1000);
-            if (audit.filleventqueue->empty()) {
-                // We timed out, so just rotate the files
+        if (audit.pending_events.load() == nullptr) {
+            audit.consumer_waiting.store(true);
+            if (audit.pending_events.load() == nullptr) {
+                cb_cond_timedwait(&audit.events_arrived,
+                                  &audit.producer_consumer_lock,
+                                  audit.auditfile.get_milliseconds_to_wakeup());
+            }
+            audit.consumer_waiting.store(false);
+            if (audit.pending_events.load() == nullptr) {
+                // We timed out, so just rotate the files (and sync
+                // them to disk if it is time to do so)
                 audit.auditfile.maybe_rotate_files();
+                audit.auditfile.flush();
             }
         }
         /* now have producer_consumer lock!
          * event(s) have arrived or shutdown requested
          */
-        swap(audit.processeventqueue, audit.filleventqueue);
         cb_mutex_exit(&audit.producer_consumer_lock);
         // Now outside of the producer_consumer_lock
 
-        while (!audit.processeventqueue->empty()) {
-            Event* event = audit.processeventqueue->front();
-            if (!event->process(audit)) {
-                audit.dropped_events++;
-            }
-            audit.processeventqueue->pop();
-            delete event;
-        }
-        audit.auditfile.flush();
+        audit.drain_events(batch);
+        process_events(audit, batch);
         cb_mutex_enter(&audit.producer_consumer_lock);
     }
     cb_mutex_exit(&audit.producer_consumer_lock);
 
+    // Write the events queued while we were told to shut down (the
+    // shutdown event)
+    audit.drain_events(batch);
+    process_events(audit, batch);
+
     // close the auditfile
     audit.auditfile.close();
 }
@@ -190,6 +213,32 @@ AUDIT_ERROR_CODE put_json_audit_event(Audit* handle,
     return put_audit_event(handle, id, text.data(), text.length());
 }
 
+MEMCACHED_PUBLIC_API
+AUDIT_ERROR_CODE put_json_audit_event(Audit* handle,
+                                      uint32_t audit_eventid,
+                                      unique_cJSON_ptr&& payload) {
+    if (handle == nullptr) {
+        throw std::invalid_argument(
+            "put_json_audit_event: handle can't be nullptr");
+    }
+    if (!payload) {
+        throw std::invalid_argument(
+            "put_json_audit_event: payload can't be nullptr");
+    }
+    if (handle->config.is_auditd_enabled()) {
+        cJSON* ts = cJSON_GetObjectItem(payload.get(), "timestamp");
+        if (ts == nullptr) {
+            std::string timestamp = ISOTime::generatetimestamp();
+            cJSON_AddStringToObject(payload.get(), "timestamp",
+                                    timestamp.c_str());
+        }
+        if (!handle->add_to_filleventqueue(audit_eventid, payload)) {
+            return AUDIT_FAILED;
+        }
+    }
+    return AUDIT_SUCCESS;
+}
+
 MEMCACHED_PUBLIC_API
 AUDIT_ERROR_CODE shutdown_auditdaemon(Audit* handle) {
     if (handle == nullptr) {
@@ -234,11 +283,19 @@ void process_auditd_stats(Audit* handle,
     enabled = handle->config.is_auditd_enabled() ? "true" : "false";
     add_stats("enabled", (uint16_t)strlen("enabled"),
               enabled, (uint32_t)strlen(enabled), cookie);
-    std::stringstream num_of_dropped_events;
-    num_of_dropped_events << handle->dropped_events;
-    add_stats("dropped_events", (uint16_t)strlen("dropped_events"),
-              num_of_dropped_events.str().c_str(),
-              (uint32_t)num_of_dropped_events.str().length(), cookie);
+
+    auto add_stat = [add_stats, cookie](const char* key, uint64_t value) {
+        const auto text = std::to_string(value);
+        add_stats(key, (uint16_t)strlen(key), text.data(),
+                  (uint32_t)text.size(), cookie);
+    };
+    add_stat("dropped_events", handle->dropped_events);
+    add_stat("queue_depth", handle->queue_depth);
+    const uint64_t processed = handle->processed_events;
+    add_stat("processed_events", processed);
+    add_stat("avg_latency_usec",
+             processed == 0 ? 0 : handle->total_latency / processed);
+    add_stat("max_latency_usec", handle->max_latency);
 }
 
 namespace cb {
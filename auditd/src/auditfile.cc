@@ -24,6 +24,11 @@
 #include <memcached/isotime.h>
 #include <JSON_checker.h>
 #include <fstream>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "auditd.h"
 #include "audit.h"
 #include "auditfile.h"
@@ -51,6 +56,19 @@ static std::string load_file(const char *file) {
 #define load_file(a) Audit::load_file(a)
 #endif
 
+const size_t AuditFile::WriteBufferSize;
+
+/**
+ * Sync the content of the file to disk
+ */
+static bool sync_file(FILE* fp) {
+#ifdef WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
+
 bool AuditFile::file_exists(const std::string& name) {
 #ifdef WIN32
     DWORD dwAttrib = GetFileAttributes(name.c_str());
@@ -102,14 +120,23 @@ bool AuditFile::open(void) {
         log_error(AuditErrorCode::FILE_OPEN_ERROR, open_file_name.c_str());
         return false;
     }
+    // We do our own buffering (and write the buffer with a single call)
+    setvbuf(file, nullptr, _IONBF, 0);
     current_size = 0;
     open_time = auditd_time();
+    last_fsync = open_time;
+    need_fsync = false;
     return true;
 }
 
 
 void AuditFile::close_and_rotate_log(void) {
     cb_assert(file != NULL);
+    write_buffer();
+    if (fsync_interval != 0 && need_fsync) {
+        sync_file(file);
+    }
+    need_fsync = false;
     fclose(file);
     file = NULL;
     if (current_size == 0) {
@@ -251,15 +278,20 @@ bool AuditFile::write_event_to_disk(cJSON *output) {
     char *content = cJSON_PrintUnformatted(output);
     bool ret = true;
     if (content) {
-        current_size += fprintf(file, "%s\n", content);
-        if (ferror(file)) {
-            log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
-            ret = false;
-            close_and_rotate_log();
-        } else if (!buffered) {
+        const size_t length = strlen(content);
+        buffer.append(content, length);
+        buffer.push_back('\n');
+        current_size += length + 1;
+        cJSON_Free(content);
+
+        if (!buffered) {
             ret = flush();
+        } else if (buffer.size() >= WriteBufferSize) {
+            ret = write_buffer();
+            if (!ret) {
+                close_and_rotate_log();
+            }
         }
-        cJSON_Free(content);
     } else {
         log_error(AuditErrorCode::MEMORY_ALLOCATION_ERROR,
                   "failed to convert audit event");
@@ -296,16 +328,56 @@ void AuditFile::reconfigure(const AuditConfig &config) {
     set_log_directory(config.get_log_directory());
     max_log_size = config.get_rotate_size();
     buffered = config.is_buffered();
+    fsync_interval = config.get_fsync_interval();
+}
+
+bool AuditFile::write_buffer(void) {
+    if (buffer.empty()) {
+        return true;
+    }
+
+    bool ret = true;
+    if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
+        ret = false;
+    }
+    buffer.clear();
+    need_fsync = true;
+    return ret;
+}
+
+bool AuditFile::maybe_fsync(void) {
+    if (fsync_interval == 0 || !need_fsync) {
+        return true;
+    }
+
+    time_t now = auditd_time();
+    if (difftime(now, last_fsync) < fsync_interval) {
+        return true;
+    }
+
+    last_fsync = now;
+    need_fsync = false;
+    if (!sync_file(file)) {
+        log_error(AuditErrorCode::WRITING_TO_DISK_ERROR, strerror(errno));
+        return false;
+    }
+    return true;
 }
 
 bool AuditFile::flush(void) {
     if (is_open()) {
+        if (!write_buffer()) {
+            close_and_rotate_log();
+            return false;
+        }
         if (fflush(file) != 0) {
             log_error(AuditErrorCode::WRITING_TO_DISK_ERROR,
                       strerror(errno));
             close_and_rotate_log();
             return false;
         }
+        return maybe_fsync();
     }
 
     return true;
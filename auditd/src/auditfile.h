@@ -34,7 +34,10 @@ public:
         current_size(0),
         max_log_size(20 * 1024 * 1024),
         rotate_interval(900),
-        buffered(true)
+        buffered(true),
+        fsync_interval(0),
+        last_fsync(0),
+        need_fsync(false)
     {
     }
 
@@ -90,7 +93,9 @@ public:
     void cleanup_old_logfile(const std::string& log_path);
 
     /**
-     * Write a json formatted object to the disk
+     * Write a json formatted object to the disk. The events are collected
+     * in a write buffer which is written to the file (with a single
+     * write) when it is full or when the file is flushed.
      *
      * @param output the data to write
      * @return true if success, false otherwise
@@ -119,7 +124,8 @@ public:
     void reconfigure(const AuditConfig &config);
 
     /**
-     * Flush the buffers to the disk
+     * Flush the buffers to the disk (and sync the file to disk if
+     * fsync_interval seconds have passed since the last sync)
      */
     bool flush(void);
 
@@ -135,8 +141,28 @@ public:
         }
     }
 
+    /**
+     * get the number of milliseconds until the file should be rotated
+     * or synced to disk
+     */
+    uint32_t get_milliseconds_to_wakeup(void) {
+        uint32_t secs = get_seconds_to_rotation();
+        if (need_fsync && fsync_interval < secs) {
+            secs = fsync_interval;
+        }
+        return secs * 1000;
+    }
+
+    /**
+     * The size of the write buffer. When the buffered events exceed
+     * this size they're written to the file
+     */
+    static const size_t WriteBufferSize = 256 * 1024;
+
 private:
     bool open(void);
+    bool write_buffer(void);
+    bool maybe_fsync(void);
     bool time_to_rotate_log(void) const;
     void close_and_rotate_log(void);
     void set_log_directory(const std::string &new_directory);
@@ -152,6 +178,10 @@ private:
     size_t max_log_size;
     uint32_t rotate_interval;
     bool buffered;
+    uint32_t fsync_interval;
+    time_t last_fsync;
+    bool need_fsync;
+    std::string buffer;
 };
 
 #endif
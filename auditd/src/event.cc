@@ -28,17 +28,24 @@ bool Event::process(Audit& audit) {
         return true;
     }
 
-    // convert the event.payload into JSON
-    cJSON *json_payload = cJSON_Parse(payload.c_str());
-    if (json_payload == NULL) {
-        Audit::log_error(AuditErrorCode::JSON_PARSING_ERROR, payload.c_str());
-        return false;
+    // convert the event.payload into JSON (unless we got the JSON
+    // object directly)
+    unique_cJSON_ptr json_payload(std::move(json));
+    if (!json_payload) {
+        json_payload.reset(cJSON_Parse(payload.c_str()));
+        if (!json_payload) {
+            Audit::log_error(AuditErrorCode::JSON_PARSING_ERROR,
+                             payload.c_str());
+            return false;
+        }
     }
-    cJSON *timestamp_ptr = cJSON_GetObjectItem(json_payload, "timestamp");
+    cJSON *timestamp_ptr = cJSON_GetObjectItem(json_payload.get(),
+                                               "timestamp");
     if (timestamp_ptr == NULL) {
         std::string timestamp;
         timestamp = ISOTime::generatetimestamp();
-        cJSON_AddStringToObject(json_payload, "timestamp", timestamp.c_str());
+        cJSON_AddStringToObject(json_payload.get(), "timestamp",
+                                timestamp.c_str());
     }
     auto evt = audit.events.find(id);
     if (evt == audit.events.end()) {
@@ -46,27 +53,23 @@ bool Event::process(Audit& audit) {
         std::ostringstream convert;
         convert << id;
         Audit::log_error(AuditErrorCode::UNKNOWN_EVENT_ERROR, convert.str().c_str());
-        cJSON_Delete(json_payload);
         return false;
     }
     if (!evt->second->isEnabled()) {
         // the event is not enabled so ignore event
-        cJSON_Delete(json_payload);
         return true;
     }
     if (!audit.auditfile.ensure_open()) {
         Audit::log_error(AuditErrorCode::OPEN_AUDITFILE_ERROR);
-        cJSON_Delete(json_payload);
         return false;
     }
-    cJSON_AddNumberToObject(json_payload, "id", id);
-    cJSON_AddStringToObject(json_payload, "name", evt->second->getName().c_str());
-    cJSON_AddStringToObject(json_payload, "description", evt->second->getDescription().c_str());
-
-    bool success = audit.auditfile.write_event_to_disk(json_payload);
+    cJSON_AddNumberToObject(json_payload.get(), "id", id);
+    cJSON_AddStringToObject(json_payload.get(), "name",
+                            evt->second->getName().c_str());
+    cJSON_AddStringToObject(json_payload.get(), "description",
+                            evt->second->getDescription().c_str());
 
-    // Release allocated resources
-    cJSON_Delete(json_payload);
+    bool success = audit.auditfile.write_event_to_disk(json_payload.get());
 
     if (success) {
         return true;
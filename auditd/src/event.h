@@ -17,6 +17,8 @@
 #ifndef EVENT_H
 #define EVENT_H
 
+#include <chrono>
+#include <cJSON_utils.h>
 #include <inttypes.h>
 #include <string>
 
@@ -27,6 +29,17 @@ public:
     const uint32_t id;
     const std::string payload;
 
+    // The payload for events handed over as a JSON object (so that
+    // they're formatted by the audit thread). payload is empty for
+    // these events.
+    unique_cJSON_ptr json;
+
+    // Link to the next event in the queue of pending events
+    Event* next = nullptr;
+
+    // The time the event was added to the queue
+    std::chrono::steady_clock::time_point queued;
+
     // Constructor required for ConfigureEvent
     Event()
         : id(0) {}
@@ -36,6 +49,10 @@ public:
         : id(event_id),
           payload(p,length) {}
 
+    Event(const uint32_t event_id, unique_cJSON_ptr object)
+        : id(event_id),
+          json(std::move(object)) {}
+
     virtual bool process(Audit& audit);
 
     virtual ~Event() {}
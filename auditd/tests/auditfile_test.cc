@@ -21,6 +21,7 @@
 #include <map>
 #include <atomic>
 #include <cstring>
+#include <fstream>
 #include <time.h>
 #include <gtest/gtest.h>
 #include <platform/platform.h>
@@ -163,6 +164,63 @@ TEST_F(AuditFileTest, TestRollover) {
                 secs == (defaultvalue.get_min_file_rotation_time() - 11));
 }
 
+/**
+ * Test that the events are kept in the write buffer until the file
+ * is flushed
+ */
+TEST_F(AuditFileTest, TestBufferedWrites) {
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    ASSERT_TRUE(auditfile.ensure_open());
+
+    for (int ii = 0; ii < 10; ++ii) {
+        EXPECT_TRUE(auditfile.write_event_to_disk(event));
+    }
+
+    const std::string filename = testdir + "/audit.log";
+    auto count_lines = [&filename]() {
+        std::ifstream file(filename);
+        std::string line;
+        int lines = 0;
+        while (std::getline(file, line)) {
+            ++lines;
+        }
+        return lines;
+    };
+
+    EXPECT_EQ(0, count_lines());
+    EXPECT_TRUE(auditfile.flush());
+    EXPECT_EQ(10, count_lines());
+
+    auditfile.close();
+}
+
+/**
+ * Test that the file is synced to disk every fsync_interval seconds
+ * (while there is data written since the last sync)
+ */
+TEST_F(AuditFileTest, TestFsyncInterval) {
+    config.set_rotate_interval(3600);
+    config.set_fsync_interval(1);
+    AuditFile auditfile;
+    auditfile.reconfigure(config);
+    ASSERT_TRUE(auditfile.ensure_open());
+
+    EXPECT_LT(1000, auditfile.get_milliseconds_to_wakeup());
+
+    EXPECT_TRUE(auditfile.write_event_to_disk(event));
+    EXPECT_TRUE(auditfile.flush());
+    EXPECT_EQ(1000, auditfile.get_milliseconds_to_wakeup())
+        << "The consumer should wake up to sync the written data";
+
+    cb_timeofday_timetravel(2);
+    EXPECT_TRUE(auditfile.flush());
+    EXPECT_LT(1000, auditfile.get_milliseconds_to_wakeup())
+        << "Nothing should be left to sync";
+
+    auditfile.close();
+}
+
 TEST_F(AuditFileTest, TestSuccessfulCrashRecovery) {
     FILE *fp = fopen((testdir + "/audit.log").c_str(), "w");
     EXPECT_TRUE(fp != nullptr);
@@ -26,6 +26,7 @@
 #include "cookie.h"
 #include "function_chain.h"
 #include "mcbp_validators.h"
+#include "subdoc_lookup_cache.h"
 #include "timings.h"
 #include "topkeys.h"
 #include "task.h"
@@ -90,7 +91,8 @@ public:
           state(BucketState::None),
           type(BucketType::Unknown),
           stats(nullptr),
-          topkeys(nullptr)
+          topkeys(nullptr),
+          subdoc_lookup_cache(nullptr)
     {
         std::memset(name, 0, sizeof(name));
         cb_mutex_initialize(&mutex);
@@ -180,6 +182,12 @@ public:
      */
     TopKeys *topkeys;
 
+    /**
+     * The location of recently looked up sub-document paths (nullptr if
+     * the cache is disabled)
+     */
+    SubdocLookupCache* subdoc_lookup_cache;
+
     /**
      * The validator chains to use for this bucket when receiving MCBP commands.
      */
@@ -20,7 +20,9 @@
 #include "runtime.h"
 #include "statemachine_mcbp.h"
 
+#include <algorithm>
 #include <exception>
+#include <limits>
 #include <utilities/protocol2text.h>
 #include <platform/checked_snprintf.h>
 #include <platform/strerror.h>
@@ -65,6 +67,7 @@ Connection::Connection(SOCKET sfd, event_base* b)
       refcount(0),
       engine_storage(nullptr),
       next(nullptr),
+      notificationNext(nullptr),
       thread(nullptr),
       parent_port(0),
       bucketEngine(nullptr),
@@ -74,9 +77,13 @@ Connection::Connection(SOCKET sfd, event_base* b)
       clustermap_revno(-2),
       trace_enabled(false),
       xerror_support(false),
-      collections_support(false) {
+      collections_support(false),
+      hot_key_hints_support(false),
+      typed_stats_support(false) {
     MEMCACHED_CONN_CREATE(this);
     bucketIndex.store(0);
+    notificationQueued.store(false);
+    notificationStatus.store(NoNotificationStatus);
     updateDescription();
 }
 
@@ -87,6 +94,7 @@ Connection::Connection(SOCKET sock,
     parent_port = interface.port;
     resolveConnectionName(false);
     setTcpNoDelay(interface.tcp_nodelay);
+    setBusyPoll(settings.getWorkerBusyPollUsec());
     updateDescription();
 }
 
@@ -191,6 +199,30 @@ bool Connection::setTcpNoDelay(bool enable) {
     return true;
 }
 
+bool Connection::setBusyPoll(size_t usec) {
+#ifdef SO_BUSY_POLL
+    if (usec == 0) {
+        return true;
+    }
+
+    int value = int(std::min(usec, size_t(std::numeric_limits<int>::max())));
+    int error = setsockopt(socketDescriptor, SOL_SOCKET, SO_BUSY_POLL,
+                           reinterpret_cast<void*>(&value), sizeof(value));
+    if (error != 0) {
+        // Raising the value above net.core.busy_read requires
+        // CAP_NET_ADMIN. Don't flood the log with a warning for every
+        // connection.
+        std::string errmsg = cb_strerror(GetLastNetworkError());
+        LOG_DEBUG(this, "setsockopt(SO_BUSY_POLL): %s", errmsg.c_str());
+        return false;
+    }
+    return true;
+#else
+    (void)usec;
+    return false;
+#endif
+}
+
 /* cJSON uses double for all numbers, so only has 53 bits of precision.
  * Therefore encode 64bit integers as string.
  */
@@ -254,6 +286,10 @@ cJSON* Connection::toJSON() const {
         json_add_bool_to_object(features, "mutation_extras",
                                 isSupportsMutationExtras());
         json_add_bool_to_object(features, "xerror", isXerrorSupport());
+        json_add_bool_to_object(features, "hot_key_hints",
+                                isHotKeyHintsSupported());
+        json_add_bool_to_object(features, "typed_stats",
+                                isTypedStatsSupported());
 
         cJSON_AddItemToObject(obj, "features", features);
 
@@ -185,6 +185,16 @@ public:
      */
     bool setTcpNoDelay(bool enable);
 
+    /**
+     * Set SO_BUSY_POLL on the underlying socket (if supported by the
+     * platform) so that the kernel may busy poll the device queue
+     * when there is no data available.
+     *
+     * @param usec the number of microseconds to busy poll (0 is a no-op)
+     * @return true on success, false otherwise
+     */
+    bool setBusyPoll(size_t usec);
+
     /**
      * Get the username this connection is authenticated as
      *
@@ -209,7 +219,7 @@ public:
      * Get the current reference count
      */
     uint8_t getRefcount() const {
-        return refcount;
+        return refcount.load();
     }
 
     void incrementRefcount() {
@@ -228,6 +238,57 @@ public:
         Connection::next = next;
     }
 
+    /**
+     * Mark the connection as queued in its thread's pending_notifications
+     * list.
+     *
+     * @return true if the caller should insert the connection in the
+     *         list, false if it is already there
+     */
+    bool markNotificationQueued() {
+        return !notificationQueued.exchange(true);
+    }
+
+    /**
+     * Clear the queued marker. Called by the worker thread once it
+     * has read the next pointer after removing the connection from the
+     * pending_notifications list.
+     */
+    void clearNotificationQueued() {
+        notificationQueued.store(false);
+    }
+
+    Connection* getNotificationNext() const {
+        return notificationNext;
+    }
+
+    void setNotificationNext(Connection* next) {
+        notificationNext = next;
+    }
+
+    /**
+     * Store the status from an engine notification to be picked up by
+     * the worker thread (a newer status replaces an older one)
+     */
+    void setNotificationStatus(ENGINE_ERROR_CODE status) {
+        notificationStatus.store(int(status));
+    }
+
+    /**
+     * Fetch (and clear) the status from an engine notification
+     *
+     * @param status where to store the status
+     * @return true if there was a status, false otherwise
+     */
+    bool consumeNotificationStatus(ENGINE_ERROR_CODE& status) {
+        auto value = notificationStatus.exchange(NoNotificationStatus);
+        if (value == NoNotificationStatus) {
+            return false;
+        }
+        status = ENGINE_ERROR_CODE(value);
+        return true;
+    }
+
     LIBEVENT_THREAD* getThread() const {
         return thread.load(std::memory_order_relaxed);
     }
@@ -351,6 +412,22 @@ public:
         Connection::collections_support = collections_support;
     }
 
+    bool isHotKeyHintsSupported() const {
+        return hot_key_hints_support;
+    }
+
+    void setHotKeyHintsSupported(bool hot_key_hints_support) {
+        Connection::hot_key_hints_support = hot_key_hints_support;
+    }
+
+    bool isTypedStatsSupported() const {
+        return typed_stats_support;
+    }
+
+    void setTypedStatsSupported(bool typed_stats_support) {
+        Connection::typed_stats_support = typed_stats_support;
+    }
+
     DocNamespace getDocNamespace() const {
         if (isCollectionsSupported()) {
             return DocNamespace::Collections;
@@ -426,8 +503,11 @@ protected:
     /** Is tcp nodelay enabled or not? */
     bool nodelay;
 
-    /** number of references to the object */
-    uint8_t refcount;
+    /**
+     * number of references to the object. Atomic as release_cookie()
+     * may be called from other threads.
+     */
+    std::atomic<uint8_t> refcount;
 
     /**
      * Pointer to engine-specific data which the engine has requested the server
@@ -439,6 +519,21 @@ protected:
     /* Used for generating a list of Connection structures */
     Connection* next;
 
+    /*
+     * Used by other threads to put the connection in the thread's
+     * pending_notifications list (may not share next as the worker
+     * thread owns that one)
+     */
+    Connection* notificationNext;
+
+    /* Set while the connection is in the pending_notifications list */
+    std::atomic_bool notificationQueued;
+
+    static const int NoNotificationStatus = -1;
+
+    /* The status from the last engine notification not yet consumed */
+    std::atomic_int notificationStatus;
+
     /** Pointer to the thread object serving this connection */
     std::atomic<LIBEVENT_THREAD*> thread;
 
@@ -491,6 +586,18 @@ protected:
      * default collection mutations/deletions etc... when subscribed to DCP.
      */
     bool collections_support;
+
+    /**
+     * Does the client want to be told (in the GET response) that the
+     * key it requested is hot so that it may cache the document locally
+     */
+    bool hot_key_hints_support;
+
+    /**
+     * Does the client want all of the stats returned in a single response
+     * with typed values (see cb::mcbp::stats)
+     */
+    bool typed_stats_support;
 };
 
 /**
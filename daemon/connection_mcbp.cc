@@ -29,6 +29,15 @@
 #include <platform/strerror.h>
 #include <platform/timeutils.h>
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_MSG_ZEROCOPY 1
+#endif
+
 /* cJSON uses double for all numbers, so only has 53 bits of precision.
  * Therefore encode 64bit integers as string.
  */
@@ -113,7 +122,8 @@ bool McbpConnection::registerEvent() {
 bool McbpConnection::updateEvent(const short new_flags) {
     struct event_base* base = event.ev_base;
 
-    if (ssl.isEnabled() && ssl.isConnected() && (new_flags & EV_READ)) {
+    if (ssl.isEnabled() && ssl.isConnected() && !ssl.isKtlsRecv() &&
+        (new_flags & EV_READ)) {
         /*
          * If we want more data and we have SSL, that data might be inside
          * SSL's internal buffers rather than inside the socket buffer. In
@@ -282,10 +292,19 @@ bool McbpConnection::tryAuthFromSslCert(const std::string& userName) {
 }
 
 int McbpConnection::sslPreConnection() {
+    sslHandshakeWantWrite = false;
     int r = ssl.accept();
     if (r == 1) {
         ssl.drainBioSendPipe(socketDescriptor);
         ssl.setConnected();
+        ssl.updateKtlsState();
+        if (ssl.isKtlsSend() || ssl.isKtlsRecv()) {
+            LOG_DEBUG(this,
+                      "%u: Using kernel TLS (send: %s, recv: %s)",
+                      getId(),
+                      ssl.isKtlsSend() ? "true" : "false",
+                      ssl.isKtlsRecv() ? "true" : "false");
+        }
         auto certResult = ssl.getCertUserName();
         bool disconnect = false;
         switch (certResult.first) {
@@ -318,8 +337,18 @@ int McbpConnection::sslPreConnection() {
             return -1;
         }
     } else {
-        if (ssl.getError(r) == SSL_ERROR_WANT_READ) {
+        const auto sslError = ssl.getError(r);
+        // SSL_ERROR_WANT_WRITE is only returned when OpenSSL operates
+        // directly on the socket (kTLS mode) and the socket buffer is
+        // full. With the BIO pair we may fail to send all of the
+        // handshake data for the same reason. In both cases the client
+        // may be waiting for that data, so we need to wait for the
+        // socket to become writable rather than readable.
+        if (sslError == SSL_ERROR_WANT_READ ||
+            sslError == SSL_ERROR_WANT_WRITE) {
             ssl.drainBioSendPipe(socketDescriptor);
+            sslHandshakeWantWrite = sslError == SSL_ERROR_WANT_WRITE ||
+                                    ssl.morePendingOutput();
             set_ewouldblock();
             return -1;
         } else {
@@ -349,7 +378,9 @@ int McbpConnection::sslPreConnection() {
 
 int McbpConnection::recv(char* dest, size_t nbytes) {
     int res;
-    if (ssl.isEnabled()) {
+    // With kernel TLS the kernel decrypts the data for us (and fails
+    // the read with EIO if it encounters a non-data record)
+    if (ssl.isEnabled() && !ssl.isKtlsRecv()) {
         ssl.drainBioRecvPipe(socketDescriptor);
 
         if (ssl.hasError()) {
@@ -380,7 +411,8 @@ int McbpConnection::recv(char* dest, size_t nbytes) {
 
 int McbpConnection::sendmsg(struct msghdr* m) {
     int res = 0;
-    if (ssl.isEnabled()) {
+    // With kernel TLS the kernel encrypts the data as part of sendmsg
+    if (ssl.isEnabled() && !ssl.isKtlsSend()) {
         for (int ii = 0; ii < int(m->msg_iovlen); ++ii) {
             int n = sslWrite(reinterpret_cast<char*>(m->msg_iov[ii].iov_base),
                              m->msg_iov[ii].iov_len);
@@ -406,6 +438,210 @@ int McbpConnection::sendmsg(struct msghdr* m) {
     return res;
 }
 
+bool McbpConnection::isZerocopyCandidate(size_t len) {
+#ifdef HAVE_MSG_ZEROCOPY
+    const auto threshold = settings.getZerocopyThreshold();
+    return threshold != 0 && len >= threshold && !zerocopy.unsupported &&
+           !ssl.isEnabled() && !isPipeConnection();
+#else
+    (void)len;
+    return false;
+#endif
+}
+
+int McbpConnection::sendmsgZerocopy(struct msghdr* m) {
+    const auto threshold = settings.getZerocopyThreshold();
+    const size_t first = size_t(m->msg_iov - iov.data());
+
+    // Locate the runs of iovecs with the same zerocopy property and
+    // check if any of the zerocopy runs is big enough
+    bool found = false;
+    size_t ii = 0;
+    while (ii < m->msg_iovlen && !found) {
+        const bool zc = iovZerocopy[first + ii];
+        size_t nbytes = 0;
+        do {
+            nbytes += m->msg_iov[ii].iov_len;
+            ++ii;
+        } while (ii < m->msg_iovlen && iovZerocopy[first + ii] == zc);
+        found = zc && nbytes >= threshold;
+    }
+
+    if (!found) {
+        return sendmsg(m);
+    }
+
+    // Send the first run only (the caller will call us again for the rest)
+    struct msghdr part = *m;
+    const bool zc = iovZerocopy[first];
+    size_t nbytes = 0;
+    part.msg_iovlen = 0;
+    do {
+        nbytes += m->msg_iov[part.msg_iovlen].iov_len;
+        ++part.msg_iovlen;
+    } while (part.msg_iovlen < m->msg_iovlen &&
+             iovZerocopy[first + part.msg_iovlen] == zc);
+
+    if (!zc || nbytes < threshold) {
+        return sendmsg(&part);
+    }
+
+#ifdef HAVE_MSG_ZEROCOPY
+    if (!zerocopy.enabled) {
+        int one = 1;
+        if (setsockopt(socketDescriptor, SOL_SOCKET, SO_ZEROCOPY,
+                       reinterpret_cast<void*>(&one), sizeof(one)) == -1) {
+            LOG_INFO(this,
+                     "%u: Failed to enable SO_ZEROCOPY: %s",
+                     getId(),
+                     cb_strerror().c_str());
+            zerocopy.unsupported = true;
+            get_thread_stats(this)->zerocopy_fallbacks++;
+            return sendmsg(&part);
+        }
+        zerocopy.enabled = true;
+    }
+
+    auto res = int(::sendmsg(socketDescriptor, &part, MSG_ZEROCOPY));
+    if (res >= 0) {
+        // Each successful send is assigned the next completion id
+        ++zerocopy.issued;
+        get_thread_stats(this)->zerocopy_sends++;
+        if (res > 0) {
+            totalSend += res;
+        }
+        return res;
+    }
+
+    if (errno == ENOBUFS) {
+        // The socket ran out of optmem for the notifications. Send this
+        // chunk the old fashion way
+        get_thread_stats(this)->zerocopy_fallbacks++;
+        return sendmsg(&part);
+    }
+    return res;
+#else
+    return sendmsg(&part);
+#endif
+}
+
+void McbpConnection::processZerocopyCompletions() {
+#ifdef HAVE_MSG_ZEROCOPY
+    while (zerocopy.completed != zerocopy.issued) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(socketDescriptor, &msg, MSG_ERRQUEUE) == -1) {
+            // EAGAIN means there isn't any more notifications (yet)
+            break;
+        }
+
+        for (auto* cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 &&
+                   cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            auto* serr = reinterpret_cast<struct sock_extended_err*>(
+                    CMSG_DATA(cm));
+            if (serr->ee_errno != 0 ||
+                serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            // [ee_info, ee_data] is the range of completed sends. TCP
+            // completes the sends in order.
+            zerocopy.completed = serr->ee_data + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                get_thread_stats(this)->zerocopy_copied +=
+                        serr->ee_data - serr->ee_info + 1;
+            }
+        }
+    }
+
+    while (!zerocopy.items.empty() &&
+           int32_t(zerocopy.completed - zerocopy.items.front().sends) >= 0) {
+        releasePendingItems(zerocopy.items.front());
+        zerocopy.items.pop_front();
+    }
+#endif
+}
+
+void McbpConnection::releasePendingItems(
+        const PendingZerocopyItems& entry) {
+    ENGINE_HANDLE* handle = reinterpret_cast<ENGINE_HANDLE*>(entry.engine);
+    for (auto* it : entry.items) {
+        entry.engine->release(handle, this, it);
+    }
+    if (entry.heldBucket != -1) {
+        release_bucket_client(entry.heldBucket);
+    }
+}
+
+void McbpConnection::releaseReservedItems() {
+    processZerocopyCompletions();
+    if (reservedItems.empty()) {
+        return;
+    }
+
+    if (zerocopy.completed != zerocopy.issued) {
+        // The kernel may still reference the item memory
+        try {
+            zerocopy.items.push_back({zerocopy.issued,
+                                      bucketEngine,
+                                      -1,
+                                      std::move(reservedItems)});
+            reservedItems.clear();
+            return;
+        } catch (const std::bad_alloc&) {
+            // fall through and release them. The worst thing that
+            // can happen is that the client receive garbage
+        }
+    }
+
+    ENGINE_HANDLE* handle = reinterpret_cast<ENGINE_HANDLE*>(bucketEngine);
+    for (auto* it : reservedItems) {
+        bucketEngine->release(handle, this, it);
+    }
+    reservedItems.clear();
+}
+
+void McbpConnection::releaseZerocopyItems() {
+    for (const auto& entry : zerocopy.items) {
+        releasePendingItems(entry);
+    }
+    zerocopy.items.clear();
+    zerocopy.completed = zerocopy.issued;
+}
+
+bool McbpConnection::detachZerocopyItems() {
+    if (isSocketClosed()) {
+        releaseZerocopyItems();
+        return false;
+    }
+
+    processZerocopyCompletions();
+    // The entries are added in order, so the items of the current bucket
+    // are the ones following the last entry we detached from a bucket
+    // (if any)
+    if (zerocopy.items.empty() || zerocopy.items.back().heldBucket != -1) {
+        return false;
+    }
+    zerocopy.items.back().heldBucket = getBucketIndex();
+    return true;
+}
+
+void McbpConnection::releaseCurrentBucketZerocopyItems() {
+    while (!zerocopy.items.empty() && zerocopy.items.back().heldBucket == -1) {
+        releasePendingItems(zerocopy.items.back());
+        zerocopy.items.pop_back();
+    }
+}
+
 McbpConnection::TransmitResult McbpConnection::transmit() {
     if (ssl.isEnabled()) {
         // We use OpenSSL to write data into a buffer before we send it
@@ -434,7 +670,15 @@ McbpConnection::TransmitResult McbpConnection::transmit() {
         ssize_t res;
         struct msghdr* m = &msglist[msgcurr];
 
-        res = sendmsg(m);
+        if (zerocopy.issued != zerocopy.completed) {
+            processZerocopyCompletions();
+        }
+
+        if (settings.getZerocopyThreshold() != 0 && !ssl.isEnabled()) {
+            res = sendmsgZerocopy(m);
+        } else {
+            res = sendmsg(m);
+        }
         auto error = GetLastNetworkError();
         if (res > 0) {
             get_thread_stats(this)->bytes_written += res;
@@ -723,12 +967,32 @@ void McbpConnection::addMsgHdr(bool reset) {
 }
 
 void McbpConnection::addIov(const void* buf, size_t len) {
+    addIovEntry(buf, len, false);
+}
+
+void McbpConnection::addZerocopyIov(const void* buf, size_t len) {
+    addIovEntry(buf, len, true);
+}
+
+void McbpConnection::addIovEntry(const void* buf, size_t len, bool zc) {
     if (len == 0) {
         return;
     }
 
     struct msghdr* m = &msglist.back();
 
+    // Extend the previous entry if the data directly follows it (for
+    // instance the extras following the response header, or the per-spec
+    // headers in the subdoc multi responses)
+    if (m->msg_iovlen > 0 && iovZerocopy[iovused - 1] == zc) {
+        auto& last = m->msg_iov[m->msg_iovlen - 1];
+        if (static_cast<const char*>(last.iov_base) + last.iov_len == buf) {
+            last.iov_len += len;
+            msgbytes += len;
+            return;
+        }
+    }
+
     /* We may need to start a new msghdr if this one is full. */
     if (m->msg_iovlen == IOV_MAX) {
         addMsgHdr(false);
@@ -741,6 +1005,7 @@ void McbpConnection::addIov(const void* buf, size_t len) {
 
     m->msg_iov[m->msg_iovlen].iov_base = (void*)buf;
     m->msg_iov[m->msg_iovlen].iov_len = len;
+    iovZerocopy[iovused] = zc;
 
     msgbytes += len;
     ++iovused;
@@ -756,6 +1021,7 @@ void McbpConnection::ensureIovSpace() {
 
     // Try to double the size of the array
     iov.resize(iov.size() * 2);
+    iovZerocopy.resize(iov.size());
 
     /* Point all the msghdr structures at the new list. */
     size_t ii;
@@ -785,8 +1051,11 @@ McbpConnection::McbpConnection(SOCKET sfd, event_base *b)
       ritem(nullptr),
       rlbytes(0),
       item(nullptr),
+      itemValueBytes(0),
+      itemPacket(nullptr),
       iov(IOV_LIST_INITIAL),
       iovused(0),
+      iovZerocopy(IOV_LIST_INITIAL),
       msglist(),
       msgcurr(0),
       msgbytes(0),
@@ -833,8 +1102,11 @@ McbpConnection::McbpConnection(SOCKET sfd,
       ritem(nullptr),
       rlbytes(0),
       item(nullptr),
+      itemValueBytes(0),
+      itemPacket(nullptr),
       iov(IOV_LIST_INITIAL),
       iovused(0),
+      iovZerocopy(IOV_LIST_INITIAL),
       msglist(),
       msgcurr(0),
       msgbytes(0),
@@ -875,6 +1147,7 @@ McbpConnection::~McbpConnection() {
     cb_free(read.buf);
     cb_free(write.buf);
 
+    releaseZerocopyItems();
     releaseReservedItems();
     for (auto* ptr : temp_alloc) {
         cb_free(ptr);
@@ -1156,6 +1429,7 @@ bool McbpConnection::includeErrorStringInResponseBody(
     case PROTOCOL_BINARY_CMD_SUBDOC_COUNTER:
     case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
     case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+    case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY:
         return false;
 
     default:
@@ -1191,6 +1465,12 @@ bool McbpConnection::shouldDelete() {
 }
 
 void McbpConnection::runEventLoop(short which) {
+    if (zerocopy.issued != zerocopy.completed) {
+        // The notifications on the error queue trigger an event for the
+        // socket, so we need to drain it
+        processZerocopyCompletions();
+    }
+
     conn_loan_buffers(this);
     currentEvent = which;
     numEvents = max_reqs_per_event;
@@ -38,6 +38,7 @@
 #include <platform/sized_buffer.h>
 
 #include <chrono>
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -384,6 +385,33 @@ public:
         McbpConnection::item = item;
     }
 
+    /**
+     * Get the number of bytes of the current packet body which is received
+     * directly into the memory of the item (see getItem()) instead of into
+     * the input buffer.
+     */
+    uint32_t getItemValueBytes() const {
+        return itemValueBytes;
+    }
+
+    void setItemValueBytes(uint32_t itemValueBytes) {
+        McbpConnection::itemValueBytes = itemValueBytes;
+    }
+
+    /**
+     * Get the start of the current packet in the input buffer if its value
+     * is received directly into the item (nullptr until the item is
+     * allocated). Set once the item is allocated, so it also tells us that
+     * the value is (being) read into the item.
+     */
+    void* getItemPacket() const {
+        return itemPacket;
+    }
+
+    void setItemPacket(void* itemPacket) {
+        McbpConnection::itemPacket = itemPacket;
+    }
+
     /**
      * Get the number of entries in use in the IO Vector
      */
@@ -409,16 +437,71 @@ public:
     void addIov(const void* buf, size_t len);
 
     /**
-     * Release all of the items we've saved a reference to
+     * Add a chunk of item memory to the IO vector to send. The data may
+     * be sent with MSG_ZEROCOPY, so the memory must stay untouched until
+     * the kernel is done with it. The caller must therefore hold a
+     * reference to the item through reserveItem().
+     *
+     * @param buf pointer to the data to send
+     * @param len number of bytes to send
+     * @throws std::bad_alloc
      */
-    void releaseReservedItems() {
-        ENGINE_HANDLE* handle = reinterpret_cast<ENGINE_HANDLE*>(bucketEngine);
-        for (auto* it : reservedItems) {
-            bucketEngine->release(handle, this, it);
-        }
-        reservedItems.clear();
+    void addZerocopyIov(const void* buf, size_t len);
+
+    /**
+     * Should data of the given size be sent with MSG_ZEROCOPY on this
+     * connection?
+     */
+    bool isZerocopyCandidate(size_t len);
+
+    /**
+     * Release all of the items we've saved a reference to. Items which
+     * may be referenced by pending MSG_ZEROCOPY sends are kept until the
+     * kernel signals that the transmission completed.
+     */
+    void releaseReservedItems();
+
+    /**
+     * Get the event the connection should wait for when it runs out of
+     * data to read. That's normally EV_READ, but the SSL handshake may
+     * need to wait for the socket to be writable.
+     */
+    short getWaitingEvent() const {
+        return sslHandshakeWantWrite ? EV_WRITE : EV_READ;
     }
 
+    /**
+     * Release all items kept for pending MSG_ZEROCOPY sends without
+     * waiting for the kernel. Only to be used once the socket is closed
+     * (the kernel may still be sending the memory of the items)
+     */
+    void releaseZerocopyItems();
+
+    /**
+     * We're about to leave the current bucket. Items of the bucket which
+     * the kernel may still be sending can't be released yet, so they keep
+     * the connections reference to the bucket (counted in its clients)
+     * until they're released.
+     *
+     * @return true if the caller should keep the reference to the bucket
+     */
+    bool detachZerocopyItems();
+
+    /**
+     * Release the items of the current bucket kept for pending
+     * MSG_ZEROCOPY sends without waiting for the kernel. Used when the
+     * bucket is deleted by this connection (which is blocked until the
+     * bucket is gone, and can't process the completions in the meantime)
+     */
+    void releaseCurrentBucketZerocopyItems();
+
+    /**
+     * Read the completion notifications for MSG_ZEROCOPY sends from the
+     * sockets error queue and release the items which are no longer
+     * referenced by the kernel.
+     */
+    void processZerocopyCompletions();
+
     /**
      * Put an item on our list of reserved items (which we should release
      * at a later time through releaseReservedItems).
@@ -672,7 +755,7 @@ public:
      * @return true if successful, false otherwise
      */
     bool enableSSL(const std::string& cert, const std::string& pkey) {
-        if (ssl.enable(cert, pkey)) {
+        if (ssl.enable(cert, pkey, socketDescriptor)) {
             if (settings.getVerbose() > 1) {
                 ssl.dumpCipherList(getId());
             }
@@ -744,8 +827,14 @@ public:
      */
     static void* getPacket(const Cookie& cookie) {
         auto c = static_cast<McbpConnection*>(cookie.connection);
+        if (c->itemPacket != nullptr) {
+            // The value bytes which were already in the input buffer are
+            // copied into the item (and skipped in the input buffer)
+            return c->itemPacket;
+        }
         return (c->read.curr -
-               (c->binary_header.request.bodylen + sizeof(c->binary_header)));
+               (c->binary_header.request.bodylen - c->itemValueBytes +
+                sizeof(c->binary_header)));
     }
 
     /**
@@ -840,11 +929,29 @@ protected:
      */
     void* item;
 
+    /**
+     * The number of bytes at the end of the current packet which is read
+     * into the memory of item (and not present in the input buffer).
+     */
+    uint32_t itemValueBytes;
+
+    /**
+     * The start of the current packet if its value is read into item
+     * (see getItemPacket())
+     */
+    void* itemPacket;
+
     /* data for the mwrite state */
     std::vector<iovec> iov;
     /** number of elements used in iov[] */
     size_t iovused;
 
+    /**
+     * The entries in iov which may be sent with MSG_ZEROCOPY (item
+     * memory we hold a reference to)
+     */
+    std::vector<bool> iovZerocopy;
+
     /** The message list being used for transfer */
     std::vector<struct msghdr> msglist;
     /** element in msglist[] being transmitted now */
@@ -858,6 +965,46 @@ protected:
      */
     std::vector<void*> reservedItems;
 
+    /**
+     * Items which can't be released before the kernel completed a number
+     * of MSG_ZEROCOPY sends
+     */
+    struct PendingZerocopyItems {
+        /** The number of sends the kernel must have completed */
+        uint32_t sends;
+        /** The engine the items belong to */
+        ENGINE_HANDLE_V1* engine;
+        /**
+         * The index of the bucket we've left while the items were pending
+         * (or -1). We hold a reference to the bucket until the items are
+         * released.
+         */
+        int heldBucket;
+        std::vector<void*> items;
+    };
+
+    /**
+     * The state used for sending data with MSG_ZEROCOPY
+     */
+    struct {
+        /** Is SO_ZEROCOPY enabled on the socket */
+        bool enabled = false;
+        /** The socket doesn't support SO_ZEROCOPY */
+        bool unsupported = false;
+        /** The number of MSG_ZEROCOPY sends issued on the socket */
+        uint32_t issued = 0;
+        /** The number of MSG_ZEROCOPY sends the kernel completed */
+        uint32_t completed = 0;
+        /** The items pending completion (in the order of the sends) */
+        std::deque<PendingZerocopyItems> items;
+    } zerocopy;
+
+    /**
+     * Release the items in an entry of zerocopy.items (and the reference
+     * to the bucket it holds)
+     */
+    void releasePendingItems(const PendingZerocopyItems& entry);
+
     /**
      * A vector of temporary allocations that should be freed when the
      * the connection is done sending all of the data. Use pushTempAlloc to
@@ -930,6 +1077,25 @@ protected:
      */
     void ensureIovSpace();
 
+    /**
+     * Add a chunk of memory to the IO vector to send
+     *
+     * @param buf pointer to the data to send
+     * @param len number of bytes to send
+     * @param zc true if the chunk may be sent with MSG_ZEROCOPY
+     * @throws std::bad_alloc
+     */
+    void addIovEntry(const void* buf, size_t len, bool zc);
+
+    /**
+     * Send (a part of) the message and use MSG_ZEROCOPY for the chunks
+     * of item data which is big enough.
+     *
+     * @param m the message header to send
+     * @return the number of bytes sent, or -1 for an error
+     */
+    int sendmsgZerocopy(struct msghdr* m);
+
     /**
      * Read data over the SSL connection
      *
@@ -954,6 +1120,13 @@ protected:
      */
     int sslPreConnection();
 
+    /**
+     * Set when the SSL handshake can't continue before the socket is
+     * writable (SSL_ERROR_WANT_WRITE, or handshake data we couldn't
+     * send yet)
+     */
+    bool sslHandshakeWantWrite = false;
+
     // Total number of bytes received on the network
     size_t totalRecv;
     // Total number of bytes sent to the network
@@ -244,6 +244,11 @@ void conn_cleanup_engine_allocations(McbpConnection * c) {
     }
 
     c->releaseReservedItems();
+    if (c->isSocketClosed()) {
+        // The kernel won't report the completion of the pending
+        // MSG_ZEROCOPY sends on a closed socket
+        c->releaseZerocopyItems();
+    }
 }
 
 static void conn_cleanup(Connection *c) {
@@ -301,6 +306,7 @@ void conn_close(McbpConnection *c) {
         throw std::logic_error("conn_close: unable to obtain non-NULL thread from connection");
     }
     /* remove from pending-io list */
+    drain_pending_notifications(thread);
     if (settings.getVerbose() > 1 && list_contains(thread->pending_io, c)) {
         LOG_WARNING(c,
                     "Current connection was in the pending-io list.. Nuking it");
@@ -16,6 +16,8 @@
  */
 #pragma once
 
+#include "phase_timings.h"
+
 #include <platform/uuid.h>
 #include <stdexcept>
 
@@ -50,6 +52,8 @@ public:
         event_id.clear();
         error_context.clear();
         json_message.clear();
+        phaseTracker.reset();
+        requestTrace.end();
     }
 
     /**
@@ -94,6 +98,22 @@ public:
         return error_context;
     }
 
+    /**
+     * Get the tracker used to record the time spent in each phase of
+     * the current command (if phase timings are enabled)
+     */
+    CommandPhaseTracker& getPhaseTracker() {
+        return phaseTracker;
+    }
+
+    /**
+     * Get the trace for the current command (only active if the command
+     * was selected for sampled tracing)
+     */
+    RequestTrace& getRequestTrace() {
+        return requestTrace;
+    }
+
     /**
      * Return the error "object" to return to the client.
      *
@@ -121,4 +141,7 @@ protected:
      * transferred to the client.
      */
     std::string json_message;
+
+    CommandPhaseTracker phaseTracker;
+    RequestTrace requestTrace;
 };
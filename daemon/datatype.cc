@@ -33,6 +33,8 @@ bool Datatype::isSupported(mcbp::Feature feature) {
     case mcbp::Feature::XERROR:
     case mcbp::Feature::SELECT_BUCKET:
     case mcbp::Feature::COLLECTIONS:
+    case mcbp::Feature::HOT_KEY_HINTS:
+    case mcbp::Feature::TYPED_STATS:
     case mcbp::Feature::Invalid:
         throw std::invalid_argument("Datatype::isSupported invalid feature:" +
                                     std::to_string(int(feature)));
@@ -58,6 +60,8 @@ void Datatype::enable(mcbp::Feature feature) {
     case mcbp::Feature::XERROR:
     case mcbp::Feature::SELECT_BUCKET:
     case mcbp::Feature::COLLECTIONS:
+    case mcbp::Feature::HOT_KEY_HINTS:
+    case mcbp::Feature::TYPED_STATS:
     case mcbp::Feature::Invalid:
         throw std::invalid_argument("Datatype::enable invalid feature:" +
                                     std::to_string(int(feature)));
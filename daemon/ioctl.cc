@@ -139,6 +139,7 @@ static const std::unordered_map<std::string, SetCallbackFunc> ioctl_set_map{
         {"trace.start", ioctlSetTracingStart},
         {"trace.stop", ioctlSetTracingStop},
         {"trace.dump.clear", ioctlSetTracingClearDump},
+        {"trace.sampled.clear", ioctlSetTracingSampledClear},
 };
 
 ENGINE_ERROR_CODE ioctl_set_property(Connection* c,
@@ -0,0 +1,433 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "json_validator.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JSON_VALIDATOR_SIMD 1
+#include <immintrin.h>
+#endif
+
+/**
+ * A function returning the first byte in [ptr, end) within a string
+ * which needs a closer look: the closing quote, an escape, a control
+ * character (invalid) or the start of a multi-byte UTF-8 sequence.
+ * Returns end if there isn't any.
+ */
+using ScanFunction = const uint8_t* (*)(const uint8_t*, const uint8_t*);
+
+static inline bool is_plain(uint8_t c) {
+    return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+static const uint8_t* scan_scalar(const uint8_t* ptr, const uint8_t* end) {
+    while (ptr < end && is_plain(*ptr)) {
+        ++ptr;
+    }
+    return ptr;
+}
+
+#ifdef JSON_VALIDATOR_SIMD
+static const uint8_t* scan_sse2(const uint8_t* ptr, const uint8_t* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+
+    while (end - ptr >= 16) {
+        const __m128i v =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        // The signed compare catches both the control characters and the
+        // bytes with the high bit set
+        const __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                             _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmplt_epi8(v, space));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 16;
+    }
+    return scan_scalar(ptr, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* scan_avx2(const uint8_t* ptr, const uint8_t* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(0x20);
+
+    while (end - ptr >= 32) {
+        const __m256i v =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        const __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                _mm256_cmpeq_epi8(v, backslash)),
+                _mm256_cmpgt_epi8(space, v));
+        const uint32_t mask = uint32_t(_mm256_movemask_epi8(special));
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 32;
+    }
+    return scan_sse2(ptr, end);
+}
+#endif
+
+static ScanFunction select_scanner(const char*& name) {
+#ifdef JSON_VALIDATOR_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        return scan_avx2;
+    }
+    name = "sse2";
+    return scan_sse2;
+#else
+    name = "scalar";
+    return scan_scalar;
+#endif
+}
+
+static const char* scanner_name;
+static const ScanFunction scan_plain = select_scanner(scanner_name);
+
+const char* JsonValidator::getScanner() {
+    return scanner_name;
+}
+
+static inline bool is_whitespace(uint8_t c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool is_digit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_hex(uint8_t c) {
+    return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+static inline const uint8_t* skip_whitespace(const uint8_t* ptr,
+                                             const uint8_t* end) {
+    while (ptr < end && is_whitespace(*ptr)) {
+        ++ptr;
+    }
+    return ptr;
+}
+
+/**
+ * Validate the UTF-8 sequence starting at ptr (RFC 3629: no overlong
+ * encodings, surrogates or code points above U+10FFFF)
+ *
+ * @return the byte following the sequence or nullptr if it is invalid
+ */
+static const uint8_t* validate_utf8(const uint8_t* ptr, const uint8_t* end) {
+    const uint8_t lead = *ptr;
+    size_t continuation;
+    uint8_t min = 0x80;
+    uint8_t max = 0xbf;
+
+    if (lead < 0xc2) {
+        return nullptr;
+    } else if (lead < 0xe0) {
+        continuation = 1;
+    } else if (lead < 0xf0) {
+        continuation = 2;
+        if (lead == 0xe0) {
+            min = 0xa0;
+        } else if (lead == 0xed) {
+            max = 0x9f;
+        }
+    } else if (lead < 0xf5) {
+        continuation = 3;
+        if (lead == 0xf0) {
+            min = 0x90;
+        } else if (lead == 0xf4) {
+            max = 0x8f;
+        }
+    } else {
+        return nullptr;
+    }
+
+    if (size_t(end - ptr) <= continuation) {
+        return nullptr;
+    }
+    ++ptr;
+    if (*ptr < min || *ptr > max) {
+        return nullptr;
+    }
+    for (size_t ii = 1; ii < continuation; ++ii) {
+        if ((ptr[ii] & 0xc0) != 0x80) {
+            return nullptr;
+        }
+    }
+    return ptr + continuation;
+}
+
+/**
+ * Parse a string
+ *
+ * @param ptr the byte following the opening quote
+ * @return the byte following the closing quote or nullptr if invalid
+ */
+static const uint8_t* parse_string(const uint8_t* ptr, const uint8_t* end) {
+    while (true) {
+        ptr = scan_plain(ptr, end);
+        if (ptr == end) {
+            return nullptr;
+        }
+
+        switch (*ptr) {
+        case '"':
+            return ptr + 1;
+        case '\\':
+            if (++ptr == end) {
+                return nullptr;
+            }
+            switch (*ptr) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                ++ptr;
+                break;
+            case 'u':
+                if (end - ptr < 5 || !is_hex(ptr[1]) || !is_hex(ptr[2]) ||
+                    !is_hex(ptr[3]) || !is_hex(ptr[4])) {
+                    return nullptr;
+                }
+                ptr += 5;
+                break;
+            default:
+                return nullptr;
+            }
+            break;
+        default:
+            if (*ptr < 0x20) {
+                return nullptr;
+            }
+            ptr = validate_utf8(ptr, end);
+            if (ptr == nullptr) {
+                return nullptr;
+            }
+        }
+    }
+}
+
+/**
+ * Parse a number
+ *
+ * @return the byte following the number or nullptr if invalid
+ */
+static const uint8_t* parse_number(const uint8_t* ptr, const uint8_t* end) {
+    if (*ptr == '-' && ++ptr == end) {
+        return nullptr;
+    }
+
+    if (*ptr == '0') {
+        ++ptr;
+    } else if (is_digit(*ptr)) {
+        while (ptr < end && is_digit(*ptr)) {
+            ++ptr;
+        }
+    } else {
+        return nullptr;
+    }
+
+    if (ptr < end && *ptr == '.') {
+        if (++ptr == end || !is_digit(*ptr)) {
+            return nullptr;
+        }
+        while (ptr < end && is_digit(*ptr)) {
+            ++ptr;
+        }
+    }
+
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        if (++ptr < end && (*ptr == '+' || *ptr == '-')) {
+            ++ptr;
+        }
+        if (ptr == end || !is_digit(*ptr)) {
+            return nullptr;
+        }
+        while (ptr < end && is_digit(*ptr)) {
+            ++ptr;
+        }
+    }
+
+    return ptr;
+}
+
+static const uint8_t* parse_literal(const uint8_t* ptr,
+                                    const uint8_t* end,
+                                    const char* literal,
+                                    size_t length) {
+    if (size_t(end - ptr) < length) {
+        return nullptr;
+    }
+    for (size_t ii = 0; ii < length; ++ii) {
+        if (ptr[ii] != uint8_t(literal[ii])) {
+            return nullptr;
+        }
+    }
+    return ptr + length;
+}
+
+/**
+ * Parse the name of an object member and the following colon
+ *
+ * @param ptr the first non-whitespace byte of the member
+ * @return the first non-whitespace byte of the value or nullptr if invalid
+ */
+static const uint8_t* parse_member_name(const uint8_t* ptr,
+                                        const uint8_t* end) {
+    if (ptr == end || *ptr != '"') {
+        return nullptr;
+    }
+    ptr = parse_string(ptr + 1, end);
+    if (ptr == nullptr) {
+        return nullptr;
+    }
+    ptr = skip_whitespace(ptr, end);
+    if (ptr == end || *ptr != ':') {
+        return nullptr;
+    }
+    return skip_whitespace(ptr + 1, end);
+}
+
+/**
+ * Check if the first and last (non-whitespace) byte of the payload may
+ * start and end a JSON value. This rejects most binary payloads without
+ * looking at the rest of the data.
+ */
+static bool may_be_json(const uint8_t* begin, const uint8_t* end) {
+    while (end > begin && is_whitespace(end[-1])) {
+        --end;
+    }
+    if (begin == end) {
+        return false;
+    }
+
+    switch (*begin) {
+    case '{':
+        return end[-1] == '}';
+    case '[':
+        return end[-1] == ']';
+    case '"':
+        return end[-1] == '"';
+    case 't':
+    case 'f':
+        return end[-1] == 'e';
+    case 'n':
+        return end[-1] == 'l';
+    case '-':
+        return is_digit(end[-1]);
+    default:
+        return is_digit(*begin) && is_digit(end[-1]);
+    }
+}
+
+bool JsonValidator::validate(const uint8_t* data, size_t size) {
+    const uint8_t* end = data + size;
+    const uint8_t* ptr = skip_whitespace(data, end);
+
+    if (!may_be_json(ptr, end)) {
+        return false;
+    }
+
+    stack.clear();
+    while (true) {
+        // Parse a value (ptr is at the first non-whitespace byte)
+        if (ptr == end) {
+            return false;
+        }
+        switch (*ptr) {
+        case '{':
+            ptr = skip_whitespace(ptr + 1, end);
+            if (ptr < end && *ptr == '}') {
+                ++ptr;
+                break;
+            }
+            stack.push_back('{');
+            ptr = parse_member_name(ptr, end);
+            if (ptr == nullptr) {
+                return false;
+            }
+            continue;
+        case '[':
+            ptr = skip_whitespace(ptr + 1, end);
+            if (ptr < end && *ptr == ']') {
+                ++ptr;
+                break;
+            }
+            stack.push_back('[');
+            continue;
+        case '"':
+            ptr = parse_string(ptr + 1, end);
+            break;
+        case 't':
+            ptr = parse_literal(ptr, end, "true", 4);
+            break;
+        case 'f':
+            ptr = parse_literal(ptr, end, "false", 5);
+            break;
+        case 'n':
+            ptr = parse_literal(ptr, end, "null", 4);
+            break;
+        default:
+            ptr = parse_number(ptr, end);
+        }
+
+        if (ptr == nullptr) {
+            return false;
+        }
+
+        // The value is complete. Close the containers until we find
+        // the next value (or the end of the document)
+        while (true) {
+            ptr = skip_whitespace(ptr, end);
+            if (stack.empty()) {
+                return ptr == end;
+            }
+            if (ptr == end) {
+                return false;
+            }
+
+            const uint8_t container = stack.back();
+            if (*ptr == ',') {
+                ptr = skip_whitespace(ptr + 1, end);
+                if (container == '{') {
+                    ptr = parse_member_name(ptr, end);
+                    if (ptr == nullptr) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            if (*ptr != (container == '{' ? '}' : ']')) {
+                return false;
+            }
+            stack.pop_back();
+            ++ptr;
+        }
+    }
+}
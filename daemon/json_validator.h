@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The JsonValidator checks if a document is valid JSON (encoded as UTF-8)
+ * in order to decide if we should set the JSON datatype for documents
+ * stored by clients which don't know about datatypes. It accepts the same
+ * documents as JSON_checker::Validator (any JSON value at the top level),
+ * but is a lot cheaper for the documents we typically see:
+ *
+ *   * Payloads which can't be JSON judging by their first and last
+ *     (non-whitespace) byte are rejected without looking at the rest.
+ *   * The content of strings (which is most of a typical document) is
+ *     scanned 16 or 32 bytes at the time with SSE2 or AVX2 (picked at
+ *     runtime) rather than running a state machine for every byte.
+ *
+ * Each worker thread owns an instance (the nesting stack is reused
+ * between the calls).
+ */
+class JsonValidator {
+public:
+    /**
+     * Check if the provided data is valid JSON
+     *
+     * @param data the document to check
+     * @param size the number of bytes in the document
+     * @return true if the document is valid JSON
+     * @throws std::bad_alloc if we fail to grow the nesting stack
+     */
+    bool validate(const uint8_t* data, size_t size);
+
+    /**
+     * Get the name of the instruction set used to scan strings
+     * ("avx2", "sse2" or "scalar")
+     */
+    static const char* getScanner();
+
+protected:
+    /// The open objects ('{') and arrays ('[')
+    std::vector<uint8_t> stack;
+};
@@ -91,7 +91,8 @@ static unique_cJSON_ptr create_memcached_audit_object(const Connection *c) {
 }
 
 /**
- * Convert the JSON object to text and send it to the audit framework
+ * Send the JSON object to the audit framework. The object is converted
+ * to text by the audit daemon.
  *
  * @param c the connection object requesting the call
  * @param id the audit identifier
@@ -102,12 +103,12 @@ static void do_audit(const Connection* c,
                      uint32_t id,
                      unique_cJSON_ptr& event,
                      const char* warn) {
-    auto text = to_string(event, false);
-    auto status = put_audit_event(get_audit_handle(), id, text.data(),
-                                  text.length());
+    auto status = put_json_audit_event(get_audit_handle(), id,
+                                       std::move(event));
 
     if (status != AUDIT_SUCCESS) {
-        LOG_WARNING(c, "%s: %s", warn, text.c_str());
+        // The audit daemon doesn't take the event unless it was queued
+        LOG_WARNING(c, "%s: %s", warn, to_string(event, false).c_str());
     }
 }
 
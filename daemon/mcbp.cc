@@ -130,6 +130,7 @@ void mcbp_write_response(McbpConnection* c,
             mcbp_collect_timings(reinterpret_cast<McbpConnection*>(c));
             c->setStart(0);
         }
+        mcbp_collect_phase_timings(c);
         // The responseCounter is updated here as this is non-responding code
         // hence mcbp_add_header will not be called (which is what normally
         // updates the responseCounters).
@@ -346,8 +347,10 @@ bool mcbp_response_handler(const void* key, uint16_t keylen,
 void mcbp_collect_timings(const McbpConnection* c) {
     hrtime_t now = gethrtime();
     const hrtime_t elapsed_ns = now - c->getStart();
+    // Each worker thread records the timings in its own histograms
+    const auto thread = size_t(c->getThread()->index);
     // aggregated timing for all buckets
-    all_buckets[0].timings.collect(c->getCmd(), elapsed_ns);
+    all_buckets[0].timings.collect(thread, c->getCmd(), elapsed_ns);
 
     // timing for current bucket
     bucket_id_t bucketid = get_bucket_id(c->getCookie());
@@ -356,10 +359,36 @@ void mcbp_collect_timings(const McbpConnection* c) {
      * to delete the bucket you're associated with and your're idle.
      */
     if (bucketid != 0) {
-        all_buckets[bucketid].timings.collect(c->getCmd(), elapsed_ns);
+        all_buckets[bucketid].timings.collect(thread, c->getCmd(), elapsed_ns);
     }
 
     // Log operations taking longer than 0.5s
     const hrtime_t elapsed_ms = elapsed_ns / (1000 * 1000);
     c->maybeLogSlowCommand(std::chrono::milliseconds(elapsed_ms));
 }
+
+void mcbp_collect_phase_timings(McbpConnection* c) {
+    auto& cookie = c->getCookieObject();
+    auto& tracker = cookie.getPhaseTracker();
+    if (!tracker.isActive()) {
+        return;
+    }
+
+    tracker.stop();
+    if (tracker.isCollectingTimings()) {
+        phase_timings.collect(size_t(c->getThread()->index), c->getCmd(),
+                              tracker);
+    }
+
+    auto& trace = cookie.getRequestTrace();
+    if (trace.isActive()) {
+        sampled_tracer.complete(c->getId(),
+                                c->getCmd(),
+                                c->getOpaque(),
+                                c->getBucket().name,
+                                trace,
+                                gethrtime(),
+                                settings.getTraceSampleThresholdUsec() * 1000);
+        trace.end();
+    }
+}
@@ -137,6 +137,129 @@ static void bin_read_chunk(McbpConnection* c, uint32_t chunk) {
     c->setState(conn_nread);
 }
 
+/**
+ * Should the value of the current command be read directly into the
+ * memory of the item instead of the input buffer? We only do this for
+ * the "simple" mutations (where the size of the item to create is
+ * known up front) and values which exceed the configured threshold.
+ */
+static bool is_direct_item_read_candidate(McbpConnection* c) {
+    const auto threshold = settings.getDirectItemReadThreshold();
+    if (threshold == 0 || c->binary_header.request.magic != PROTOCOL_BINARY_REQ ||
+        c->isTAP() || c->isDCP()) {
+        return false;
+    }
+
+    switch (c->binary_header.request.opcode) {
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_SETQ:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_ADDQ:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+        break;
+    default:
+        return false;
+    }
+
+    const auto& req = c->binary_header.request;
+    const uint32_t headerlen = req.extlen + req.keylen;
+    return req.extlen == 8 && req.keylen != 0 && req.bodylen > headerlen &&
+           (req.bodylen - headerlen) >= threshold;
+}
+
+static protocol_binary_response_status validate_bin_header(McbpConnection* c);
+
+static McbpPrivilegeChains& get_privilege_chains() {
+    static McbpPrivilegeChains privilegeChains;
+    return privilegeChains;
+}
+
+/**
+ * Check if the connection may execute the mutation it sent us the extras
+ * and key for, and that they're valid. Neither of the checks need the
+ * value, so we can run them before we ask the bucket to allocate memory
+ * for the item (they're run again by process_bin_packet once the entire
+ * packet is received).
+ */
+static bool may_allocate_item_for_value(McbpConnection* c) {
+    const auto opcode =
+            protocol_binary_command(c->binary_header.request.opcode);
+    return c->isAuthenticated() &&
+           get_privilege_chains().invoke(opcode, c->getCookieObject()) ==
+                   cb::rbac::PrivilegeAccess::Ok &&
+           validate_bin_header(c) == PROTOCOL_BINARY_RESPONSE_SUCCESS &&
+           c->validateCommand(opcode) == PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+/**
+ * Try to allocate the item for the value of the current mutation and
+ * set up the connection to read the value directly into the items
+ * memory.
+ *
+ * @return true if the value is to be read into the item
+ */
+static bool allocate_item_for_value(McbpConnection* c) {
+    const auto valuelen = c->getItemValueBytes();
+    auto* packet = McbpConnection::getPacket(c->getCookieObject());
+    auto* req = reinterpret_cast<protocol_binary_request_set*>(packet);
+    const DocKey key(req->bytes + sizeof(req->bytes),
+                     c->binary_header.request.keylen,
+                     c->getDocNamespace());
+
+    try {
+        auto pair = bucket_allocate_ex(*c,
+                                       key,
+                                       valuelen,
+                                       0,
+                                       req->message.body.flags,
+                                       ntohl(req->message.body.expiration),
+                                       c->binary_header.request.datatype,
+                                       c->binary_header.request.vbucket);
+        if (pair.second.value[0].iov_len == valuelen) {
+            c->setRitem(static_cast<char*>(pair.second.value[0].iov_base));
+            c->setItem(pair.first.release());
+            // conn_nread moves read.curr past any part of the value
+            // already in the input buffer, so remember where the packet is
+            c->setItemPacket(packet);
+            c->setRlbytes(valuelen);
+            c->setState(conn_nread);
+            return true;
+        }
+    } catch (const cb::engine_error&) {
+        // Fall back to the normal path
+    } catch (const std::bad_alloc&) {
+        // Fall back to the normal path
+    }
+    return false;
+}
+
+/**
+ * We've received the extras and the key for a mutation with a large value.
+ * Try to allocate the item and read the value directly into the items
+ * memory. If the connection isn't allowed to run the command (or the
+ * packet is invalid), or we fail to allocate the item, we'll fall back to
+ * read the value into the input buffer and let process_bin_packet and
+ * the mutation command report the error (if it persists).
+ */
+static void bin_read_value_into_item(McbpConnection* c) {
+    if (may_allocate_item_for_value(c) && allocate_item_for_value(c)) {
+        return;
+    }
+
+    // Put the extras and the key back into the input buffer and read
+    // the entire body into the input buffer like we do for all other
+    // packets.
+    const uint32_t headerlen = c->binary_header.request.extlen +
+                               c->binary_header.request.keylen;
+    c->setItemValueBytes(0);
+    c->read.curr -= headerlen + sizeof(c->binary_header);
+    c->read.bytes += headerlen + sizeof(c->binary_header);
+    bin_read_chunk(c, c->binary_header.request.bodylen);
+    c->read.curr += sizeof(c->binary_header);
+    c->read.bytes -= sizeof(c->binary_header);
+}
+
 /* Just write an error message and disconnect the client */
 static void handle_binary_protocol_error(McbpConnection* c) {
     mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL);
@@ -149,15 +272,20 @@ static void handle_binary_protocol_error(McbpConnection* c) {
  * Triggers topkeys_update (i.e., increments topkeys stats) if called by a
  * valid operation.
  */
-void update_topkeys(const DocKey& key, McbpConnection* c) {
+bool update_topkeys(const DocKey& key, McbpConnection* c,
+                    size_t bytes_read, size_t bytes_written) {
 
     if (topkey_commands[c->binary_header.request.opcode]) {
         if (all_buckets[c->getBucketIndex()].topkeys != nullptr) {
-            all_buckets[c->getBucketIndex()].topkeys->updateKey(key.data(),
-                                                                key.size(),
-                                                                mc_time_get_current_time());
+            const auto threshold = settings.getHotKeyThreshold();
+            const auto rate = all_buckets[c->getBucketIndex()].topkeys->updateKey(
+                    size_t(c->getThread()->index), key.data(), key.size(),
+                    mc_time_get_current_time(), bytes_read, bytes_written,
+                    threshold != 0);
+            return threshold != 0 && rate >= threshold;
         }
     }
+    return false;
 }
 
 static void process_bin_get(McbpConnection* c, void* packet) {
@@ -1802,6 +1930,7 @@ std::array<mcbp_package_execute, 0x100>& get_mcbp_executors(void) {
     executors[PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP] = subdoc_multi_lookup_executor;
     executors[PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION] = subdoc_multi_mutation_executor;
     executors[PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT] = subdoc_get_count_executor;
+    executors[PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY] = subdoc_multi_key_executor;
 
     executors[PROTOCOL_BINARY_CMD_CREATE_BUCKET] = create_bucket_executor;
     executors[PROTOCOL_BINARY_CMD_LIST_BUCKETS] = list_bucket_executor;
@@ -1906,16 +2035,23 @@ static protocol_binary_response_status validate_bin_header(McbpConnection* c) {
 }
 
 static void process_bin_packet(McbpConnection* c) {
-    static McbpPrivilegeChains privilegeChains;
     protocol_binary_response_status result;
 
-    char* packet = (c->read.curr - (c->binary_header.request.bodylen +
-                                    sizeof(c->binary_header)));
+    auto* packet = McbpConnection::getPacket(c->getCookieObject());
+    auto& phaseTracker = c->getCookieObject().getPhaseTracker();
+    if (phaseTracker.getCurrentPhase() == CommandPhase::EWouldBlock) {
+        // The engine notified us and the command is resuming; the wait
+        // ends now and re-running the checks is part of the engine phase
+        phaseTracker.enter(CommandPhase::Engine);
+    } else {
+        phaseTracker.enter(CommandPhase::Parse);
+    }
 
     auto opcode = static_cast<protocol_binary_command>(c->binary_header.request.opcode);
     auto executor = executors[opcode];
 
-    const auto res = privilegeChains.invoke(opcode, c->getCookieObject());
+    const auto res =
+            get_privilege_chains().invoke(opcode, c->getCookieObject());
     switch (res) {
     case cb::rbac::PrivilegeAccess::Fail:
         LOG_WARNING(c,
@@ -1949,6 +2085,7 @@ static void process_bin_packet(McbpConnection* c) {
             return;
         }
 
+        phaseTracker.enter(CommandPhase::Engine);
         if (executor != NULL) {
             executor(c, packet);
         } else {
@@ -2015,6 +2152,20 @@ static void dispatch_bin_command(McbpConnection* c) {
 
     if (c->getStart() == 0) {
         c->setStart(gethrtime());
+        const bool timings = settings.isPhaseTimingsEnabled();
+        const bool sampled = sampled_tracer.shouldSample(
+                size_t(c->getThread()->index),
+                c->binary_header.request.opcode,
+                settings.getTraceSampleRate());
+        if (timings || sampled) {
+            auto& cookie = c->getCookieObject();
+            RequestTrace* trace = nullptr;
+            if (sampled) {
+                trace = &cookie.getRequestTrace();
+                trace->begin(c->getStart());
+            }
+            cookie.getPhaseTracker().start(c->getStart(), timings, trace);
+        }
     }
 
     MEMCACHED_PROCESS_COMMAND_START(c->getId(), c->read.curr, c->read.bytes);
@@ -2034,6 +2185,13 @@ static void dispatch_bin_command(McbpConnection* c) {
     if (c->binary_header.request.bodylen > settings.getMaxPacketSize()) {
         mcbp_write_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL);
         c->setWriteAndGo(conn_closing);
+    } else if (is_direct_item_read_candidate(c)) {
+        // Only read the extras and the key into the input buffer. The
+        // value is read into the item once we've allocated it.
+        const uint32_t headerlen = c->binary_header.request.extlen +
+                                   c->binary_header.request.keylen;
+        c->setItemValueBytes(c->binary_header.request.bodylen - headerlen);
+        bin_read_chunk(c, headerlen);
     } else {
         bin_read_chunk(c, c->binary_header.request.bodylen);
     }
@@ -2051,6 +2209,11 @@ void mcbp_complete_nread(McbpConnection* c) {
                         (unsigned int)c->binary_header.request.opcode);
             c->setState(conn_closing);
         }
+    } else if (c->getItemValueBytes() != 0 && c->getItemPacket() == nullptr) {
+        // We've got the extras and the key; the value is yet to be read.
+        // (Once it is read the mutation may have taken the item, and be
+        // resumed here after EWOULDBLOCK.)
+        bin_read_value_into_item(c);
     } else {
         process_bin_packet(c);
     }
@@ -279,6 +279,8 @@ McbpPrivilegeChains::McbpPrivilegeChains() {
     setup(PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, require<Privilege::Read>);
     setup(PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, require<Privilege::Write>);
+    // The executor checks for Write if the keys are to be mutated
+    setup(PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY, require<Privilege::Read>);
 
 
     /* Scrub the data */
@@ -41,6 +41,7 @@
 #include "enginemap.h"
 #include "buckets.h"
 #include "parent_monitor.h"
+#include "prometheus_exporter.h"
 #include "topkeys.h"
 #include "stats.h"
 #include "mcbp_executors.h"
@@ -92,6 +93,10 @@ static EXTENSION_LOG_LEVEL get_log_level(void);
 static cb_mutex_t buckets_lock;
 std::array<Bucket, COUCHBASE_MAX_NUM_BUCKETS + 1> all_buckets;
 
+PhaseTimings phase_timings;
+
+SampledTracer sampled_tracer;
+
 static ENGINE_HANDLE* v1_handle_2_handle(ENGINE_HANDLE_V1* v1) {
     return reinterpret_cast<ENGINE_HANDLE*>(v1);
 }
@@ -187,10 +192,30 @@ static void set_stats_reset_time(void)
     }
 }
 
+void release_bucket_client(int bucketIndex) {
+    Bucket &b = all_buckets.at(bucketIndex);
+    cb_mutex_enter(&b.mutex);
+    b.clients--;
+    if (b.clients == 0 && b.state == BucketState::Destroying) {
+        cb_cond_signal(&b.cond);
+    }
+    cb_mutex_exit(&b.mutex);
+}
+
 void disassociate_bucket(Connection *c) {
+    // Items held for pending MSG_ZEROCOPY sends may keep our reference
+    // to the bucket we're leaving (until the kernel is done with them)
+    bool keep_reference = false;
+    auto* mcbp = dynamic_cast<McbpConnection*>(c);
+    if (mcbp != nullptr) {
+        keep_reference = mcbp->detachZerocopyItems();
+    }
+
     Bucket &b = all_buckets.at(c->getBucketIndex());
     cb_mutex_enter(&b.mutex);
-    b.clients--;
+    if (!keep_reference) {
+        b.clients--;
+    }
 
     c->setBucketIndex(0);
     c->setBucketEngine(nullptr);
@@ -563,6 +588,13 @@ static void settings_init(void) {
      */
     settings.setMaxPacketSize(30 * 1024 * 1024);
 
+    /*
+     * Values of 64k and above for SET/ADD/REPLACE is read straight into
+     * the memory allocated for the item instead of being copied from the
+     * input buffer.
+     */
+    settings.setDirectItemReadThreshold(64 * 1024);
+
     settings.setRequireInit(false);
     settings.setDedupeNmvbMaps(false);
 
@@ -1041,6 +1073,8 @@ void event_handler(evutil_socket_t fd, short which, void *arg) {
         return;
     }
 
+    thr->num_events++;
+
     LOCK_THREAD(thr);
     if (memcached_shutdown) {
         // Someone requested memcached to shut down.
@@ -1057,6 +1091,7 @@ void event_handler(evutil_socket_t fd, short which, void *arg) {
      * object was scheduled to run in the dispatcher before the
      * callback for the worker thread is executed.
      */
+    drain_pending_notifications(thr);
     thr->pending_io = list_remove(thr->pending_io, c);
 
     /* sanity */
@@ -1131,8 +1166,7 @@ void listen_event_handler(evutil_socket_t, short which, void *arg) {
 }
 
 static void dispatch_event_handler(evutil_socket_t fd, short, void *) {
-    char buffer[80];
-    ssize_t nr = recv(fd, buffer, sizeof(buffer), 0);
+    auto nr = drain_notification_channel(fd);
 
     if (enable_common_ports.load()) {
         enable_common_ports.store(false);
@@ -1708,16 +1742,25 @@ static ENGINE_ERROR_CODE release_cookie(const void *void_cookie) {
 
     thr = c->getThread();
     cb_assert(thr);
-    LOCK_THREAD(thr);
-    c->decrementRefcount();
 
     /* Releasing the refererence to the object may cause it to change
      * state. (NOTE: the release call shall never be called from the
      * worker threads), so should put the connection in the pool of
      * pending IO and have the system retry the operation for the
-     * connection
+     * connection.
+     *
+     * Unlike notify_io_complete() we need the thread lock here. The
+     * worker only runs the pending connections while holding it, so
+     * it can't run the connection between us queueing it and dropping
+     * the reference (and miss that the reference is gone, leaving a
+     * closing connection without anyone to run it again). Queueing it
+     * after dropping the reference isn't an option either, as the
+     * worker may release the connection as soon as the reference is
+     * gone.
      */
+    LOCK_THREAD(thr);
     notify = add_conn_to_pending_io_list(c);
+    c->decrementRefcount();
     UNLOCK_THREAD(thr);
 
     /* kick the thread in the butt */
@@ -2111,7 +2154,13 @@ void CreateBucketThread::create() {
         all_buckets[ii].type = type;
         strcpy(all_buckets[ii].name, name.c_str());
         try {
-            all_buckets[ii].topkeys = new TopKeys(settings.getTopkeysSize());
+            all_buckets[ii].topkeys =
+                    new TopKeys(settings.getTopkeysSize(),
+                                settings.getNumWorkerThreads() + 1);
+            if (settings.getSubdocLookupCacheSize() > 0) {
+                all_buckets[ii].subdoc_lookup_cache = new SubdocLookupCache(
+                        settings.getSubdocLookupCacheSize());
+            }
         } catch (const std::bad_alloc &) {
             result = ENGINE_ENOMEM;
             LOG_WARNING(&connection,
@@ -2170,6 +2219,8 @@ void CreateBucketThread::create() {
             bucket.engine = nullptr;
             delete bucket.topkeys;
             bucket.topkeys = nullptr;
+            delete bucket.subdoc_lookup_cache;
+            bucket.subdoc_lookup_cache = nullptr;
             cb_mutex_exit(&bucket.mutex);
 
             result = ENGINE_NOT_STORED;
@@ -2181,6 +2232,8 @@ void CreateBucketThread::create() {
         bucket.engine = nullptr;
         delete bucket.topkeys;
         bucket.topkeys = nullptr;
+        delete bucket.subdoc_lookup_cache;
+        bucket.subdoc_lookup_cache = nullptr;
         cb_mutex_exit(&bucket.mutex);
 
         LOG_WARNING(&connection,
@@ -2269,6 +2322,13 @@ void DestroyBucketThread::destroy() {
 
     /* If this thread is connected to the requested bucket... release it */
     if (connection != nullptr && idx == size_t(connection->getBucketIndex())) {
+        // We're blocking the connection until the bucket is gone, so it
+        // can't wait for the kernel to complete its MSG_ZEROCOPY sends of
+        // the items in the bucket (which go away with the bucket anyway)
+        auto* mcbp = dynamic_cast<McbpConnection*>(connection);
+        if (mcbp != nullptr) {
+            mcbp->releaseCurrentBucketZerocopyItems();
+        }
         disassociate_bucket(connection);
     }
 
@@ -2335,6 +2395,8 @@ void DestroyBucketThread::destroy() {
     delete all_buckets[idx].topkeys;
     all_buckets[idx].responseCounters.fill(0);
     all_buckets[idx].topkeys = nullptr;
+    delete all_buckets[idx].subdoc_lookup_cache;
+    all_buckets[idx].subdoc_lookup_cache = nullptr;
     cb_mutex_exit(&all_buckets[idx].mutex);
     // don't need lock because all timing data uses atomics
     all_buckets[idx].timings.reset();
@@ -2357,6 +2419,7 @@ static void initialize_buckets(void) {
     int numthread = settings.getNumWorkerThreads() + 1;
     for (auto &b : all_buckets) {
         b.stats = new thread_stats[numthread];
+        b.timings.setNumThreads(numthread, settings.getTimingsPrecision());
     }
 
     // To make the life easier for us in the code, index 0
@@ -2401,6 +2464,7 @@ static void cleanup_buckets(void) {
         if (bucket.state == BucketState::Ready) {
             bucket.engine->destroy(v1_handle_2_handle(bucket.engine), false);
             delete bucket.topkeys;
+            delete bucket.subdoc_lookup_cache;
         }
 
         delete []bucket.stats;
@@ -2698,6 +2762,7 @@ extern "C" int memcached_main(int argc, char **argv) {
     const std::string numa_status = configure_numa_policy();
 #endif
     std::unique_ptr<ParentMonitor> parent_monitor;
+    std::unique_ptr<PrometheusExporter> prometheus_exporter;
 
     // Setup terminate handler - initially with no logger (to catch
     // super-early crashes).
@@ -2817,6 +2882,10 @@ extern "C" int memcached_main(int argc, char **argv) {
     }
 #endif
 
+    phase_timings.setNumThreads(settings.getNumWorkerThreads() + 1,
+                                settings.getTimingsPrecision());
+    sampled_tracer.setNumThreads(settings.getNumWorkerThreads() + 1);
+
     /* start up worker threads if MT mode */
     thread_init(settings.getNumWorkerThreads(), main_base, dispatch_event_handler);
 
@@ -2842,6 +2911,18 @@ extern "C" int memcached_main(int argc, char **argv) {
         parent_monitor.reset(new ParentMonitor(std::stoi(env)));
     }
 
+    /* Optional metrics exporter */
+    if (settings.getPrometheusPort() != 0) {
+        try {
+            prometheus_exporter.reset(
+                    new PrometheusExporter(settings.getPrometheusPort()));
+        } catch (const std::exception& exception) {
+            FATAL_ERROR(EXIT_FAILURE, "%s", exception.what());
+        }
+        LOG_NOTICE(nullptr, "Serving metrics on 127.0.0.1:%u",
+                   unsigned(settings.getPrometheusPort()));
+    }
+
     if (!memcached_shutdown) {
         /* enter the event loop */
         if (settings.isRequireInit()) {
@@ -2856,6 +2937,11 @@ extern "C" int memcached_main(int argc, char **argv) {
     }
 
     LOG_NOTICE(NULL, "Initiating graceful shutdown.");
+    if (prometheus_exporter) {
+        LOG_NOTICE(nullptr, "Shutting down metrics exporter");
+        prometheus_exporter.reset();
+    }
+
     delete_all_buckets();
 
     if (parent_monitor.get() != nullptr) {
@@ -2,6 +2,7 @@
 #ifndef MEMCACHED_H
 #define MEMCACHED_H
 
+#include <atomic>
 #include <mutex>
 #include <vector>
 
@@ -20,12 +21,14 @@
 #include <memcached/engine.h>
 #include <memcached/engine_error.h>
 #include <memcached/extension.h>
-#include <JSON_checker.h>
 
 #include "dynamic_buffer.h"
 #include "executorpool.h"
+#include "json_validator.h"
 #include "log_macros.h"
 #include "net_buf.h"
+#include "phase_timings.h"
+#include "sampled_tracing.h"
 #include "settings.h"
 
 /** Maximum length of a key. */
@@ -62,6 +65,12 @@
 
 extern struct stats stats;
 
+/* The per-phase command timings (if enabled) */
+extern PhaseTimings phase_timings;
+
+/* The slow requests found by the sampled tracing */
+extern SampledTracer sampled_tracer;
+
 enum class ThreadType {
     GENERAL = 11,
     TAP = 13,
@@ -75,11 +84,20 @@ struct LIBEVENT_THREAD {
     cb_thread_t thread_id;      /* unique ID of this thread */
     struct event_base *base;    /* libevent handle this thread uses */
     struct event notify_event;  /* listen event for notify pipe */
-    SOCKET notify[2];           /* notification pipes */
+    SOCKET notify[2];           /* notification pipe (read end, write end).
+                                   Both refer to the same eventfd on Linux */
+    std::atomic_bool notified;  /* set while a wakeup is pending in notify */
     ConnectionQueue *new_conn_queue; /* queue of new connections to handle */
-    cb_mutex_t mutex;      /* Mutex to lock protect access to the pending_io */
+    cb_mutex_t mutex;      /* Mutex to serialize the worker with other threads */
     bool is_locked;
-    Connection *pending_io;    /* List of connection with pending async io ops */
+    Connection *pending_io;    /* List of connection with pending async io ops
+                                  (only accessed by the thread itself) */
+    /**
+     * Lock-free list of connections other threads want to be rescheduled
+     * (see add_conn_to_pending_io_list()). The thread moves the entries
+     * over to pending_io with drain_pending_notifications()
+     */
+    std::atomic<Connection*> pending_notifications;
     int index;                  /* index of this thread in the threads array */
     ThreadType type;      /* Type of IO this thread processes */
 
@@ -102,7 +120,14 @@ struct LIBEVENT_THREAD {
      */
     int deleting_buckets;
 
-    JSON_checker::Validator *validator;
+    JsonValidator* validator;
+
+    /**
+     * The number of event callbacks run by this thread. Used by the
+     * busy polling loop to detect if a non-blocking poll found any work.
+     * Only accessed by the thread itself.
+     */
+    uint64_t num_events;
 };
 
 #define LOCK_THREAD(t) \
@@ -118,6 +143,7 @@ struct LIBEVENT_THREAD {
 extern void notify_thread(LIBEVENT_THREAD *thread);
 extern void notify_dispatcher(void);
 extern bool create_notification_pipe(LIBEVENT_THREAD *me);
+extern int64_t drain_notification_channel(evutil_socket_t fd);
 
 #include "connection.h"
 #include "connection_listen.h"
@@ -172,6 +198,8 @@ Connection *list_remove(Connection *h, Connection *n);
 bool load_extension(const char *soname, const char *config);
 
 int add_conn_to_pending_io_list(Connection *c);
+int add_conn_to_pending_io_list(Connection *c, ENGINE_ERROR_CODE status);
+void drain_pending_notifications(LIBEVENT_THREAD *me);
 
 /* connection state machine */
 bool conn_listening(ListenConnection *c);
@@ -180,6 +208,7 @@ void event_handler(evutil_socket_t fd, short which, void *arg);
 void listen_event_handler(evutil_socket_t, short, void *);
 
 void mcbp_collect_timings(const McbpConnection* c);
+void mcbp_collect_phase_timings(McbpConnection* c);
 
 void log_socket_error(EXTENSION_LOG_LEVEL severity,
                       const void* client_cookie,
@@ -208,8 +237,12 @@ const char* get_server_version(void);
  * Connection-related functions
  */
 
-/* Increments topkeys count for a key when called by a valid operation. */
-void update_topkeys(const DocKey& key, McbpConnection *c);
+/* Increments topkeys count for a key when called by a valid operation.
+ * bytes_read / bytes_written is the size of the value returned / stored
+ * by the operation. Returns true if the key is hot (accessed at least
+ * hot_key_threshold times in the bucket during the current second) */
+bool update_topkeys(const DocKey& key, McbpConnection *c,
+                    size_t bytes_read = 0, size_t bytes_written = 0);
 
 
 void notify_thread_bucket_deletion(LIBEVENT_THREAD *me);
@@ -274,6 +307,12 @@ void shutdown_server(void);
 bool associate_bucket(Connection *c, const char *name);
 void disassociate_bucket(Connection *c);
 
+/**
+ * Drop a reference to a bucket (counted in its clients) kept after the
+ * connection holding it left the bucket
+ */
+void release_bucket_client(int bucketIndex);
+
 bool is_listen_disabled(void);
 uint64_t get_listen_disabled_num(void);
 
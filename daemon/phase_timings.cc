@@ -0,0 +1,96 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "phase_timings.h"
+
+#include <stdexcept>
+
+const char* to_string(CommandPhase phase) {
+    switch (phase) {
+    case CommandPhase::Read:
+        return "read";
+    case CommandPhase::Parse:
+        return "parse";
+    case CommandPhase::Engine:
+        return "engine";
+    case CommandPhase::EWouldBlock:
+        return "ewouldblock";
+    case CommandPhase::Write:
+        return "write";
+    }
+    throw std::invalid_argument("to_string(CommandPhase): Invalid phase " +
+                                std::to_string(int(phase)));
+}
+
+PhaseTimings::ThreadTimings::ThreadTimings(uint8_t precision) {
+    for (auto& opcode : timings) {
+        for (auto& histogram : opcode) {
+            histogram = TimingHistogram(precision);
+        }
+    }
+}
+
+PhaseTimings::PhaseTimings() {
+    setNumThreads(1);
+}
+
+void PhaseTimings::setNumThreads(size_t num, uint8_t precision) {
+    PhaseTimings::precision = precision;
+    threads.clear();
+    for (size_t ii = 0; ii < num; ++ii) {
+        threads.emplace_back(new ThreadTimings(precision));
+    }
+}
+
+void PhaseTimings::collect(size_t thread,
+                           const uint8_t opcode,
+                           const CommandPhaseTracker& tracker) {
+    auto& timings = threads[thread]->timings[opcode];
+    for (size_t ii = 0; ii < NumCommandPhases; ++ii) {
+        if (tracker.hasEntered(CommandPhase(ii))) {
+            timings[ii].add(tracker.getDuration(CommandPhase(ii)));
+        }
+    }
+}
+
+TimingHistogram PhaseTimings::get(const uint8_t opcode,
+                                  CommandPhase phase) const {
+    TimingHistogram ret(precision);
+    for (const auto& thread : threads) {
+        ret += thread->timings[opcode][size_t(phase)];
+    }
+    return ret;
+}
+
+TimingHistogram PhaseTimings::get(CommandPhase phase) const {
+    TimingHistogram ret(precision);
+    for (const auto& thread : threads) {
+        for (const auto& opcode : thread->timings) {
+            ret += opcode[size_t(phase)];
+        }
+    }
+    return ret;
+}
+
+void PhaseTimings::reset() {
+    for (auto& thread : threads) {
+        for (auto& opcode : thread->timings) {
+            for (auto& histogram : opcode) {
+                histogram.reset();
+            }
+        }
+    }
+}
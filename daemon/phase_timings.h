@@ -0,0 +1,219 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/platform.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sampled_tracing.h"
+#include "timing_histogram.h"
+#include "timings.h"
+
+/**
+ * The phases a command goes through while it is being served
+ */
+enum class CommandPhase : uint8_t {
+    /// Reading the body of the packet after the header arrived
+    Read,
+    /// Privilege checks and packet validation
+    Parse,
+    /// Executing the command (calling the engine)
+    Engine,
+    /// Waiting for the engine to notify that a blocked command may continue
+    EWouldBlock,
+    /// Transmitting the response
+    Write
+};
+
+static const size_t NumCommandPhases = 5;
+
+/**
+ * Get a textual representation of the phase (as used in the stats)
+ */
+const char* to_string(CommandPhase phase);
+
+/**
+ * The CommandPhaseTracker keeps track of the time spent in each phase
+ * of a single command. It is owned by the cookie and driven by the
+ * state machine calling enter() every time the command moves to a new
+ * phase (which costs a single call to gethrtime()). It is a noop unless
+ * start() was called for the command.
+ *
+ * If the command is sampled for tracing, each phase the command goes
+ * through is also recorded as a span in the request trace.
+ */
+class CommandPhaseTracker {
+public:
+    /**
+     * Start tracking a new command (in the Read phase)
+     *
+     * @param now the time the command started
+     * @param timings should the durations be recorded in the phase timings
+     * @param requestTrace where to record the phases as spans (or nullptr
+     *                     if the command isn't traced)
+     */
+    void start(hrtime_t now, bool timings, RequestTrace* requestTrace) {
+        durations.fill(0);
+        entered = 1 << size_t(CommandPhase::Read);
+        current = CommandPhase::Read;
+        phaseStart = now;
+        collectTimings = timings;
+        trace = requestTrace;
+        active = true;
+    }
+
+    /**
+     * Move the command to the given phase. The time since the last
+     * transition is accounted to the phase the command was in.
+     */
+    void enter(CommandPhase phase) {
+        if (active && phase != current) {
+            const auto now = gethrtime();
+            account(now);
+            current = phase;
+            entered |= 1 << size_t(phase);
+            phaseStart = now;
+        }
+    }
+
+    /**
+     * Account the time spent in the current phase and stop tracking
+     */
+    void stop() {
+        if (active) {
+            account(gethrtime());
+            active = false;
+        }
+    }
+
+    /**
+     * Stop tracking without accounting the current phase
+     */
+    void reset() {
+        active = false;
+    }
+
+    bool isActive() const {
+        return active;
+    }
+
+    /**
+     * Should the durations be recorded in the phase timings?
+     */
+    bool isCollectingTimings() const {
+        return collectTimings;
+    }
+
+    /**
+     * Get the phase the command is currently in
+     */
+    CommandPhase getCurrentPhase() const {
+        return current;
+    }
+
+    /**
+     * Get the number of nanoseconds spent in the given phase
+     */
+    hrtime_t getDuration(CommandPhase phase) const {
+        return durations[size_t(phase)];
+    }
+
+    /**
+     * Did the command go through the given phase?
+     */
+    bool hasEntered(CommandPhase phase) const {
+        return (entered & (1 << size_t(phase))) != 0;
+    }
+
+private:
+    void account(hrtime_t now) {
+        durations[size_t(current)] += now - phaseStart;
+        if (trace != nullptr) {
+            trace->addSpan(to_string(current), phaseStart, now);
+        }
+    }
+
+    std::array<hrtime_t, NumCommandPhases> durations;
+    /// Bitmask of the phases the command went through
+    uint8_t entered = 0;
+    hrtime_t phaseStart = 0;
+    RequestTrace* trace = nullptr;
+    CommandPhase current = CommandPhase::Read;
+    bool collectTimings = false;
+    bool active = false;
+};
+
+/**
+ * PhaseTimings holds a histogram for each phase of each opcode. Like
+ * Timings each thread records into its own histograms, which are
+ * merged when the stats are requested.
+ */
+class PhaseTimings {
+public:
+    PhaseTimings();
+    PhaseTimings(const PhaseTimings&) = delete;
+
+    /**
+     * Set the number of threads which may collect timings and the
+     * precision of their histograms. This must be called before any
+     * samples are collected.
+     */
+    void setNumThreads(size_t num,
+                       uint8_t precision = TimingHistogram::DefaultPrecision);
+
+    /**
+     * Record the phase durations of a completed command. Only the phases
+     * the command went through are recorded.
+     *
+     * @param thread the index of the calling thread
+     * @param opcode the command the durations belong to
+     * @param tracker the tracker for the command (must be stopped)
+     */
+    void collect(size_t thread,
+                 const uint8_t opcode,
+                 const CommandPhaseTracker& tracker);
+
+    /**
+     * Get the histogram for the given phase of an opcode
+     */
+    TimingHistogram get(const uint8_t opcode, CommandPhase phase) const;
+
+    /**
+     * Get the histogram for the given phase aggregated over all opcodes
+     */
+    TimingHistogram get(CommandPhase phase) const;
+
+    void reset();
+
+private:
+    using OpcodeTimings = std::array<TimingHistogram, NumCommandPhases>;
+
+    struct ThreadTimings {
+        explicit ThreadTimings(uint8_t precision);
+
+        std::array<OpcodeTimings, MAX_NUM_OPCODES> timings;
+    };
+
+    std::vector<std::unique_ptr<ThreadTimings>> threads;
+
+    // The precision of the histograms
+    uint8_t precision = TimingHistogram::DefaultPrecision;
+};
@@ -0,0 +1,271 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "prometheus_exporter.h"
+
+#include "buckets.h"
+#include "mc_time.h"
+#include "memcached.h"
+#include "settings.h"
+#include "stats.h"
+#include "utilities/protocol2text.h"
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <platform/strerror.h>
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * The per-thread counters we export for each bucket
+ */
+static const struct {
+    const char* name;
+    const char* help;
+    Couchbase::RelaxedAtomic<uint64_t> thread_stats::*member;
+} counters[] = {
+        {"memcached_cmd_get", "GET commands", &thread_stats::cmd_get},
+        {"memcached_get_hits", "GET commands which found the document",
+         &thread_stats::get_hits},
+        {"memcached_get_misses", "GET commands which didn't find the document",
+         &thread_stats::get_misses},
+        {"memcached_cmd_set", "Mutation commands", &thread_stats::cmd_set},
+        {"memcached_delete_hits", "Successful DELETE commands",
+         &thread_stats::delete_hits},
+        {"memcached_delete_misses", "DELETE commands of missing documents",
+         &thread_stats::delete_misses},
+        {"memcached_incr_hits", "Successful INCREMENT commands",
+         &thread_stats::incr_hits},
+        {"memcached_incr_misses", "INCREMENT commands of missing documents",
+         &thread_stats::incr_misses},
+        {"memcached_decr_hits", "Successful DECREMENT commands",
+         &thread_stats::decr_hits},
+        {"memcached_decr_misses", "DECREMENT commands of missing documents",
+         &thread_stats::decr_misses},
+        {"memcached_cas_hits", "Successful CAS mutations",
+         &thread_stats::cas_hits},
+        {"memcached_cas_misses", "CAS mutations of missing documents",
+         &thread_stats::cas_misses},
+        {"memcached_cas_badval", "CAS mutations with a stale CAS",
+         &thread_stats::cas_badval},
+        {"memcached_cmd_flush", "FLUSH commands", &thread_stats::cmd_flush},
+        {"memcached_cmd_lock", "GET_LOCKED commands", &thread_stats::cmd_lock},
+        {"memcached_lock_errors", "Commands failing on a locked document",
+         &thread_stats::lock_errors},
+        {"memcached_cmd_subdoc_lookup", "Sub-document lookup commands",
+         &thread_stats::cmd_subdoc_lookup},
+        {"memcached_cmd_subdoc_mutation", "Sub-document mutation commands",
+         &thread_stats::cmd_subdoc_mutation},
+        {"memcached_subdoc_cas_conflicts",
+         "Sub-document mutations which lost a race storing the document",
+         &thread_stats::subdoc_cas_conflicts},
+        {"memcached_subdoc_retries",
+         "Sub-document mutations executed again after a CAS conflict",
+         &thread_stats::subdoc_retries},
+        {"memcached_subdoc_engine_updates",
+         "Sub-document mutations stored through the engine's update call",
+         &thread_stats::subdoc_engine_updates},
+        {"memcached_auth_cmds", "Authentication commands",
+         &thread_stats::auth_cmds},
+        {"memcached_auth_errors", "Failed authentication commands",
+         &thread_stats::auth_errors},
+        {"memcached_read_bytes", "Bytes received from clients",
+         &thread_stats::bytes_read},
+        {"memcached_written_bytes", "Bytes sent to clients",
+         &thread_stats::bytes_written},
+        {"memcached_conn_yields", "Times a connection yielded the thread",
+         &thread_stats::conn_yields},
+        {"memcached_hot_key_hints", "GET responses with a hot key hint",
+         &thread_stats::hot_key_hints}};
+
+/**
+ * A copy of the statistics for a bucket taken while holding the bucket
+ * lock, so that we don't hold it while formatting the metrics
+ */
+struct BucketSnapshot {
+    struct OpcodeTimings {
+        uint8_t opcode;
+        uint64_t duration;
+        TimingHistogram histogram;
+    };
+
+    std::string name;
+    thread_stats stats;
+    std::vector<OpcodeTimings> timings;
+};
+
+PrometheusExporter::PrometheusExporter(in_port_t port) {
+    base = event_base_new();
+    if (base == nullptr) {
+        throw std::runtime_error(
+                "PrometheusExporter: Failed to create event base");
+    }
+    http = evhttp_new(base);
+    if (http == nullptr) {
+        event_base_free(base);
+        throw std::runtime_error(
+                "PrometheusExporter: Failed to create http server");
+    }
+    evhttp_set_allowed_methods(http, EVHTTP_REQ_GET);
+    evhttp_set_cb(http, "/metrics", handle_metrics, this);
+
+    if (evhttp_bind_socket(http, "127.0.0.1", port) != 0) {
+        const auto error = cb_strerror();
+        evhttp_free(http);
+        event_base_free(base);
+        throw std::runtime_error("PrometheusExporter: Failed to listen to "
+                                 "127.0.0.1:" + std::to_string(port) +
+                                 ": " + error);
+    }
+
+    if (cb_create_named_thread(&thread, PrometheusExporter::thread_main,
+                               this, 0, "mc:prometheus") != 0) {
+        const auto error = cb_strerror();
+        evhttp_free(http);
+        event_base_free(base);
+        throw std::runtime_error(
+                "PrometheusExporter: Failed to create thread: " + error);
+    }
+}
+
+PrometheusExporter::~PrometheusExporter() {
+    event_base_loopexit(base, nullptr);
+    cb_join_thread(thread);
+    evhttp_free(http);
+    event_base_free(base);
+}
+
+void PrometheusExporter::thread_main(void* arg) {
+    auto* exporter = reinterpret_cast<PrometheusExporter*>(arg);
+    event_base_loop(exporter->base, 0);
+}
+
+void PrometheusExporter::handle_metrics(evhttp_request* request, void* arg) {
+    auto* exporter = reinterpret_cast<PrometheusExporter*>(arg);
+    const auto& metrics = exporter->generate();
+
+    evhttp_add_header(evhttp_request_get_output_headers(request),
+                      "Content-Type", PrometheusWriter::ContentType);
+    evbuffer_add(evhttp_request_get_output_buffer(request),
+                 metrics.data(), metrics.size());
+    evhttp_send_reply(request, HTTP_OK, "OK", nullptr);
+}
+
+const std::string& PrometheusExporter::generate() {
+    writer.reset();
+    addServerMetrics();
+    addBucketMetrics();
+    return writer.finish();
+}
+
+void PrometheusExporter::addServerMetrics() {
+    writer.addFamily("memcached_uptime_seconds", "gauge",
+                     "Seconds since the server started");
+    writer.addSample("memcached_uptime_seconds", {},
+                     mc_time_get_current_time());
+
+    writer.addFamily("memcached_curr_connections", "gauge",
+                     "Connections currently open");
+    writer.addSample("memcached_curr_connections", {},
+                     stats.curr_conns.load(std::memory_order_relaxed));
+
+    writer.addFamily("memcached_daemon_connections", "gauge",
+                     "Connections used by the server itself");
+    writer.addSample("memcached_daemon_connections", {}, stats.daemon_conns);
+
+    writer.addFamily("memcached_connections", "counter",
+                     "Connections accepted");
+    writer.addSample("memcached_connections_total", {}, stats.total_conns);
+
+    writer.addFamily("memcached_rejected_connections", "counter",
+                     "Connections rejected");
+    writer.addSample("memcached_rejected_connections_total", {},
+                     stats.rejected_conns);
+
+    writer.addFamily("memcached_listen_disabled", "counter",
+                     "Times we stopped accepting clients (too many "
+                     "connections)");
+    writer.addSample("memcached_listen_disabled_total", {},
+                     get_listen_disabled_num());
+
+    writer.addFamily("memcached_threads", "gauge", "Worker threads");
+    writer.addSample("memcached_threads", {}, settings.getNumWorkerThreads());
+}
+
+void PrometheusExporter::addBucketMetrics() {
+    std::vector<std::unique_ptr<BucketSnapshot>> buckets;
+
+    bucketsForEach([](Bucket& bucket, void* arg) -> bool {
+        if (bucket.type == BucketType::NoBucket) {
+            // Only used for connections which didn't select a bucket (and
+            // its timings are the aggregate of all of the buckets)
+            return true;
+        }
+
+        auto& snapshots =
+                *reinterpret_cast<std::vector<std::unique_ptr<BucketSnapshot>>*>(
+                        arg);
+        std::unique_ptr<BucketSnapshot> snapshot(new BucketSnapshot);
+        snapshot->name = bucket.name;
+        snapshot->stats.aggregate(bucket.stats,
+                                  settings.getNumWorkerThreads() + 1);
+        for (int opcode = 0; opcode < MAX_NUM_OPCODES; ++opcode) {
+            if (bucket.timings.get_total(uint8_t(opcode)) != 0) {
+                snapshot->timings.push_back(
+                        {uint8_t(opcode),
+                         bucket.timings.get_duration(uint8_t(opcode)),
+                         bucket.timings.get_histogram(uint8_t(opcode))});
+            }
+        }
+        snapshots.emplace_back(std::move(snapshot));
+        return true;
+    }, &buckets);
+
+    std::string name;
+    for (const auto& counter : counters) {
+        writer.addFamily(counter.name, "counter", counter.help);
+        name.assign(counter.name);
+        name.append("_total");
+        for (const auto& bucket : buckets) {
+            writer.addSample(name.c_str(),
+                             {{"bucket", bucket->name.c_str()}},
+                             bucket->stats.*counter.member);
+        }
+    }
+
+    writer.addFamily("memcached_cmd_duration_seconds", "histogram",
+                     "Command execution time");
+    for (const auto& bucket : buckets) {
+        for (const auto& timings : bucket->timings) {
+            const char* opcode = memcached_opcode_2_text(timings.opcode);
+            char unknown[8];
+            if (opcode == nullptr) {
+                snprintf(unknown, sizeof(unknown), "0x%02x", timings.opcode);
+                opcode = unknown;
+            }
+            writer.addHistogram("memcached_cmd_duration_seconds",
+                                {{"bucket", bucket->name.c_str()},
+                                 {"opcode", opcode}},
+                                timings.histogram,
+                                timings.duration);
+        }
+    }
+}
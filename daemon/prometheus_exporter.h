@@ -0,0 +1,74 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "config.h"
+#include "prometheus_writer.h"
+
+#include <platform/platform.h>
+
+struct event_base;
+struct evhttp;
+struct evhttp_request;
+
+/**
+ * The PrometheusExporter serves the server and bucket statistics in the
+ * OpenMetrics text format over HTTP ("GET /metrics") so that they may be
+ * scraped by Prometheus (or anything else understanding the format).
+ *
+ * It runs its own event loop on a background thread and only listens on
+ * the loopback interface, so scraping it doesn't compete with the
+ * clients for the worker threads (and it doesn't need to authenticate
+ * the scraper). The metrics are generated straight from the counters
+ * and histograms rather than going through the ADD_STAT callbacks.
+ */
+class PrometheusExporter {
+public:
+    /**
+     * Create the exporter and start serving metrics
+     *
+     * @param port the port to listen to on the loopback interface
+     * @throws std::runtime_error if we failed to set up the listener
+     */
+    explicit PrometheusExporter(in_port_t port);
+
+    PrometheusExporter(const PrometheusExporter&) = delete;
+
+    /* Stop serving metrics and shut down the background thread */
+    ~PrometheusExporter();
+
+    /**
+     * Generate the metrics for the server and all of the buckets. Only
+     * one thread may generate the metrics at the time.
+     */
+    const std::string& generate();
+
+protected:
+    /* Main function for the background thread. */
+    static void thread_main(void* arg);
+
+    /* Callback from libevent when a client requests the metrics */
+    static void handle_metrics(evhttp_request* request, void* arg);
+
+    void addServerMetrics();
+    void addBucketMetrics();
+
+    cb_thread_t thread;
+    event_base* base;
+    evhttp* http;
+    PrometheusWriter writer;
+};
@@ -0,0 +1,191 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "prometheus_writer.h"
+#include "timing_histogram.h"
+
+#include <array>
+
+const char* PrometheusWriter::ContentType =
+        "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+/**
+ * The upper bounds of the histogram buckets, in usec and as the text
+ * for the "le" label (in seconds)
+ */
+static const std::array<std::pair<uint64_t, const char*>, 17> bounds = {{
+        {50, "0.00005"},
+        {100, "0.0001"},
+        {250, "0.00025"},
+        {500, "0.0005"},
+        {1000, "0.001"},
+        {2500, "0.0025"},
+        {5000, "0.005"},
+        {10000, "0.01"},
+        {25000, "0.025"},
+        {50000, "0.05"},
+        {100000, "0.1"},
+        {250000, "0.25"},
+        {500000, "0.5"},
+        {1000000, "1.0"},
+        {2500000, "2.5"},
+        {5000000, "5.0"},
+        {10000000, "10.0"}}};
+
+void PrometheusWriter::addFamily(const char* name,
+                                 const char* type,
+                                 const char* help) {
+    buffer.append("# TYPE ");
+    buffer.append(name);
+    buffer.push_back(' ');
+    buffer.append(type);
+    buffer.append("\n# HELP ");
+    buffer.append(name);
+    buffer.push_back(' ');
+    buffer.append(help);
+    buffer.push_back('\n');
+}
+
+void PrometheusWriter::addSample(const char* name,
+                                 Labels labels,
+                                 uint64_t value) {
+    buffer.append(name);
+    appendLabels(labels);
+    buffer.push_back(' ');
+    appendNumber(value);
+    buffer.push_back('\n');
+}
+
+void PrometheusWriter::addHistogram(const char* name,
+                                    Labels labels,
+                                    const TimingHistogram& histogram,
+                                    uint64_t sum_ns) {
+    std::array<uint64_t, bounds.size() + 1> counts{};
+
+    const auto nbins = histogram.getNumBins();
+    uint64_t total = 0;
+    size_t idx = 0;
+    for (size_t bin = 0; bin < nbins; ++bin) {
+        const auto count = histogram.getBinCount(bin);
+        if (count == 0) {
+            continue;
+        }
+        const auto upper = histogram.getBinUpperBound(bin);
+        // The bins are sorted so we never need to look at a lower bucket
+        while (idx < bounds.size() && bounds[idx].first < upper) {
+            ++idx;
+        }
+        counts[idx] += count;
+        total += count;
+    }
+
+    // Bucket counts are cumulative
+    uint64_t cumulative = 0;
+    for (size_t ii = 0; ii < counts.size(); ++ii) {
+        cumulative += counts[ii];
+        buffer.append(name);
+        buffer.append("_bucket");
+        appendLabels(labels, ii < bounds.size() ? bounds[ii].second : "+Inf");
+        buffer.push_back(' ');
+        appendNumber(cumulative);
+        buffer.push_back('\n');
+    }
+
+    buffer.append(name);
+    buffer.append("_count");
+    appendLabels(labels);
+    buffer.push_back(' ');
+    appendNumber(total);
+    buffer.push_back('\n');
+
+    // The sum is in seconds, format it with a fixed number of decimals
+    // rather than going through floating point
+    buffer.append(name);
+    buffer.append("_sum");
+    appendLabels(labels);
+    buffer.push_back(' ');
+    appendNumber(sum_ns / 1000000000);
+    buffer.push_back('.');
+    char decimals[9];
+    uint64_t fraction = sum_ns % 1000000000;
+    for (int ii = 8; ii >= 0; --ii) {
+        decimals[ii] = char('0' + fraction % 10);
+        fraction /= 10;
+    }
+    buffer.append(decimals, sizeof(decimals));
+    buffer.push_back('\n');
+}
+
+const std::string& PrometheusWriter::finish() {
+    buffer.append("# EOF\n");
+    return buffer;
+}
+
+void PrometheusWriter::appendNumber(uint64_t value) {
+    char digits[20];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    buffer.append(digits + pos, sizeof(digits) - pos);
+}
+
+void PrometheusWriter::appendLabels(Labels labels, const char* le) {
+    if (labels.size() == 0 && le == nullptr) {
+        return;
+    }
+
+    buffer.push_back('{');
+    bool first = true;
+    for (const auto& label : labels) {
+        if (!first) {
+            buffer.push_back(',');
+        }
+        first = false;
+        buffer.append(label.first);
+        buffer.append("=\"");
+        appendLabelValue(label.second);
+        buffer.push_back('"');
+    }
+    if (le != nullptr) {
+        if (!first) {
+            buffer.push_back(',');
+        }
+        buffer.append("le=\"");
+        buffer.append(le);
+        buffer.push_back('"');
+    }
+    buffer.push_back('}');
+}
+
+void PrometheusWriter::appendLabelValue(const char* value) {
+    for (const char* ptr = value; *ptr != '\0'; ++ptr) {
+        switch (*ptr) {
+        case '\\':
+            buffer.append("\\\\");
+            break;
+        case '"':
+            buffer.append("\\\"");
+            break;
+        case '\n':
+            buffer.append("\\n");
+            break;
+        default:
+            buffer.push_back(*ptr);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+
+class TimingHistogram;
+
+/**
+ * The PrometheusWriter formats metrics in the OpenMetrics text format
+ * (which Prometheus also accepts). The values are formatted straight
+ * into a single buffer which keeps its capacity between scrapes, so
+ * generating the metrics doesn't allocate memory once it has grown to
+ * its working size.
+ *
+ * All of the samples of a metric family must be added right after the
+ * family itself:
+ *
+ *     writer.addFamily("memcached_cmd_get", "counter", "GET commands");
+ *     writer.addSample("memcached_cmd_get_total", {{"bucket", "a"}}, 10);
+ *     writer.addSample("memcached_cmd_get_total", {{"bucket", "b"}}, 5);
+ */
+class PrometheusWriter {
+public:
+    /// The content type of the generated text
+    static const char* ContentType;
+
+    /// A label is a name and a value (which is escaped as needed)
+    using Labels = std::initializer_list<std::pair<const char*, const char*>>;
+
+    /**
+     * Drop all of the metrics (but keep the memory allocated)
+     */
+    void reset() {
+        buffer.clear();
+    }
+
+    /**
+     * Add the metadata for a metric family
+     *
+     * @param name the name of the family
+     * @param type the type of the family ("counter", "gauge", "histogram")
+     * @param help the description of the family
+     */
+    void addFamily(const char* name, const char* type, const char* help);
+
+    /**
+     * Add a sample to the current family
+     *
+     * @param name the name of the sample (for counters the family name
+     *             followed by "_total")
+     * @param labels the labels for the sample
+     * @param value the value of the sample
+     */
+    void addSample(const char* name, Labels labels, uint64_t value);
+
+    /**
+     * Add a histogram (in seconds) to the current family. The samples
+     * in the timing histogram are distributed into the fixed set of
+     * buckets the exporter uses (which allows the histograms to be
+     * aggregated across buckets and nodes). A bin of the timing histogram
+     * is counted in the first bucket covering its upper bound, so the
+     * buckets are accurate to within the precision of the histogram.
+     *
+     * @param name the name of the family
+     * @param labels the labels for the histogram (excluding "le")
+     * @param histogram the samples (in usec)
+     * @param sum_ns the sum of the samples (in nsec)
+     */
+    void addHistogram(const char* name,
+                      Labels labels,
+                      const TimingHistogram& histogram,
+                      uint64_t sum_ns);
+
+    /**
+     * Terminate the exposition and return the complete text
+     */
+    const std::string& finish();
+
+protected:
+    void appendNumber(uint64_t value);
+    void appendLabels(Labels labels, const char* le = nullptr);
+    void appendLabelValue(const char* value);
+
+    std::string buffer;
+};
@@ -18,9 +18,18 @@
 #include <utilities/protocol2text.h>
 #include <daemon/mcaudit.h>
 
+/**
+ * Get the trace to record the engine calls in (if the current command
+ * was selected for sampled tracing)
+ */
+static RequestTrace& getTrace(McbpConnection& c) {
+    return c.getCookieObject().getRequestTrace();
+}
+
 ENGINE_ERROR_CODE bucket_unknown_command(McbpConnection* c,
                                          protocol_binary_request_header* request,
                                          ADD_RESPONSE response) {
+    TraceSpanScope span(getTrace(*c), "bucket_unknown_command");
     auto ret = c->getBucketEngine()->unknown_command(c->getBucketEngineAsV0(),
                                                      c->getCookie(),
                                                      request,
@@ -93,6 +102,7 @@ ENGINE_ERROR_CODE bucket_store(McbpConnection* c,
                                uint64_t* cas,
                                ENGINE_STORE_OPERATION operation,
                                DocumentState document_state) {
+    TraceSpanScope span(getTrace(*c), "bucket_store");
     auto ret = c->getBucketEngine()->store(c->getBucketEngineAsV0(),
                                            c->getCookie(),
                                            item_,
@@ -118,6 +128,7 @@ ENGINE_ERROR_CODE bucket_remove(McbpConnection* c,
                                 uint64_t* cas,
                                 uint16_t vbucket,
                                 mutation_descr_t* mut_info) {
+    TraceSpanScope span(getTrace(*c), "bucket_remove");
     auto ret = c->getBucketEngine()->remove(c->getBucketEngineAsV0(),
                                             c->getCookie(),
                                             key,
@@ -135,11 +146,39 @@ ENGINE_ERROR_CODE bucket_remove(McbpConnection* c,
     return ret;
 }
 
+ENGINE_ERROR_CODE bucket_update(McbpConnection* c,
+                                const DocKey& key,
+                                uint16_t vbucket,
+                                DocStateFilter documentStateFilter,
+                                engine_update_cb callback,
+                                uint64_t* cas,
+                                mutation_descr_t* mut_info) {
+    TraceSpanScope span(getTrace(*c), "bucket_update");
+    auto ret = c->getBucketEngine()->update(c->getBucketEngineAsV0(),
+                                            c->getCookie(),
+                                            key,
+                                            vbucket,
+                                            documentStateFilter,
+                                            callback,
+                                            cas,
+                                            mut_info);
+    if (ret == ENGINE_SUCCESS) {
+        cb::audit::document::add(*c, cb::audit::document::Operation::Modify);
+    } else if (ret == ENGINE_DISCONNECT) {
+        LOG_INFO(c,
+                 "%u: %s bucket_update return ENGINE_DISCONNECT",
+                 c->getId(),
+                 c->getDescription().c_str());
+    }
+    return ret;
+}
+
 ENGINE_ERROR_CODE bucket_get(McbpConnection* c,
                              item** item_,
                              const DocKey& key,
                              uint16_t vbucket,
                              DocStateFilter documentStateFilter) {
+    TraceSpanScope span(getTrace(*c), "bucket_get");
     auto ret = c->getBucketEngine()->get(c->getBucketEngineAsV0(),
                                          c->getCookie(),
                                          item_,
@@ -160,6 +199,7 @@ cb::EngineErrorItemPair bucket_get_if(McbpConnection* c,
                                       uint16_t vbucket,
                                       std::function<bool(
                                           const item_info&)> filter) {
+    TraceSpanScope span(getTrace(*c), "bucket_get_if");
     auto ret = c->getBucketEngine()->get_if(
             c->getBucketEngineAsV0(), c->getCookie(), key, vbucket, filter);
 
@@ -176,6 +216,7 @@ cb::EngineErrorItemPair bucket_get_and_touch(McbpConnection* c,
                                              const DocKey& key,
                                              uint16_t vbucket,
                                              uint32_t expiration) {
+    TraceSpanScope span(getTrace(*c), "bucket_get_and_touch");
     auto ret = c->getBucketEngine()->get_and_touch(
         c->getBucketEngineAsV0(), c->getCookie(), key, vbucket, expiration);
 
@@ -193,6 +234,7 @@ ENGINE_ERROR_CODE bucket_get_locked(McbpConnection& c,
                                     const DocKey& key,
                                     uint16_t vbucket,
                                     uint32_t lock_timeout) {
+    TraceSpanScope span(getTrace(c), "bucket_get_locked");
     auto ret = c.getBucketEngine()->get_locked(c.getBucketEngineAsV0(),
                                                c.getCookie(),
                                                item_,
@@ -215,6 +257,7 @@ ENGINE_ERROR_CODE bucket_unlock(McbpConnection& c,
                                 const DocKey& key,
                                 uint16_t vbucket,
                                 uint64_t cas) {
+    TraceSpanScope span(getTrace(c), "bucket_unlock");
     auto ret = c.getBucketEngine()->unlock(
             c.getBucketEngineAsV0(), c.getCookie(), key, vbucket, cas);
     if (ret == ENGINE_DISCONNECT) {
@@ -239,6 +282,7 @@ ENGINE_ERROR_CODE bucket_allocate(McbpConnection* c,
                                   const rel_time_t exptime,
                                   uint8_t datatype,
                                   uint16_t vbucket) {
+    TraceSpanScope span(getTrace(*c), "bucket_allocate");
     auto ret = c->getBucketEngine()->allocate(c->getBucketEngineAsV0(),
                                               c->getCookie(),
                                               it,
@@ -265,6 +309,7 @@ std::pair<cb::unique_item_ptr, item_info> bucket_allocate_ex(McbpConnection& c,
                                                              const rel_time_t exptime,
                                                              uint8_t datatype,
                                                              uint16_t vbucket) {
+    TraceSpanScope span(getTrace(c), "bucket_allocate_ex");
     try {
         return c.getBucketEngine()->allocate_ex(c.getBucketEngineAsV0(),
                                                 c.getCookie(),
@@ -62,6 +62,14 @@ ENGINE_ERROR_CODE bucket_remove(McbpConnection* c,
                                 uint16_t vbucket,
                                 mutation_descr_t* mut_info);
 
+ENGINE_ERROR_CODE bucket_update(McbpConnection* c,
+                                const DocKey& key,
+                                uint16_t vbucket,
+                                DocStateFilter documentStateFilter,
+                                engine_update_cb callback,
+                                uint64_t* cas,
+                                mutation_descr_t* mut_info);
+
 ENGINE_ERROR_CODE bucket_get(
         McbpConnection* c,
         item** item_,
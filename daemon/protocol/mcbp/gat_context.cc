@@ -90,7 +90,7 @@ ENGINE_ERROR_CODE GatCommandContext::inflateItem() {
 
 ENGINE_ERROR_CODE GatCommandContext::sendResponse() {
     STATS_HIT(&connection, get);
-    update_topkeys(key, &connection);
+    update_topkeys(key, &connection, payload.len);
 
     // Audit the modification to the document (change of EXP)
     cb::audit::document::add(connection,
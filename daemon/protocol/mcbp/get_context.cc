@@ -87,10 +87,20 @@ ENGINE_ERROR_CODE GetCommandContext::sendResponse() {
 
     datatype = connection.getEnabledDatatypes(datatype);
 
-    auto* rsp = reinterpret_cast<protocol_binary_response_get*>(connection.write.buf);
+    // Tell the client it may cache the document if the key is hot (and
+    // the client asked for it)
+    const bool hot = update_topkeys(key, &connection, payload.len) &&
+                     connection.isHotKeyHintsSupported();
+
+    auto* rsp = reinterpret_cast<protocol_binary_response_get_hot_key*>(
+            connection.write.buf);
+    const uint8_t extlen =
+            hot ? sizeof(rsp->message.body)
+                : sizeof(protocol_binary_response_get) -
+                          sizeof(protocol_binary_response_header);
 
     uint16_t keylen = 0;
-    uint32_t bodylen = sizeof(rsp->message.body) + payload.len;
+    uint32_t bodylen = extlen + payload.len;
 
     if (shouldSendKey()) {
         keylen = uint16_t(key.size());
@@ -99,24 +109,37 @@ ENGINE_ERROR_CODE GetCommandContext::sendResponse() {
 
     mcbp_add_header(&connection,
                     PROTOCOL_BINARY_RESPONSE_SUCCESS,
-                    sizeof(rsp->message.body),
+                    extlen,
                     keylen, bodylen, datatype);
 
     rsp->message.header.response.cas = htonll(info.cas);
     /* add the flags */
     rsp->message.body.flags = info.flags;
-    connection.addIov(&rsp->message.body, sizeof(rsp->message.body));
+    if (hot) {
+        rsp->message.body.cache_ttl =
+                htonl(uint32_t(settings.getHotKeyTtlMs()));
+        get_thread_stats(&connection)->hot_key_hints++;
+    }
+    connection.addIov(&rsp->message.body, extlen);
 
     if (shouldSendKey()) {
         connection.addIov(info.key, info.nkey);
     }
 
-    connection.addIov(payload.buf, payload.len);
+    if (!buffer.data &&
+        connection.isZerocopyCandidate(payload.len) &&
+        connection.reserveItem(it)) {
+        // The connection holds the reference to the item until the
+        // kernel is done sending it
+        it = nullptr;
+        connection.addZerocopyIov(payload.buf, payload.len);
+    } else {
+        connection.addIov(payload.buf, payload.len);
+    }
     connection.setState(conn_mwrite);
     cb::audit::document::add(connection, cb::audit::document::Operation::Read);
 
     STATS_HIT(&connection, get);
-    update_topkeys(key, &connection);
 
     state = State::Done;
     return ENGINE_SUCCESS;
@@ -99,7 +99,7 @@ ENGINE_ERROR_CODE GetLockedCommandContext::sendResponse() {
     connection.setState(conn_mwrite);
 
     STATS_INCR(&connection, cmd_lock);
-    update_topkeys(key, &connection);
+    update_topkeys(key, &connection, payload.len);
 
     state = State::Done;
     return ENGINE_SUCCESS;
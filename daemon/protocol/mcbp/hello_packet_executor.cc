@@ -43,6 +43,8 @@ void process_hello_packet_executor(McbpConnection* c, void* packet) {
     c->setSupportsMutationExtras(false);
     c->setXerrorSupport(false);
     c->setCollectionsSupported(false);
+    c->setHotKeyHintsSupported(false);
+    c->setTypedStatsSupported(false);
 
     if (!key.empty()) {
         log_buffer.append("[");
@@ -117,6 +119,18 @@ void process_hello_packet_executor(McbpConnection* c, void* packet) {
                 added = true;
             }
             break;
+        case mcbp::Feature::HOT_KEY_HINTS:
+            if (!c->isHotKeyHintsSupported()) {
+                c->setHotKeyHintsSupported(true);
+                added = true;
+            }
+            break;
+        case mcbp::Feature::TYPED_STATS:
+            if (!c->isTypedStatsSupported()) {
+                c->setTypedStatsSupported(true);
+                added = true;
+            }
+            break;
         }
 
         if (added) {
@@ -41,8 +41,26 @@ MutationCommandContext::MutationCommandContext(McbpConnection& c,
       datatype(req->message.header.request.datatype),
       state(State::ValidateInput),
       newitem(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
+      preallocated(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
+      preallocatedUsed(false),
       existing(nullptr, cb::ItemDeleter{c.getBucketEngineAsV0()}),
       xattr_size(0) {
+    if (c.getItem() != nullptr) {
+        // The value was read directly into an item allocated by the
+        // core while reading the packet. Take over the ownership of the
+        // item and use its memory as the source of the value.
+        preallocated.reset(reinterpret_cast<item*>(c.getItem()));
+        c.setItem(nullptr);
+
+        item_info info;
+        if (bucket_get_item_info(&c, preallocated.get(), &info)) {
+            value = cb::const_char_buffer{
+                    static_cast<const char*>(info.value[0].iov_base),
+                    info.value[0].iov_len};
+        } else {
+            value = cb::const_char_buffer{};
+        }
+    }
 }
 
 ENGINE_ERROR_CODE MutationCommandContext::step() {
@@ -101,6 +119,10 @@ ENGINE_ERROR_CODE MutationCommandContext::validateInput() {
         return ENGINE_EINVAL;
     }
 
+    if (preallocated && value.buf == nullptr) {
+        return ENGINE_FAILED;
+    }
+
     if (!connection.isJsonEnabled()) {
         auto* validator = connection.getThread()->validator;
         try {
@@ -171,6 +193,10 @@ ENGINE_ERROR_CODE MutationCommandContext::getExistingItemToPreserveXattr() {
 }
 
 ENGINE_ERROR_CODE MutationCommandContext::allocateNewItem() {
+    if (preallocated && !preallocatedUsed && xattr_size == 0) {
+        return usePreallocatedItem();
+    }
+
     item* it = nullptr;
     auto dtype = datatype;
     if (xattr_size > 0) {
@@ -215,6 +241,35 @@ ENGINE_ERROR_CODE MutationCommandContext::allocateNewItem() {
     return ENGINE_SUCCESS;
 }
 
+ENGINE_ERROR_CODE MutationCommandContext::usePreallocatedItem() {
+    // The value is already in place, we just need to update the
+    // datatype (we might have detected JSON) and the CAS
+    item_info info;
+    if (!bucket_get_item_info(&connection, preallocated.get(), &info)) {
+        return ENGINE_FAILED;
+    }
+
+    if (info.datatype != datatype) {
+        info.datatype = datatype;
+        if (!bucket_set_item_info(&connection, preallocated.get(), &info)) {
+            return ENGINE_FAILED;
+        }
+    }
+
+    if (operation == OPERATION_ADD || input_cas != 0 || !existing) {
+        bucket_item_set_cas(&connection, preallocated.get(), input_cas);
+    } else {
+        bucket_item_set_cas(&connection, preallocated.get(), existing_info.cas);
+    }
+
+    // The value buffer still refers to the memory of the item, so it is
+    // kept alive by newitem from now on
+    newitem = std::move(preallocated);
+    preallocatedUsed = true;
+    state = State::StoreItem;
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE MutationCommandContext::storeItem() {
     uint64_t new_cas = input_cas;
     auto ret = bucket_store(&connection, newitem.get(), &new_cas, operation);
@@ -239,7 +294,7 @@ ENGINE_ERROR_CODE MutationCommandContext::storeItem() {
 }
 
 ENGINE_ERROR_CODE MutationCommandContext::sendResponse() {
-    update_topkeys(key, &connection);
+    update_topkeys(key, &connection, 0, value.len);
     state = State::Done;
 
     if (connection.isNoReply()) {
@@ -279,6 +334,11 @@ ENGINE_ERROR_CODE MutationCommandContext::sendResponse() {
 }
 
 ENGINE_ERROR_CODE MutationCommandContext::reset() {
+    if (preallocatedUsed && !preallocated) {
+        // The value lives in the item we tried to store. Keep it around
+        // and copy the value out of it for the retry.
+        preallocated = std::move(newitem);
+    }
     newitem.reset();
     existing.reset();
     xattr_size = 0;
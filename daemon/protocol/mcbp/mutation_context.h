@@ -79,6 +79,14 @@ protected:
      */
     ENGINE_ERROR_CODE allocateNewItem();
 
+    /**
+     * Use the item the core allocated (and read the value into) while
+     * reading the packet as the new document.
+     *
+     * @return ENGINE_SUCCESS if we want to proceed to the next state
+     */
+    ENGINE_ERROR_CODE usePreallocatedItem();
+
     /**
      * Store the newly created document in the engine
      *
@@ -105,7 +113,10 @@ protected:
 private:
     const ENGINE_STORE_OPERATION operation;
     const DocKey key;
-    const cb::const_char_buffer value;
+
+    // The value provided by the client. It either lives in the input
+    // buffer or in the memory of the preallocated item.
+    cb::const_char_buffer value;
     const uint16_t vbucket;
     const uint64_t input_cas;
     const rel_time_t expiration;
@@ -121,6 +132,14 @@ private:
     // The newly created document
     cb::unique_item_ptr newitem;
 
+    // The item the daemon allocated and received the value directly
+    // into while reading the packet off the network (if any)
+    cb::unique_item_ptr preallocated;
+
+    // Set to true once the preallocated item has been passed on to the
+    // engine to be stored (it won't be reused for a retry).
+    bool preallocatedUsed;
+
     // Pointer to the current value stored in the engine
     cb::unique_item_ptr existing;
 
@@ -22,15 +22,103 @@
 
 #include <daemon/connections.h>
 #include <daemon/debug_helpers.h>
+#include <daemon/executorpool.h>
 #include <daemon/mc_time.h>
 #include <daemon/mcbp.h>
 #include <daemon/runtime.h>
+#include <mcbp/protocol/typed_stats.h>
 #include <memcached/audit_interface.h>
 #include <platform/checked_snprintf.h>
 #include <utilities/protocol2text.h>
 
 #include <numeric>
 
+static void append_stats(const char* key, const uint16_t klen,
+                         const char* val, const uint32_t vlen,
+                         const void* void_cookie);
+
+/**
+ * Get the connection to add the stats to as typed values, or nullptr if
+ * they should be formatted as strings and passed to the ADD_STAT callback
+ */
+static McbpConnection* get_typed_stats_connection(const void* cookie,
+                                                  ADD_STAT add_stat_callback) {
+    if (add_stat_callback != append_stats) {
+        return nullptr;
+    }
+    auto* connection = reinterpret_cast<const Cookie*>(cookie)->connection;
+    if (connection == nullptr || !connection->isTypedStatsSupported()) {
+        return nullptr;
+    }
+    return dynamic_cast<McbpConnection*>(connection);
+}
+
+/**
+ * Make room for an entry of the given size in the typed stats response
+ * (and for the response header if this is the first entry)
+ */
+static bool grow_typed_stats(McbpConnection* c, size_t needed) {
+    auto& dbuf = c->getDynamicBuffer();
+    const bool first = dbuf.getOffset() == 0;
+    if (first) {
+        needed += sizeof(protocol_binary_response_header);
+    }
+    if (!c->growDynamicBuffer(needed)) {
+        return false;
+    }
+    if (first) {
+        // The header is filled in by finish_typed_stats()
+        dbuf.moveOffset(sizeof(protocol_binary_response_header));
+    }
+    return true;
+}
+
+static void add_typed_stat(McbpConnection* c, const char* name, uint64_t val) {
+    const size_t klen = strlen(name);
+    if (grow_typed_stats(c, cb::mcbp::stats::getNumericEntrySize(klen))) {
+        auto& dbuf = c->getDynamicBuffer();
+        dbuf.moveOffset(cb::mcbp::stats::encodeUnsigned(
+                dbuf.getCurrent(), {name, klen}, val));
+    }
+}
+
+static void add_typed_stat(McbpConnection* c, const char* name, int64_t val) {
+    const size_t klen = strlen(name);
+    if (grow_typed_stats(c, cb::mcbp::stats::getNumericEntrySize(klen))) {
+        auto& dbuf = c->getDynamicBuffer();
+        dbuf.moveOffset(cb::mcbp::stats::encodeSigned(
+                dbuf.getCurrent(), {name, klen}, val));
+    }
+}
+
+static void add_typed_stat(McbpConnection* c, const char* name, bool val) {
+    const size_t klen = strlen(name);
+    if (grow_typed_stats(c, cb::mcbp::stats::getNumericEntrySize(klen))) {
+        auto& dbuf = c->getDynamicBuffer();
+        dbuf.moveOffset(cb::mcbp::stats::encodeBoolean(
+                dbuf.getCurrent(), {name, klen}, val));
+    }
+}
+
+/**
+ * Fill in the response header in front of the typed stats
+ */
+static void finish_typed_stats(McbpConnection* c) {
+    if (!grow_typed_stats(c, 0)) {
+        return;
+    }
+    auto& dbuf = c->getDynamicBuffer();
+    auto* header =
+            reinterpret_cast<protocol_binary_response_header*>(dbuf.getRoot());
+    memset(header, 0, sizeof(*header));
+    header->response.magic = (uint8_t)PROTOCOL_BINARY_RES;
+    header->response.opcode = PROTOCOL_BINARY_CMD_STAT;
+    header->response.datatype = (uint8_t)PROTOCOL_BINARY_RAW_BYTES;
+    header->response.bodylen = htonl(
+            uint32_t(dbuf.getOffset() - sizeof(header->response)));
+    header->response.opaque = c->getOpaque();
+}
+
 // Generic add_stat<T>. Uses std::to_string which requires heap allocation.
 template<typename T>
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
@@ -44,6 +132,11 @@ void add_stat(const void* cookie, ADD_STAT add_stat_callback,
 // int-to-string conversion.
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
               const char* name, int32_t val) {
+    auto* c = get_typed_stats_connection(cookie, add_stat_callback);
+    if (c != nullptr) {
+        add_typed_stat(c, name, int64_t(val));
+        return;
+    }
     char buf[16];
     int len = checked_snprintf(buf, sizeof(buf), "%" PRId32, val);
     if (len < 0 || size_t(len) >= sizeof(buf)) {
@@ -56,6 +149,11 @@ void add_stat(const void* cookie, ADD_STAT add_stat_callback,
 
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
               const char* name, uint32_t val) {
+    auto* c = get_typed_stats_connection(cookie, add_stat_callback);
+    if (c != nullptr) {
+        add_typed_stat(c, name, uint64_t(val));
+        return;
+    }
     char buf[16];
     int len = checked_snprintf(buf, sizeof(buf), "%" PRIu32, val);
     if (len < 0 || size_t(len) >= sizeof(buf)) {
@@ -68,6 +166,11 @@ void add_stat(const void* cookie, ADD_STAT add_stat_callback,
 
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
               const char* name, int64_t val) {
+    auto* c = get_typed_stats_connection(cookie, add_stat_callback);
+    if (c != nullptr) {
+        add_typed_stat(c, name, int64_t(val));
+        return;
+    }
     char buf[32];
     int len = checked_snprintf(buf, sizeof(buf), "%" PRId64, val);
     if (len < 0 || size_t(len) >= sizeof(buf)) {
@@ -80,6 +183,11 @@ void add_stat(const void* cookie, ADD_STAT add_stat_callback,
 
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
               const char* name, uint64_t val) {
+    auto* c = get_typed_stats_connection(cookie, add_stat_callback);
+    if (c != nullptr) {
+        add_typed_stat(c, name, uint64_t(val));
+        return;
+    }
     char buf[32];
     int len = checked_snprintf(buf, sizeof(buf), "%" PRIu64, val);
     if (len < 0 || size_t(len) >= sizeof(buf)) {
@@ -104,6 +212,11 @@ void add_stat(const void* cookie, ADD_STAT add_stat_callback,
 
 void add_stat(const void* cookie, ADD_STAT add_stat_callback,
               const char* name, const bool value) {
+    auto* c = get_typed_stats_connection(cookie, add_stat_callback);
+    if (c != nullptr) {
+        add_typed_stat(c, name, value);
+        return;
+    }
     if (value) {
         add_stat(cookie, add_stat_callback, name, "true");
     } else {
@@ -167,6 +280,30 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
                  thread_stats.bytes_subdoc_mutation_total);
         add_stat(cookie, add_stat_callback, "bytes_subdoc_mutation_inserted",
                  thread_stats.bytes_subdoc_mutation_inserted);
+        add_stat(cookie, add_stat_callback, "bytes_subdoc_inflated",
+                 thread_stats.bytes_subdoc_inflated);
+        add_stat(cookie, add_stat_callback, "bytes_subdoc_deflated",
+                 thread_stats.bytes_subdoc_deflated);
+        add_stat(cookie, add_stat_callback, "subdoc_cas_conflicts",
+                 thread_stats.subdoc_cas_conflicts);
+        add_stat(cookie, add_stat_callback, "subdoc_retries",
+                 thread_stats.subdoc_retries);
+        add_stat(cookie, add_stat_callback, "subdoc_engine_updates",
+                 thread_stats.subdoc_engine_updates);
+
+        const auto* lookup_cache =
+                all_buckets[c->getBucketIndex()].subdoc_lookup_cache;
+        if (lookup_cache != nullptr) {
+            add_stat(cookie, add_stat_callback, "subdoc_lookup_cache_hits",
+                     lookup_cache->getHits());
+            add_stat(cookie, add_stat_callback, "subdoc_lookup_cache_misses",
+                     lookup_cache->getMisses());
+            add_stat(cookie, add_stat_callback,
+                     "subdoc_lookup_cache_evictions",
+                     lookup_cache->getEvictions());
+            add_stat(cookie, add_stat_callback, "subdoc_lookup_cache_bytes",
+                     uint64_t(lookup_cache->getMemoryUsage()));
+        }
 
         // index 0 contains the aggregated timings for all buckets
         auto& timings = all_buckets[0].timings;
@@ -214,6 +351,14 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
                  thread_stats.iovused_high_watermark);
         add_stat(cookie, add_stat_callback, "msgused_high_watermark",
                  thread_stats.msgused_high_watermark);
+        add_stat(cookie, add_stat_callback, "zerocopy_sends",
+                 thread_stats.zerocopy_sends);
+        add_stat(cookie, add_stat_callback, "zerocopy_copied",
+                 thread_stats.zerocopy_copied);
+        add_stat(cookie, add_stat_callback, "zerocopy_fallbacks",
+                 thread_stats.zerocopy_fallbacks);
+        add_stat(cookie, add_stat_callback, "hot_key_hints",
+                 thread_stats.hot_key_hints);
 
         add_stat(cookie, add_stat_callback, "cmd_lock", thread_stats.cmd_lock);
         add_stat(cookie, add_stat_callback, "lock_errors",
@@ -434,6 +579,40 @@ static void process_stat_settings(ADD_STAT add_stat_callback,
              std::to_string(settings.getMaxPacketSize()).c_str());
     add_stat(cookie, add_stat_callback, "xattr_enabled",
             settings.isXattrEnabled());
+    add_stat(cookie, add_stat_callback, "direct_item_read_threshold",
+             std::to_string(settings.getDirectItemReadThreshold()).c_str());
+    add_stat(cookie, add_stat_callback, "zerocopy_threshold",
+             std::to_string(settings.getZerocopyThreshold()).c_str());
+    add_stat(cookie, add_stat_callback, "ssl_ktls", settings.isSslKtlsEnabled());
+    add_stat(cookie, add_stat_callback, "worker_busy_poll_usec",
+             std::to_string(settings.getWorkerBusyPollUsec()).c_str());
+    {
+        std::string cpus;
+        for (const auto cpu : settings.getWorkerCpuAffinity()) {
+            if (!cpus.empty()) {
+                cpus.push_back(',');
+            }
+            cpus.append(std::to_string(cpu));
+        }
+        add_stat(cookie, add_stat_callback, "worker_cpu_affinity",
+                 cpus.c_str());
+    }
+    add_stat(cookie, add_stat_callback, "phase_timings",
+             settings.isPhaseTimingsEnabled());
+    add_stat(cookie, add_stat_callback, "trace_sample_rate",
+             std::to_string(settings.getTraceSampleRate()).c_str());
+    add_stat(cookie, add_stat_callback, "trace_sample_threshold_usec",
+             std::to_string(settings.getTraceSampleThresholdUsec()).c_str());
+    add_stat(cookie, add_stat_callback, "hot_key_threshold",
+             std::to_string(settings.getHotKeyThreshold()).c_str());
+    add_stat(cookie, add_stat_callback, "hot_key_ttl_ms",
+             std::to_string(settings.getHotKeyTtlMs()).c_str());
+    add_stat(cookie, add_stat_callback, "prometheus_port",
+             uint32_t(settings.getPrometheusPort()));
+    add_stat(cookie, add_stat_callback, "subdoc_lookup_cache_size",
+             std::to_string(settings.getSubdocLookupCacheSize()).c_str());
+    add_stat(cookie, add_stat_callback, "timings_precision",
+             uint32_t(settings.getTimingsPrecision()));
     add_stat(cookie, add_stat_callback, "privilege_debug",
              settings.isPrivilegeDebug());
 
@@ -494,6 +673,15 @@ static void append_stats(const char* key, const uint16_t klen,
     // Using dynamic cast to ensure a coredump when we implement this for
     // Greenstack and fix it
     auto* c = dynamic_cast<McbpConnection*>(cookie->connection);
+    if (c->isTypedStatsSupported()) {
+        needed = cb::mcbp::stats::getStringEntrySize(klen, vlen);
+        if (grow_typed_stats(c, needed)) {
+            auto& dbuf = c->getDynamicBuffer();
+            dbuf.moveOffset(cb::mcbp::stats::encodeString(
+                    dbuf.getCurrent(), {key, klen}, {val, vlen}));
+        }
+        return;
+    }
     needed = vlen + klen + sizeof(protocol_binary_response_header);
     if (!c->growDynamicBuffer(needed)) {
         return;
@@ -535,6 +723,7 @@ static void process_bucket_details(McbpConnection* c) {
  * The following submodules exists:
  * <ul>
  *    <li>timings</li>
+ *    <li>phase_timings</li>
  * </ul>
  *
  * @todo I would have assumed that we wanted to clear the stats from
@@ -550,11 +739,15 @@ static ENGINE_ERROR_CODE stat_reset_executor(const std::string& arg,
         bucket_reset_stats(&connection);
         all_buckets[0].timings.reset();
         all_buckets[connection.getBucketIndex()].timings.reset();
+        phase_timings.reset();
         return ENGINE_SUCCESS;
     } else if (arg == "timings") {
         // Nuke the command timings section for the connected bucket
         all_buckets[connection.getBucketIndex()].timings.reset();
         return ENGINE_SUCCESS;
+    } else if (arg == "phase_timings") {
+        phase_timings.reset();
+        return ENGINE_SUCCESS;
     } else {
         return ENGINE_EINVAL;
     }
@@ -597,6 +790,27 @@ static ENGINE_ERROR_CODE stat_audit_executor(const std::string& arg,
     }
 }
 
+/**
+ * Handler for the <code>stats logger</code> used to get statistics from
+ * the logger (if the logger provides any).
+ *
+ * @param arg - should be empty
+ * @param connection the connection that requested the operation
+ */
+static ENGINE_ERROR_CODE stat_logger_executor(const std::string& arg,
+                                              McbpConnection& connection) {
+    if (arg.empty()) {
+        auto* logger = settings.extensions.logger;
+        if (logger->get_stats != NULL) {
+            logger->get_stats(&append_stats,
+                              const_cast<void*>(connection.getCookie()));
+        }
+        return ENGINE_SUCCESS;
+    } else {
+        return ENGINE_EINVAL;
+    }
+}
+
 
 /**
  * Handler for the <code>stats bucket details</code> used to get information
@@ -632,15 +846,42 @@ static ENGINE_ERROR_CODE stat_aggregate_executor(const std::string& arg,
 }
 
 /**
- * Handler for the <code>stats connection[ fd]</code> command to retrieve
- * information about connection specific details.
- *
- * @param arg an optional file descriptor representing the connection
- *            object to retrieve information about. If empty dump all.
- * @param connection the connection that requested the operation
+ * The ConnectionStatsTask generates the stats for the connections. It
+ * needs to walk (and generate JSON for) every connection while holding
+ * the connections mutex, which takes a while on a node with many clients,
+ * so it is run by the executor pool instead of blocking all of the other
+ * connections served by the worker thread.
  */
-static ENGINE_ERROR_CODE stat_connections_executor(const std::string& arg,
-                                                   McbpConnection& connection) {
+class ConnectionStatsTask : public Task {
+public:
+    ConnectionStatsTask(McbpConnection& connection_, int64_t fd_)
+        : connection(connection_),
+          fd(fd_),
+          status(ENGINE_SUCCESS) {
+        // Empty
+    }
+
+    virtual bool execute() override {
+        try {
+            connection_stats(&append_stats, connection.getCookie(), fd);
+        } catch (const std::bad_alloc&) {
+            status = ENGINE_ENOMEM;
+        }
+        return true;
+    }
+
+    virtual void notifyExecutionComplete() override {
+        notify_io_complete(connection.getCookie(), status);
+    }
+
+private:
+    McbpConnection& connection;
+    const int64_t fd;
+    ENGINE_ERROR_CODE status;
+};
+
+ENGINE_ERROR_CODE StatsCommandContext::stat_connections(
+        const std::string& arg) {
     int64_t fd = -1;
 
     if (!arg.empty()) {
@@ -651,8 +892,16 @@ static ENGINE_ERROR_CODE stat_connections_executor(const std::string& arg,
         }
     }
 
-    connection_stats(&append_stats, connection.getCookie(), fd);
-    return ENGINE_SUCCESS;
+    if (fd != -1) {
+        // Just a single connection, no need to go via the executor
+        connection_stats(&append_stats, connection.getCookie(), fd);
+        return ENGINE_SUCCESS;
+    }
+
+    task = std::make_shared<ConnectionStatsTask>(connection, fd);
+    std::lock_guard<std::mutex> guard(task->getMutex());
+    executorPool->schedule(task);
+    return ENGINE_EWOULDBLOCK;
 }
 
 /**
@@ -678,40 +927,46 @@ static ENGINE_ERROR_CODE stat_topkeys_executor(const std::string& arg,
  * Handler for the <code>stats topkeys</code> command used to retrieve
  * a JSON document containing the most popular keys in the attached bucket.
  *
- * @param arg - should be empty
+ * @param arg - empty (order by access count), "bytes_read" or
+ *              "bytes_written"
  * @param connection the connection that requested the operation
  */
 static ENGINE_ERROR_CODE stat_topkeys_json_executor(const std::string& arg,
                                                     McbpConnection& connection) {
-    if (arg.empty()) {
-        ENGINE_ERROR_CODE ret;
+    TopKeys::Order order = TopKeys::Order::Ops;
+    if (arg == "bytes_read") {
+        order = TopKeys::Order::BytesRead;
+    } else if (arg == "bytes_written") {
+        order = TopKeys::Order::BytesWritten;
+    } else if (!arg.empty()) {
+        return ENGINE_EINVAL;
+    }
 
-        cJSON* topkeys_doc = cJSON_CreateObject();
-        if (topkeys_doc == nullptr) {
-            ret = ENGINE_ENOMEM;
-        } else {
-            auto& bucket = all_buckets[connection.getBucketIndex()];
-            ret = bucket.topkeys->json_stats(topkeys_doc,
-                                             mc_time_get_current_time());
+    ENGINE_ERROR_CODE ret;
+    cJSON* topkeys_doc = cJSON_CreateObject();
+    if (topkeys_doc == nullptr) {
+        ret = ENGINE_ENOMEM;
+    } else {
+        auto& bucket = all_buckets[connection.getBucketIndex()];
+        ret = bucket.topkeys->json_stats(topkeys_doc,
+                                         mc_time_get_current_time(),
+                                         order);
 
-            if (ret == ENGINE_SUCCESS) {
-                char key[] = "topkeys_json";
-                char* topkeys_str = cJSON_PrintUnformatted(topkeys_doc);
-                if (topkeys_str != nullptr) {
-                    append_stats(key, (uint16_t)strlen(key),
-                                 topkeys_str, (uint32_t)strlen(topkeys_str),
-                                 connection.getCookie());
-                    cJSON_Free(topkeys_str);
-                } else {
-                    ret = ENGINE_ENOMEM;
-                }
+        if (ret == ENGINE_SUCCESS) {
+            char key[] = "topkeys_json";
+            char* topkeys_str = cJSON_PrintUnformatted(topkeys_doc);
+            if (topkeys_str != nullptr) {
+                append_stats(key, (uint16_t)strlen(key),
+                             topkeys_str, (uint32_t)strlen(topkeys_str),
+                             connection.getCookie());
+                cJSON_Free(topkeys_str);
+            } else {
+                ret = ENGINE_ENOMEM;
             }
-            cJSON_Delete(topkeys_doc);
         }
-        return ret;
-    } else {
-        return ENGINE_EINVAL;
+        cJSON_Delete(topkeys_doc);
     }
+    return ret;
 }
 
 /**
@@ -746,6 +1001,45 @@ static ENGINE_ERROR_CODE stat_subdoc_execute_executor(const std::string& arg,
     }
 }
 
+/**
+ * Handler for the <code>stats phase_timings [opcode]</code> command used to
+ * retrieve the time spent in each phase of the commands. Each phase is
+ * returned as a separate stat containing its histogram.
+ *
+ * @param arg - the name of the opcode to get the timings for, or empty
+ *              to get the timings aggregated over all opcodes
+ * @param connection the connection that requested the operation
+ */
+static ENGINE_ERROR_CODE stat_phase_timings_executor(
+        const std::string& arg, McbpConnection& connection) {
+    uint8_t opcode = PROTOCOL_BINARY_CMD_INVALID;
+    if (!arg.empty()) {
+        opcode = memcached_text_2_opcode(arg.c_str());
+        if (opcode == PROTOCOL_BINARY_CMD_INVALID) {
+            return ENGINE_EINVAL;
+        }
+    }
+
+    try {
+        for (size_t ii = 0; ii < NumCommandPhases; ++ii) {
+            const auto phase = CommandPhase(ii);
+            const auto histogram = arg.empty()
+                                           ? phase_timings.get(phase)
+                                           : phase_timings.get(opcode, phase);
+            const std::string json_str = histogram.to_string();
+            const char* name = to_string(phase);
+            append_stats(name,
+                         uint16_t(strlen(name)),
+                         json_str.c_str(),
+                         uint32_t(json_str.size()),
+                         connection.getCookie());
+        }
+        return ENGINE_SUCCESS;
+    } catch (std::bad_alloc&) {
+        return ENGINE_ENOMEM;
+    }
+}
+
 static ENGINE_ERROR_CODE stat_responses_json_executor(
         const std::string& arg, McbpConnection& connection) {
     try {
@@ -795,17 +1089,22 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
             {"reset", {true, stat_reset_executor}},
             {"settings", {false, stat_settings_executor}},
             {"audit", {true, stat_audit_executor}},
+            {"logger", {true, stat_logger_executor}},
             {"bucket_details", {true, stat_bucket_details_executor}},
             {"aggregate", {false, stat_aggregate_executor}},
-            {"connections", {false, stat_connections_executor}},
             {"topkeys", {false, stat_topkeys_executor}},
             {"topkeys_json", {false, stat_topkeys_json_executor}},
             {"subdoc_execute", {false, stat_subdoc_execute_executor}},
-            {"responses", {false, stat_responses_json_executor}}};
+            {"responses", {false, stat_responses_json_executor}},
+            {"phase_timings", {true, stat_phase_timings_executor}}};
 
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
 
-    if (key.empty()) {
+    if (task) {
+        // The stats were generated by the task we scheduled in the
+        // previous step (it notified us with its status)
+        task.reset();
+    } else if (key.empty()) {
         /* request all statistics */
         ret = get_stats({reinterpret_cast<const char*>(key.data()), key.size()});
         if (ret == ENGINE_SUCCESS) {
@@ -829,7 +1128,9 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
         }
 
         auto iter = handlers.find(command);
-        if (iter == handlers.end()) {
+        if (command == "connections") {
+            ret = stat_connections(argument);
+        } else if (iter == handlers.end()) {
             // This may be specific to the underlying engine
             ret = get_stats({reinterpret_cast<const char*>(key.data()),
                              key.size()});
@@ -846,7 +1147,12 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
     }
 
     if (ret == ENGINE_SUCCESS) {
-        append_stats(nullptr, 0, nullptr, 0, connection.getCookie());
+        if (connection.isTypedStatsSupported()) {
+            // All of the stats are sent in a single response
+            finish_typed_stats(&connection);
+        } else {
+            append_stats(nullptr, 0, nullptr, 0, connection.getCookie());
+        }
 
         // We just want to record this once rather than for each packet sent
         ++connection.getBucket()
@@ -21,6 +21,11 @@
 
 #include "steppable_command_context.h"
 
+#include <memory>
+#include <string>
+
+class Task;
+
 /**
  * The StatsCommandContext is responsible for implementing all of the
  * various stats commands (including the sub commands).
@@ -58,8 +63,25 @@ private:
      */
     ENGINE_ERROR_CODE get_stats(const cb::const_char_buffer& k);
 
+    /**
+     * Handler for the <code>stats connections[ fd]</code> command to
+     * retrieve information about connection specific details. The stats
+     * for all of the connections are generated by a background task.
+     *
+     * @param arg an optional file descriptor representing the connection
+     *            object to retrieve information about. If empty dump all.
+     * @return ENGINE_EWOULDBLOCK if the stats are generated in the
+     *         background
+     */
+    ENGINE_ERROR_CODE stat_connections(const std::string& arg);
+
     /**
      * The key as specified in the input buffer (it may contain a sub command)
      */
     const cb::const_byte_buffer key;
+
+    /**
+     * The task generating the stats in the background (if any)
+     */
+    std::shared_ptr<Task> task;
 };
@@ -0,0 +1,127 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "sampled_tracing.h"
+
+#include <cJSON.h>
+#include <cJSON_utils.h>
+#include <memcached/protocol_binary.h>
+#include <utilities/protocol2text.h>
+
+const size_t SampledTracer::MaxSamples;
+
+SampledTracer::SampledTracer() {
+    setNumThreads(1);
+}
+
+void SampledTracer::setNumThreads(size_t num) {
+    counters.clear();
+    for (size_t ii = 0; ii < num; ++ii) {
+        counters.emplace_back(new std::array<size_t, 0x100>());
+        counters.back()->fill(0);
+    }
+}
+
+void SampledTracer::complete(uint32_t connection,
+                             uint8_t opcode,
+                             uint32_t opaque,
+                             const char* bucket,
+                             const RequestTrace& trace,
+                             hrtime_t end,
+                             hrtime_t threshold) {
+    const auto duration = end - trace.getStart();
+    if (duration < threshold) {
+        return;
+    }
+
+    SampledRequest request{connection,
+                           opcode,
+                           opaque,
+                           bucket,
+                           trace.getStart(),
+                           duration,
+                           trace.getSpans()};
+
+    std::lock_guard<std::mutex> guard(mutex);
+    samples.emplace_back(std::move(request));
+    if (samples.size() > MaxSamples) {
+        samples.pop_front();
+    }
+}
+
+size_t SampledTracer::size() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return samples.size();
+}
+
+void SampledTracer::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    samples.clear();
+}
+
+/**
+ * Create a Chrome trace "complete" event
+ */
+static cJSON* create_event(const char* name,
+                           const char* category,
+                           uint32_t tid,
+                           hrtime_t start,
+                           hrtime_t duration) {
+    cJSON* event = cJSON_CreateObject();
+    cJSON_AddStringToObject(event, "name", name);
+    cJSON_AddStringToObject(event, "cat", category);
+    cJSON_AddStringToObject(event, "ph", "X");
+    cJSON_AddNumberToObject(event, "pid", 0);
+    cJSON_AddNumberToObject(event, "tid", tid);
+    // The trace format use microseconds
+    cJSON_AddNumberToObject(event, "ts", double(start) / 1000.0);
+    cJSON_AddNumberToObject(event, "dur", double(duration) / 1000.0);
+    return event;
+}
+
+std::string SampledTracer::toJSON() const {
+    unique_cJSON_ptr root(cJSON_CreateObject());
+    cJSON* events = cJSON_CreateArray();
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (const auto& request : samples) {
+            const char* name = memcached_opcode_2_text(request.opcode);
+            cJSON* event = create_event(name != nullptr ? name : "unknown",
+                                        "request",
+                                        request.connection,
+                                        request.start,
+                                        request.duration);
+            cJSON* args = cJSON_CreateObject();
+            cJSON_AddStringToObject(args, "bucket", request.bucket.c_str());
+            cJSON_AddNumberToObject(args, "opaque", request.opaque);
+            cJSON_AddItemToObject(event, "args", args);
+            cJSON_AddItemToArray(events, event);
+
+            for (const auto& span : request.spans) {
+                cJSON_AddItemToArray(events,
+                                     create_event(span.name,
+                                                  "span",
+                                                  request.connection,
+                                                  span.start,
+                                                  span.duration));
+            }
+        }
+    }
+
+    cJSON_AddItemToObject(root.get(), "traceEvents", events);
+    return to_string(root, false);
+}
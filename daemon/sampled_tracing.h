@@ -0,0 +1,203 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/platform.h>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * A timed region within a sampled request
+ */
+struct TraceSpan {
+    /// The name of the span (must be a string literal)
+    const char* name;
+    hrtime_t start;
+    hrtime_t duration;
+};
+
+/**
+ * The RequestTrace holds the spans recorded for the command currently
+ * being executed by a connection if the command was selected for
+ * sampling. It is owned by the cookie and reused for the next command so
+ * that we don't need to allocate memory for every sampled request.
+ */
+class RequestTrace {
+public:
+    /**
+     * Start tracing a new request
+     *
+     * @param now the time the request started
+     */
+    void begin(hrtime_t now) {
+        spans.clear();
+        start = now;
+        active = true;
+    }
+
+    /**
+     * Stop tracing (and drop the spans)
+     */
+    void end() {
+        active = false;
+    }
+
+    bool isActive() const {
+        return active;
+    }
+
+    /**
+     * Add a span to the trace (if tracing)
+     */
+    void addSpan(const char* name, hrtime_t begin, hrtime_t end) {
+        if (active) {
+            spans.push_back({name, begin, end - begin});
+        }
+    }
+
+    hrtime_t getStart() const {
+        return start;
+    }
+
+    const std::vector<TraceSpan>& getSpans() const {
+        return spans;
+    }
+
+private:
+    std::vector<TraceSpan> spans;
+    hrtime_t start = 0;
+    bool active = false;
+};
+
+/**
+ * Record a span covering the lifetime of the object in the given trace.
+ * It only reads the clock if the request is being traced.
+ */
+class TraceSpanScope {
+public:
+    TraceSpanScope(RequestTrace& trace, const char* name)
+        : trace(trace),
+          name(name),
+          start(trace.isActive() ? gethrtime() : 0) {
+    }
+
+    ~TraceSpanScope() {
+        if (start != 0) {
+            trace.addSpan(name, start, gethrtime());
+        }
+    }
+
+private:
+    RequestTrace& trace;
+    const char* name;
+    const hrtime_t start;
+};
+
+/**
+ * A completed request which was sampled and was slower than the
+ * threshold
+ */
+struct SampledRequest {
+    uint32_t connection;
+    uint8_t opcode;
+    uint32_t opaque;
+    std::string bucket;
+    hrtime_t start;
+    hrtime_t duration;
+    std::vector<TraceSpan> spans;
+};
+
+/**
+ * The SampledTracer selects 1 in N commands (per opcode on each worker
+ * thread) for tracing, and keeps the most recent of the sampled commands
+ * which were slower than the configured threshold so that they may be
+ * dumped (as Chrome trace JSON) after the fact.
+ */
+class SampledTracer {
+public:
+    /// The maximum number of requests we keep
+    static const size_t MaxSamples = 1000;
+
+    SampledTracer();
+    SampledTracer(const SampledTracer&) = delete;
+
+    /**
+     * Set the number of threads which may call shouldSample(). This must
+     * be called before any requests are sampled.
+     */
+    void setNumThreads(size_t num);
+
+    /**
+     * Should the next command on the given thread be traced?
+     *
+     * @param thread the index of the calling thread
+     * @param opcode the command about to be executed
+     * @param rate trace 1 in rate commands (0 to disable)
+     */
+    bool shouldSample(size_t thread, uint8_t opcode, size_t rate) {
+        if (rate == 0) {
+            return false;
+        }
+        auto& counter = (*counters[thread])[opcode];
+        if (++counter >= rate) {
+            counter = 0;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * A traced request completed. Keep it if it took at least threshold
+     * nanoseconds.
+     */
+    void complete(uint32_t connection,
+                  uint8_t opcode,
+                  uint32_t opaque,
+                  const char* bucket,
+                  const RequestTrace& trace,
+                  hrtime_t end,
+                  hrtime_t threshold);
+
+    /**
+     * Get the number of requests we've kept
+     */
+    size_t size() const;
+
+    /**
+     * Generate a Chrome trace (JSON) containing all of the requests we've
+     * kept. Each request is represented by a "complete" event named after
+     * the opcode, with its spans as nested complete events on the same
+     * thread id (the connection id).
+     */
+    std::string toJSON() const;
+
+    /**
+     * Drop all of the kept requests
+     */
+    void clear();
+
+private:
+    std::vector<std::unique_ptr<std::array<size_t, 0x100>>> counters;
+
+    mutable std::mutex mutex;
+    std::deque<SampledRequest> samples;
+};
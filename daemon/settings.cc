@@ -28,6 +28,7 @@
 #include "log_macros.h"
 #include "settings.h"
 #include "ssl_utils.h"
+#include "timing_histogram.h"
 
 // the global entry of the settings object
 Settings settings;
@@ -60,6 +61,18 @@ Settings::Settings()
     xattr_enabled.store(false);
     privilege_debug.store(false);
     collections_prototype.store(false);
+    direct_item_read_threshold.reset();
+    zerocopy_threshold.reset();
+    ssl_ktls.store(false);
+    worker_busy_poll_usec.reset();
+    phase_timings.store(false);
+    trace_sample_rate.reset();
+    trace_sample_threshold_usec.reset();
+    hot_key_threshold.reset();
+    hot_key_ttl_ms.store(1000);
+    prometheus_port = 0;
+    subdoc_lookup_cache_size = 0;
+    timings_precision = TimingHistogram::DefaultPrecision;
 
     memset(&has, 0, sizeof(has));
     memset(&extensions, 0, sizeof(extensions));
@@ -557,6 +570,263 @@ static void handle_xattr_enabled(Settings& s, cJSON* obj) {
     }
 }
 
+/**
+ * Handle the "direct_item_read_threshold" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_direct_item_read_threshold(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"direct_item_read_threshold\" must be an integer");
+    }
+    s.setDirectItemReadThreshold(obj->valueint);
+}
+
+/**
+ * Handle the "zerocopy_threshold" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_zerocopy_threshold(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"zerocopy_threshold\" must be an integer");
+    }
+    s.setZerocopyThreshold(obj->valueint);
+}
+
+/**
+ * Handle the "ssl_ktls" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_ssl_ktls(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setSslKtlsEnabled(true);
+    } else if (obj->type == cJSON_False) {
+        s.setSslKtlsEnabled(false);
+    } else {
+        throw std::invalid_argument("\"ssl_ktls\" must be a boolean value");
+    }
+}
+
+/**
+ * Handle the "worker_busy_poll_usec" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_worker_busy_poll_usec(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"worker_busy_poll_usec\" must be an integer");
+    }
+    if (obj->valueint < 0) {
+        throw std::invalid_argument(
+            "\"worker_busy_poll_usec\" can't be negative");
+    }
+    s.setWorkerBusyPollUsec(obj->valueint);
+}
+
+/**
+ * Handle the "worker_cpu_affinity" tag in the settings
+ *
+ *  The value must be an array of CPU ids
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_worker_cpu_affinity(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Array) {
+        throw std::invalid_argument(
+            "\"worker_cpu_affinity\" must be an array");
+    }
+
+    std::vector<int> cpus;
+    for (auto* child = obj->child; child != nullptr; child = child->next) {
+        if (child->type != cJSON_Number || child->valueint < 0) {
+            throw std::invalid_argument(
+                "Elements in the \"worker_cpu_affinity\" array must be "
+                "non-negative integers");
+        }
+        cpus.push_back(child->valueint);
+    }
+    s.setWorkerCpuAffinity(cpus);
+}
+
+/**
+ * Handle the "phase_timings" tag in the settings
+ *
+ *  The value must be a boolean value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_phase_timings(Settings& s, cJSON* obj) {
+    if (obj->type == cJSON_True) {
+        s.setPhaseTimingsEnabled(true);
+    } else if (obj->type == cJSON_False) {
+        s.setPhaseTimingsEnabled(false);
+    } else {
+        throw std::invalid_argument(
+            "\"phase_timings\" must be a boolean value");
+    }
+}
+
+/**
+ * Handle the "trace_sample_rate" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_trace_sample_rate(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"trace_sample_rate\" must be an integer");
+    }
+    if (obj->valueint < 0) {
+        throw std::invalid_argument(
+            "\"trace_sample_rate\" can't be negative");
+    }
+    s.setTraceSampleRate(obj->valueint);
+}
+
+/**
+ * Handle the "trace_sample_threshold_usec" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_trace_sample_threshold_usec(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"trace_sample_threshold_usec\" must be an integer");
+    }
+    if (obj->valueint < 0) {
+        throw std::invalid_argument(
+            "\"trace_sample_threshold_usec\" can't be negative");
+    }
+    s.setTraceSampleThresholdUsec(obj->valueint);
+}
+
+/**
+ * Handle the "hot_key_threshold" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_hot_key_threshold(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"hot_key_threshold\" must be an integer");
+    }
+    if (obj->valueint < 0) {
+        throw std::invalid_argument(
+            "\"hot_key_threshold\" can't be negative");
+    }
+    s.setHotKeyThreshold(obj->valueint);
+}
+
+/**
+ * Handle the "hot_key_ttl_ms" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_hot_key_ttl_ms(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"hot_key_ttl_ms\" must be an integer");
+    }
+    if (obj->valueint < 0) {
+        throw std::invalid_argument(
+            "\"hot_key_ttl_ms\" can't be negative");
+    }
+    s.setHotKeyTtlMs(obj->valueint);
+}
+
+/**
+ * Handle the "prometheus_port" tag in the settings
+ *
+ *  The value must be a numeric value in the range [0, 65535]
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_prometheus_port(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"prometheus_port\" must be an integer");
+    }
+    if (obj->valueint < 0 || obj->valueint > 65535) {
+        throw std::invalid_argument(
+            "\"prometheus_port\" must be in the range [0, 65535]");
+    }
+    s.setPrometheusPort(in_port_t(obj->valueint));
+}
+
+/**
+ * Handle the "subdoc_lookup_cache_size" tag in the settings
+ *
+ *  The value must be a numeric value
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_subdoc_lookup_cache_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"subdoc_lookup_cache_size\" must be an integer");
+    }
+    if (obj->valuedouble < 0) {
+        throw std::invalid_argument(
+            "\"subdoc_lookup_cache_size\" can't be negative");
+    }
+    s.setSubdocLookupCacheSize(size_t(obj->valuedouble));
+}
+
+/**
+ * Handle the "timings_precision" tag in the settings
+ *
+ *  The value must be a numeric value in the range
+ *  [1, TimingHistogram::MaxPrecision]
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_timings_precision(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+            "\"timings_precision\" must be an integer");
+    }
+    if (obj->valueint < 1 || obj->valueint > TimingHistogram::MaxPrecision) {
+        throw std::invalid_argument(
+            "\"timings_precision\" must be in the range [1, " +
+            std::to_string(TimingHistogram::MaxPrecision) + "]");
+    }
+    s.setTimingsPrecision(uint8_t(obj->valueint));
+}
+
 /**
  * Handle the "client_cert_auth" tag in the settings
  *
@@ -705,7 +975,22 @@ void Settings::reconfigure(const unique_cJSON_ptr& json) {
             {"dedupe_nmvb_maps", handle_dedupe_nmvb_maps},
             {"xattr_enabled", handle_xattr_enabled},
             {"client_cert_auth", handle_client_cert_auth},
-            {"collections_prototype", handle_collections_prototype}};
+            {"collections_prototype", handle_collections_prototype},
+            {"direct_item_read_threshold",
+             handle_direct_item_read_threshold},
+            {"zerocopy_threshold", handle_zerocopy_threshold},
+            {"ssl_ktls", handle_ssl_ktls},
+            {"worker_busy_poll_usec", handle_worker_busy_poll_usec},
+            {"worker_cpu_affinity", handle_worker_cpu_affinity},
+            {"phase_timings", handle_phase_timings},
+            {"trace_sample_rate", handle_trace_sample_rate},
+            {"trace_sample_threshold_usec",
+             handle_trace_sample_threshold_usec},
+            {"hot_key_threshold", handle_hot_key_threshold},
+            {"hot_key_ttl_ms", handle_hot_key_ttl_ms},
+            {"prometheus_port", handle_prometheus_port},
+            {"subdoc_lookup_cache_size", handle_subdoc_lookup_cache_size},
+            {"timings_precision", handle_timings_precision}};
 
     cJSON* obj = json->child;
     while (obj != nullptr) {
@@ -915,6 +1200,13 @@ void Settings::updateSettings(const Settings& other, bool apply) {
         }
     }
 
+    if (other.has.worker_cpu_affinity) {
+        if (other.worker_cpu_affinity != worker_cpu_affinity) {
+            throw std::invalid_argument(
+                "worker_cpu_affinity can't be changed dynamically");
+        }
+    }
+
     if (other.has.audit) {
         if (other.audit_file != audit_file) {
             throw std::invalid_argument("audit can't be changed dynamically");
@@ -955,6 +1247,24 @@ void Settings::updateSettings(const Settings& other, bool apply) {
                 "require_init can't be changed dynamically");
         }
     }
+    if (other.has.prometheus_port) {
+        if (other.prometheus_port != prometheus_port) {
+            throw std::invalid_argument(
+                "prometheus_port can't be changed dynamically");
+        }
+    }
+    if (other.has.subdoc_lookup_cache_size) {
+        if (other.subdoc_lookup_cache_size != subdoc_lookup_cache_size) {
+            throw std::invalid_argument(
+                "subdoc_lookup_cache_size can't be changed dynamically");
+        }
+    }
+    if (other.has.timings_precision) {
+        if (other.timings_precision != timings_precision) {
+            throw std::invalid_argument(
+                "timings_precision can't be changed dynamically");
+        }
+    }
     if (other.has.topkeys_size) {
         if (other.topkeys_size != topkeys_size) {
             throw std::invalid_argument(
@@ -1165,6 +1475,94 @@ void Settings::updateSettings(const Settings& other, bool apply) {
         }
     }
 
+    if (other.has.direct_item_read_threshold) {
+        if (other.direct_item_read_threshold != direct_item_read_threshold) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change direct item read threshold from %u to %u",
+                  direct_item_read_threshold.load(),
+                  other.direct_item_read_threshold.load());
+            setDirectItemReadThreshold(other.direct_item_read_threshold);
+        }
+    }
+
+    if (other.has.zerocopy_threshold) {
+        if (other.zerocopy_threshold != zerocopy_threshold) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change zerocopy threshold from %u to %u",
+                  zerocopy_threshold.load(),
+                  other.zerocopy_threshold.load());
+            setZerocopyThreshold(other.zerocopy_threshold);
+        }
+    }
+
+    if (other.has.ssl_ktls) {
+        if (other.ssl_ktls != ssl_ktls) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "%s kernel TLS offload for new SSL connections",
+                  other.ssl_ktls.load() ? "Enable" : "Disable");
+            setSslKtlsEnabled(other.ssl_ktls.load());
+        }
+    }
+
+    if (other.has.worker_busy_poll_usec) {
+        if (other.worker_busy_poll_usec != worker_busy_poll_usec) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change worker busy poll window from %u to %u usec",
+                  worker_busy_poll_usec.load(),
+                  other.worker_busy_poll_usec.load());
+            setWorkerBusyPollUsec(other.worker_busy_poll_usec);
+        }
+    }
+
+    if (other.has.phase_timings) {
+        if (other.phase_timings != phase_timings) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "%s per-phase command timings",
+                  other.phase_timings.load() ? "Enable" : "Disable");
+            setPhaseTimingsEnabled(other.phase_timings.load());
+        }
+    }
+
+    if (other.has.trace_sample_rate) {
+        if (other.trace_sample_rate != trace_sample_rate) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change trace sample rate from %u to %u",
+                  trace_sample_rate.load(),
+                  other.trace_sample_rate.load());
+            setTraceSampleRate(other.trace_sample_rate);
+        }
+    }
+
+    if (other.has.trace_sample_threshold_usec) {
+        if (other.trace_sample_threshold_usec != trace_sample_threshold_usec) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change trace sample threshold from %u to %u usec",
+                  trace_sample_threshold_usec.load(),
+                  other.trace_sample_threshold_usec.load());
+            setTraceSampleThresholdUsec(other.trace_sample_threshold_usec);
+        }
+    }
+
+    if (other.has.hot_key_threshold) {
+        if (other.hot_key_threshold != hot_key_threshold) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change hot key threshold from %u to %u requests/sec",
+                  hot_key_threshold.load(),
+                  other.hot_key_threshold.load());
+            setHotKeyThreshold(other.hot_key_threshold);
+        }
+    }
+
+    if (other.has.hot_key_ttl_ms) {
+        if (other.hot_key_ttl_ms != hot_key_ttl_ms) {
+            logit(EXTENSION_LOG_NOTICE,
+                  "Change hot key ttl from %u to %u ms",
+                  hot_key_ttl_ms.load(),
+                  other.hot_key_ttl_ms.load());
+            setHotKeyTtlMs(other.hot_key_ttl_ms);
+        }
+    }
+
     if (other.has.interfaces) {
         // validate that we haven't changed stuff in the entries
         auto total = interfaces.size();
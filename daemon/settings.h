@@ -1012,6 +1012,281 @@ public:
         notify_changed("collections_prototype");
     }
 
+    /**
+     * Get the minimum size of a value (in bytes) for SET, ADD and REPLACE
+     * before the server reads the value directly into the memory of the
+     * item instead of going through the input buffer.
+     *
+     * @return the threshold in bytes (0 means that the feature is disabled)
+     */
+    size_t getDirectItemReadThreshold() const {
+        return direct_item_read_threshold;
+    }
+
+    /**
+     * Set the minimum size of a value before the server reads the value
+     * directly into the memory of the item.
+     *
+     * @param threshold the new threshold in bytes (0 to disable)
+     */
+    void setDirectItemReadThreshold(size_t threshold) {
+        Settings::direct_item_read_threshold = threshold;
+        has.direct_item_read_threshold = true;
+        notify_changed("direct_item_read_threshold");
+    }
+
+    /**
+     * Get the minimum size of a chunk of item data in a response before
+     * the server tries to send it with MSG_ZEROCOPY
+     *
+     * @return the threshold in bytes (0 means that the feature is disabled)
+     */
+    size_t getZerocopyThreshold() const {
+        return zerocopy_threshold;
+    }
+
+    /**
+     * Set the minimum size of a chunk of item data in a response before
+     * the server tries to send it with MSG_ZEROCOPY
+     *
+     * @param threshold the new threshold in bytes (0 to disable)
+     */
+    void setZerocopyThreshold(size_t threshold) {
+        Settings::zerocopy_threshold = threshold;
+        has.zerocopy_threshold = true;
+        notify_changed("zerocopy_threshold");
+    }
+
+    /**
+     * Should SSL connections try to hand the session over to kernel TLS
+     * once the handshake completes?
+     *
+     * @return true if kTLS should be used for new SSL connections
+     */
+    bool isSslKtlsEnabled() const {
+        return ssl_ktls.load();
+    }
+
+    /**
+     * Set if SSL connections should try to use kernel TLS
+     *
+     * @param enable true if new SSL connections should try to use kTLS
+     */
+    void setSslKtlsEnabled(bool enable) {
+        Settings::ssl_ktls.store(enable);
+        has.ssl_ktls = true;
+        notify_changed("ssl_ktls");
+    }
+
+    /**
+     * Get the number of microseconds a worker thread should keep polling
+     * for new events before it blocks waiting for them.
+     *
+     * @return the busy poll window in usec (0 means that the worker
+     *         threads block immediately)
+     */
+    size_t getWorkerBusyPollUsec() const {
+        return worker_busy_poll_usec;
+    }
+
+    /**
+     * Set the number of microseconds a worker thread should keep polling
+     * for new events before it blocks waiting for them.
+     *
+     * @param usec the new busy poll window (0 to disable)
+     */
+    void setWorkerBusyPollUsec(size_t usec) {
+        Settings::worker_busy_poll_usec = usec;
+        has.worker_busy_poll_usec = true;
+        notify_changed("worker_busy_poll_usec");
+    }
+
+    /**
+     * Get the list of CPUs the worker threads should be bound to. Worker
+     * thread n is bound to the CPU at index (n % size)
+     *
+     * @return the list of CPU ids (empty if the threads may run anywhere)
+     */
+    const std::vector<int>& getWorkerCpuAffinity() const {
+        return worker_cpu_affinity;
+    }
+
+    /**
+     * Set the list of CPUs the worker threads should be bound to
+     *
+     * @param cpus the CPU ids to use
+     */
+    void setWorkerCpuAffinity(const std::vector<int>& cpus) {
+        Settings::worker_cpu_affinity = cpus;
+        has.worker_cpu_affinity = true;
+        notify_changed("worker_cpu_affinity");
+    }
+
+    /**
+     * Should we record the time spent in each phase of a command?
+     *
+     * @return true if per-phase timings should be collected
+     */
+    bool isPhaseTimingsEnabled() const {
+        return phase_timings.load();
+    }
+
+    /**
+     * Set if we should record the time spent in each phase of a command
+     *
+     * @param enable true to collect per-phase timings
+     */
+    void setPhaseTimingsEnabled(bool enable) {
+        Settings::phase_timings.store(enable);
+        has.phase_timings = true;
+        notify_changed("phase_timings");
+    }
+
+    /**
+     * Get the sampling rate for the request tracing. 1 in N commands
+     * (per opcode) is traced.
+     *
+     * @return N (0 means that sampled tracing is disabled)
+     */
+    size_t getTraceSampleRate() const {
+        return trace_sample_rate;
+    }
+
+    /**
+     * Set the sampling rate for the request tracing
+     *
+     * @param rate trace 1 in rate commands (0 to disable)
+     */
+    void setTraceSampleRate(size_t rate) {
+        Settings::trace_sample_rate = rate;
+        has.trace_sample_rate = true;
+        notify_changed("trace_sample_rate");
+    }
+
+    /**
+     * Get the minimum duration (in usec) of a sampled request before we
+     * keep its trace
+     */
+    size_t getTraceSampleThresholdUsec() const {
+        return trace_sample_threshold_usec;
+    }
+
+    /**
+     * Set the minimum duration (in usec) of a sampled request before we
+     * keep its trace
+     *
+     * @param usec the new threshold
+     */
+    void setTraceSampleThresholdUsec(size_t usec) {
+        Settings::trace_sample_threshold_usec = usec;
+        has.trace_sample_threshold_usec = true;
+        notify_changed("trace_sample_threshold_usec");
+    }
+
+    /**
+     * Get the number of requests per second (to the key in its bucket)
+     * before a key is considered hot
+     *
+     * @return the threshold (0 means that hot key hints is disabled)
+     */
+    size_t getHotKeyThreshold() const {
+        return hot_key_threshold;
+    }
+
+    /**
+     * Set the number of requests per second (to the key in its bucket)
+     * before a key is considered hot
+     *
+     * @param threshold the new threshold (0 to disable)
+     */
+    void setHotKeyThreshold(size_t threshold) {
+        Settings::hot_key_threshold = threshold;
+        has.hot_key_threshold = true;
+        notify_changed("hot_key_threshold");
+    }
+
+    /**
+     * Get the number of milliseconds a client may cache a hot key
+     */
+    size_t getHotKeyTtlMs() const {
+        return hot_key_ttl_ms;
+    }
+
+    /**
+     * Set the number of milliseconds a client may cache a hot key
+     *
+     * @param ms the new ttl
+     */
+    void setHotKeyTtlMs(size_t ms) {
+        Settings::hot_key_ttl_ms = ms;
+        has.hot_key_ttl_ms = true;
+        notify_changed("hot_key_ttl_ms");
+    }
+
+    /**
+     * Get the port (on the loopback interface) the metrics exporter
+     * listens on
+     *
+     * @return the port number (0 means that the exporter is disabled)
+     */
+    in_port_t getPrometheusPort() const {
+        return prometheus_port;
+    }
+
+    /**
+     * Set the port (on the loopback interface) the metrics exporter
+     * should listen on
+     *
+     * @param port the port number (0 to disable the exporter)
+     */
+    void setPrometheusPort(in_port_t port) {
+        Settings::prometheus_port = port;
+        has.prometheus_port = true;
+        notify_changed("prometheus_port");
+    }
+
+    /**
+     * Get the maximum number of bytes each bucket may use to cache the
+     * location of the paths looked up by sub-document commands
+     *
+     * @return the size (0 means that the cache is disabled)
+     */
+    size_t getSubdocLookupCacheSize() const {
+        return subdoc_lookup_cache_size;
+    }
+
+    /**
+     * Set the maximum number of bytes each bucket may use to cache the
+     * location of the paths looked up by sub-document commands
+     *
+     * @param size the new size (0 to disable the cache)
+     */
+    void setSubdocLookupCacheSize(size_t size) {
+        Settings::subdoc_lookup_cache_size = size;
+        has.subdoc_lookup_cache_size = true;
+        notify_changed("subdoc_lookup_cache_size");
+    }
+
+    /**
+     * Get the number of significant bits kept by the command timing
+     * histograms (see TimingHistogram)
+     */
+    uint8_t getTimingsPrecision() const {
+        return timings_precision;
+    }
+
+    /**
+     * Set the number of significant bits the command timing histograms
+     * should keep
+     *
+     * @param precision the new precision (1 - TimingHistogram::MaxPrecision)
+     */
+    void setTimingsPrecision(uint8_t precision) {
+        Settings::timings_precision = precision;
+        has.timings_precision = true;
+        notify_changed("timings_precision");
+    }
+
 protected:
 
     /**
@@ -1176,6 +1451,77 @@ protected:
      */
     std::atomic_bool collections_prototype;
 
+    /**
+     * Values bigger than this is read directly into the allocated item
+     * rather than the connections input buffer
+     */
+    Couchbase::RelaxedAtomic<size_t> direct_item_read_threshold;
+
+    /**
+     * Item data bigger than this is sent with MSG_ZEROCOPY (if supported
+     * by the platform)
+     */
+    Couchbase::RelaxedAtomic<size_t> zerocopy_threshold;
+
+    /**
+     * Should new SSL connections try to use kernel TLS offload
+     */
+    std::atomic_bool ssl_ktls;
+
+    /**
+     * The number of microseconds the worker threads poll for new events
+     * before blocking
+     */
+    Couchbase::RelaxedAtomic<size_t> worker_busy_poll_usec;
+
+    /**
+     * The CPUs to bind the worker threads to
+     */
+    std::vector<int> worker_cpu_affinity;
+
+    /**
+     * Should we collect per-phase command timings
+     */
+    std::atomic_bool phase_timings;
+
+    /**
+     * Trace 1 in N commands (0 to disable)
+     */
+    Couchbase::RelaxedAtomic<size_t> trace_sample_rate;
+
+    /**
+     * Only keep the traces for sampled commands which took longer than
+     * this (in usec)
+     */
+    Couchbase::RelaxedAtomic<size_t> trace_sample_threshold_usec;
+
+    /**
+     * The number of requests per second (to the key in its bucket)
+     * before a key is considered hot (0 to disable)
+     */
+    Couchbase::RelaxedAtomic<size_t> hot_key_threshold;
+
+    /**
+     * The number of milliseconds clients may cache a hot key
+     */
+    Couchbase::RelaxedAtomic<size_t> hot_key_ttl_ms;
+
+    /**
+     * The port the metrics exporter listens on (0 if disabled)
+     */
+    in_port_t prometheus_port;
+
+    /**
+     * The number of bytes each bucket may use for the sub-document
+     * lookup cache (0 if disabled)
+     */
+    size_t subdoc_lookup_cache_size;
+
+    /**
+     * The precision of the command timing histograms
+     */
+    uint8_t timings_precision;
+
 public:
     /**
      * Flags for each of the above config options, indicating if they were
@@ -1217,6 +1563,19 @@ public:
         bool error_maps;
         bool xattr_enabled;
         bool collections_prototype;
+        bool direct_item_read_threshold;
+        bool zerocopy_threshold;
+        bool ssl_ktls;
+        bool worker_busy_poll_usec;
+        bool worker_cpu_affinity;
+        bool phase_timings;
+        bool trace_sample_rate;
+        bool trace_sample_threshold_usec;
+        bool hot_key_threshold;
+        bool hot_key_ttl_ms;
+        bool prometheus_port;
+        bool subdoc_lookup_cache_size;
+        bool timings_precision;
     } has;
 
 protected:
@@ -64,11 +64,16 @@ public:
     /**
      * Enable SSL for this connection.
      *
+     * If kernel TLS is enabled in the settings OpenSSL operates directly
+     * on the socket (instead of through the BIO pair) so that it may
+     * hand the session over to the kernel once the handshake completes.
+     *
      * @param cert the certificate file to use
      * @param pkey the private key file to use
+     * @param sfd the socket used by the connection
      * @return true if success, false if we failed to enable SSL
      */
-    bool enable(const std::string& cert, const std::string& pkey);
+    bool enable(const std::string& cert, const std::string& pkey, SOCKET sfd);
 
     /**
      * Disable SSL for this connection
@@ -99,6 +104,28 @@ public:
         return (out.total > 0);
     }
 
+    /**
+     * Check if the kernel took over the encryption of the session
+     * after the handshake. Must be called once the handshake completes.
+     */
+    void updateKtlsState();
+
+    /**
+     * Is the kernel encrypting the data we send? If so the caller may
+     * write the plain data directly to the socket.
+     */
+    bool isKtlsSend() const {
+        return ktls.send;
+    }
+
+    /**
+     * Is the kernel decrypting the data we receive? If so the caller may
+     * read the plain data directly from the socket.
+     */
+    bool isKtlsRecv() const {
+        return ktls.recv;
+    }
+
     /**
      * Dump the list of available ciphers to the log
      * @param id the connection id. Its only used in the
@@ -142,6 +169,13 @@ protected:
         size_t current;
     } in, out;
 
+    // The state of the kernel TLS offload (only possible when OpenSSL
+    // operates directly on the socket, in which case network is nullptr)
+    struct {
+        bool send = false;
+        bool recv = false;
+    } ktls;
+
     // Total number of bytes received on the network
     size_t totalRecv = 0;
     // Total number of bytes sent to the network
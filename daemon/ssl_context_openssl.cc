@@ -45,7 +45,9 @@ int SslContext::peek(void* buf, int num) {
     return SSL_peek(client, buf, num);
 }
 
-bool SslContext::enable(const std::string& cert, const std::string& pkey) {
+bool SslContext::enable(const std::string& cert,
+                        const std::string& pkey,
+                        SOCKET sfd) {
     ctx = SSL_CTX_new(SSLv23_server_method());
     set_ssl_ctx_protocol_mask(ctx);
 
@@ -85,6 +87,27 @@ bool SslContext::enable(const std::string& cert, const std::string& pkey) {
     error = false;
     client = NULL;
 
+#ifdef HAVE_KTLS
+    if (settings.isSslKtlsEnabled()) {
+        // OpenSSL can only set up kTLS when it owns the socket BIO. The
+        // drainBio methods are no-ops in this mode as OpenSSL reads and
+        // writes the socket itself.
+        // Report a plain EOF from the client as a normal shutdown like
+        // we do when the BIO pair is used
+        SSL_CTX_set_options(ctx,
+                            SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF);
+        client = SSL_new(ctx);
+        SSL_set_mode(client, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        if (SSL_set_fd(client, int(sfd)) != 1) {
+            LOG_WARNING(nullptr, "Failed to attach socket to SSL context");
+            return false;
+        }
+        return true;
+    }
+#else
+    (void)sfd;
+#endif
+
     try {
         in.buffer.resize(settings.getBioDrainBufferSize());
         out.buffer.resize(settings.getBioDrainBufferSize());
@@ -133,10 +156,24 @@ void SslContext::disable() {
     enabled = false;
 }
 
+void SslContext::updateKtlsState() {
+#ifdef HAVE_KTLS
+    if (network == nullptr && client != nullptr) {
+        ktls.send = BIO_get_ktls_send(SSL_get_wbio(client)) == 1;
+        ktls.recv = BIO_get_ktls_recv(SSL_get_rbio(client)) == 1;
+    }
+#endif
+}
+
 void SslContext::drainBioRecvPipe(SOCKET sfd) {
     int n;
     bool stop = false;
 
+    if (network == nullptr) {
+        // OpenSSL reads directly from the socket
+        return;
+    }
+
     do {
         if (in.current < in.total) {
             n = BIO_write(network,
@@ -181,6 +218,11 @@ void SslContext::drainBioSendPipe(SOCKET sfd) {
     int n;
     bool stop = false;
 
+    if (network == nullptr) {
+        // OpenSSL writes directly to the socket
+        return;
+    }
+
     do {
         if (out.current < out.total) {
             n = send(sfd,
@@ -233,6 +275,8 @@ cJSON* SslContext::toJSON() const {
     if (enabled) {
         cJSON_AddBoolToObject(obj, "connected", connected);
         cJSON_AddBoolToObject(obj, "error", error);
+        cJSON_AddBoolToObject(obj, "ktls_send", ktls.send);
+        cJSON_AddBoolToObject(obj, "ktls_recv", ktls.recv);
         cJSON_AddNumberToObject(obj, "total_recv", totalRecv);
         cJSON_AddNumberToObject(obj, "total_send", totalSend);
         cJSON_AddNumberToObject(obj, "input_buff_total", in.total);
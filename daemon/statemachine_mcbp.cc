@@ -66,6 +66,8 @@ void McbpStateMachine::setCurrentTask(McbpConnection& connection, TaskFunction t
             mcbp_collect_timings(&connection);
             connection.setStart(0);
         }
+        connection.getCookieObject().getPhaseTracker().enter(
+                CommandPhase::Write);
         MEMCACHED_PROCESS_COMMAND_END(connection.getId(),
                                       connection.write.buf,
                                       connection.write.bytes);
@@ -125,6 +127,8 @@ static void reset_cmd_handler(McbpConnection *c) {
         bucket_release_item(c, c->getItem());
         c->setItem(nullptr);
     }
+    c->setItemValueBytes(0);
+    c->setItemPacket(nullptr);
 
     c->getCookieObject().reset();
     c->resetCommandContext();
@@ -217,11 +221,13 @@ bool conn_waiting(McbpConnection *c) {
         return true;
     }
 
-    if (!c->updateEvent(EV_READ | EV_PERSIST)) {
+    if (!c->updateEvent(c->getWaitingEvent() | EV_PERSIST)) {
         LOG_WARNING(c, "%u: conn_waiting - Unable to update libevent "
-                    "settings with (EV_READ | EV_PERSIST), closing connection "
+                    "settings with (%s | EV_PERSIST), closing connection "
                     "(%p) %s",
-                    c->getId(), c->getCookie(), c->getDescription().c_str());
+                    c->getId(),
+                    c->getWaitingEvent() == EV_READ ? "EV_READ" : "EV_WRITE",
+                    c->getCookie(), c->getDescription().c_str());
         c->setState(conn_closing);
         return true;
     }
@@ -329,6 +335,8 @@ bool conn_nread(McbpConnection *c) {
         bool block = false;
         mcbp_complete_nread(c);
         if (c->isEwouldblock()) {
+            c->getCookieObject().getPhaseTracker().enter(
+                    CommandPhase::EWouldBlock);
             c->unregisterEvent();
             block = true;
         }
@@ -410,6 +418,7 @@ bool conn_mwrite(McbpConnection *c) {
 
     switch (c->transmit()) {
     case McbpConnection::TransmitResult::Complete:
+        mcbp_collect_phase_timings(c);
 
         c->releaseTempAlloc();
         if (c->getState() == conn_mwrite) {
@@ -59,6 +59,11 @@ struct thread_stats {
         bytes_subdoc_lookup_extracted = 0;
         bytes_subdoc_mutation_total = 0;
         bytes_subdoc_mutation_inserted = 0;
+        bytes_subdoc_inflated = 0;
+        bytes_subdoc_deflated = 0;
+        subdoc_cas_conflicts = 0;
+        subdoc_retries = 0;
+        subdoc_engine_updates = 0;
 
         rbufs_allocated = 0;
         rbufs_loaned = 0;
@@ -68,6 +73,12 @@ struct thread_stats {
 
         iovused_high_watermark = 0;
         msgused_high_watermark = 0;
+
+        zerocopy_sends = 0;
+        zerocopy_copied = 0;
+        zerocopy_fallbacks = 0;
+
+        hot_key_hints = 0;
     }
 
     thread_stats & operator += (const thread_stats &other) {
@@ -100,6 +111,11 @@ struct thread_stats {
         bytes_subdoc_lookup_extracted += other.bytes_subdoc_lookup_extracted;
         bytes_subdoc_mutation_total += other.bytes_subdoc_mutation_total;
         bytes_subdoc_mutation_inserted += other.bytes_subdoc_mutation_inserted;
+        bytes_subdoc_inflated += other.bytes_subdoc_inflated;
+        bytes_subdoc_deflated += other.bytes_subdoc_deflated;
+        subdoc_cas_conflicts += other.subdoc_cas_conflicts;
+        subdoc_retries += other.subdoc_retries;
+        subdoc_engine_updates += other.subdoc_engine_updates;
 
         rbufs_allocated += other.rbufs_allocated;
         rbufs_loaned += other.rbufs_loaned;
@@ -110,6 +126,12 @@ struct thread_stats {
         iovused_high_watermark.setIfGreater(other.iovused_high_watermark);
         msgused_high_watermark.setIfGreater(other.msgused_high_watermark);
 
+        zerocopy_sends += other.zerocopy_sends;
+        zerocopy_copied += other.zerocopy_copied;
+        zerocopy_fallbacks += other.zerocopy_fallbacks;
+
+        hot_key_hints += other.hot_key_hints;
+
         return *this;
     }
 
@@ -162,6 +184,21 @@ struct thread_stats {
     /* # of bytes inserted during a subdoc mutation operation (which were
        received from the client). */
     Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_mutation_inserted;
+    /* # of (uncompressed) bytes of Snappy compressed documents subdoc
+       operations had to inflate. Compare with 'bytes_subdoc_lookup_total'
+       and 'bytes_subdoc_mutation_total' */
+    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_inflated;
+    /* # of (uncompressed) bytes of new documents compressed by subdoc
+       mutations before they were stored */
+    Couchbase::RelaxedAtomic<uint64_t> bytes_subdoc_deflated;
+    /* # of times a subdoc mutation without a CAS failed to store the new
+       document because someone else updated it after we fetched it */
+    Couchbase::RelaxedAtomic<uint64_t> subdoc_cas_conflicts;
+    /* # of times a subdoc mutation was executed again after a CAS conflict */
+    Couchbase::RelaxedAtomic<uint64_t> subdoc_retries;
+    /* # of subdoc mutations which let the engine fetch and store the
+       document in a single call (see ENGINE_HANDLE_V1::update) */
+    Couchbase::RelaxedAtomic<uint64_t> subdoc_engine_updates;
 
     /* # of read buffers allocated. */
     Couchbase::RelaxedAtomic<uint64_t> rbufs_allocated;
@@ -183,6 +220,17 @@ struct thread_stats {
     Couchbase::RelaxedAtomic<int> iovused_high_watermark;
     /* High value Connection->msgused has got to */
     Couchbase::RelaxedAtomic<int> msgused_high_watermark;
+
+    /* # of sendmsg calls which used MSG_ZEROCOPY */
+    Couchbase::RelaxedAtomic<uint64_t> zerocopy_sends;
+    /* # of MSG_ZEROCOPY sends where the kernel had to copy the data anyway */
+    Couchbase::RelaxedAtomic<uint64_t> zerocopy_copied;
+    /* # of times we wanted to use MSG_ZEROCOPY but had to fall back to a
+       normal send (not supported by the socket, out of optmem etc) */
+    Couchbase::RelaxedAtomic<uint64_t> zerocopy_fallbacks;
+
+    /* # of GET responses which told the client the key is hot */
+    Couchbase::RelaxedAtomic<uint64_t> hot_key_hints;
 };
 
 /**
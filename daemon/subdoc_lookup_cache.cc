@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "subdoc_lookup_cache.h"
+
+#include <cstring>
+#include <functional>
+
+/**
+ * The (approximate) number of bytes used for each document in addition
+ * to the key and the paths: the entry in the list and in the index
+ */
+static const size_t DocumentOverhead = 128;
+
+static bool is_path(const std::string& entry, cb::const_char_buffer path) {
+    return entry.size() == path.size() &&
+           std::memcmp(entry.data(), path.data(), path.size()) == 0;
+}
+
+/**
+ * The key of a document in the index: the namespace followed by the key
+ */
+static std::string make_key(const DocKey& key) {
+    std::string ret;
+    ret.reserve(key.size() + 1);
+    ret.push_back(char(key.getDocNamespace()));
+    ret.append(reinterpret_cast<const char*>(key.data()), key.size());
+    return ret;
+}
+
+SubdocLookupCache::SubdocLookupCache(size_t max_size, size_t nshards)
+    : shard_size(max_size / nshards) {
+    for (size_t ii = 0; ii < nshards; ++ii) {
+        shards.emplace_back(new Shard);
+    }
+}
+
+SubdocLookupCache::Shard& SubdocLookupCache::getShard(const std::string& key) {
+    return *shards[std::hash<std::string>()(key) % shards.size()];
+}
+
+bool SubdocLookupCache::lookup(const DocKey& key,
+                               uint64_t cas,
+                               cb::const_char_buffer path,
+                               Location& location) {
+    const std::string k = make_key(key);
+    auto& shard = getShard(k);
+
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto iter = shard.index.find(k);
+    if (iter != shard.index.end() && iter->second->cas == cas) {
+        for (const auto& entry : iter->second->paths) {
+            if (is_path(entry.path, path)) {
+                location = entry.location;
+                shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+                hits++;
+                return true;
+            }
+        }
+    }
+
+    misses++;
+    return false;
+}
+
+void SubdocLookupCache::insert(const DocKey& key,
+                               uint64_t cas,
+                               cb::const_char_buffer path,
+                               const Location& location) {
+    const std::string k = make_key(key);
+    auto& shard = getShard(k);
+
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto iter = shard.index.find(k);
+    if (iter == shard.index.end()) {
+        shard.lru.push_front({k, cas, {}, DocumentOverhead + k.size() * 2});
+        iter = shard.index.emplace(k, shard.lru.begin()).first;
+        shard.size += shard.lru.front().size;
+    } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    }
+
+    auto& document = *iter->second;
+    if (document.cas != cas) {
+        // A different version of the document; none of the locations
+        // we've got is valid for it
+        for (const auto& entry : document.paths) {
+            document.size -= sizeof(PathEntry) + entry.path.size();
+            shard.size -= sizeof(PathEntry) + entry.path.size();
+        }
+        document.paths.clear();
+        document.cas = cas;
+    }
+
+    for (auto& entry : document.paths) {
+        if (is_path(entry.path, path)) {
+            entry.location = location;
+            return;
+        }
+    }
+
+    if (document.paths.size() < MaxPathsPerDocument) {
+        document.paths.push_back({{path.data(), path.size()}, location});
+        document.size += sizeof(PathEntry) + path.size();
+        shard.size += sizeof(PathEntry) + path.size();
+    }
+
+    // Evict the least recently used documents (but never the one we
+    // just inserted)
+    while (shard.size > shard_size && shard.lru.size() > 1) {
+        auto& victim = shard.lru.back();
+        shard.size -= victim.size;
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+        evictions++;
+    }
+}
+
+size_t SubdocLookupCache::getMemoryUsage() const {
+    size_t ret = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->mutex);
+        ret += shard->size;
+    }
+    return ret;
+}
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/dockey.h>
+#include <memcached/protocol_binary.h>
+#include <platform/sized_buffer.h>
+#include <relaxed_atomic.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The SubdocLookupCache remembers where the paths recently looked up by
+ * the subdoc lookup commands are located in a document, so that repeated
+ * lookups of the same paths in a document which hasn't changed can skip
+ * parsing the document.
+ *
+ * The entries are keyed by the document key (including its namespace)
+ * and tagged with the CAS of the document they were generated from. A
+ * mutation of the document changes the CAS, which makes the old locations
+ * unreachable (and the entry is reset the next time a path is inserted).
+ * The memory used is bounded by evicting the least recently used
+ * documents.
+ */
+class SubdocLookupCache {
+public:
+    /**
+     * The result of looking up a path: the status, and the location of
+     * the value in the document (if the status is success)
+     */
+    struct Location {
+        protocol_binary_response_status status;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    /**
+     * @param max_size the (approximate) maximum number of bytes to use
+     * @param nshards the number of independent shards (each with its own
+     *                lock and size budget)
+     */
+    explicit SubdocLookupCache(size_t max_size, size_t nshards = 16);
+
+    /**
+     * Look up the location of a path in a given version of a document
+     *
+     * @return true (and location is updated) if the path was found
+     */
+    bool lookup(const DocKey& key,
+                uint64_t cas,
+                cb::const_char_buffer path,
+                Location& location);
+
+    /**
+     * Insert the location of a path in a given version of a document
+     */
+    void insert(const DocKey& key,
+                uint64_t cas,
+                cb::const_char_buffer path,
+                const Location& location);
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+
+    uint64_t getEvictions() const {
+        return evictions;
+    }
+
+    /// Get the (approximate) number of bytes in use
+    size_t getMemoryUsage() const;
+
+    /// The maximum number of paths cached per document
+    static const size_t MaxPathsPerDocument = 32;
+
+protected:
+    struct PathEntry {
+        std::string path;
+        Location location;
+    };
+
+    struct DocumentEntry {
+        std::string key;
+        uint64_t cas;
+        std::vector<PathEntry> paths;
+        size_t size;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        /// The documents, most recently used first
+        std::list<DocumentEntry> lru;
+        std::unordered_map<std::string, std::list<DocumentEntry>::iterator>
+                index;
+        size_t size = 0;
+    };
+
+    Shard& getShard(const std::string& key);
+
+    const size_t shard_size;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    Couchbase::RelaxedAtomic<uint64_t> hits;
+    Couchbase::RelaxedAtomic<uint64_t> misses;
+    Couchbase::RelaxedAtomic<uint64_t> evictions;
+};
@@ -17,6 +17,7 @@
 
 #include "subdocument.h"
 
+#include "buckets.h"
 #include "connections.h"
 #include "debug_helpers.h"
 #include "mcbp.h"
@@ -36,6 +37,10 @@
 #include <platform/histogram.h>
 #include <xattr/blob.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 static const std::array<SubdocCmdContext::Phase, 2> phases{{SubdocCmdContext::Phase::XATTR,
                                                             SubdocCmdContext::Phase::Body}};
 
@@ -58,8 +63,28 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
                                        ENGINE_ERROR_CODE ret,
                                        const char* key, size_t keylen,
                                        uint16_t vbucket, uint32_t expiration);
+static bool subdoc_may_update_in_engine(SubdocCmdContext& context);
+static ENGINE_ERROR_CODE subdoc_update_in_engine(SubdocCmdContext& context,
+                                                 const char* key,
+                                                 size_t keylen,
+                                                 uint16_t vbucket,
+                                                 uint32_t expiration);
 static void subdoc_response(SubdocCmdContext& context);
 
+/**
+ * Report that the command failed with the given status. The keys of a
+ * SUBDOC_MULTI_KEY command record the status (to be returned as the status
+ * of the key), all other commands send it to the client.
+ */
+static void subdoc_send_error(SubdocCmdContext& context,
+                              protocol_binary_response_status status) {
+    if (context.batch) {
+        context.batch_status = status;
+    } else {
+        mcbp_write_packet(&context.connection, status);
+    }
+}
+
 // Debug - print details of the specified subdocument command.
 static void subdoc_print_command(Connection& c, protocol_binary_command cmd,
                                  const char* key, const uint16_t keylen,
@@ -322,6 +347,41 @@ uint32_t subdoc_decode_expiration(const protocol_binary_request_header* header,
     }
 }
 
+/**
+ * Update the statistics (and topkeys) for a successful command on the
+ * given key.
+ */
+static void subdoc_update_stats(McbpConnection& c, SubdocCmdContext& context,
+                                const char* key, size_t keylen) {
+    // Treat all mutations as 'cmd_set', all accesses as 'cmd_get',
+    // in addition to specific subdoc counters. (This is mainly so we
+    // see subdoc commands in the GUI, which used cmd_set / cmd_get).
+    auto* thread_stats = get_thread_stats(&c);
+    if (context.traits.is_mutator) {
+        thread_stats->cmd_subdoc_mutation++;
+        thread_stats->bytes_subdoc_mutation_total += context.out_doc_len;
+        thread_stats->bytes_subdoc_mutation_inserted +=
+                context.getOperationValueBytesTotal();
+
+        SLAB_INCR(&c, cmd_set);
+    } else {
+        thread_stats->cmd_subdoc_lookup++;
+        thread_stats->bytes_subdoc_lookup_total += context.in_doc.len;
+        thread_stats->bytes_subdoc_lookup_extracted += context.response_val_len;
+
+        STATS_HIT(&c, get);
+    }
+    if (context.traits.is_mutator) {
+        update_topkeys(DocKey(reinterpret_cast<const uint8_t*>(key),
+                              keylen, c.getDocNamespace()),
+                       &c, 0, context.getOperationValueBytesTotal());
+    } else {
+        update_topkeys(DocKey(reinterpret_cast<const uint8_t*>(key),
+                              keylen, c.getDocNamespace()),
+                       &c, context.response_val_len);
+    }
+}
+
 /* Main function which handles execution of all sub-document
  * commands: fetches, operates on, updates and finally responds to the client.
  *
@@ -372,6 +432,11 @@ static void subdoc_executor(McbpConnection& c, const void *packet,
     // possible bugs in our code ;)
     const int MAXIMUM_ATTEMPTS = 100;
 
+    // Once we've lost a race with another client we let the engine fetch
+    // and update the document in a single call (if it can), as a document
+    // which is updated concurrently is likely to need more retries.
+    bool update_in_engine = false;
+
     int attempts = 0;
     do {
         attempts++;
@@ -391,25 +456,48 @@ static void subdoc_executor(McbpConnection& c, const void *packet,
             c.setCommandContext(context);
         }
 
-        // 1. Attempt to fetch from the engine the document to operate on. Only
-        // continue if it returned true, otherwise return from this function
-        // (which may result in it being called again later in the EWOULDBLOCK
-        // case).
-        if (!subdoc_fetch(c, *context, ret, key, keylen, vbucket, cas)) {
-            return;
-        }
+        if (update_in_engine) {
+            // 1-3. Let the engine fetch the document, and update it with
+            // the result of the operation.
+            ret = subdoc_update_in_engine(
+                    *context, key, keylen, vbucket, expiration);
+            if (ret == ENGINE_ENOTSUP) {
+                // Not possible for this document; do it ourselves.
+                update_in_engine = false;
+                ret = ENGINE_SUCCESS;
+                c.resetCommandContext();
+                continue;
+            }
+        } else {
+            // 1. Attempt to fetch from the engine the document to operate on.
+            // Only continue if it returned true, otherwise return from this
+            // function (which may result in it being called again later in
+            // the EWOULDBLOCK case).
+            if (!subdoc_fetch(c, *context, ret, key, keylen, vbucket, cas)) {
+                return;
+            }
 
-        // 2. Perform the operation specified by CMD. Again, return if it fails.
-        if (!subdoc_operate(*context)) {
-            return;
+            // 2. Perform the operation specified by CMD. Again, return if it
+            // fails.
+            if (!subdoc_operate(*context)) {
+                return;
+            }
+
+            // 3. Update the document in the engine (mutations only).
+            ret = subdoc_update(
+                    *context, ret, key, keylen, vbucket, expiration);
         }
 
-        // 3. Update the document in the engine (mutations only).
-        ret = subdoc_update(*context, ret, key, keylen, vbucket, expiration);
         if (ret == ENGINE_KEY_EEXISTS) {
             if (auto_retry) {
                 // Retry the operation. Reset the command context and related
                 // state, so start from the beginning again.
+                auto* thread_stats = get_thread_stats(&c);
+                thread_stats->subdoc_cas_conflicts++;
+                if (attempts < MAXIMUM_ATTEMPTS) {
+                    thread_stats->subdoc_retries++;
+                }
+                update_in_engine = subdoc_may_update_in_engine(*context);
                 ret = ENGINE_SUCCESS;
                 if (c.getItem() != nullptr) {
                     bucket_release_item(&c, c.getItem());
@@ -429,27 +517,7 @@ static void subdoc_executor(McbpConnection& c, const void *packet,
 
         // 4. Form a response and send it back to the client.
         subdoc_response(*context);
-
-        // Update stats. Treat all mutations as 'cmd_set', all accesses as 'cmd_get',
-        // in addition to specific subdoc counters. (This is mainly so we
-        // see subdoc commands in the GUI, which used cmd_set / cmd_get).
-        auto* thread_stats = get_thread_stats(&c);
-        if (context->traits.is_mutator) {
-            thread_stats->cmd_subdoc_mutation++;
-            thread_stats->bytes_subdoc_mutation_total += context->out_doc_len;
-            thread_stats->bytes_subdoc_mutation_inserted +=
-                    context->getOperationValueBytesTotal();
-
-            SLAB_INCR(&c, cmd_set);
-        } else {
-            thread_stats->cmd_subdoc_lookup++;
-            thread_stats->bytes_subdoc_lookup_total += context->in_doc.len;
-            thread_stats->bytes_subdoc_lookup_extracted += context->response_val_len;
-
-            STATS_HIT(&c, get);
-        }
-        update_topkeys(DocKey(reinterpret_cast<const uint8_t*>(key),
-                              keylen, c.getDocNamespace()), &c);
+        subdoc_update_stats(c, *context, key, keylen);
         return;
     } while (auto_retry && attempts < MAXIMUM_ATTEMPTS);
 
@@ -492,8 +560,8 @@ static bool subdoc_fetch(McbpConnection& c, SubdocCmdContext& ctx,
             if (ctx.traits.is_mutator &&
                 ctx.mutationSemantics == MutationSemantics::Add) {
                 bucket_release_item(&c, initial_item);
-                mcbp_write_packet(
-                        &c,
+                subdoc_send_error(
+                        ctx,
                         engine_error_2_mcbp_protocol_error(ENGINE_KEY_EEXISTS));
                 return false;
             }
@@ -506,7 +574,7 @@ static bool subdoc_fetch(McbpConnection& c, SubdocCmdContext& ctx,
         case ENGINE_KEY_ENOENT:
             if (ctx.traits.is_mutator &&
                 ctx.mutationSemantics == MutationSemantics::Replace) {
-                mcbp_write_packet(&c, engine_error_2_mcbp_protocol_error(ret));
+                subdoc_send_error(ctx, engine_error_2_mcbp_protocol_error(ret));
                 return false;
             }
 
@@ -520,7 +588,7 @@ static bool subdoc_fetch(McbpConnection& c, SubdocCmdContext& ctx,
             } else if (ctx.jroot_type == JSONSL_T_OBJECT) {
                 ctx.in_doc = {"{}", 2};
             } else {
-                mcbp_write_packet(&c, engine_error_2_mcbp_protocol_error(ret));
+                subdoc_send_error(ctx, engine_error_2_mcbp_protocol_error(ret));
                 return false;
             }
 
@@ -538,7 +606,7 @@ static bool subdoc_fetch(McbpConnection& c, SubdocCmdContext& ctx,
             return false;
 
         default:
-            mcbp_write_packet(&c, engine_error_2_mcbp_protocol_error(ret));
+            subdoc_send_error(ctx, engine_error_2_mcbp_protocol_error(ret));
             return false;
         }
     }
@@ -551,7 +619,7 @@ static bool subdoc_fetch(McbpConnection& c, SubdocCmdContext& ctx,
         if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
             // Failed. Note c.item and c.commandContext will both be freed for
             // us as part of preparing for the next command.
-            mcbp_write_packet(&c, status);
+            subdoc_send_error(ctx, status);
             return false;
         }
     }
@@ -642,6 +710,65 @@ subdoc_operate_one_path(SubdocCmdContext& context, SubdocCmdContext::OperationSp
     }
 }
 
+/**
+ * Perform the lookup specified by {spec} to one path in the document body,
+ * using the bucket's lookup cache to avoid parsing the document if we've
+ * already looked up the same path in this version (CAS) of the document.
+ *
+ * Only GET and EXISTS are cached as their result is either a part of the
+ * document or the status alone. A CAS of 0 (not set) or -1 (locked)
+ * doesn't identify a version of the document, so those bypass the cache.
+ */
+static protocol_binary_response_status subdoc_lookup_one_path(
+        SubdocCmdContext& context,
+        SubdocCmdContext::OperationSpec& spec,
+        const cb::const_char_buffer& doc) {
+    auto* cache = context.connection.getBucket().subdoc_lookup_cache;
+    const auto& info = context.getInputItemInfo();
+    if (cache == nullptr || context.traits.is_mutator ||
+        context.getCurrentPhase() != SubdocCmdContext::Phase::Body ||
+        info.cas == 0 || info.cas == -1ull ||
+        (spec.traits.subdocCommand != Subdoc::Command::GET &&
+         spec.traits.subdocCommand != Subdoc::Command::EXISTS)) {
+        return subdoc_operate_one_path(context, spec, doc);
+    }
+
+    const DocKey key{reinterpret_cast<const uint8_t*>(info.key), info.nkey,
+                     context.connection.getDocNamespace()};
+    SubdocLookupCache::Location location;
+    if (cache->lookup(key, info.cas, spec.path, location) &&
+        size_t(location.offset) + location.length <= doc.len) {
+        if (location.status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            spec.result.set_matchloc({doc.buf + location.offset,
+                                      location.length});
+        }
+        return location.status;
+    }
+
+    const auto status = subdoc_operate_one_path(context, spec, doc);
+    switch (status) {
+    case PROTOCOL_BINARY_RESPONSE_SUCCESS: {
+        const auto& match = spec.result.matchloc();
+        if (match.at >= doc.buf &&
+            match.at + match.length <= doc.buf + doc.len) {
+            cache->insert(key, info.cas, spec.path,
+                          {status, uint32_t(match.at - doc.buf),
+                           uint32_t(match.length)});
+        }
+        break;
+    }
+    case PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT:
+    case PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_MISMATCH:
+        cache->insert(key, info.cas, spec.path, {status, 0, 0});
+        break;
+    default:
+        // Don't remember errors which depend on the request (invalid
+        // path etc) or the state of the server
+        break;
+    }
+    return status;
+}
+
 /**
  * Perform the wholedoc (mcbp) operation defined by spec
  */
@@ -671,6 +798,243 @@ static protocol_binary_response_status subdoc_operate_wholedoc(
     }
 }
 
+/**
+ * The part of the input document replaced by a mutation: the bytes
+ * [begin, end) are replaced by the pieces.
+ */
+struct DocumentSplice {
+    size_t begin;
+    size_t end;
+    std::vector<cb::const_char_buffer> pieces;
+};
+
+/**
+ * Describe the result of a mutation as a splice of the input document
+ * (the newdoc iovecs returned by subjson consist of the unmodified
+ * prefix of the document, the new data and the unmodified suffix).
+ */
+static DocumentSplice get_document_splice(const cb::const_char_buffer& doc,
+                                          const Subdoc::Result& result) {
+    DocumentSplice splice;
+    for (const auto& loc : result.newdoc()) {
+        if (loc.length > 0) {
+            splice.pieces.emplace_back(loc.at, loc.length);
+        }
+    }
+
+    auto& pieces = splice.pieces;
+    size_t first = 0;
+    splice.begin = 0;
+    while (first < pieces.size() &&
+           pieces[first].data() == doc.data() + splice.begin &&
+           pieces[first].size() <= doc.size() - splice.begin) {
+        splice.begin += pieces[first].size();
+        ++first;
+    }
+
+    size_t last = pieces.size();
+    splice.end = doc.size();
+    while (last > first &&
+           pieces[last - 1].data() + pieces[last - 1].size() ==
+                   doc.data() + splice.end &&
+           pieces[last - 1].size() <= splice.end - splice.begin) {
+        splice.end -= pieces[last - 1].size();
+        --last;
+    }
+
+    pieces.erase(pieces.begin() + last, pieces.end());
+    pieces.erase(pieces.begin(), pieces.begin() + first);
+    return splice;
+}
+
+/**
+ * Can the mutation be applied to the original document in the same pass
+ * as the other mutations (given that they don't touch the same part of
+ * the document)? Array indexes refer to a position which the other
+ * mutations may move, and ARRAY_ADD_UNIQUE depends on the content of the
+ * entire array.
+ */
+static bool is_position_independent(
+        const SubdocCmdContext::OperationSpec& spec) {
+    if (spec.traits.scope != CommandScope::SubJSON ||
+        spec.traits.mcbpCommand == PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE) {
+        return false;
+    }
+    return std::find(spec.path.buf, spec.path.buf + spec.path.len, '[') ==
+           spec.path.buf + spec.path.len;
+}
+
+/**
+ * The container (dictionary or array) whose members a mutation adds,
+ * removes or modifies, described by the (unescaped) components of its
+ * path. Paths with array indexes are never batched, so we only need to
+ * deal with dictionary keys.
+ */
+struct MutationContainer {
+    std::vector<std::string> path;
+
+    /// May the mutation change the number of members of the container?
+    bool changes_members;
+};
+
+static MutationContainer get_mutation_container(
+        const SubdocCmdContext::OperationSpec& spec) {
+    MutationContainer container;
+    std::string component;
+    bool quoted = false;
+    for (size_t ii = 0; ii < spec.path.len; ++ii) {
+        const char c = spec.path.buf[ii];
+        if (c == '`') {
+            if (quoted && ii + 1 < spec.path.len &&
+                spec.path.buf[ii + 1] == '`') {
+                // Escaped backtick within a quoted key
+                component.push_back(c);
+                ++ii;
+            } else {
+                quoted = !quoted;
+            }
+        } else if (c == '.' && !quoted) {
+            container.path.emplace_back(std::move(component));
+            component.clear();
+        } else {
+            component.push_back(c);
+        }
+    }
+
+    switch (spec.traits.mcbpCommand) {
+    case PROTOCOL_BINARY_CMD_SUBDOC_REPLACE:
+    case PROTOCOL_BINARY_CMD_SUBDOC_COUNTER:
+        container.changes_members = false;
+        break;
+    case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST:
+    case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST:
+        // The path is the array itself
+        container.path.emplace_back(std::move(component));
+        container.changes_members = true;
+        return container;
+    default:
+        // Dictionary add/upsert and delete (we don't know if an upsert
+        // replaces an existing key until it is done)
+        container.changes_members = true;
+    }
+
+    // The path refers to a member of the container
+    return container;
+}
+
+/**
+ * Apply the leading mutations of a multi-mutation which modify
+ * disjoint parts of the document in a single pass: each of them is
+ * run against the original document and the new document is built
+ * with a single copy once we've got all of them (rather than copying the
+ * document after every mutation so that the next one may operate on it).
+ *
+ * We stop at the first mutation which doesn't succeed or which touches
+ * the same part of the document as one of the previous ones (as its
+ * result may depend on them), and the caller applies it and the rest of
+ * the mutations one by one. We also stop at a mutation which adds or
+ * removes members of a container modified by a previous one, or which
+ * modifies a container a previous one added or removed members of:
+ * subjson decides where the separating commas go from the members present
+ * in the original document, so two such mutations don't compose even if
+ * they replace disjoint ranges (e.g. deleting the only member of `{"x":1 }`
+ * and adding another one to it).
+ *
+ * @return the number of operations applied
+ * @throws std::bad_alloc if allocation fails
+ */
+static size_t operate_disjoint_paths(SubdocCmdContext& context,
+                                     cb::const_char_buffer& doc,
+                                     std::unique_ptr<char[]>& temp_buffer,
+                                     bool& modified) {
+    auto& operations = context.getOperations();
+    std::vector<DocumentSplice> splices;
+    std::vector<MutationContainer> containers;
+
+    size_t applied = 0;
+    for (auto& op : operations) {
+        if (!is_position_independent(op)) {
+            break;
+        }
+
+        auto container = get_mutation_container(op);
+        auto shared = std::find_if(
+                containers.begin(), containers.end(),
+                [&container](const MutationContainer& other) {
+                    return (container.changes_members ||
+                            other.changes_members) &&
+                           container.path == other.path;
+                });
+        if (shared != containers.end()) {
+            break;
+        }
+
+        op.status = subdoc_operate_one_path(context, op, doc);
+        if (op.status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            op.result.clear();
+            break;
+        }
+
+        auto splice = get_document_splice(doc, op.result);
+        auto conflict = std::find_if(
+                splices.begin(), splices.end(),
+                [&splice](const DocumentSplice& other) {
+                    return !(splice.end < other.begin ||
+                             other.end < splice.begin);
+                });
+        if (conflict != splices.end()) {
+            op.result.clear();
+            break;
+        }
+
+        splices.emplace_back(std::move(splice));
+        containers.emplace_back(std::move(container));
+        ++applied;
+    }
+
+    if (splices.empty()) {
+        return 0;
+    }
+
+    std::sort(splices.begin(), splices.end(),
+              [](const DocumentSplice& a, const DocumentSplice& b) {
+                  return a.begin < b.begin;
+              });
+
+    size_t new_doc_len = doc.len;
+    for (const auto& splice : splices) {
+        new_doc_len -= splice.end - splice.begin;
+        for (const auto& piece : splice.pieces) {
+            new_doc_len += piece.size();
+        }
+    }
+
+    // Allocate an extra byte to make sure we can zero term it (as
+    // operate_single_doc does)
+    std::unique_ptr<char[]> temp(new char[new_doc_len + 1]);
+    temp[new_doc_len] = '\0';
+
+    char* ptr = temp.get();
+    size_t offset = 0;
+    for (const auto& splice : splices) {
+        std::memcpy(ptr, doc.buf + offset, splice.begin - offset);
+        ptr += splice.begin - offset;
+        for (const auto& piece : splice.pieces) {
+            std::memcpy(ptr, piece.data(), piece.size());
+            ptr += piece.size();
+        }
+        offset = splice.end;
+    }
+    std::memcpy(ptr, doc.buf + offset, doc.len - offset);
+
+    temp_buffer.swap(temp);
+    doc.buf = temp_buffer.get();
+    doc.len = new_doc_len;
+    modified = true;
+
+    return applied;
+}
+
 /**
  * Run through all of the subdoc operations for the current phase on
  * a single 'document' (either the user document, or a XATTR).
@@ -696,13 +1060,22 @@ static bool operate_single_doc(SubdocCmdContext& context,
     modified = false;
     auto& operations = context.getOperations();
 
-    // 2. Perform each of the operations on document.
-    for (auto op = operations.begin(); op != operations.end(); op++) {
+    // 1. Apply as many of the mutations as possible in a single pass.
+    size_t applied = 0;
+    if (context.traits.is_mutator &&
+        context.traits.path == SubdocPath::MULTI &&
+        operations.size() > 1 && mcbp::datatype::is_json(doc_datatype)) {
+        applied = operate_disjoint_paths(context, doc, temp_buffer, modified);
+    }
+
+    // 2. Perform each of the (remaining) operations on document.
+    for (auto op = operations.begin() + applied; op != operations.end();
+         op++) {
         switch (op->traits.scope) {
         case CommandScope::SubJSON:
             if (mcbp::datatype::is_json(doc_datatype)) {
                 // Got JSON, perform the operation.
-                op->status = subdoc_operate_one_path(context, *op, doc);
+                op->status = subdoc_lookup_one_path(context, *op, doc);
             } else {
                 // No good; need to have JSON.
                 op->status = PROTOCOL_BINARY_RESPONSE_SUBDOC_DOC_NOTJSON;
@@ -758,7 +1131,7 @@ static bool operate_single_doc(SubdocCmdContext& context,
             case SubdocPath::SINGLE:
                 // Failure of a (the only) op stops execution and returns an
                 // error to the client.
-                mcbp_write_packet(&context.connection, op->status);
+                subdoc_send_error(context, op->status);
                 return false;
 
             case SubdocPath::MULTI:
@@ -911,7 +1284,7 @@ static bool do_xattr_phase(SubdocCmdContext& context) {
         case SubdocPath::SINGLE:
             // Failure of a (the only) op stops execution and returns an
             // error to the client.
-            mcbp_write_packet(&context.connection,
+            subdoc_send_error(context,
                               engine_error_2_mcbp_protocol_error(access));
             return false;
 
@@ -1092,14 +1465,53 @@ static bool subdoc_operate(SubdocCmdContext& context) {
         }
     } catch (const std::bad_alloc&) {
         // Insufficient memory - unable to continue.
-        mcbp_write_packet(&context.connection,
-                          PROTOCOL_BINARY_RESPONSE_ENOMEM);
+        subdoc_send_error(context, PROTOCOL_BINARY_RESPONSE_ENOMEM);
         return false;
     }
 
     return false;
 }
 
+/**
+ * Should the new document be stored Snappy compressed? Documents which
+ * were compressed in the engine stay compressed (rather than growing back
+ * to full size), and documents updated by clients which use compression
+ * themselves get compressed.
+ */
+static bool should_compress(SubdocCmdContext& context) {
+    return settings.isDatatypeSnappyEnabled() &&
+           (context.in_compressed || context.connection.isSnappyEnabled());
+}
+
+/**
+ * Compress the new document into the context's deflated_doc_buffer
+ *
+ * @return true if the compressed document is smaller than the original
+ */
+static bool deflate_document(SubdocCmdContext& context) {
+    try {
+        using namespace cb::compression;
+        if (!deflate(Algorithm::Snappy,
+                     context.in_doc.buf,
+                     context.in_doc.len,
+                     context.deflated_doc_buffer)) {
+            return false;
+        }
+    } catch (const std::bad_alloc&) {
+        // Store it uncompressed
+        return false;
+    }
+
+    get_thread_stats(&context.connection)->bytes_subdoc_deflated +=
+            context.in_doc.len;
+    if (context.deflated_doc_buffer.len >= context.in_doc.len) {
+        context.deflated_doc_buffer.data.reset();
+        context.deflated_doc_buffer.len = 0;
+        return false;
+    }
+    return true;
+}
+
 // Update the engine with whatever modifications the subdocument command made
 // to the document.
 // Returns true if the update was successful (and execution should continue),
@@ -1136,16 +1548,25 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
         !(context.no_sys_xattrs && context.do_delete_doc)) {
         item *new_doc;
 
+        cb::const_char_buffer value = context.in_doc;
+        auto datatype = context.in_datatype;
+        if (should_compress(context) &&
+            (context.deflated_doc_buffer.data || deflate_document(context))) {
+            value = {context.deflated_doc_buffer.data.get(),
+                     context.deflated_doc_buffer.len};
+            datatype |= PROTOCOL_BINARY_DATATYPE_SNAPPY;
+        }
+
         if (ret == ENGINE_SUCCESS) {
             context.out_doc_len = context.in_doc.len;
             DocKey allocate_key(reinterpret_cast<const uint8_t*>(key),
                                 keylen, connection.getDocNamespace());
             // Calculate the updated document length - use the last operation result.
             ret = bucket_allocate(&connection, &new_doc, allocate_key,
-                                  context.out_doc_len,
+                                  value.len,
                                   context.in_flags,
                                   expiration,
-                                  context.in_datatype,
+                                  datatype,
                                   vbucket);
             ret = context.connection.remapErrorCode(ret);
         }
@@ -1165,7 +1586,7 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
             return ret;
 
         default:
-            mcbp_write_packet(&connection, engine_error_2_mcbp_protocol_error(ret));
+            subdoc_send_error(context, engine_error_2_mcbp_protocol_error(ret));
             return ret;
         }
 
@@ -1176,13 +1597,13 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
         // Obtain the item info (and it's iovectors)
         item_info new_doc_info;
         if (!bucket_get_item_info(&connection, new_doc, &new_doc_info)) {
-            mcbp_write_packet(&connection, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
+            subdoc_send_error(context, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
             return ENGINE_FAILED;
         }
 
         // Copy the new document into the item.
         char* write_ptr = static_cast<char*>(new_doc_info.value[0].iov_base);
-        std::memcpy(write_ptr, context.in_doc.buf, context.in_doc.len);
+        std::memcpy(write_ptr, value.buf, value.len);
     }
 
     // And finally, store the new document.
@@ -1219,7 +1640,7 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
                     LOG_WARNING(&connection,
                                 "%u: Subdoc: Failed to get item info",
                                 connection.getId());
-                    mcbp_write_packet(&connection,
+                    subdoc_send_error(context,
                                       PROTOCOL_BINARY_RESPONSE_EINTERNAL);
                     return ENGINE_FAILED;
                 }
@@ -1246,7 +1667,142 @@ static ENGINE_ERROR_CODE subdoc_update(SubdocCmdContext& context,
         break;
 
     default:
-        mcbp_write_packet(&connection, engine_error_2_mcbp_protocol_error(ret));
+        subdoc_send_error(context, engine_error_2_mcbp_protocol_error(ret));
+        break;
+    }
+
+    return ret;
+}
+
+/**
+ * Can the operation be executed through the engine's update (see
+ * subdoc_update_in_engine)? Commands which may create or delete the
+ * document are left to subdoc_update.
+ */
+static bool subdoc_may_update_in_engine(SubdocCmdContext& context) {
+    return context.traits.is_mutator &&
+           context.mutationSemantics != MutationSemantics::Add &&
+           !context.do_delete_doc &&
+           context.connection.getBucketEngine()->update != nullptr;
+}
+
+/**
+ * Fetch, operate on and update the document with a single call into the
+ * engine (see ENGINE_HANDLE_V1::update). The engine passes us the current
+ * version of the document and runs concurrent updates of the same document
+ * one after another, so they don't conflict with each other. Used for
+ * mutations without a CAS once storing the document failed because someone
+ * else updated it, as a hot document (such as a counter) is likely to be
+ * retried a number of times.
+ *
+ * @return ENGINE_SUCCESS if execution should continue with the response,
+ *         ENGINE_ENOTSUP if the engine can't do it (nothing is sent, and
+ *         the command should be executed with subdoc_fetch/subdoc_update
+ *         instead), or else the same as subdoc_update
+ */
+static ENGINE_ERROR_CODE subdoc_update_in_engine(SubdocCmdContext& context,
+                                                 const char* key,
+                                                 size_t keylen,
+                                                 uint16_t vbucket,
+                                                 uint32_t expiration) {
+    auto& connection = context.connection;
+
+    // The callback only records errors; they're sent once the engine
+    // returns.
+    auto error = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    bool failed = false;
+    bool unchanged = false;
+    auto callback = [&context, &error, &failed, &unchanged, expiration](
+                            const item_info& info,
+                            item_update& update) -> ENGINE_ERROR_CODE {
+        error = context.get_document_for_searching(info, 0);
+        if (error != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            return ENGINE_NOT_STORED;
+        }
+
+        if (!subdoc_operate(context)) {
+            failed = true;
+            return ENGINE_NOT_STORED;
+        }
+
+        if (context.overall_status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            // One of the paths failed, leave the document unchanged (see
+            // subdoc_update)
+            unchanged = true;
+            return ENGINE_NOT_STORED;
+        }
+
+        update.value = context.in_doc;
+        update.datatype = context.in_datatype;
+        if (should_compress(context) &&
+            (context.deflated_doc_buffer.data || deflate_document(context))) {
+            update.value = {context.deflated_doc_buffer.data.get(),
+                            context.deflated_doc_buffer.len};
+            update.datatype |= PROTOCOL_BINARY_DATATYPE_SNAPPY;
+        }
+        update.exptime = expiration;
+        update.document_state = context.in_document_state;
+        context.out_doc_len = context.in_doc.len;
+        return ENGINE_SUCCESS;
+    };
+
+    DocKey docKey(reinterpret_cast<const uint8_t*>(key),
+                  keylen,
+                  connection.getDocNamespace());
+    uint64_t new_cas;
+    mutation_descr_t mdt;
+    auto ret = bucket_update(&connection,
+                             docKey,
+                             vbucket,
+                             context.do_allow_deleted_docs
+                                     ? DocStateFilter::AliveOrDeleted
+                                     : DocStateFilter::Alive,
+                             callback,
+                             &new_cas,
+                             &mdt);
+    if (error != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        subdoc_send_error(context, error);
+        return ENGINE_FAILED;
+    }
+    if (failed) {
+        return ENGINE_FAILED;
+    }
+    if (unchanged) {
+        return ENGINE_SUCCESS;
+    }
+
+    ret = connection.remapErrorCode(ret);
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        get_thread_stats(&connection)->subdoc_engine_updates++;
+        context.vbucket_uuid = mdt.vbucket_uuid;
+        context.sequence_no = mdt.seqno;
+        connection.setCAS(new_cas);
+        break;
+
+    case ENGINE_KEY_ENOENT:
+        // The document is gone; subdoc_fetch knows if we should create it
+        return ENGINE_ENOTSUP;
+
+    case ENGINE_ENOTSUP:
+    case ENGINE_KEY_EEXISTS:
+        // Someone else updated the document after the engine passed it to
+        // us; the caller retries
+        break;
+
+    case ENGINE_EWOULDBLOCK:
+        // The callback isn't called in this case, so the context is still
+        // fresh and we'll fetch the document ourselves when we're called
+        // again.
+        connection.setEwouldblock(true);
+        break;
+
+    case ENGINE_DISCONNECT:
+        connection.setState(conn_closing);
+        break;
+
+    default:
+        subdoc_send_error(context, engine_error_2_mcbp_protocol_error(ret));
         break;
     }
 
@@ -1292,6 +1848,36 @@ static size_t encode_multi_mutation_result_spec(uint8_t index,
     return cursor - buffer;
 }
 
+/**
+ * Add the value of a lookup result to the response. The value points
+ * into the input document, which is kept alive until the response is
+ * sent. Large values located in the item's own memory (the document
+ * wasn't inflated) may be sent with MSG_ZEROCOPY, in which case the
+ * connection takes over the reference to the item until the kernel is
+ * done with it.
+ */
+static void add_result_iov(SubdocCmdContext& context, const char* value,
+                           size_t length) {
+    auto& connection = context.connection;
+    const auto& payload = context.getInputItemInfo().value[0];
+    const auto* begin = static_cast<const char*>(payload.iov_base);
+
+    if (!context.traits.is_mutator &&
+        connection.isZerocopyCandidate(length) &&
+        value >= begin && value + length <= begin + payload.iov_len) {
+        if (!context.item_reserved && connection.getItem() != nullptr &&
+            connection.reserveItem(connection.getItem())) {
+            connection.setItem(nullptr);
+            context.item_reserved = true;
+        }
+        if (context.item_reserved) {
+            connection.addZerocopyIov(value, length);
+            return;
+        }
+    }
+    connection.addIov(value, length);
+}
+
 /* Construct and send a response to a single-path request back to the client.
  */
 static void subdoc_single_response(SubdocCmdContext& context) {
@@ -1346,7 +1932,7 @@ static void subdoc_single_response(SubdocCmdContext& context) {
     }
 
     if (context.traits.response_has_value) {
-        connection.addIov(value, context.response_val_len);
+        add_result_iov(context, value, context.response_val_len);
     }
 
     connection.setState(conn_mwrite);
@@ -1548,7 +2134,7 @@ static void subdoc_multi_lookup_response(SubdocCmdContext& context) {
             connection.addIov(reinterpret_cast<void*>(header), header_sz);
 
             if (result_len != 0) {
-                connection.addIov(mloc.at, mloc.length);
+                add_result_iov(context, mloc.at, mloc.length);
             }
             response_buf.moveOffset(header_sz);
         }
@@ -1579,6 +2165,323 @@ static void subdoc_response(SubdocCmdContext& context) {
     connection.setState(conn_closing);
 }
 
+/*
+ * SUBDOC_MULTI_KEY: run a multi-path lookup or mutation on a list of keys
+ */
+
+static void append_uint16(std::vector<char>& buffer, uint16_t value) {
+    value = htons(value);
+    const auto* ptr = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), ptr, ptr + sizeof(value));
+}
+
+static void append_uint32(std::vector<char>& buffer, uint32_t value) {
+    value = htonl(value);
+    const auto* ptr = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), ptr, ptr + sizeof(value));
+}
+
+static void append_uint64(std::vector<char>& buffer, uint64_t value) {
+    value = htonll(value);
+    const auto* ptr = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), ptr, ptr + sizeof(value));
+}
+
+/**
+ * The maximum size of the response value of a SUBDOC_MULTI_KEY command
+ * (so that the response doesn't exceed the size of the packets we accept)
+ */
+static size_t get_max_multi_key_response() {
+    return settings.getMaxPacketSize() -
+           sizeof(protocol_binary_response_header);
+}
+
+/**
+ * The largest result of a key of a multi-mutation: the status, CAS and
+ * length, and the index, status, length and value of a counter (at most
+ * 20 characters) for each of the paths.
+ */
+static const size_t MaxMutationKeyResult =
+        sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t) +
+        PROTOCOL_BINARY_SUBDOC_MULTI_MAX_PATHS *
+                (sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t) + 20);
+
+/**
+ * Append the result for a key which failed (without a body) to the
+ * response of a SUBDOC_MULTI_KEY command.
+ */
+static void append_key_status(SubdocMultiKeyContext& batch,
+                              protocol_binary_response_status status) {
+    append_uint16(batch.response, status);
+    append_uint64(batch.response, 0);
+    append_uint32(batch.response, 0);
+}
+
+/**
+ * Append the result for a key to the response of a SUBDOC_MULTI_KEY
+ * command. The result body is the same as the body of the response to
+ * the multi-path command (see subdoc_multi_lookup_response() and
+ * subdoc_multi_mutation_response()), but the values are copied as the
+ * document they refer to is released before we move on to the next key.
+ *
+ * If the result of a lookup doesn't fit in the response, the status of
+ * the key is E2BIG instead.
+ */
+static void append_key_result(SubdocMultiKeyContext& batch,
+                              SubdocCmdContext& context) {
+    auto& response = batch.response;
+    const size_t result_offset = response.size();
+    const auto deleted = context.in_document_state == DocumentState::Deleted;
+
+    auto status = context.overall_status;
+    if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS && deleted) {
+        status = PROTOCOL_BINARY_RESPONSE_SUBDOC_SUCCESS_DELETED;
+    } else if (status == PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE &&
+               deleted && !context.traits.is_mutator) {
+        status = PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE_DELETED;
+    }
+
+    append_uint16(response, status);
+    append_uint64(response, context.connection.getCAS());
+    const size_t length_offset = response.size();
+    append_uint32(response, 0);
+    const size_t body_offset = response.size();
+
+    uint8_t index = 0;
+    bool failure_reported = false;
+    for (auto phase : phases) {
+        for (auto& op : context.getOperations(phase)) {
+            const auto mloc = op.result.matchloc();
+            if (!context.traits.is_mutator) {
+                const size_t length =
+                        op.traits.response_has_value ? mloc.length : 0;
+                append_uint16(response, op.status);
+                append_uint32(response, uint32_t(length));
+                response.insert(response.end(), mloc.at, mloc.at + length);
+            } else if (context.overall_status ==
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                if (op.traits.response_has_value && mloc.length > 0) {
+                    response.push_back(char(index));
+                    append_uint16(response, op.status);
+                    append_uint32(response, uint32_t(mloc.length));
+                    response.insert(
+                            response.end(), mloc.at, mloc.at + mloc.length);
+                }
+            } else if (op.status != PROTOCOL_BINARY_RESPONSE_SUCCESS &&
+                       !failure_reported) {
+                // Only the first unsuccessful op is reported.
+                response.push_back(char(index));
+                append_uint16(response, op.status);
+                failure_reported = true;
+            }
+            ++index;
+        }
+    }
+
+    if (response.size() > get_max_multi_key_response()) {
+        response.resize(result_offset);
+        append_key_status(batch, PROTOCOL_BINARY_RESPONSE_E2BIG);
+        return;
+    }
+
+    const uint32_t length = htonl(uint32_t(response.size() - body_offset));
+    std::memcpy(response.data() + length_offset, &length, sizeof(length));
+    if (!context.traits.is_mutator) {
+        context.response_val_len = response.size() - body_offset;
+    }
+}
+
+/**
+ * Decode the keys of a SUBDOC_MULTI_KEY command (the validator has checked
+ * that the value is well formed).
+ */
+static SubdocMultiKeyContext* subdoc_create_multi_key_context(
+        cb::const_char_buffer value) {
+    SubdocCmdTraits traits;
+    if (uint8_t(value.buf[0]) == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION) {
+        traits = get_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION>();
+    } else {
+        traits = get_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP>();
+    }
+
+    uint16_t nkeys;
+    std::memcpy(&nkeys, value.buf + sizeof(uint8_t), sizeof(nkeys));
+    nkeys = ntohs(nkeys);
+
+    std::vector<SubdocMultiKeyContext::Key> keys;
+    keys.reserve(nkeys);
+    size_t offset = sizeof(uint8_t) + sizeof(nkeys);
+    for (uint16_t ii = 0; ii < nkeys; ++ii) {
+        uint16_t vbucket;
+        uint16_t keylen;
+        std::memcpy(&vbucket, value.buf + offset, sizeof(vbucket));
+        std::memcpy(&keylen, value.buf + offset + sizeof(vbucket),
+                    sizeof(keylen));
+        offset += sizeof(vbucket) + sizeof(keylen);
+        keys.push_back({{value.buf + offset, ntohs(keylen)}, ntohs(vbucket)});
+        offset += ntohs(keylen);
+    }
+
+    auto* batch = new SubdocMultiKeyContext(
+            traits, {value.buf + offset, value.len - offset});
+    batch->keys = std::move(keys);
+    return batch;
+}
+
+/**
+ * Run the multi-path command on each of the keys in turn, and send a
+ * single response with the result of each of them. There isn't a batch
+ * interface to the engine, so each key is fetched, operated on and
+ * stored just as the multi-path command would, but we save the parsing,
+ * validation, dispatch and response of a command per key.
+ */
+static void subdoc_multi_key_execute(McbpConnection& c, const void* packet) {
+    const auto* header =
+            reinterpret_cast<const protocol_binary_request_header*>(packet);
+    const uint8_t extlen = header->request.extlen;
+    const uint32_t bodylen = ntohl(header->request.bodylen);
+    const char* value =
+            reinterpret_cast<const char*>(packet) + sizeof(*header) + extlen;
+
+    ENGINE_ERROR_CODE ret = c.getAiostat();
+    c.setAiostat(ENGINE_SUCCESS);
+
+    auto* batch = dynamic_cast<SubdocMultiKeyContext*>(c.getCommandContext());
+    if (batch == nullptr) {
+        try {
+            batch = subdoc_create_multi_key_context({value, bodylen - extlen});
+        } catch (const std::bad_alloc&) {
+            mcbp_write_packet(&c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+            return;
+        }
+        c.setCommandContext(batch);
+
+        // The privilege chain only checked that we may read the documents
+        if (batch->traits.is_mutator) {
+            switch (c.checkPrivilege(cb::rbac::Privilege::Write,
+                                     c.getCookieObject())) {
+            case cb::rbac::PrivilegeAccess::Ok:
+                break;
+            case cb::rbac::PrivilegeAccess::Fail:
+                mcbp_write_packet(&c, PROTOCOL_BINARY_RESPONSE_EACCESS);
+                return;
+            case cb::rbac::PrivilegeAccess::Stale:
+                mcbp_write_packet(&c, PROTOCOL_BINARY_RESPONSE_AUTH_STALE);
+                return;
+            }
+        }
+    }
+
+    const uint32_t expiration = subdoc_decode_expiration(header, batch->traits);
+    const doc_flag doc_flags =
+            subdoc_decode_doc_flags(header, batch->traits.path);
+
+    // See subdoc_executor()
+    const int MAXIMUM_ATTEMPTS = 100;
+
+    try {
+        while (batch->next < batch->keys.size()) {
+            const auto& key = batch->keys[batch->next];
+            if (batch->traits.is_mutator && batch->attempts == 0 &&
+                batch->response.size() + MaxMutationKeyResult >
+                        get_max_multi_key_response()) {
+                // We might not be able to return the result, so don't
+                // modify the document
+                append_key_status(*batch, PROTOCOL_BINARY_RESPONSE_E2BIG);
+                batch->next++;
+                continue;
+            }
+
+            if (!batch->current) {
+                batch->current.reset(subdoc_create_context(
+                        c, batch->traits, packet, batch->specs, doc_flags));
+                if (!batch->current) {
+                    throw std::bad_alloc();
+                }
+                batch->current->batch = true;
+                batch->attempts++;
+                // Lookups and successful mutations set the CAS to return
+                c.setCAS(0);
+            }
+            auto& context = *batch->current;
+
+            ENGINE_ERROR_CODE status = ENGINE_FAILED;
+            if (batch->update_in_engine) {
+                status = subdoc_update_in_engine(context, key.key.buf,
+                                                 key.key.len, key.vbucket,
+                                                 expiration);
+                if (status == ENGINE_ENOTSUP) {
+                    batch->update_in_engine = false;
+                    batch->current.reset();
+                    continue;
+                }
+            } else if (subdoc_fetch(c, context, ret, key.key.buf, key.key.len,
+                                    key.vbucket, 0) &&
+                       subdoc_operate(context)) {
+                status = subdoc_update(context, ret, key.key.buf, key.key.len,
+                                       key.vbucket, expiration);
+            }
+
+            if (c.isEwouldblock() || c.getState() == conn_closing) {
+                return;
+            }
+            ret = ENGINE_SUCCESS;
+
+            if (c.getItem() != nullptr) {
+                bucket_release_item(&c, c.getItem());
+                c.setItem(nullptr);
+            }
+
+            if (status == ENGINE_KEY_EEXISTS) {
+                auto* thread_stats = get_thread_stats(&c);
+                thread_stats->subdoc_cas_conflicts++;
+                if (batch->attempts < MAXIMUM_ATTEMPTS) {
+                    // Someone else updated the document; start over
+                    thread_stats->subdoc_retries++;
+                    batch->update_in_engine =
+                            subdoc_may_update_in_engine(context);
+                    batch->current.reset();
+                    continue;
+                }
+                LOG_WARNING(&c,
+                            "%u: Subdoc: Hit maximum number of auto-retry "
+                            "attempts (%d) for a key of SUBDOC_MULTI_KEY "
+                            "for client %s - returning TMPFAIL",
+                            c.getId(), MAXIMUM_ATTEMPTS,
+                            c.getDescription().c_str());
+                context.batch_status =
+                        engine_error_2_mcbp_protocol_error(ENGINE_TMPFAIL);
+            }
+
+            if (status == ENGINE_SUCCESS) {
+                append_key_result(*batch, context);
+                subdoc_update_stats(c, context, key.key.buf, key.key.len);
+            } else if (context.batch_status !=
+                       PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                append_key_status(*batch, context.batch_status);
+            } else {
+                append_key_status(*batch, PROTOCOL_BINARY_RESPONSE_EINTERNAL);
+            }
+
+            batch->current.reset();
+            batch->attempts = 0;
+            batch->update_in_engine = false;
+            batch->next++;
+        }
+    } catch (const std::bad_alloc&) {
+        mcbp_write_packet(&c, PROTOCOL_BINARY_RESPONSE_ENOMEM);
+        return;
+    }
+
+    // The CAS of each key is in its result
+    c.setCAS(0);
+    mcbp_add_header(&c, PROTOCOL_BINARY_RESPONSE_SUCCESS, 0 /*extlen*/,
+                    0 /*keylen*/, uint32_t(batch->response.size()),
+                    PROTOCOL_BINARY_RAW_BYTES);
+    c.addIov(batch->response.data(), batch->response.size());
+    c.setState(conn_mwrite);
+}
+
 void subdoc_get_executor(McbpConnection* c, void* packet) {
     return subdoc_executor(*c, packet,
                            get_traits<PROTOCOL_BINARY_CMD_SUBDOC_GET>());
@@ -1648,3 +2551,7 @@ void subdoc_multi_mutation_executor(McbpConnection* c, void *packet) {
     return subdoc_executor(*c, packet,
                            get_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION>());
 }
+
+void subdoc_multi_key_executor(McbpConnection* c, void *packet) {
+    return subdoc_multi_key_execute(*c, packet);
+}
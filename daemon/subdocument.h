@@ -40,3 +40,4 @@ void subdoc_counter_executor(McbpConnection *c, void *packet);
 void subdoc_get_count_executor(McbpConnection *c, void *packet);
 void subdoc_multi_lookup_executor(McbpConnection *c, void *packet);
 void subdoc_multi_mutation_executor(McbpConnection *c, void *packet);
+void subdoc_multi_key_executor(McbpConnection *c, void *packet);
@@ -20,13 +20,14 @@
 #include "debug_helpers.h"
 #include "mc_time.h"
 #include "protocol/mcbp/engine_wrapper.h"
+#include "stats.h"
 #include "subdocument.h"
 
 #include <xattr/blob.h>
 
-#include <iomanip>
+#include <cinttypes>
+#include <cstdio>
 #include <random>
-#include <sstream>
 #include <utilities/string_utilities.h>
 
 SubdocCmdContext::OperationSpec::OperationSpec(SubdocCmdTraits traits_,
@@ -67,16 +68,26 @@ uint64_t SubdocCmdContext::getOperationValueBytesTotal() const {
     return result;
 }
 
-template <typename T>
-std::string SubdocCmdContext::macroToString(T macroValue) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    ss << "\"0x" << std::setw(sizeof(T) * 2) << macroValue << "\"";
-    return ss.str();
+/**
+ * Format the value as "0x" followed by 16 hex digits, in quotes (the format
+ * used for the macro values and the hex fields in $document)
+ *
+ * @param dest where to write the value (MacroValueLength bytes)
+ */
+static void format_hex_value(char* dest, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    dest[0] = '"';
+    dest[1] = '0';
+    dest[2] = 'x';
+    for (int ii = 18; ii > 2; --ii) {
+        dest[ii] = digits[value & 0xf];
+        value >>= 4;
+    }
+    dest[19] = '"';
 }
 
 ENGINE_ERROR_CODE SubdocCmdContext::pre_link_document(item_info& info) {
-    if (do_macro_expansion) {
+    if (do_macro_expansion && numPaddedMacros > 0) {
         auto bodyoffset = cb::xattr::get_body_offset(
             {static_cast<const char*>(info.value[0].iov_base),
              info.value[0].iov_len});
@@ -94,70 +105,53 @@ ENGINE_ERROR_CODE SubdocCmdContext::pre_link_document(item_info& info) {
             return ENGINE_SUCCESS;
         }
 
-        // Replace the CAS
-        if (std::any_of(std::begin(paddedMacros),
-                        std::end(paddedMacros),
-                        [](const MacroPair& m) {
-                            return m.first == cb::xattr::macros::CAS;
-                        })) {
-            substituteMacro(cb::xattr::macros::CAS,
-                            macroToString(htonll(info.cas)),
-                            value);
+        // Format the expanded values up front, so that we may patch them
+        // in with a single pass over the value
+        std::array<std::array<char, MacroValueLength>, 2> expanded;
+        for (size_t ii = 0; ii < numPaddedMacros; ++ii) {
+            if (paddedMacros[ii].name == cb::xattr::macros::CAS) {
+                format_hex_value(expanded[ii].data(), htonll(info.cas));
+            } else {
+                format_hex_value(expanded[ii].data(), info.seqno);
+            }
         }
 
-        // Replace the Seqno
-        if (std::any_of(std::begin(paddedMacros),
-                        std::end(paddedMacros),
-                        [](const MacroPair& m) {
-                            return m.first == cb::xattr::macros::SEQNO;
-                        })) {
-            substituteMacro(
-                    cb::xattr::macros::SEQNO, macroToString(info.seqno), value);
+        // This replaces ALL instances of the padded strings (which all
+        // start with a quote)
+        uint8_t* root = value.buf;
+        uint8_t* end = value.buf + value.len;
+        while ((root = static_cast<uint8_t*>(
+                        std::memchr(root, '"', end - root))) != nullptr) {
+            if (size_t(end - root) < MacroValueLength) {
+                break;
+            }
+            size_t ii = 0;
+            while (ii < numPaddedMacros &&
+                   std::memcmp(root, paddedMacros[ii].value.data(),
+                               MacroValueLength) != 0) {
+                ++ii;
+            }
+            if (ii == numPaddedMacros) {
+                ++root;
+            } else {
+                std::copy(expanded[ii].begin(), expanded[ii].end(), root);
+                root += MacroValueLength;
+            }
         }
     }
 
     return ENGINE_SUCCESS;
 }
 
-void SubdocCmdContext::substituteMacro(cb::const_char_buffer macroName,
-                                       const std::string& macroValue,
-                                       cb::byte_buffer& value) {
-    // Do an in-place substitution of the real macro value where we
-    // wrote the padded macro string.
-    uint8_t* root = value.buf;
-    uint8_t* end = value.buf + value.len;
-    auto& macro = std::find_if(std::begin(paddedMacros),
-                               std::end(paddedMacros),
-                               [macroName](const MacroPair& m) {
-                                   return m.first == macroName;
-                               })
-                          ->second;
-    auto* needle = macro.data();
-    auto* needle_end = macro.data() + macro.length();
-
-    // This replaces ALL instances of the padded string
-    while ((root = std::search(root, end, needle, needle_end)) != end) {
-        std::copy(macroValue.data(),
-                  macroValue.data() + macroValue.length(),
-                  root);
-        root += macroValue.length();
-    }
-}
-
 cb::const_char_buffer SubdocCmdContext::get_padded_macro(
         cb::const_char_buffer macro) {
-    return std::find_if(
-                   std::begin(paddedMacros),
-                   std::end(paddedMacros),
-                   [macro](const MacroPair& a) { return a.first == macro; })
-            ->second;
-}
-
-static inline std::string to_hex_string(uint64_t value) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    ss << "0x" << std::setw(16) << value;
-    return ss.str();
+    for (size_t ii = 0; ii < numPaddedMacros; ++ii) {
+        if (paddedMacros[ii].name == macro) {
+            return {paddedMacros[ii].value.data(), MacroValueLength};
+        }
+    }
+    throw std::logic_error(
+            "SubdocCmdContext::get_padded_macro: no padding for the macro");
 }
 
 void SubdocCmdContext::generate_macro_padding(cb::const_char_buffer payload,
@@ -167,28 +161,40 @@ void SubdocCmdContext::generate_macro_padding(cb::const_char_buffer payload,
         return;
     }
 
+    // Seeding the generator is expensive, so only do it once per thread
+    static thread_local std::mt19937_64 gen{std::random_device{}()};
+
     bool unique = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<uint64_t> dis;
+    char candidate[MacroValueLength + 1];
+    candidate[MacroValueLength] = '\0';
 
     while (!unique) {
         unique = true;
-        uint64_t ii = dis(gen);
-        const std::string candidate = "\"" + to_hex_string(ii) + "\"";
+        format_hex_value(candidate, gen());
 
         for (auto& op : getOperations(Phase::XATTR)) {
-            if (cb::strnstr(op.value.buf, candidate.c_str(), op.value.len)) {
+            if (cb::strnstr(op.value.buf, candidate, op.value.len)) {
                 unique = false;
                 break;
             }
         }
 
         if (unique) {
-            if (cb::strnstr(payload.buf, candidate.c_str(), payload.len)) {
+            if (cb::strnstr(payload.buf, candidate, payload.len)) {
                 unique = false;
             } else {
-                paddedMacros.push_back(std::make_pair(macro, candidate));
+                // The xattr phase runs again if the command is retried,
+                // so replace the padding from the previous attempt
+                size_t ii = 0;
+                while (ii < numPaddedMacros &&
+                       !(paddedMacros[ii].name == macro)) {
+                    ++ii;
+                }
+                if (ii == numPaddedMacros) {
+                    paddedMacros[numPaddedMacros++].name = macro;
+                }
+                std::copy(candidate, candidate + MacroValueLength,
+                          paddedMacros[ii].value.begin());
             }
         }
     }
@@ -204,75 +210,88 @@ void SubdocCmdContext::setMutationSemantics(mcbp::subdoc::doc_flag docFlags) {
     }
 }
 
-cb::const_char_buffer SubdocCmdContext::get_document_vattr() {
-    if (document_vattr.empty()) {
-        // @todo we can optimize this by building the json in a more efficient
-        //       way, but for now just do it by using cJSON...
-        unique_cJSON_ptr doc(cJSON_CreateObject());
-
-        cJSON_AddStringToObject(
-                doc.get(), "CAS", to_hex_string(input_item_info.cas).c_str());
-
-        cJSON_AddStringToObject(
-                doc.get(),
-                "vbucket_uuid",
-                to_hex_string(input_item_info.vbucket_uuid).c_str());
-
-        cJSON_AddStringToObject(doc.get(),
-                                "seqno",
-                                to_hex_string(input_item_info.seqno).c_str());
-
-        cJSON_AddNumberToObject(
-                doc.get(),
-                "exptime",
-                mc_time_convert_to_abs_time(input_item_info.exptime));
+/**
+ * The datatype array in $document for each of the (valid) datatypes
+ */
+static const char* datatype_array[] = {
+        "\"raw\"",
+        "\"json\"",
+        "\"snappy\"",
+        "\"snappy\",\"json\"",
+        "\"xattr\"",
+        "\"json\",\"xattr\"",
+        "\"snappy\",\"xattr\"",
+        "\"snappy\",\"json\",\"xattr\""};
 
+cb::const_char_buffer SubdocCmdContext::get_document_vattr() {
+    if (document_vattr_len == 0) {
+        char cas[MacroValueLength + 1];
+        char vbucket_uuid[MacroValueLength + 1];
+        char seqno[MacroValueLength + 1];
+        format_hex_value(cas, input_item_info.cas);
+        format_hex_value(vbucket_uuid, input_item_info.vbucket_uuid);
+        format_hex_value(seqno, input_item_info.seqno);
+        cas[MacroValueLength] = '\0';
+        vbucket_uuid[MacroValueLength] = '\0';
+        seqno[MacroValueLength] = '\0';
+
+        uint64_t value_bytes = input_item_info.nbytes;
         if (mcbp::datatype::is_xattr(input_item_info.datatype)) {
             // strip off xattr
-            auto bodyoffset = cb::xattr::get_body_offset(
+            value_bytes -= cb::xattr::get_body_offset(
                     {static_cast<const char*>(
                              input_item_info.value[0].iov_base),
                      input_item_info.value[0].iov_len});
-            cJSON_AddNumberToObject(doc.get(),
-                                    "value_bytes",
-                                    input_item_info.nbytes - bodyoffset);
-        } else {
-            cJSON_AddNumberToObject(
-                    doc.get(), "value_bytes", input_item_info.nbytes);
         }
 
-        unique_cJSON_ptr array(cJSON_CreateArray());
-        auto datatypes = split_string(
-            mcbp::datatype::to_string(input_item_info.datatype), ",");
-        for (const auto& d : datatypes) {
-            cJSON_AddItemToArray(array.get(), cJSON_CreateString(d.c_str()));
+        const char* datatype = "\"invalid\"";
+        if (mcbp::datatype::is_valid(input_item_info.datatype)) {
+            datatype = datatype_array[input_item_info.datatype];
         }
 
-        cJSON_AddItemToObject(doc.get(), "datatype", array.release());
-
-        cJSON_AddBoolToObject(
-                doc.get(),
-                "deleted",
-                input_item_info.document_state == DocumentState::Deleted);
-
-        unique_cJSON_ptr root(cJSON_CreateObject());
-        cJSON_AddItemToObject(root.get(), "$document", doc.release());
-        document_vattr = to_string(root, false);
+        const int len = snprintf(
+                document_vattr.data(),
+                document_vattr.size(),
+                "{\"$document\":{\"CAS\":%s,\"vbucket_uuid\":%s,"
+                "\"seqno\":%s,\"exptime\":%" PRId64 ",\"value_bytes\":%" PRIu64
+                ",\"datatype\":[%s],\"deleted\":%s}}",
+                cas,
+                vbucket_uuid,
+                seqno,
+                int64_t(mc_time_convert_to_abs_time(input_item_info.exptime)),
+                value_bytes,
+                datatype,
+                input_item_info.document_state == DocumentState::Deleted
+                        ? "true"
+                        : "false");
+        if (len < 0 || size_t(len) >= document_vattr.size()) {
+            throw std::logic_error(
+                    "SubdocCmdContext::get_document_vattr: buffer too small");
+        }
+        document_vattr_len = size_t(len);
     }
 
-    return cb::const_char_buffer(document_vattr.data(), document_vattr.size());
+    return cb::const_char_buffer(document_vattr.data(), document_vattr_len);
 }
 
 protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
         uint64_t client_cas) {
-    item_info& info = getInputItemInfo();
-    auto& c = connection;
-
-    if (!bucket_get_item_info(&connection, c.getItem(), &info)) {
-        LOG_WARNING(&c, "%u: Failed to get item info", c.getId());
+    item_info info;
+    if (!bucket_get_item_info(&connection, connection.getItem(), &info)) {
+        LOG_WARNING(&connection, "%u: Failed to get item info",
+                    connection.getId());
         return PROTOCOL_BINARY_RESPONSE_EINTERNAL;
     }
 
+    return get_document_for_searching(info, client_cas);
+}
+
+protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
+        const item_info& document, uint64_t client_cas) {
+    input_item_info = document;
+    const item_info& info = input_item_info;
+    auto& c = connection;
+
     if (info.cas == -1ull) {
         // Check that item is not locked:
         if (client_cas == 0 || client_cas == -1ull) {
@@ -299,7 +318,10 @@ protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
     in_document_state = info.document_state;
 
     if (mcbp::datatype::is_snappy(info.datatype)) {
-        // Need to expand before attempting to extract from it.
+        // Need to expand before attempting to extract from it. The entire
+        // document is inflated: the value is a single Snappy blob (which
+        // is what GET and DCP hand out), and subjson needs a contiguous
+        // document to search anyway.
         try {
             using namespace cb::compression;
             if (!inflate(Algorithm::Snappy,
@@ -325,10 +347,14 @@ protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
             return PROTOCOL_BINARY_RESPONSE_ENOMEM;
         }
 
+        get_thread_stats(&c)->bytes_subdoc_inflated +=
+                inflated_doc_buffer.len;
+
         // Update document to point to the uncompressed version in the buffer.
         in_doc.buf = inflated_doc_buffer.data.get();
         in_doc.len = inflated_doc_buffer.len;
         in_datatype &= ~PROTOCOL_BINARY_DATATYPE_SNAPPY;
+        in_compressed = true;
     }
 
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
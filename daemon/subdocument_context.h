@@ -22,6 +22,7 @@
 #include "subdocument_traits.h"
 #include "xattr/utils.h"
 
+#include <array>
 #include <cstddef>
 #include <iomanip>
 #include <memory>
@@ -29,6 +30,7 @@
 #include <platform/sized_buffer.h>
 
 #include <unordered_map>
+#include <vector>
 
 enum class MutationSemantics : uint8_t { Add, Replace, Set };
 
@@ -61,6 +63,7 @@ public:
         in_flags(0),
         in_datatype(PROTOCOL_BINARY_RAW_BYTES),
         in_document_state(DocumentState::Alive),
+        in_compressed(false),
         executed(false),
         jroot_type(JSONSL_T_ROOT),
         needs_new_doc(false),
@@ -69,12 +72,17 @@ public:
         out_doc_len(0),
         out_doc(),
         response_val_len(0),
+        item_reserved(false),
+        batch(false),
+        batch_status(PROTOCOL_BINARY_RESPONSE_SUCCESS),
         do_macro_expansion(false),
         do_allow_deleted_docs(false),
         do_delete_doc(false),
         no_sys_xattrs(false),
         mutationSemantics(MutationSemantics::Replace),
-        currentPhase(Phase::XATTR) {
+        currentPhase(Phase::XATTR),
+        numPaddedMacros(0),
+        document_vattr_len(0) {
         std::memset(&input_item_info, 0, sizeof(input_item_info));
     }
 
@@ -124,6 +132,10 @@ public:
      * Not impossible, but I don't think it would simplify the logic
      * that much ;-)
      *
+     * The padding has the same width as the expanded value ("0x" followed
+     * by 16 hex digits, in quotes) so that pre_link_document may patch the
+     * value in place.
+     *
      * @param payload the JSON value for the xattr to perform macro
      *                substitution in
      */
@@ -175,6 +187,10 @@ public:
     // document in the engine being compressed
     cb::compression::Buffer inflated_doc_buffer;
 
+    // Temporary buffer to hold the compressed version of the new document
+    // (if we should store it compressed)
+    cb::compression::Buffer deflated_doc_buffer;
+
 
     // Temporary buffer used to hold the intermediate result document for
     // multi-path mutations. {in_doc} is then updated to point to this to use
@@ -201,6 +217,10 @@ public:
     // to to set the new documents state.
     DocumentState in_document_state;
 
+    // True if the document in the engine was Snappy compressed (and
+    // `in_doc` refers to the inflated version)
+    bool in_compressed;
+
     // True if this operation has been successfully executed (via subjson)
     // and we have valid result.
     bool executed;
@@ -222,8 +242,9 @@ public:
     uint64_t vbucket_uuid;
     uint64_t sequence_no;
 
-    // [Mutations only] Size in bytes of the new item to store into engine.
-    // Held in the context so upon success we can update statistics.
+    // [Mutations only] Size in bytes of the new (uncompressed) document to
+    // store into engine. Held in the context so upon success we can update
+    // statistics.
     size_t out_doc_len;
 
     // [Mutations only] New item to store into engine. _Must_ be released
@@ -233,6 +254,16 @@ public:
     // Size in bytes of the response value to send back to the client.
     size_t response_val_len;
 
+    // [Lookups only] True if the connection took over the reference to the
+    // input item so that the response may be sent with MSG_ZEROCOPY.
+    bool item_reserved;
+
+    // True if this is one of the keys of a SUBDOC_MULTI_KEY command. Errors
+    // are then recorded in batch_status (and returned as the status of the
+    // key) instead of being sent to the client.
+    bool batch;
+    protocol_binary_response_status batch_status;
+
     // Set to true if one (or more) of the xattr operation wants to do
     // macro expansion.
     bool do_macro_expansion;
@@ -312,8 +343,9 @@ public:
 
     /**
      * Get the document containing all of the virtual attributes for
-     * the document. The storage is created the first time the method is called,
-     * and reused for the rest of the lifetime of the context.
+     * the document. It is formatted into a buffer in the context the first
+     * time the method is called, and reused for the rest of the lifetime
+     * of the context.
      */
     cb::const_char_buffer get_document_vattr();
 
@@ -338,6 +370,14 @@ public:
     protocol_binary_response_status get_document_for_searching(
             uint64_t client_cas);
 
+    /**
+     * Same as above, but for a document provided by the engine (see
+     * ENGINE_HANDLE_V1::update) rather than the item held by the
+     * connection. The document must stay valid while it is operated on.
+     */
+    protocol_binary_response_status get_document_for_searching(
+            const item_info& info, uint64_t client_cas);
+
 private:
     // The item info representing the input document
     item_info input_item_info;
@@ -352,18 +392,84 @@ private:
     // The phase we're currently operating in
     Phase currentPhase;
 
-    template <typename T>
-    std::string macroToString(T macroValue);
-
-    void substituteMacro(cb::const_char_buffer macroName,
-                         const std::string& macroValue,
-                         cb::byte_buffer& value);
-
     // The xattr key being accessed in this command
     cb::const_byte_buffer xattr_key;
 
-    using MacroPair = std::pair<cb::const_char_buffer, std::string>;
-    std::vector<MacroPair> paddedMacros;
+    /**
+     * The width of the macro padding (and the expanded values): "0x"
+     * followed by 16 hex digits, in quotes
+     */
+    static const size_t MacroValueLength = 20;
+
+    struct PaddedMacro {
+        cb::const_char_buffer name;
+        std::array<char, MacroValueLength> value;
+    };
+
+    // The padding generated for each of the macros used in the command
+    // (there is only ${Mutation.CAS} and ${Mutation.seqno})
+    std::array<PaddedMacro, 2> paddedMacros;
+    size_t numPaddedMacros;
 
-    std::string document_vattr;
+    // The document returned by get_document_vattr (the size fits the
+    // longest possible document), and its length (0 until it is formatted)
+    std::array<char, 320> document_vattr;
+    size_t document_vattr_len;
 }; // class SubdocCmdContext
+
+/**
+ * Command context for SUBDOC_MULTI_KEY, which applies the same multi-path
+ * lookup or mutation to a list of keys. The keys are executed one at the
+ * time, each with its own SubdocCmdContext which is kept here while the
+ * key is being executed (so that we may resume after EWOULDBLOCK), and the
+ * result of each key is appended to the response value.
+ */
+class SubdocMultiKeyContext : public CommandContext {
+public:
+    struct Key {
+        cb::const_char_buffer key;
+        uint16_t vbucket;
+    };
+
+    SubdocMultiKeyContext(const SubdocCmdTraits traits_,
+                          cb::const_char_buffer specs_)
+        : traits(traits_),
+          specs(specs_),
+          next(0),
+          attempts(0),
+          update_in_engine(false) {
+    }
+
+    ENGINE_ERROR_CODE pre_link_document(item_info& info) override {
+        if (current) {
+            return current->pre_link_document(info);
+        }
+        return ENGINE_SUCCESS;
+    }
+
+    // The traits of the multi-path command to run for each of the keys
+    const SubdocCmdTraits traits;
+
+    // The lookup or mutation specs. Owned by the request packet.
+    const cb::const_char_buffer specs;
+
+    // The keys to operate on. Owned by the request packet.
+    std::vector<Key> keys;
+
+    // Index (in keys) of the key currently being executed
+    size_t next;
+
+    // The number of attempts made for the current key (we auto-retry in
+    // the event of a concurrent update of the document)
+    int attempts;
+
+    // Set once the current key lost a race with another client, so that
+    // the operation is run through the engine's update call
+    bool update_in_engine;
+
+    // The context for the current key
+    std::unique_ptr<SubdocCmdContext> current;
+
+    // The response value; the status, CAS and result of each of the keys
+    std::vector<char> response;
+};
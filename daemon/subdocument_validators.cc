@@ -401,26 +401,21 @@ static protocol_binary_response_status is_valid_multipath_spec(
 }
 
 
-// Multi-path commands are a bit special - don't use the subdoc_validator<>
-// for them.
-static protocol_binary_response_status subdoc_multi_validator(const Cookie& cookie,
-                                                              const SubdocMultiCmdTraits traits)
-{
-    auto req = static_cast<protocol_binary_request_header*>(McbpConnection::getPacket(cookie));
-
-    // 1. Check simple static values.
-
-    // Must have at least one lookup spec
-    const size_t minimum_body_len = ntohs(req->request.keylen) + req->request.extlen + traits.min_value_len;
-
-    if ((req->request.magic != PROTOCOL_BINARY_REQ) ||
-        (req->request.keylen == 0) ||
-        (req->request.bodylen < minimum_body_len) ||
-        (req->request.datatype != PROTOCOL_BINARY_RAW_BYTES)) {
-        return PROTOCOL_BINARY_RESPONSE_EINVAL;
-    }
-
-    // 1a. extlen can be either 0 or 1 for lookups, can be 0, 1, 4 or 5 for
+/**
+ * Validate the extras of a multi-path command (or a SUBDOC_MULTI_KEY
+ * command, which uses the same extras as its multi-path command)
+ *
+ * @param req The request header
+ * @param traits The traits of the multi-path command
+ * @param doc_flags [OUT] The doc flags of the command
+ * @return PROTOCOL_BINARY_RESPONSE_SUCCESS if the extras are valid, or an
+ *         error to return to the client otherwise
+ */
+static protocol_binary_response_status validate_multi_extras(
+        const protocol_binary_request_header* req,
+        const SubdocMultiCmdTraits traits,
+        mcbp::subdoc::doc_flag& doc_flags) {
+    // extlen can be either 0 or 1 for lookups, can be 0, 1, 4 or 5 for
     // mutations. Mutations can have expiry (4) and both mutations and lookups
     // can have doc_flags (1)
     if (traits.is_mutator) {
@@ -436,8 +431,7 @@ static protocol_binary_response_status subdoc_multi_validator(const Cookie& cook
     }
 
     // Can only decode only after we've checked the extlen is valid
-    const mcbp::subdoc::doc_flag doc_flags =
-            subdoc_decode_doc_flags(req, SubdocPath::MULTI);
+    doc_flags = subdoc_decode_doc_flags(req, SubdocPath::MULTI);
 
     // If an add command, check that the CAS is 0:
     if (hasAdd(doc_flags) && req->request.cas != 0) {
@@ -449,17 +443,30 @@ static protocol_binary_response_status subdoc_multi_validator(const Cookie& cook
         return PROTOCOL_BINARY_RESPONSE_EINVAL;
     }
 
-    // 2. Check that the lookup operation specs are valid.
-    //    As an "optimization" you can't mix and match the xattr and the
-    //    normal paths given that they operate on different segments of
-    //    the packet. Let's force the client to sort all of the xattrs
-    //    operations _first_.
+    return PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+/**
+ * Validate the lookup or mutation specs of a multi-path command
+ *
+ * @param cookie The cookie representing the command
+ * @param traits The traits of the multi-path command
+ * @param doc_flags The doc flags of the command
+ * @param specs The encoded specs (the rest of the body)
+ * @return PROTOCOL_BINARY_RESPONSE_SUCCESS if all of the specs are valid,
+ *         or an error to return to the client otherwise
+ */
+static protocol_binary_response_status validate_multipath_specs(
+        const Cookie& cookie,
+        const SubdocMultiCmdTraits traits,
+        mcbp::subdoc::doc_flag doc_flags,
+        cb::const_char_buffer specs) {
+    // As an "optimization" you can't mix and match the xattr and the
+    // normal paths given that they operate on different segments of
+    // the packet. Let's force the client to sort all of the xattrs
+    // operations _first_.
     bool xattrs_allowed = true;
-    const char* const body_ptr = reinterpret_cast<const char*>(McbpConnection::getPacket(cookie)) +
-                                 sizeof(*req);
-    const size_t keylen = ntohs(req->request.keylen);
-    const size_t bodylen = ntohl(req->request.bodylen);
-    size_t body_validated = keylen + req->request.extlen;
+    size_t body_validated = 0;
     unsigned int path_index;
 
     cb::const_byte_buffer xattr_key;
@@ -468,7 +475,7 @@ static protocol_binary_response_status subdoc_multi_validator(const Cookie& cook
 
     for (path_index = 0;
          (path_index < PROTOCOL_BINARY_SUBDOC_MULTI_MAX_PATHS) &&
-         (body_validated < bodylen);
+         (body_validated < specs.len);
          path_index++) {
         if (!body_commands_allowed) {
             return PROTOCOL_BINARY_RESPONSE_SUBDOC_INVALID_COMBO;
@@ -481,7 +488,7 @@ static protocol_binary_response_status subdoc_multi_validator(const Cookie& cook
         bool is_isolationist;
 
         const auto status = is_valid_multipath_spec(cookie,
-                                                    body_ptr + body_validated,
+                                                    specs.buf + body_validated,
                                                     traits,
                                                     spec_len,
                                                     is_xattr,
@@ -510,13 +517,50 @@ static protocol_binary_response_status subdoc_multi_validator(const Cookie& cook
 
     // Only valid if we found at least one path and the validated
     // length is exactly the same as the specified length.
-    if ((path_index == 0) || (body_validated != bodylen)) {
+    if ((path_index == 0) || (body_validated != specs.len)) {
         return PROTOCOL_BINARY_RESPONSE_SUBDOC_INVALID_COMBO;
     }
 
     return PROTOCOL_BINARY_RESPONSE_SUCCESS;
 }
 
+// Multi-path commands are a bit special - don't use the subdoc_validator<>
+// for them.
+static protocol_binary_response_status subdoc_multi_validator(const Cookie& cookie,
+                                                              const SubdocMultiCmdTraits traits)
+{
+    auto req = static_cast<protocol_binary_request_header*>(McbpConnection::getPacket(cookie));
+
+    // 1. Check simple static values.
+
+    // Must have at least one lookup spec
+    const size_t minimum_body_len = ntohs(req->request.keylen) + req->request.extlen + traits.min_value_len;
+
+    if ((req->request.magic != PROTOCOL_BINARY_REQ) ||
+        (req->request.keylen == 0) ||
+        (req->request.bodylen < minimum_body_len) ||
+        (req->request.datatype != PROTOCOL_BINARY_RAW_BYTES)) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    // 1a. Check the extras (and the doc flags encoded there)
+    mcbp::subdoc::doc_flag doc_flags;
+    auto status = validate_multi_extras(req, traits, doc_flags);
+    if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        return status;
+    }
+
+    // 2. Check that the lookup operation specs are valid.
+    const char* const body_ptr = reinterpret_cast<const char*>(McbpConnection::getPacket(cookie)) +
+                                 sizeof(*req);
+    const size_t keylen = ntohs(req->request.keylen);
+    const size_t bodylen = ntohl(req->request.bodylen);
+    const size_t offset = keylen + req->request.extlen;
+
+    return validate_multipath_specs(
+            cookie, traits, doc_flags, {body_ptr + offset, bodylen - offset});
+}
+
 protocol_binary_response_status subdoc_multi_lookup_validator(const Cookie& cookie) {
     return subdoc_multi_validator(cookie, get_multi_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP>());
 }
@@ -525,6 +569,74 @@ protocol_binary_response_status subdoc_multi_mutation_validator(const Cookie& co
     return subdoc_multi_validator(cookie, get_multi_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION>());
 }
 
+protocol_binary_response_status subdoc_multi_key_validator(const Cookie& cookie) {
+    auto req = static_cast<protocol_binary_request_header*>(McbpConnection::getPacket(cookie));
+
+    // The keys are in the value and the CAS of each of them is picked
+    // by the server (we auto-retry on a concurrent update)
+    const size_t bodylen = ntohl(req->request.bodylen);
+    const size_t header_len = sizeof(uint8_t) + sizeof(uint16_t);
+    if ((req->request.magic != PROTOCOL_BINARY_REQ) ||
+        (req->request.keylen != 0) ||
+        (req->request.cas != 0) ||
+        (bodylen < req->request.extlen + header_len) ||
+        (req->request.datatype != PROTOCOL_BINARY_RAW_BYTES)) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    const char* ptr = reinterpret_cast<const char*>(req) + sizeof(*req) +
+                      req->request.extlen;
+    const char* const end = ptr + bodylen - req->request.extlen;
+
+    SubdocMultiCmdTraits traits;
+    switch (uint8_t(*ptr)) {
+    case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+        traits = get_multi_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP>();
+        break;
+    case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+        traits = get_multi_traits<PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION>();
+        break;
+    default:
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    mcbp::subdoc::doc_flag doc_flags;
+    auto status = validate_multi_extras(req, traits, doc_flags);
+    if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        return status;
+    }
+
+    uint16_t nkeys;
+    std::memcpy(&nkeys, ptr + sizeof(uint8_t), sizeof(nkeys));
+    nkeys = ntohs(nkeys);
+    if (nkeys == 0 || nkeys > PROTOCOL_BINARY_SUBDOC_MULTI_KEY_MAX_KEYS) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+    ptr += header_len;
+
+    for (uint16_t ii = 0; ii < nkeys; ++ii) {
+        uint16_t keylen;
+        if (size_t(end - ptr) < sizeof(uint16_t) + sizeof(keylen)) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+        std::memcpy(&keylen, ptr + sizeof(uint16_t), sizeof(keylen));
+        keylen = ntohs(keylen);
+        ptr += sizeof(uint16_t) + sizeof(keylen);
+        if (keylen == 0 || keylen > KEY_MAX_LENGTH ||
+            size_t(end - ptr) < keylen) {
+            return PROTOCOL_BINARY_RESPONSE_EINVAL;
+        }
+        ptr += keylen;
+    }
+
+    if (size_t(end - ptr) < traits.min_value_len) {
+        return PROTOCOL_BINARY_RESPONSE_EINVAL;
+    }
+
+    return validate_multipath_specs(
+            cookie, traits, doc_flags, {ptr, size_t(end - ptr)});
+}
+
 using namespace mcbp::subdoc;
 
 doc_flag subdoc_decode_doc_flags(const protocol_binary_request_header* header,
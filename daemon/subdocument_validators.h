@@ -73,6 +73,7 @@ protocol_binary_response_status subdoc_counter_validator(const Cookie& cookie);
 protocol_binary_response_status subdoc_get_count_validator(const Cookie& cookie);
 protocol_binary_response_status subdoc_multi_lookup_validator(const Cookie& cookie);
 protocol_binary_response_status subdoc_multi_mutation_validator(const Cookie& cookie);
+protocol_binary_response_status subdoc_multi_key_validator(const Cookie& cookie);
 
 /* Decode the doc flags from a packet */
 mcbp::subdoc::doc_flag subdoc_decode_doc_flags(
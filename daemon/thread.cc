@@ -7,6 +7,7 @@
 #include "connections.h"
 
 #include <atomic>
+#include <chrono>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -18,53 +19,83 @@
 #include <platform/cb_malloc.h>
 #include <platform/platform.h>
 #include <platform/strerror.h>
-#include <queue>
+#include <deque>
 #include <memory>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #define ITEMS_PER_ALLOC 64
 
+#ifndef __linux__
 static char devnull[8192];
+#endif
 extern std::atomic<bool> memcached_shutdown;
 
 /* An item in the connection queue. */
 struct ConnectionQueueItem {
     ConnectionQueueItem(SOCKET sock, in_port_t port)
         : sfd(sock),
-          parent_port(port) {
+          parent_port(port),
+          next(nullptr) {
         // empty
     }
 
     SOCKET sfd;
     in_port_t parent_port;
+    ConnectionQueueItem* next;
 };
 
+/*
+ * Multi-producer single-consumer queue of new connections. Producers
+ * push onto a lock-free stack; the owning thread grabs the entire stack
+ * in a single exchange and reverses it to restore the FIFO order.
+ */
 class ConnectionQueue {
 public:
     ~ConnectionQueue() {
-        while (!connections.empty()) {
-            safe_close(connections.front()->sfd);
-            connections.pop();
+        std::unique_ptr<ConnectionQueueItem> item;
+        while ((item = pop()) != nullptr) {
+            safe_close(item->sfd);
         }
     }
 
+    /* May only be called by the thread owning the queue */
     std::unique_ptr<ConnectionQueueItem> pop() {
-        std::lock_guard<std::mutex> guard(mutex);
         if (connections.empty()) {
-            return nullptr;
+            auto* item = head.exchange(nullptr);
+            while (item != nullptr) {
+                auto* next = item->next;
+                item->next = nullptr;
+                connections.emplace_front(item);
+                item = next;
+            }
+            if (connections.empty()) {
+                return nullptr;
+            }
         }
         std::unique_ptr<ConnectionQueueItem> ret(std::move(connections.front()));
-        connections.pop();
+        connections.pop_front();
         return ret;
     }
 
     void push(std::unique_ptr<ConnectionQueueItem> &item) {
-        std::lock_guard<std::mutex> guard(mutex);
-        connections.push(std::move(item));
+        auto* entry = item.release();
+        entry->next = head.load();
+        while (!head.compare_exchange_weak(entry->next, entry)) {
+            // entry->next was updated with the current head
+        }
     }
 
 private:
-    std::mutex mutex;
-    std::queue< std::unique_ptr<ConnectionQueueItem> > connections;
+    /* Items pushed by other threads (in LIFO order) */
+    std::atomic<ConnectionQueueItem*> head{nullptr};
+    /* Items grabbed by the owning thread (in FIFO order) */
+    std::deque< std::unique_ptr<ConnectionQueueItem> > connections;
 };
 
 
@@ -105,8 +136,23 @@ static void create_worker(void (*func)(void *), void *arg, cb_thread_t *id,
 
 /****************************** LIBEVENT THREADS *****************************/
 
+/*
+ * Create the channel other threads use to wake up the thread. On Linux
+ * this is an eventfd (so notify[0] and notify[1] refer to the same
+ * descriptor), elsewhere a socketpair.
+ */
 bool create_notification_pipe(LIBEVENT_THREAD *me)
 {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        log_system_error(EXTENSION_LOG_WARNING, NULL,
+                         "Can't create notify eventfd: %s");
+        return false;
+    }
+    me->notify[0] = me->notify[1] = fd;
+    return true;
+#else
     int j;
 
 #ifdef WIN32
@@ -142,12 +188,35 @@ bool create_notification_pipe(LIBEVENT_THREAD *me)
         }
     }
     return true;
+#endif
+}
+
+/*
+ * Write a single notification to the channel created by
+ * create_notification_pipe()
+ */
+static void send_notification(SOCKET fd) {
+#ifdef __linux__
+    const uint64_t one = 1;
+    if (::write(fd, &one, sizeof(one)) != sizeof(one) &&
+        !is_blocking(GetLastNetworkError())) {
+        log_system_error(EXTENSION_LOG_WARNING, NULL,
+                         "Failed to notify thread: %s");
+    }
+#else
+    if (send(fd, "", 1, 0) != 1 &&
+            !is_blocking(GetLastNetworkError())) {
+        log_socket_error(EXTENSION_LOG_WARNING, NULL,
+                         "Failed to notify thread: %s");
+    }
+#endif
 }
 
 static void setup_dispatcher(struct event_base *main_base,
                              void (*dispatcher_callback)(evutil_socket_t, short, void *))
 {
-    memset(&dispatcher_thread, 0, sizeof(dispatcher_thread));
+    memset(static_cast<void*>(&dispatcher_thread), 0,
+           sizeof(dispatcher_thread));
     dispatcher_thread.type = ThreadType::DISPATCHER;
     dispatcher_thread.base = main_base;
 	dispatcher_thread.thread_id = cb_thread_self();
@@ -208,12 +277,80 @@ static void setup_thread(LIBEVENT_THREAD *me) {
     me->subdoc_op = subdoc_op_alloc();
 
     try {
-        me->validator = new JSON_checker::Validator();
+        me->validator = new JsonValidator();
     } catch (const std::bad_alloc&) {
         FATAL_ERROR(EXIT_FAILURE, "Failed to allocate memory for JSON validator");
     }
 }
 
+/*
+ * Bind the calling worker thread to the CPU specified in the
+ * "worker_cpu_affinity" setting (if any)
+ */
+static void set_worker_cpu_affinity(LIBEVENT_THREAD *me) {
+    const auto& cpus = settings.getWorkerCpuAffinity();
+    if (cpus.empty()) {
+        return;
+    }
+
+    const int cpu = cpus[me->index % cpus.size()];
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+                                       &cpuset);
+    if (error != 0) {
+        LOG_WARNING(nullptr, "Failed to bind worker thread %u to CPU %d: %s",
+                    me->index, cpu, cb_strerror(error).c_str());
+    } else {
+        LOG_INFO(nullptr, "Bound worker thread %u to CPU %d", me->index, cpu);
+    }
+#else
+    LOG_WARNING(nullptr,
+                "worker_cpu_affinity is not supported on this platform. "
+                "Worker thread %u not bound to CPU %d", me->index, cpu);
+#endif
+}
+
+/*
+ * Run the event loop for a worker thread until someone breaks it.
+ *
+ * When "worker_busy_poll_usec" is set the thread keeps polling libevent
+ * without blocking until it hasn't found any work for the configured
+ * window, before it blocks in the kernel waiting for the next event. This
+ * avoids the cost of being woken up by the scheduler (at the cost of
+ * burning CPU) for workloads where the next request arrives shortly
+ * after the previous one.
+ */
+static void worker_event_loop(LIBEVENT_THREAD *me) {
+    using std::chrono::steady_clock;
+
+    while (true) {
+        const std::chrono::microseconds window(
+                settings.getWorkerBusyPollUsec());
+        if (window.count() != 0) {
+            auto deadline = steady_clock::now() + window;
+            auto events = me->num_events;
+            do {
+                if (event_base_loop(me->base, EVLOOP_NONBLOCK) != 0 ||
+                    event_base_got_break(me->base)) {
+                    return;
+                }
+                if (me->num_events != events) {
+                    events = me->num_events;
+                    deadline = steady_clock::now() + window;
+                }
+            } while (steady_clock::now() < deadline);
+        }
+
+        if (event_base_loop(me->base, EVLOOP_ONCE) != 0 ||
+            event_base_got_break(me->base)) {
+            return;
+        }
+    }
+}
+
 /*
  * Worker thread: main event loop
  */
@@ -223,39 +360,59 @@ static void worker_libevent(void *arg) {
     /* Any per-thread setup can happen here; thread_init() will block until
      * all threads have finished initializing.
      */
+    set_worker_cpu_affinity(me);
 
     cb_mutex_enter(&init_lock);
     init_count++;
     cb_cond_signal(&init_cond);
     cb_mutex_exit(&init_lock);
 
-    event_base_loop(me->base, 0);
+    worker_event_loop(me);
 
     // Event loop exited; cleanup before thread exits.
     ERR_remove_state(0);
 }
 
-static int number_of_pending(Connection *c, Connection *list) {
-    int rv = 0;
-    for (; list; list = list->getNext()) {
-        if (list == c) {
-            rv ++;
-        }
+/*
+ * Read all of the pending notifications from the channel created by
+ * create_notification_pipe()
+ *
+ * @return the number of notifications read, or -1 on failure
+ */
+int64_t drain_notification_channel(evutil_socket_t fd)
+{
+#ifdef __linux__
+    uint64_t value;
+    if (::read(fd, &value, sizeof(value)) == sizeof(value)) {
+        return int64_t(value);
     }
-    return rv;
-}
 
-static void drain_notification_channel(evutil_socket_t fd)
-{
+    if (is_blocking(GetLastNetworkError())) {
+        return 0;
+    }
+
+    log_system_error(EXTENSION_LOG_WARNING, NULL,
+                     "Can't read from libevent pipe: %s");
+    return -1;
+#else
+    int64_t total = 0;
     int nread;
-    while ((nread = recv(fd, devnull, sizeof(devnull), 0)) == (int)sizeof(devnull)) {
-        /* empty */
+    while ((nread = recv(fd, devnull, sizeof(devnull), 0)) > 0) {
+        total += nread;
+        if (nread != (int)sizeof(devnull)) {
+            break;
+        }
     }
 
     if (nread == -1) {
-        log_socket_error(EXTENSION_LOG_WARNING, NULL,
-                         "Can't read from libevent pipe: %s");
+        if (!is_blocking(GetLastNetworkError())) {
+            log_socket_error(EXTENSION_LOG_WARNING, NULL,
+                             "Can't read from libevent pipe: %s");
+            return -1;
+        }
     }
+    return total;
+#endif
 }
 
 void dispatch_new_connections(LIBEVENT_THREAD* me) {
@@ -283,12 +440,14 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
     LIBEVENT_THREAD* me = reinterpret_cast<LIBEVENT_THREAD*>(arg);
 
     cb_assert(me->type == ThreadType::GENERAL);
-    // Start by draining the notification channel before doing any work.
-    // By doing so we know that we'll be notified again if someone
-    // tries to notify us while we're doing the work below (so we don't have
-    // to care about race conditions for stuff people try to notify us
-    // about.
+    me->num_events++;
+    // Start by draining the notification channel and clearing the
+    // notified flag before doing any work. By doing so we know that
+    // we'll be notified again if someone tries to notify us while we're
+    // doing the work below (so we don't have to care about race
+    // conditions for stuff people try to notify us about.
     drain_notification_channel(fd);
+    me->notified.store(false);
 
     if (memcached_shutdown) {
         // Someone requested memcached to shut down. The listen thread should
@@ -309,6 +468,7 @@ static void thread_libevent_process(evutil_socket_t fd, short which, void *arg)
     dispatch_new_connections(me);
 
     LOCK_THREAD(me);
+    drain_pending_notifications(me);
     Connection* pending = me->pending_io;
     me->pending_io = NULL;
     while (pending != NULL) {
@@ -439,18 +599,14 @@ void notify_io_complete(const void *void_cookie, ENGINE_ERROR_CODE status)
             "notify_io_complete: connection should be bound to a thread");
     }
 
-    int notify;
-
     LOG_DEBUG(NULL, "Got notify from %u, status 0x%x",
               connection->getId(), status);
 
-    LOCK_THREAD(thr);
-    reinterpret_cast<McbpConnection*>(connection)->setAiostat(status);
-    notify = add_conn_to_pending_io_list(connection);
-    UNLOCK_THREAD(thr);
-
-    /* kick the thread in the butt */
-    if (notify) {
+    // The status is handed over to the connection by the worker thread
+    // when it drains the list, so we don't need to lock the thread (and
+    // wait for it to finish whatever it's doing)
+    if (add_conn_to_pending_io_list(connection, status)) {
+        /* kick the thread in the butt */
         notify_thread(thr);
     }
 }
@@ -491,7 +647,9 @@ int is_listen_thread() {
 }
 
 void notify_dispatcher(void) {
-    notify_thread(&dispatcher_thread);
+    // The dispatcher counts the notifications (see dispatch_event_handler)
+    // so they can't be coalesced
+    send_notification(dispatcher_thread.notify[1]);
 }
 
 /******************************* GLOBAL STATS ******************************/
@@ -568,7 +726,9 @@ void threads_cleanup(void)
     int ii;
     for (ii = 0; ii < nthreads; ++ii) {
         safe_close(threads[ii].notify[0]);
-        safe_close(threads[ii].notify[1]);
+        if (threads[ii].notify[1] != threads[ii].notify[0]) {
+            safe_close(threads[ii].notify[1]);
+        }
         event_base_free(threads[ii].base);
 
         cb_free(threads[ii].read.buf);
@@ -611,22 +771,50 @@ void threads_initiate_bucket_deletion(void)
 }
 
 void notify_thread(LIBEVENT_THREAD *thread) {
-    if (send(thread->notify[1], "", 1, 0) != 1 &&
-            !is_blocking(GetLastNetworkError())) {
-        log_socket_error(EXTENSION_LOG_WARNING, NULL,
-                         "Failed to notify thread: %s");
+    // Coalesce the wakeups; the thread clears the flag when it drains
+    // the notification channel
+    if (!thread->notified.exchange(true)) {
+        send_notification(thread->notify[1]);
     }
 }
 
 int add_conn_to_pending_io_list(Connection *c) {
-    int notify = 0;
     auto thread = c->getThread();
-    if (number_of_pending(c, thread->pending_io) == 0) {
-        if (thread->pending_io == NULL) {
-            notify = 1;
-        }
-        enlist_conn(c, &thread->pending_io);
+    if (!c->markNotificationQueued()) {
+        // Already in the list (and the thread has been notified)
+        return 0;
     }
 
-    return notify;
+    Connection* head = thread->pending_notifications.load();
+    do {
+        c->setNotificationNext(head);
+    } while (!thread->pending_notifications.compare_exchange_weak(head, c));
+
+    return head == nullptr ? 1 : 0;
+}
+
+int add_conn_to_pending_io_list(Connection *c, ENGINE_ERROR_CODE status) {
+    // Must be stored before the connection is queued so that the worker
+    // sees it when it clears the queued flag
+    c->setNotificationStatus(status);
+    return add_conn_to_pending_io_list(c);
+}
+
+void drain_pending_notifications(LIBEVENT_THREAD *me) {
+    Connection* c = me->pending_notifications.exchange(nullptr);
+    while (c != nullptr) {
+        Connection* next = c->getNotificationNext();
+        c->setNotificationNext(nullptr);
+        c->clearNotificationQueued();
+
+        ENGINE_ERROR_CODE status;
+        if (c->consumeNotificationStatus(status)) {
+            reinterpret_cast<McbpConnection*>(c)->setAiostat(status);
+        }
+
+        if (!list_contains(me->pending_io, c)) {
+            enlist_conn(c, &me->pending_io);
+        }
+        c = next;
+    }
 }
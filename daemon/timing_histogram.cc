@@ -18,124 +18,310 @@
 #include "timing_histogram.h"
 
 #include <platform/platform.h>
-#include <atomic>
-#include <functional>
-#include <sstream>
-#include <string>
 #include <cJSON.h>
 #include <cJSON_utils.h>
-
-TimingHistogram::TimingHistogram() {
-    reset();
+#include <array>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+const uint8_t TimingHistogram::DefaultPrecision;
+const uint8_t TimingHistogram::MaxPrecision;
+const uint64_t TimingHistogram::MaxValue;
+
+TimingHistogram::TimingHistogram(uint8_t precision)
+    : precision(precision), bins(nullptr) {
+    if (precision == 0 || precision > MaxPrecision) {
+        throw std::invalid_argument(
+                "TimingHistogram: precision must be in the range [1, " +
+                std::to_string(MaxPrecision) + "]");
+    }
+    total.reset();
 }
 
-TimingHistogram::TimingHistogram(const TimingHistogram &other) {
+TimingHistogram::TimingHistogram(const TimingHistogram &other)
+    : TimingHistogram(other.precision) {
     *this = other;
 }
 
-template <template <typename ...Args> class F>
-void TimingHistogram::arith_op(TimingHistogram& a, const TimingHistogram& b) {
-    a.ns = F<uint32_t>()(a.ns, b.ns);
+TimingHistogram::~TimingHistogram() {
+    freeBins();
+}
 
-    size_t idx;
-    size_t len = a.usec.size();
-    for (idx = 0; idx < len; ++idx) {
-        a.usec[idx] = F<uint32_t>()(a.usec[idx], b.usec[idx]);
-    }
+void TimingHistogram::freeBins() {
+    delete[] bins.exchange(nullptr);
+}
 
-    len = a.msec.size();
-    for (idx = 0; idx < len; ++idx) {
-        a.msec[idx] = F<uint32_t>()(a.msec[idx], b.msec[idx]);
-    }
+size_t TimingHistogram::getNumBins(uint8_t precision) {
+    // One linear bin per value below 2^precision, then 2^precision bins
+    // for each power of two up to MaxValue (which needs 36 bits)
+    return size_t(37 - precision) << precision;
+}
 
-    len = a.halfsec.size();
-    for (idx = 0; idx < len; ++idx) {
-        a.halfsec[idx] = F<uint32_t>()(a.halfsec[idx], b.halfsec[idx]);
+std::atomic<uint64_t>* TimingHistogram::getBins() {
+    auto* ret = bins.load();
+    if (ret != nullptr) {
+        return ret;
     }
 
-    len = a.wayout.size();
-    for (idx = 0; idx < len; ++idx) {
-        a.wayout[idx] = F<uint32_t>()(a.wayout[idx], b.wayout[idx]);
+    const auto num = getNumBins();
+    std::unique_ptr<std::atomic<uint64_t>[]> allocated(
+            new std::atomic<uint64_t>[num]);
+    for (size_t ii = 0; ii < num; ++ii) {
+        allocated[ii].store(0, std::memory_order_relaxed);
     }
-    a.total = F<uint64_t>()(a.total, b.total);
-}
 
-template <typename T>
-struct identity {
-    T operator() (const T& a, const T& b) {
-        return b;
+    if (bins.compare_exchange_strong(ret, allocated.get())) {
+        return allocated.release();
     }
-};
+    // Someone else beat us to it (ret now contains their array)
+    return ret;
+}
 
 /**
- * This isn't completely accurate, but it's only called whenever we're
- * grabbing the stats. We don't want to create a lock in order to make
- * sure that "total" is in 100% sync with all of the samples.. We
- * don't care <em>THAT</em> much for being accurate..
+ * As with the old fixed bucket histogram this isn't completely accurate
+ * if samples are added while we're copying, but it's only called whenever
+ * we're grabbing the stats.
  */
 TimingHistogram& TimingHistogram::operator=(const TimingHistogram& other) {
-    TimingHistogram::arith_op<identity>(*this, other);
+    if (this == &other) {
+        return *this;
+    }
+
+    if (precision != other.precision) {
+        freeBins();
+        precision = other.precision;
+    }
+
+    const auto* src = other.bins.load();
+    if (src == nullptr) {
+        reset();
+        return *this;
+    }
+
+    auto* dst = getBins();
+    const auto num = getNumBins();
+    for (size_t ii = 0; ii < num; ++ii) {
+        dst[ii].store(src[ii].load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    }
+    total = other.total.load();
     return *this;
 }
 
-/**
- * As per operator=, this isn't completely accurate/consistent, but it's only
- * called whenever we're grabbing the stats.
- */
 TimingHistogram& TimingHistogram::operator+=(const TimingHistogram& other) {
-    TimingHistogram::arith_op<std::plus>(*this, other);
+    if (precision != other.precision) {
+        throw std::invalid_argument(
+                "TimingHistogram::operator+=: can't merge histograms with "
+                "different precision");
+    }
+
+    const auto* src = other.bins.load();
+    if (src == nullptr) {
+        return *this;
+    }
+
+    auto* dst = getBins();
+    const auto num = getNumBins();
+    for (size_t ii = 0; ii < num; ++ii) {
+        const auto value = src[ii].load(std::memory_order_relaxed);
+        if (value != 0) {
+            dst[ii].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+    total += other.total.load();
     return *this;
 }
 
 void TimingHistogram::reset(void) {
-    ns = 0;
-    for (auto& us : usec) {
-        us.reset();
+    // Don't free the bins as other threads may be adding samples
+    auto* array = bins.load();
+    if (array != nullptr) {
+        const auto num = getNumBins();
+        for (size_t ii = 0; ii < num; ++ii) {
+            array[ii].store(0, std::memory_order_relaxed);
+        }
     }
-    for (auto& ms : msec) {
-        ms.reset();
+    total.reset();
+}
+
+size_t TimingHistogram::getBinIndex(uint64_t usec) const {
+    if (usec > MaxValue) {
+        usec = MaxValue;
     }
-    for (auto& hs : halfsec) {
-        hs.reset();
+
+    const uint64_t linear = uint64_t(1) << precision;
+    if (usec < linear) {
+        return size_t(usec);
     }
-    for (auto& wo: wayout) {
-        wo.reset();
+
+    // Position of the most significant bit
+    int msb = 63;
+    while ((usec & (uint64_t(1) << msb)) == 0) {
+        --msb;
     }
-    total.reset();
+    const int shift = msb - precision;
+    return (size_t(shift + 1) << precision) +
+           size_t((usec >> shift) - linear);
+}
+
+uint64_t TimingHistogram::getBinLowerBound(size_t index) const {
+    const size_t linear = size_t(1) << precision;
+    if (index < linear) {
+        return index;
+    }
+    const int shift = int(index >> precision) - 1;
+    return uint64_t(linear + (index & (linear - 1))) << shift;
+}
+
+uint64_t TimingHistogram::getBinUpperBound(size_t index) const {
+    const size_t linear = size_t(1) << precision;
+    if (index < linear) {
+        return index;
+    }
+    const int shift = int(index >> precision) - 1;
+    return getBinLowerBound(index) + (uint64_t(1) << shift) - 1;
 }
 
 void TimingHistogram::add(const hrtime_t nsec) {
-    hrtime_t us = nsec / 1000;
-    hrtime_t ms = us / 1000;
-    hrtime_t hs = ms / 500;
-
-    if (us == 0) {
-        ns++;
-    } else if (us < 1000) {
-        usec[us / 10]++;
-    } else if (ms < 50) {
-        msec[ms]++;
-    } else if (hs < 10) {
-        halfsec[hs]++;
-    } else {
-        // [5-9], [10-19], [20-39], [40-79], [80-inf].
-        hrtime_t sec = hs / 2;
-        if (sec < 10) {
-            wayout[0]++;
-        } else if (sec < 20) {
-            wayout[1]++;
-        } else if (sec < 40) {
-            wayout[2]++;
-        } else if (sec < 80) {
-            wayout[3]++;
-        } else {
-            wayout[4]++;
+    auto* array = getBins();
+    array[getBinIndex(nsec / 1000)].fetch_add(1, std::memory_order_relaxed);
+    total++;
+}
+
+uint64_t TimingHistogram::getBinCount(size_t index) const {
+    if (index >= getNumBins()) {
+        throw std::out_of_range("TimingHistogram::getBinCount: index " +
+                                std::to_string(index) + " is out of range");
+    }
+    const auto* array = bins.load();
+    if (array == nullptr) {
+        return 0;
+    }
+    return array[index].load(std::memory_order_relaxed);
+}
+
+uint64_t TimingHistogram::getValueAtPercentile(double percentile) const {
+    const auto* array = bins.load();
+    if (array == nullptr) {
+        return 0;
+    }
+
+    // Use a snapshot of the counters so that the total is consistent
+    // with the bins even if samples are added while we're looking
+    const auto num = getNumBins();
+    uint64_t sum = 0;
+    for (size_t ii = 0; ii < num; ++ii) {
+        sum += array[ii].load(std::memory_order_relaxed);
+    }
+    if (sum == 0) {
+        return 0;
+    }
+
+    if (percentile < 0.0) {
+        percentile = 0.0;
+    } else if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+
+    auto target = uint64_t(std::ceil(percentile / 100.0 * sum));
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t cumulative = 0;
+    for (size_t ii = 0; ii < num; ++ii) {
+        cumulative += array[ii].load(std::memory_order_relaxed);
+        if (cumulative >= target) {
+            return getBinUpperBound(ii);
         }
     }
-    total++;
+    return getBinUpperBound(num - 1);
 }
 
-std::string TimingHistogram::to_string(void) {
+namespace {
+/**
+ * The fixed buckets the histogram used to have. They're still part of
+ * the JSON we return so that existing consumers of "stats timings" keep
+ * working.
+ */
+struct LegacyBuckets {
+    void add(uint64_t usec, uint64_t count) {
+        const uint64_t ms = usec / 1000;
+        const uint64_t hs = ms / 500;
+
+        if (usec == 0) {
+            ns += count;
+        } else if (usec < 1000) {
+            this->usec[usec / 10] += count;
+        } else if (ms < 50) {
+            msec[ms] += count;
+        } else if (hs < 10) {
+            halfsec[hs] += count;
+        } else {
+            // [5-9], [10-19], [20-39], [40-79], [80-inf].
+            const uint64_t sec = hs / 2;
+            if (sec < 10) {
+                wayout[0] += count;
+            } else if (sec < 20) {
+                wayout[1] += count;
+            } else if (sec < 40) {
+                wayout[2] += count;
+            } else if (sec < 80) {
+                wayout[3] += count;
+            } else {
+                wayout[4] += count;
+            }
+        }
+    }
+
+    void addToObject(cJSON* root) const {
+        cJSON_AddNumberToObject(root, "ns", double(ns));
+
+        cJSON* array = cJSON_CreateArray();
+        for (const auto us : usec) {
+            cJSON_AddItemToArray(array, cJSON_CreateNumber(double(us)));
+        }
+        cJSON_AddItemToObject(root, "us", array);
+
+        array = cJSON_CreateArray();
+        // element 0 isn't used
+        for (size_t ii = 1; ii < msec.size(); ii++) {
+            cJSON_AddItemToArray(array, cJSON_CreateNumber(double(msec[ii])));
+        }
+        cJSON_AddItemToObject(root, "ms", array);
+
+        array = cJSON_CreateArray();
+        for (const auto hs : halfsec) {
+            cJSON_AddItemToArray(array, cJSON_CreateNumber(double(hs)));
+        }
+        cJSON_AddItemToObject(root, "500ms", array);
+
+        cJSON_AddNumberToObject(root, "5s-9s", double(wayout[0]));
+        cJSON_AddNumberToObject(root, "10s-19s", double(wayout[1]));
+        cJSON_AddNumberToObject(root, "20s-39s", double(wayout[2]));
+        cJSON_AddNumberToObject(root, "40s-79s", double(wayout[3]));
+        cJSON_AddNumberToObject(root, "80s-inf", double(wayout[4]));
+
+        uint64_t aggregated = 0;
+        for (const auto wo : wayout) {
+            aggregated += wo;
+        }
+        cJSON_AddNumberToObject(root, "wayout", double(aggregated));
+    }
+
+    uint64_t ns = 0;
+    std::array<uint64_t, 100> usec{};
+    std::array<uint64_t, 50> msec{};
+    std::array<uint64_t, 10> halfsec{};
+    std::array<uint64_t, 5> wayout{};
+};
+} // namespace
+
+std::string TimingHistogram::to_string(void) const {
     unique_cJSON_ptr json(cJSON_CreateObject());
     cJSON* root = json.get();
 
@@ -143,39 +329,43 @@ std::string TimingHistogram::to_string(void) {
         throw std::bad_alloc();
     }
 
-    cJSON_AddNumberToObject(root, "ns", get_ns());
-
-    cJSON *array = cJSON_CreateArray();
-    for (auto &us : usec) {
-        cJSON *obj = cJSON_CreateNumber(us);
-        cJSON_AddItemToArray(array, obj);
+    // Take a snapshot of the counters so that the legacy buckets and
+    // the bins are consistent even if samples are added while we're
+    // looking
+    std::vector<std::pair<size_t, uint64_t>> snapshot;
+    LegacyBuckets legacy;
+    const auto* counters = bins.load();
+    if (counters != nullptr) {
+        const auto num = getNumBins();
+        for (size_t ii = 0; ii < num; ++ii) {
+            const auto value = counters[ii].load(std::memory_order_relaxed);
+            if (value != 0) {
+                snapshot.emplace_back(ii, value);
+                // A bin may span more than one of the old buckets; use
+                // the one its lower bound falls into
+                legacy.add(getBinLowerBound(ii), value);
+            }
+        }
     }
-    cJSON_AddItemToObject(root, "us", array);
 
-    array = cJSON_CreateArray();
-    size_t len = msec.size();
-    // element 0 isn't used
-    for (size_t ii = 1; ii < len; ii++) {
-        cJSON *obj = cJSON_CreateNumber(get_msec(ii));
-        cJSON_AddItemToArray(array, obj);
-    }
-    cJSON_AddItemToObject(root, "ms", array);
+    legacy.addToObject(root);
 
-    array = cJSON_CreateArray();
-    for (auto &hs : halfsec) {
-        cJSON *obj = cJSON_CreateNumber(hs);
-        cJSON_AddItemToArray(array, obj);
-    }
-    cJSON_AddItemToObject(root, "500ms", array);
+    cJSON_AddNumberToObject(root, "precision", precision);
+    cJSON_AddStringToObject(root, "unit", "us");
 
-    cJSON_AddNumberToObject(root, "5s-9s", get_wayout(0));
-    cJSON_AddNumberToObject(root, "10s-19s", get_wayout(1));
-    cJSON_AddNumberToObject(root, "20s-39s", get_wayout(2));
-    cJSON_AddNumberToObject(root, "40s-79s", get_wayout(3));
-    cJSON_AddNumberToObject(root, "80s-inf", get_wayout(4));
+    uint64_t sum = 0;
+    cJSON* array = cJSON_CreateArray();
+    for (const auto& entry : snapshot) {
+        cJSON* bin = cJSON_CreateArray();
+        cJSON_AddItemToArray(bin, cJSON_CreateNumber(double(entry.first)));
+        cJSON_AddItemToArray(bin, cJSON_CreateNumber(double(entry.second)));
+        cJSON_AddItemToArray(array, bin);
+        sum += entry.second;
+    }
+    // Use the sum of the bins we dumped so that it is consistent
+    cJSON_AddNumberToObject(root, "total", double(sum));
+    cJSON_AddItemToObject(root, "bins", array);
 
-    // for backwards compatibility, add the old wayouts
-    cJSON_AddNumberToObject(root, "wayout", aggregate_wayout());
     char *ptr = cJSON_PrintUnformatted(root);
     std::string ret(ptr);
     cJSON_Free(ptr);
@@ -183,36 +373,47 @@ std::string TimingHistogram::to_string(void) {
     return ret;
 }
 
-/* get functions of Timings class */
-
-uint32_t TimingHistogram::get_ns() {
-    return ns;
-}
-
-uint32_t TimingHistogram::get_usec(const uint8_t index) {
-    return usec[index];
-}
-
-uint32_t TimingHistogram::get_msec(const uint8_t index) {
-    return msec[index];
-}
+TimingHistogram TimingHistogram::fromJSON(const cJSON* json) {
+    if (json == nullptr || json->type != cJSON_Object) {
+        throw std::invalid_argument(
+                "TimingHistogram::fromJSON: histogram must be an object");
+    }
 
-uint32_t TimingHistogram::get_halfsec(const uint8_t index) {
-    return halfsec[index];
-}
+    auto* obj = cJSON_GetObjectItem(const_cast<cJSON*>(json), "precision");
+    if (obj == nullptr || obj->type != cJSON_Number) {
+        throw std::invalid_argument(
+                "TimingHistogram::fromJSON: missing \"precision\"");
+    }
+    TimingHistogram ret(uint8_t(obj->valueint));
 
-uint32_t TimingHistogram::get_wayout(const uint8_t index) {
-    return wayout[index];
-}
+    obj = cJSON_GetObjectItem(const_cast<cJSON*>(json), "bins");
+    if (obj == nullptr || obj->type != cJSON_Array) {
+        throw std::invalid_argument(
+                "TimingHistogram::fromJSON: missing \"bins\"");
+    }
 
-uint32_t TimingHistogram::aggregate_wayout() {
-    uint32_t ret = 0;
-    for (auto &wo : wayout) {
-        ret += wo;
+    const auto num = ret.getNumBins();
+    for (auto* bin = obj->child; bin != nullptr; bin = bin->next) {
+        if (bin->type != cJSON_Array || cJSON_GetArraySize(bin) != 2 ||
+            bin->child->type != cJSON_Number ||
+            bin->child->next->type != cJSON_Number) {
+            throw std::invalid_argument(
+                    "TimingHistogram::fromJSON: bins must be [index, count]");
+        }
+        const auto index = size_t(bin->child->valuedouble);
+        const auto count = uint64_t(bin->child->next->valuedouble);
+        if (index >= num) {
+            throw std::invalid_argument(
+                    "TimingHistogram::fromJSON: bin index " +
+                    std::to_string(index) + " is out of range");
+        }
+        ret.getBins()[index] += count;
+        ret.total += count;
     }
+
     return ret;
 }
 
-uint32_t TimingHistogram::get_total() {
+uint64_t TimingHistogram::get_total() const {
     return total;
 }
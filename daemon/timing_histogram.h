@@ -17,57 +17,134 @@
 #pragma once
 
 #include <platform/platform.h>
-#include <array>
+#include <atomic>
+#include <cstdint>
 #include <relaxed_atomic.h>
 #include <string>
 
-/** Records timings of some event, accumulating them in a histogram.
- *
- * Histogram has buckets of approximately exponentially increasing sizes:
+struct cJSON;
+
+/** Records timings of some event, accumulating them in a log-linear
+ * (HDR style) histogram.
  *
- *     - Less than or equal to 1 microsecond (µs)
- *     - [10-19], [20-29], ..., [900-999] µs
- *     - 1, 2, ..., 49 ms
- *     - 500, 1000, 1500, ... 4500 ms
- *     - [5-9], [10-19], [20-39], [40-79], [80-inf] seconds.
+ * Samples are recorded in microseconds. Values below 2^precision get a
+ * bin of their own, after that every power of two is split into
+ * 2^precision linear bins. The relative error of a sample is thus at most
+ * 1 / 2^precision (0.78% with the default precision of 7), independent
+ * of its magnitude. Values above MaxValue are recorded in the last bin.
  *
+ * The counters are 64 bit and allocated the first time a sample is
+ * added, so unused histograms (for instance for opcodes which are never
+ * used) only cost a few bytes.
  */
 class TimingHistogram {
 public:
-    TimingHistogram(void);
+    /// The default number of significant bits
+    static const uint8_t DefaultPrecision = 7;
+    /// The highest precision supported
+    static const uint8_t MaxPrecision = 8;
+    /// The largest value (in usec) with its own bin (~19 hours)
+    static const uint64_t MaxValue = (uint64_t(1) << 36) - 1;
+
+    explicit TimingHistogram(uint8_t precision = DefaultPrecision);
     TimingHistogram(const TimingHistogram &other);
+    ~TimingHistogram();
+
+    /**
+     * Copy the samples from other (and its precision). Not safe to call
+     * while other threads add samples to this histogram.
+     */
     TimingHistogram& operator=(const TimingHistogram &other);
+
+    /**
+     * Add all of the samples from other to this histogram.
+     *
+     * @throws std::invalid_argument if the histograms use a different
+     *         precision
+     */
     TimingHistogram& operator+=(const TimingHistogram& other);
 
     void reset(void);
+
+    /**
+     * Record a sample
+     *
+     * @param nsec the duration of the event in nanoseconds
+     */
     void add(const hrtime_t nsec);
-    std::string to_string(void);
-    uint32_t get_ns();
-    uint32_t get_usec(const uint8_t index);
-    uint32_t get_msec(const uint8_t index);
-    uint32_t get_halfsec(const uint8_t index);
-    uint32_t get_wayout(const uint8_t index);
-    uint32_t get_total();
 
-    uint32_t aggregate_wayout();
+    /**
+     * Get a JSON representation of the histogram. For backwards
+     * compatibility it starts with the fixed buckets we used to have
+     * ("ns", "us", "ms", "500ms", "5s-9s" ... "80s-inf" and "wayout"),
+     * each bin being counted in the bucket its lower bound falls into.
+     * It is followed by the log-linear bins:
+     *
+     *     "precision":4,"unit":"us","total":10,"bins":[[index,count],...]
+     *
+     * Only bins with samples are included. Use fromJSON to parse it.
+     */
+    std::string to_string(void) const;
+
+    /**
+     * Create a histogram from the JSON generated by to_string()
+     *
+     * @throws std::invalid_argument if the JSON isn't a valid histogram
+     */
+    static TimingHistogram fromJSON(const cJSON* json);
+
+    uint64_t get_total() const;
+
+    uint8_t getPrecision() const {
+        return precision;
+    }
+
+    /**
+     * Get the number of bins in the histogram
+     */
+    size_t getNumBins() const {
+        return getNumBins(precision);
+    }
+
+    /**
+     * Get the number of samples in the given bin
+     */
+    uint64_t getBinCount(size_t index) const;
+
+    /**
+     * Get the lowest value (in usec) recorded in the given bin
+     */
+    uint64_t getBinLowerBound(size_t index) const;
+
+    /**
+     * Get the highest value (in usec) recorded in the given bin
+     */
+    uint64_t getBinUpperBound(size_t index) const;
+
+    /**
+     * Get the value (in usec) the given percentage of the samples are
+     * less than or equal to (within the precision of the histogram).
+     *
+     * @param percentile the percentile in the range [0, 100]
+     * @return the upper bound of the bin containing the percentile, or
+     *         0 if the histogram is empty
+     */
+    uint64_t getValueAtPercentile(double percentile) const;
 
 private:
-    // This helper is used for operator overloads. It is supplied a
-    // class such as std::plus, std::minus; with the first argument (of
-    // the class's function) being the current value and the second being
-    // the new value.
-    template <template <typename ...Args> class F>
-    static void arith_op(TimingHistogram& dst, const TimingHistogram& src);
-
-    /* We collect timings for <=1 us */
-    Couchbase::RelaxedAtomic<uint32_t> ns;
-    /* We collect timings per 10usec */
-    std::array<Couchbase::RelaxedAtomic<uint32_t>, 100> usec;
-    /* we collect timings from 0-49 ms (entry 0 is never used!) */
-    std::array<Couchbase::RelaxedAtomic<uint32_t>, 50> msec;
-    std::array<Couchbase::RelaxedAtomic<uint32_t>, 10> halfsec;
-    // wayout use the following buckets:
-    // [5-9], [10-19], [20-39], [40-79], [80-inf].
-    std::array<Couchbase::RelaxedAtomic<uint32_t>, 5> wayout;
+    static size_t getNumBins(uint8_t precision);
+
+    size_t getBinIndex(uint64_t usec) const;
+
+    /**
+     * Get the counters, allocating them if this is the first time
+     * they're used
+     */
+    std::atomic<uint64_t>* getBins();
+
+    void freeBins();
+
+    uint8_t precision;
+    std::atomic<std::atomic<uint64_t>*> bins;
     Couchbase::RelaxedAtomic<uint64_t> total;
 };
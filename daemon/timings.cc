@@ -19,20 +19,47 @@
 #include <platform/platform.h>
 #include "timing_histogram.h"
 
+Timings::ThreadTimings::ThreadTimings(uint8_t precision) {
+    for (auto& histogram : timings) {
+        histogram = TimingHistogram(precision);
+    }
+}
+
 Timings::Timings() {
-    reset();
+    setNumThreads(1);
 }
 
 Timings& Timings::operator=(const Timings& other) {
-    timings = other.timings;
+    precision = other.precision;
+    threads.clear();
+    for (const auto& thread : other.threads) {
+        threads.emplace_back(new ThreadTimings(*thread));
+    }
     interval_latency_lookups = other.interval_latency_lookups;
     interval_latency_mutations = other.interval_latency_mutations;
     return *this;
 }
 
+void Timings::setNumThreads(size_t num, uint8_t precision) {
+    Timings::precision = precision;
+    threads.clear();
+    for (size_t ii = 0; ii < num; ++ii) {
+        threads.emplace_back(new ThreadTimings(precision));
+    }
+    reset();
+}
+
 void Timings::reset(void) {
-    for (int ii = 0; ii < MAX_NUM_OPCODES; ++ii) {
-        timings[ii].reset();
+    for (auto& thread : threads) {
+        for (auto& histogram : thread->timings) {
+            histogram.reset();
+        }
+        for (auto& interval : thread->interval_counters) {
+            interval.reset();
+        }
+        for (auto& duration : thread->durations) {
+            duration.reset();
+        }
     }
 
     {
@@ -42,15 +69,43 @@ void Timings::reset(void) {
     }
 }
 
-void Timings::collect(const uint8_t opcode, const hrtime_t nsec) {
-    timings[opcode].add(nsec);
-    auto& interval = interval_counters[opcode];
+void Timings::collect(size_t thread,
+                      const uint8_t opcode,
+                      const hrtime_t nsec) {
+    auto& timings = *threads[thread];
+    timings.timings[opcode].add(nsec);
+    auto& interval = timings.interval_counters[opcode];
     interval.count++;
     interval.duration_ns += nsec;
+    timings.durations[opcode] += nsec;
 }
 
 std::string Timings::generate(const uint8_t opcode) {
-    return timings[opcode].to_string();
+    return get_histogram(opcode).to_string();
+}
+
+TimingHistogram Timings::get_histogram(const uint8_t opcode) const {
+    TimingHistogram aggregated(precision);
+    for (const auto& thread : threads) {
+        aggregated += thread->timings[opcode];
+    }
+    return aggregated;
+}
+
+uint64_t Timings::get_duration(const uint8_t opcode) const {
+    uint64_t ret = 0;
+    for (const auto& thread : threads) {
+        ret += thread->durations[opcode];
+    }
+    return ret;
+}
+
+uint64_t Timings::get_total(const uint8_t opcode) const {
+    uint64_t ret = 0;
+    for (const auto& thread : threads) {
+        ret += thread->timings[opcode].get_total();
+    }
+    return ret;
 }
 
 static const uint8_t timings_mutations[] = {
@@ -104,7 +159,7 @@ uint64_t Timings::get_aggregated_mutation_stats() {
 
     uint64_t ret = 0;
     for (auto cmd : timings_mutations) {
-        ret += timings[cmd].get_total();
+        ret += get_total(cmd);
     }
     return ret;
 }
@@ -113,7 +168,7 @@ uint64_t Timings::get_aggregated_retrival_stats() {
 
     uint64_t ret = 0;
     for (auto cmd : timings_retrievals) {
-        ret += timings[cmd].get_total();
+        ret += get_total(cmd);
     }
     return ret;
 }
@@ -131,14 +186,17 @@ cb::sampling::Interval Timings::get_interval_lookup_latency() {
 void Timings::sample(std::chrono::seconds sample_interval) {
     cb::sampling::Interval interval_lookup, interval_mutation;
 
-    for (auto op : timings_mutations) {
-        interval_mutation += interval_counters[op];
-        interval_counters[op].reset();
-    }
-
-    for (auto op : timings_retrievals) {
-        interval_lookup += interval_counters[op];
-        interval_counters[op].reset();
+    for (auto& thread : threads) {
+        auto& interval_counters = thread->interval_counters;
+        for (auto op : timings_mutations) {
+            interval_mutation += interval_counters[op];
+            interval_counters[op].reset();
+        }
+
+        for (auto op : timings_retrievals) {
+            interval_lookup += interval_counters[op];
+            interval_counters[op].reset();
+        }
     }
 
     {
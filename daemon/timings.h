@@ -19,8 +19,10 @@
 #include <platform/platform.h>
 #include <array>
 #include <string>
+#include <memory>
 #include <mutex>
 #include <cstdint>
+#include <vector>
 
 #include "timing_histogram.h"
 #include "timing_interval.h"
@@ -29,6 +31,11 @@
 
 /** Records timings for each memcached opcode. Each opcode has a histogram of
  * times.
+ *
+ * To avoid having all of the worker threads update the same counters (and
+ * bounce the cache lines between the cores) each thread records its
+ * samples in its own set of histograms. They're merged when the stats are
+ * requested (generate() etc) or sampled.
  */
 class Timings {
 public:
@@ -36,10 +43,35 @@ public:
     Timings& operator=(const Timings& other);
     Timings(const Timings&) = delete;
 
+    /**
+     * Set the number of threads which may collect timings and the
+     * precision of their histograms. This must be called before any
+     * samples are collected, and the thread index passed to collect()
+     * must be less than num.
+     */
+    void setNumThreads(size_t num,
+                       uint8_t precision = TimingHistogram::DefaultPrecision);
+
     void reset(void);
-    void collect(const uint8_t opcode, const hrtime_t nsec);
+    void collect(size_t thread, const uint8_t opcode, const hrtime_t nsec);
     void sample(std::chrono::seconds sample_interval);
     std::string generate(const uint8_t opcode);
+
+    /**
+     * Get the number of samples collected for the opcode
+     */
+    uint64_t get_total(const uint8_t opcode) const;
+
+    /**
+     * Get the sum of the samples collected for the opcode (in nsec)
+     */
+    uint64_t get_duration(const uint8_t opcode) const;
+
+    /**
+     * Get a histogram containing the samples collected for the opcode by
+     * all of the threads
+     */
+    TimingHistogram get_histogram(const uint8_t opcode) const;
     uint64_t get_aggregated_mutation_stats();
     uint64_t get_aggregated_retrival_stats();
 
@@ -47,6 +79,20 @@ public:
     cb::sampling::Interval get_interval_lookup_latency();
 
 private:
+    /**
+     * The timings recorded by a single thread
+     */
+    struct ThreadTimings {
+        explicit ThreadTimings(uint8_t precision);
+
+        std::array<TimingHistogram, MAX_NUM_OPCODES> timings;
+        std::array<cb::sampling::Interval, MAX_NUM_OPCODES> interval_counters;
+        /// The sum of all of the samples (in nsec), unlike the interval
+        /// counters these are only cleared by reset()
+        std::array<Couchbase::RelaxedAtomic<uint64_t>, MAX_NUM_OPCODES>
+                durations;
+    };
+
     // This lock is only held by sample() and some blocks within generate().
     // It guards the various IntervalSeries variables which internally
     // contain cb::RingBuffer objects which are not thread safe.
@@ -54,6 +100,11 @@ private:
 
     cb::sampling::IntervalSeries interval_latency_lookups;
     cb::sampling::IntervalSeries interval_latency_mutations;
-    std::array<TimingHistogram, MAX_NUM_OPCODES> timings;
-    std::array<cb::sampling::Interval, MAX_NUM_OPCODES> interval_counters;
+
+    // One entry per thread. Each entry is allocated separately so that
+    // the threads don't share cache lines.
+    std::vector<std::unique_ptr<ThreadTimings>> threads;
+
+    // The precision of the histograms
+    uint8_t precision = TimingHistogram::DefaultPrecision;
 };
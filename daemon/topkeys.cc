@@ -31,160 +31,307 @@
  *
  * === TopKeys ===
  *
- * The TopKeys class is split into NUM_SHARDS shards, each which owns
- * 1/NUM_SHARDS of the keyspace. This is to allow some level of
- * concurrent access - each shard has a mutex guarding all access.
- * Other than that the TopKeys class is pretty uninteresting - it
- * simply passes on requests to the correct Shard, and when statistics
- * are requested it aggregates information from each shard.
+ * The TopKeys class keeps one Sketch per thread, so that the threads
+ * never contend for the same lock or cache lines when they update the
+ * keys (the per-sketch mutex is only contended when the stats are
+ * requested). When statistics are requested the counters from all of
+ * the sketches are merged, and the top mkeys * 8 keys are reported.
  *
- * === TopKeys::Shard ===
+ * === TopKeys::Sketch ===
  *
- * This is where the action happens. Each Shard maintains an ordered
- * list of key names and related statistics, orded by when they were
- * last accessed. There is a fixed number of keys each Shard tracks.
-
- * Given we generally track only a small number of keys per shard (10
- * by default), it's highly likely that any one key access will 'miss'
- * - i.e. not find an existing topkey. Therefore this class is
- * optimized for that case, attempting to minimise memory allocation
- * in steady-state.
- *
- * Internally Shard consists of a vector of topkey_t, storing the
- * current max_keys top_keys, and a list of topkey_t pointers, used to
- * main the current most -> least recently used ordering:
-
- * max_keys elements. Each element is a tuple of
- * {hash(key), key, topkey_stats}:
+ * Each Sketch tracks the heavy hitters using the Space-Saving algorithm:
+ * it keeps a fixed number of counters (capacity), and a key which isn't
+ * tracked replaces the key with the smallest count. The new key inherits
+ * the smallest count, which is recorded as the error of the counter (the
+ * access count is an upper bound, and access_count - error is a lower
+ * bound).
  *
+ * Replacing a counter on every miss would churn through the counters
+ * for the long tail of keys accessed once or twice, so all accesses are
+ * first counted in a count-min sketch (Depth rows of Width counters).
+ * A key is only admitted to the summary when its estimated count exceeds
+ * the smallest counter, and it inherits the estimated count instead of
+ * the smallest count (which tightens the error).
  *
- *       vector<topkey_t>
- *   +----------+-------------+---------------+
- *   | size_t   | std::string | topkey_item_t |
- *   +----------+-------------+---------------+
- *   | <hash 1> | <key 1>     | stats 1       | <--- Node1
- *   | <hash 2> | <key 2>     | stats 2       | <--- Node2
- *   | <hash 3> | <key 3>     | stats 3       | <--- Node3
- *   . ....                                   .
- *   | <hash N> | <key N>     | stats N       | <--- NodeN
- *   +----------------------------------------+
+ * To report the recent access pattern the sketch is split in windows.
+ * When a window expires the summary becomes the previous summary and the
+ * counters start from zero. The stats report the sum of the current and
+ * the previous window (i.e. between 1 and 2 windows of accesses).
  *
- *   Node3 <---> Node1 <---> ... <---> Node2
- *   ^^^                               ^^^
- *   MRU                               LRU
+ * === TopKeys::RateSketch ===
  *
+ * To detect the keys which are hot right now, the accesses to the bucket
+ * during the current second are counted in another count-min sketch. It
+ * is shared by all of the threads (the counters are atomic) so that the
+ * rate is per bucket and not per thread. The first thread to see a new
+ * second clears the counters; accesses racing with the clear may or may
+ * not be counted, which is fine for a hint. It is only updated when the
+ * caller asks for the rate.
  *
- * Upon a key 'hit', TopKeys::updateKey() is called. That hashes the
- * key, and finds the Shard responsible for that
- * key. TopKeys::Shard::updateKey() is then called.
- *
- * Shard::updateKey() iterates over the vector, searching for a hash
- * match with an existing element, using the actual key string to
- * validate (in case of a hash collision). If it is found, then the
- * stats are simply updated.  If it is not found, then the
- * least-recently-used element is selected as a 'victim' and it's
- * contents is replaced by the incoming key.  Finally the linked-list
- * is updated to move the updated element to the head of the list.
+ * The bytes read and written are only counted while the key is tracked,
+ * so they are lower bounds (and the keys are selected by access count,
+ * not by the number of bytes).
  */
 
-
-TopKeys::TopKeys(int mkeys) {
-    for (auto& shard : shards) {
-        shard.setMaxKeys(mkeys);
+TopKeys::TopKeys(int mkeys, size_t nthreads, rel_time_t window)
+    : max_keys(size_t(mkeys) * 8) {
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+    for (size_t ii = 0; ii < nthreads; ++ii) {
+        sketches.emplace_back(new Sketch(max_keys * 2, window));
     }
 }
 
 TopKeys::~TopKeys() {
 }
 
-TopKeys::Shard& TopKeys::getShard(size_t key_hash) {
-    /* This is special-cased for 8 */
-    static_assert(NUM_SHARDS == 8,
-                  "Topkeys::getShard() special-cased for SHARDS==8");
-    return shards[key_hash & 0x7];
+TopKeys::Sketch::Sketch(size_t capacity_, rel_time_t window_)
+    : capacity(capacity_),
+      window(window_),
+      window_start(0),
+      minimum(0) {
+    current.counters.reserve(capacity);
+    for (auto& row : cms) {
+        row.fill(0);
+    }
 }
 
-TopKeys::Shard::topkey_t*
-TopKeys::Shard::searchForKey(size_t key_hash,
-                             const cb::const_char_buffer& key) {
-
-    for (auto& topkey : storage) {
-        if (topkey.first.hash == key_hash) {
-            // Double-check with full compare
-            if (topkey.first.key.compare(0, topkey.first.key.size(),
-                                         key.buf, key.len) == 0) {
-                // Match found.
-                return &topkey;
-            }
+void TopKeys::Sketch::maybeRotate(rel_time_t current_time) {
+    if (current_time < window_start + window) {
+        return;
+    }
+
+    if (current_time < window_start + 2 * window) {
+        std::swap(previous, current);
+    } else {
+        // Both windows expired
+        previous.counters.clear();
+        previous.index.clear();
+    }
+    current.counters.clear();
+    current.index.clear();
+    for (auto& row : cms) {
+        row.fill(0);
+    }
+    minimum = 0;
+    window_start = current_time;
+}
+
+/* The multipliers used to derive the column in each row of the count-min
+ * sketches from the key hash */
+static const uint64_t cms_multipliers[] = {0x9e3779b97f4a7c15ULL,
+                                           0xc2b2ae3d27d4eb4fULL,
+                                           0x165667b19e3779f9ULL,
+                                           0xd6e8feb86659fd93ULL};
+
+static size_t cms_column(size_t row, size_t key_hash, size_t width) {
+    const uint64_t hash = uint64_t(key_hash) * cms_multipliers[row];
+    return size_t((hash >> 32) % width);
+}
+
+uint32_t TopKeys::Sketch::increment(size_t key_hash) {
+    static_assert(Depth <= sizeof(cms_multipliers) / sizeof(uint64_t),
+                  "Need a multiplier for each row of the sketch");
+    uint32_t* counters[Depth];
+    uint32_t estimate = UINT32_MAX;
+    for (size_t ii = 0; ii < Depth; ++ii) {
+        counters[ii] = &cms[ii][cms_column(ii, key_hash, Width)];
+        estimate = std::min(estimate, *counters[ii]);
+    }
+
+    // Conservative update: only increment the counters which are at the
+    // minimum (the others already overestimate the count)
+    if (estimate != UINT32_MAX) {
+        ++estimate;
+    }
+    for (auto* counter : counters) {
+        if (*counter < estimate) {
+            *counter = estimate;
         }
     }
-    return nullptr;
+    return estimate;
 }
 
-bool TopKeys::Shard::updateKey(const cb::const_char_buffer& key,
-                               size_t key_hash,
-                               const rel_time_t ct) {
-    try {
-        std::lock_guard<std::mutex> lock(mutex);
-
-        topkey_t* found_key = searchForKey(key_hash, key);
-
-        if (found_key == NULL) {
-            // Key not found.
-            if (storage.size() == max_keys) {
-                // Re-use the lowest keys' storage.
-                found_key = list.back();
-                found_key->first.hash = key_hash;
-                found_key->first.key.assign(key.buf, key.len);
-                found_key->second = topkey_item_t(ct);
-
-                // Move back element to the front, shuffling down the
-                // rest.
-                list.splice(list.begin(), list, --list.end());
-
-            } else {
-                // add a new element to the storage array.
-
-                storage.emplace_back(
-                    std::make_pair(KeyId{key_hash,
-                                         std::string(key.buf, key.len)},
-                                   topkey_item_t(ct)));
-                found_key = &storage.back();
-
-                // Insert the new item to the front of the list
-                list.push_front(found_key);
+TopKeys::RateSketch::RateSketch() : second(0) {
+    for (auto& row : counters) {
+        for (auto& counter : row) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+uint32_t TopKeys::RateSketch::increment(size_t key_hash, rel_time_t now) {
+    static_assert(Depth <= sizeof(cms_multipliers) / sizeof(uint64_t),
+                  "Need a multiplier for each row of the sketch");
+    auto current = second.load(std::memory_order_relaxed);
+    if (current != now &&
+        second.compare_exchange_strong(current, now)) {
+        for (auto& row : counters) {
+            for (auto& counter : row) {
+                counter.store(0, std::memory_order_relaxed);
             }
-        } else {
-            // Found - shuffle to the front.
-            auto it = std::find(list.begin(), list.end(),
-                                found_key);
-            list.splice(list.begin(), list, it);
         }
+    }
 
-        // Increment access count.
-        found_key->second.ti_access_count++;
-        return true;
+    uint32_t estimate = UINT32_MAX;
+    for (size_t ii = 0; ii < Depth; ++ii) {
+        auto& counter = counters[ii][cms_column(ii, key_hash, Width)];
+        estimate = std::min(
+                estimate,
+                counter.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    return estimate;
+}
 
-    } catch (const std::bad_alloc&) {
-        // Failed to update.
-        return false;
+TopKeys::Sketch::Counter* TopKeys::Sketch::findMinimum() {
+    auto iter = std::min_element(current.counters.begin(),
+                                 current.counters.end(),
+                                 [](const Counter& a, const Counter& b) {
+                                     return a.stats.ti_access_count <
+                                            b.stats.ti_access_count;
+                                 });
+    minimum = iter->stats.ti_access_count;
+    return &*iter;
+}
+
+void TopKeys::Sketch::updateKey(const cb::const_char_buffer& key,
+                                size_t key_hash,
+                                const rel_time_t ct,
+                                size_t bytes_read,
+                                size_t bytes_written) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maybeRotate(ct);
+
+    const uint32_t estimate = increment(key_hash);
+
+    Counter* counter = nullptr;
+    auto iter = current.index.find(key_hash);
+    if (iter != current.index.end()) {
+        counter = &current.counters[iter->second];
+        if (counter->key.compare(0, counter->key.size(),
+                                 key.buf, key.len) != 0) {
+            // Hash collision with a tracked key; the key is only
+            // counted in the count-min sketch.
+            return;
+        }
+    } else {
+        const uint64_t inherited = estimate - 1;
+        if (current.counters.size() < capacity) {
+            current.index[key_hash] = current.counters.size();
+            current.counters.emplace_back(key_hash, key, ct);
+            counter = &current.counters.back();
+        } else {
+            // The cached minimum is a lower bound of the real minimum
+            // (the counters only grow), so we only need to search for
+            // the real minimum if the estimate exceeds it.
+            if (estimate <= minimum) {
+                return;
+            }
+            counter = findMinimum();
+            if (estimate <= minimum) {
+                return;
+            }
+
+            current.index.erase(counter->hash);
+            current.index[key_hash] = size_t(counter - current.counters.data());
+            *counter = Counter(key_hash, key, ct);
+            minimum = 0;
+        }
+        counter->stats.ti_access_count = inherited;
+        counter->stats.ti_error = inherited;
     }
+
+    counter->stats.ti_access_count++;
+    counter->stats.ti_atime = ct;
+    counter->stats.ti_bytes_read += bytes_read;
+    counter->stats.ti_bytes_written += bytes_written;
 }
 
-void TopKeys::updateKey(const void *key, size_t nkey,
-                        rel_time_t operation_time) {
+uint32_t TopKeys::updateKey(size_t thread, const void *key, size_t nkey,
+                            rel_time_t operation_time, size_t bytes_read,
+                            size_t bytes_written, bool count_rate) {
     cb_assert(key);
     cb_assert(nkey > 0);
+    cb_assert(thread < sketches.size());
 
     try {
         cb::const_char_buffer key_buf(static_cast<const char*>(key), nkey);
         std::hash<cb::const_char_buffer > hash_fn;
         const size_t key_hash = hash_fn(key_buf);
 
-        getShard(key_hash).updateKey(key_buf, key_hash, operation_time);
+        sketches[thread]->updateKey(key_buf, key_hash, operation_time,
+                                    bytes_read, bytes_written);
+        if (count_rate) {
+            return rate.increment(key_hash, operation_time);
+        }
     } catch (std::bad_alloc) {
         // Failed to increment topkeys, continue...
     }
+    return 0;
+}
+
+void TopKeys::Sketch::accept_visitor(iterfunc_t visitor_func,
+                                     void* visitor_ctx,
+                                     rel_time_t current_time) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maybeRotate(current_time);
+    for (const auto& counter : previous.counters) {
+        visitor_func(counter.key, counter.stats, visitor_ctx);
+    }
+    for (const auto& counter : current.counters) {
+        visitor_func(counter.key, counter.stats, visitor_ctx);
+    }
+}
+
+typedef std::unordered_map<std::string, topkey_item_t> merged_keys_t;
+
+static void tk_mergefunc(const std::string& key, const topkey_item_t& it,
+                         void* arg) {
+    auto& merged = *static_cast<merged_keys_t*>(arg);
+    auto iter = merged.find(key);
+    if (iter == merged.end()) {
+        merged.emplace(key, it);
+    } else {
+        auto& item = iter->second;
+        item.ti_ctime = std::min(item.ti_ctime, it.ti_ctime);
+        item.ti_atime = std::max(item.ti_atime, it.ti_atime);
+        item.ti_access_count += it.ti_access_count;
+        item.ti_error += it.ti_error;
+        item.ti_bytes_read += it.ti_bytes_read;
+        item.ti_bytes_written += it.ti_bytes_written;
+    }
+}
+
+std::vector<std::pair<std::string, topkey_item_t>>
+TopKeys::collect(rel_time_t current_time, Order order) {
+    merged_keys_t merged;
+    for (auto& sketch : sketches) {
+        sketch->accept_visitor(tk_mergefunc, &merged, current_time);
+    }
+
+    std::vector<std::pair<std::string, topkey_item_t>> ret(merged.begin(),
+                                                           merged.end());
+    auto value = [order](const topkey_item_t& it) {
+        switch (order) {
+        case Order::Ops:
+            return it.ti_access_count;
+        case Order::BytesRead:
+            return it.ti_bytes_read;
+        case Order::BytesWritten:
+            return it.ti_bytes_written;
+        }
+        return it.ti_access_count;
+    };
+    std::sort(ret.begin(), ret.end(),
+              [&value](const std::pair<std::string, topkey_item_t>& a,
+                       const std::pair<std::string, topkey_item_t>& b) {
+                  return value(a.second) > value(b.second);
+              });
+    if (ret.size() > max_keys) {
+        ret.erase(ret.begin() + max_keys, ret.end());
+    }
+    return ret;
 }
 
 struct tk_context {
@@ -204,19 +351,18 @@ static void tk_iterfunc(const std::string& key, const topkey_item_t& it,
                         void *arg) {
     struct tk_context *c = (struct tk_context*)arg;
     char val_str[500];
-    /* Note we use accessed time for both 'atime' and 'ctime' below. They have
-     * had the same value since the topkeys code was added; but given that
-     * clients may expect separate values we print both.
-     */
     rel_time_t created_time = c->current_time - it.ti_ctime;
-    int vlen = snprintf(val_str, sizeof(val_str) - 1, "get_hits=%d,"
+    rel_time_t accessed_time = c->current_time - it.ti_atime;
+    int vlen = snprintf(val_str, sizeof(val_str) - 1, "get_hits=%" PRIu64 ","
                         "get_misses=0,cmd_set=0,incr_hits=0,incr_misses=0,"
                         "decr_hits=0,decr_misses=0,delete_hits=0,"
                         "delete_misses=0,evictions=0,cas_hits=0,cas_badval=0,"
                         "cas_misses=0,get_replica=0,evict=0,getl=0,unlock=0,"
                         "get_meta=0,set_meta=0,del_meta=0,ctime=%" PRIu32
-                        ",atime=%" PRIu32, it.ti_access_count,
-                        created_time, created_time);
+                        ",atime=%" PRIu32 ",error=%" PRIu64
+                        ",bytes_read=%" PRIu64 ",bytes_written=%" PRIu64,
+                        it.ti_access_count, created_time, accessed_time,
+                        it.ti_error, it.ti_bytes_read, it.ti_bytes_written);
     if (vlen > 0 && vlen < int(sizeof(val_str) - 1)) {
         c->add_stat(key.c_str(), key.size(), val_str, vlen, c->cookie);
     }
@@ -228,6 +374,9 @@ static void tk_iterfunc(const std::string& key, const topkey_item_t& it,
  * {
  *    "key": "somekey",
  *    "access_count": nnn,
+ *    "error": eee,
+ *    "bytes_read": rrr,
+ *    "bytes_written": www,
  *    "ctime": ccc,
  *    "atime": aaa
  * }
@@ -238,9 +387,17 @@ static void tk_jsonfunc(const std::string& key, const topkey_item_t& it,
     cJSON *obj = cJSON_CreateObject();
     cJSON_AddItemToObject(obj, "key", cJSON_CreateString(key.c_str()));
     cJSON_AddItemToObject(obj, "access_count",
-                          cJSON_CreateNumber(it.ti_access_count));
+                          cJSON_CreateNumber(double(it.ti_access_count)));
+    cJSON_AddItemToObject(obj, "error",
+                          cJSON_CreateNumber(double(it.ti_error)));
+    cJSON_AddItemToObject(obj, "bytes_read",
+                          cJSON_CreateNumber(double(it.ti_bytes_read)));
+    cJSON_AddItemToObject(obj, "bytes_written",
+                          cJSON_CreateNumber(double(it.ti_bytes_written)));
     cJSON_AddItemToObject(obj, "ctime", cJSON_CreateNumber(c->current_time
                                                            - it.ti_ctime));
+    cJSON_AddItemToObject(obj, "atime", cJSON_CreateNumber(c->current_time
+                                                           - it.ti_atime));
     cb_assert(c->array != NULL);
     cJSON_AddItemToArray(c->array, obj);
 }
@@ -250,8 +407,8 @@ ENGINE_ERROR_CODE TopKeys::stats(const void *cookie,
                                  ADD_STAT add_stat) {
     struct tk_context context(cookie, add_stat, current_time, nullptr);
 
-    for (auto& shard : shards) {
-        shard.accept_visitor(tk_iterfunc, &context);
+    for (const auto& key : collect(current_time, Order::Ops)) {
+        tk_iterfunc(key.first, key.second, &context);
     }
 
     return ENGINE_SUCCESS;
@@ -268,24 +425,17 @@ ENGINE_ERROR_CODE TopKeys::stats(const void *cookie,
  * }
  */
 ENGINE_ERROR_CODE TopKeys::json_stats(cJSON *object,
-                                     const rel_time_t current_time) {
+                                      const rel_time_t current_time,
+                                      Order order) {
 
     cJSON *topkeys = cJSON_CreateArray();
     struct tk_context context(nullptr, nullptr, current_time, topkeys);
 
     /* Collate the topkeys JSON object */
-    for (auto& shard : shards) {
-        shard.accept_visitor(tk_jsonfunc, &context);
+    for (const auto& key : collect(current_time, order)) {
+        tk_jsonfunc(key.first, key.second, &context);
     }
 
     cJSON_AddItemToObject(object, "topkeys", topkeys);
     return ENGINE_SUCCESS;
 }
-
-void TopKeys::Shard::accept_visitor(iterfunc_t visitor_func,
-                                    void* visitor_ctx) {
-    std::lock_guard<std::mutex> lock(mutex);
-    for (const auto key : list) {
-        visitor_func(key->first.key, key->second, visitor_ctx);
-    }
-}
@@ -17,47 +17,88 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <platform/cbassert.h>
 #include <platform/sized_buffer.h>
 #include <memcached/engine.h>
 #include <cJSON.h>
 
+#include <memory>
 #include <mutex>
-#include <list>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 /*
  * TopKeys
  *
- * Tracks the top N most recently accessed keys. The details are
- * accessible by a stats call, which is used by ns_server to print the
- * top keys list in the GUI.
+ * Tracks the (approximate) most frequently accessed keys over the last
+ * couple of minutes. The details are accessible by a stats call, which is
+ * used by ns_server to print the top keys list in the GUI.
  */
 
+/* The statistics for a key tracked by TopKeys */
 struct topkey_item_t {
     topkey_item_t(rel_time_t create_time)
         : ti_ctime(create_time),
-          ti_access_count(0) { }
-
-    rel_time_t ti_ctime; /* Time this item was created */
-    int ti_access_count; /* Int count for number of times key has been accessed */
+          ti_atime(create_time),
+          ti_access_count(0),
+          ti_error(0),
+          ti_bytes_read(0),
+          ti_bytes_written(0) { }
+
+    rel_time_t ti_ctime; /* Time this key started being tracked */
+    rel_time_t ti_atime; /* Time this key was last accessed */
+    uint64_t ti_access_count; /* Number of times key has been accessed */
+    /* The access count may be overestimated by up to this many accesses
+     * (the accesses counted before the key started being tracked) */
+    uint64_t ti_error;
+    uint64_t ti_bytes_read; /* Bytes read while the key was tracked */
+    uint64_t ti_bytes_written; /* Bytes written while the key was tracked */
 };
 
 /* Class to track the "top" keys in a bucket.
  */
 class TopKeys {
 public:
+    /* The order to report the keys in */
+    enum class Order { Ops, BytesRead, BytesWritten };
+
     /* Constructor.
-     * @param mkeys Number of keys stored in each shard (i.e. up to
-     * mkeys * SHARDS will be tracked).
+     * @param mkeys Number of keys reported is mkeys * 8 (for compatibility
+     *              with the old sharded implementation)
+     * @param nthreads The number of threads which may update the keys
+     *                 (each thread gets its own sketch)
+     * @param window The number of seconds each window of the sketch covers.
+     *               The keys are reported for the current and the previous
+     *               window.
      */
-    TopKeys(int mkeys);
+    TopKeys(int mkeys, size_t nthreads = 1, rel_time_t window = 60);
     ~TopKeys();
 
-    void updateKey(const void *key,
-                   size_t nkey,
-                   rel_time_t operation_time);
+    /**
+     * Record an access to a key
+     *
+     * @param thread The index of the calling thread (must be less than
+     *               the number of threads specified in the constructor)
+     * @param key the key accessed
+     * @param nkey the length of the key
+     * @param operation_time the current time
+     * @param bytes_read the number of bytes of the value returned
+     * @param bytes_written the number of bytes of the value stored
+     * @param count_rate should the access be counted in the rate of the
+     *                   current second
+     * @return the estimated number of accesses to the key (from all of
+     *         the threads) during the current second if count_rate is
+     *         set, 0 otherwise
+     */
+    uint32_t updateKey(size_t thread,
+                       const void *key,
+                       size_t nkey,
+                       rel_time_t operation_time,
+                       size_t bytes_read = 0,
+                       size_t bytes_written = 0,
+                       bool count_rate = false);
 
     ENGINE_ERROR_CODE stats(const void *cookie,
                             const rel_time_t current_time,
@@ -71,6 +112,9 @@ public:
      *      {
      *          "key": "somekey",
      *          "access_count": nnn,
+     *          "error": eee,
+     *          "bytes_read": rrr,
+     *          "bytes_written": www,
      *          "ctime": ccc,
      *          "atime": aaa
      *      }, ..., { ... }
@@ -78,83 +122,116 @@ public:
      * }
      */
     ENGINE_ERROR_CODE json_stats(cJSON *object,
-                                 const rel_time_t current_time);
-
+                                 const rel_time_t current_time,
+                                 Order order = Order::Ops);
 
 private:
-    // Number of shards the keyspace is broken into. Permits some level of
-    // concurrent update (there is one mutex per shard).
-    static const int NUM_SHARDS = 8;
-
-    class Shard;
-
-    Shard& getShard(size_t key_hash);
-
-    // One of N Shards which the keyspace has been broken
-    // into.
-    // Responsible for tracking the top {mkeys} within it's keyspace.
-    class Shard {
+    /*
+     * The sketch for a single thread. Each thread pre-aggregates the
+     * access counts in a count-min sketch, and only keys whose estimated
+     * count exceeds the smallest counter are admitted to the Space-Saving
+     * summary.
+     */
+    class Sketch {
     public:
+        Sketch(size_t capacity, rel_time_t window);
 
-        void setMaxKeys(int mkeys) {
-            max_keys = mkeys;
-            storage.reserve(max_keys);
-            // reallocating storage invalidates the LRU list.
-            list.clear();
-        }
-
-        // Updates the topkey 'ranking' for the specified key.
-        // If the item does not exist it will be created (with it's creation
-        // time set to operation_time), otherwise the existing item will be
-        // updated.
-        // On success returns true, If insufficient memory to create a
-        // new item, returns false.
-        bool updateKey(const cb::const_char_buffer& key,
+        void updateKey(const cb::const_char_buffer& key,
                        size_t key_hash,
-                       rel_time_t operation_time);
+                       rel_time_t operation_time,
+                       size_t bytes_read,
+                       size_t bytes_written);
 
         typedef void (*iterfunc_t)(const std::string& key,
                                    const topkey_item_t& it,
                                    void *arg);
 
-        /* For each key in this shard, invoke the given callback function.
+        /* For each key in the current and previous window, invoke the
+         * given callback function.
          */
-        void accept_visitor(iterfunc_t visitor_func, void* visitor_ctx);
+        void accept_visitor(iterfunc_t visitor_func, void* visitor_ctx,
+                            rel_time_t current_time);
 
     private:
+        static const size_t Depth = 4;
+        static const size_t Width = 512;
 
-        struct KeyId {
+        struct Counter {
+            Counter(size_t h, const cb::const_char_buffer& k, rel_time_t ct)
+                : hash(h), key(k.buf, k.len), stats(ct) {
+            }
             size_t hash;
             std::string key;
+            topkey_item_t stats;
         };
 
-        // Pair of the key's string and the statistics related to it.
-        typedef std::pair<KeyId, topkey_item_t> topkey_t;
+        // The Space-Saving summary for one window
+        struct Summary {
+            std::vector<Counter> counters;
+            // Map from key hash to the index in counters
+            std::unordered_map<size_t, size_t> index;
+        };
 
-        // An ordered list of topkey_t*, used for LRU.
-        typedef std::list<topkey_t*> key_history_t;
+        void maybeRotate(rel_time_t current_time);
 
-        // Vector topket_t, used for actual topke storage.
-        typedef std::vector<topkey_t> key_storage_t;
+        // Count the key in the count-min sketch and return the estimated
+        // count (including this access)
+        uint32_t increment(size_t key_hash);
 
-        // Searches for the given key. If found returns a pointer to the
-        // topkey_t, else returns NULL.
-        topkey_t* searchForKey(size_t hash, const cb::const_char_buffer& key);
+        // Find the counter with the smallest count in the current summary
+        // (and update minimum)
+        Counter* findMinimum();
 
-        // Maxumum numbers of keys to be tracked per shard.
-        unsigned int max_keys;
+        const size_t capacity;
+        const rel_time_t window;
 
-        // mutex to serial access to this shard.
+        // mutex to serialize the owning thread and the stats calls
         std::mutex mutex;
 
-        // list of keys, ordered from most-recently used (front) to least recently
-        // used (back).
-        key_history_t list;
+        // The start of the current window
+        rel_time_t window_start;
+        Summary current;
+        Summary previous;
+
+        // A lower bound of the smallest count in the current summary
+        uint64_t minimum;
 
-        // Underlying topkey storage.
-        key_storage_t storage;
+        // The count-min sketch for the current window
+        std::array<std::array<uint32_t, Width>, Depth> cms;
     };
 
-    // array of topkey shards.
-    std::array<Shard, NUM_SHARDS> shards;
+    /*
+     * The number of accesses to the keys during the current second,
+     * shared by all of the threads (used to detect the keys which are
+     * hot right now).
+     */
+    class RateSketch {
+    public:
+        RateSketch();
+
+        // Count an access to the key and return the estimated number of
+        // accesses during the current second (including this one)
+        uint32_t increment(size_t key_hash, rel_time_t now);
+
+    private:
+        static const size_t Depth = 4;
+        static const size_t Width = 512;
+
+        // The second the counters belong to
+        std::atomic<rel_time_t> second;
+        std::array<std::array<std::atomic<uint32_t>, Width>, Depth> counters;
+    };
+
+    // Merge the keys from all of the sketches and return the top
+    // max_keys keys in the requested order
+    std::vector<std::pair<std::string, topkey_item_t>> collect(
+            rel_time_t current_time, Order order);
+
+    const size_t max_keys;
+
+    // One sketch per thread (each allocated separately so the threads
+    // don't share cache lines)
+    std::vector<std::unique_ptr<Sketch>> sketches;
+
+    RateSketch rate;
 };
@@ -20,6 +20,7 @@
 
 #include <phosphor/phosphor.h>
 #include <phosphor/tools/export.h>
+#include <algorithm>
 #include <mutex>
 
 // TODO: MB-20640 The default config should be configurable from memcached.json
@@ -43,25 +44,75 @@ ENGINE_ERROR_CODE ioctlGetTracingConfig(Connection*,
     return ENGINE_SUCCESS;
 }
 
+/**
+ * A dump in progress. The JSON is read out in chunks by
+ * ioctlGetTracingDumpChunk
+ */
 struct DumpContext {
-    DumpContext(phosphor::TraceContext&& _context)
+    virtual ~DumpContext() = default;
+
+    /// Has all of the JSON been read?
+    virtual bool done() = 0;
+
+    /// Read the next (up to) size bytes of the JSON into ptr
+    virtual size_t read(char* ptr, size_t size) = 0;
+};
+
+/**
+ * A dump of the phosphor trace buffer
+ */
+struct PhosphorDumpContext : public DumpContext {
+    PhosphorDumpContext(phosphor::TraceContext&& _context)
         : context(std::move(_context)), json_export(context) {
     }
 
     // Moving is dangerous as json_export contains a reference to
     // context.
-    DumpContext(DumpContext&& other) = delete;
+    PhosphorDumpContext(PhosphorDumpContext&& other) = delete;
+
+    bool done() override {
+        return json_export.done();
+    }
+
+    size_t read(char* ptr, size_t size) override {
+        return json_export.read(ptr, size);
+    }
 
     phosphor::TraceContext context;
     phosphor::tools::JSONExport json_export;
 };
 
+/**
+ * A dump of the requests kept by the sampled tracing. The JSON is small
+ * enough (bounded by SampledTracer::MaxSamples) to be generated up front.
+ */
+struct SampledDumpContext : public DumpContext {
+    SampledDumpContext(std::string json) : json(std::move(json)) {
+    }
+
+    bool done() override {
+        return offset == json.size();
+    }
+
+    size_t read(char* ptr, size_t size) override {
+        const auto count = std::min(size, json.size() - offset);
+        std::copy(json.data() + offset, json.data() + offset + count, ptr);
+        offset += count;
+        return count;
+    }
+
+    std::string json;
+    size_t offset = 0;
+};
+
 static std::map<cb::uuid::uuid_t, std::unique_ptr<DumpContext>> dumps;
 static std::mutex dumpsMutex;
 
-ENGINE_ERROR_CODE ioctlGetTracingBeginDump(Connection*,
-                                           const StrToStrMap&,
-                                           std::string& value) {
+/**
+ * Create a dump of the phosphor trace buffer (stopping the trace if
+ * it is running)
+ */
+static std::unique_ptr<DumpContext> createPhosphorDump() {
     std::lock_guard<phosphor::TraceLog> lh(PHOSPHOR_INSTANCE);
     if (PHOSPHOR_INSTANCE.isEnabled()) {
         PHOSPHOR_INSTANCE.stop(lh);
@@ -69,6 +120,24 @@ ENGINE_ERROR_CODE ioctlGetTracingBeginDump(Connection*,
 
     phosphor::TraceContext context = PHOSPHOR_INSTANCE.getTraceContext(lh);
     if (context.getBuffer() == nullptr) {
+        return {};
+    }
+
+    return std::make_unique<PhosphorDumpContext>(std::move(context));
+}
+
+ENGINE_ERROR_CODE ioctlGetTracingBeginDump(Connection*,
+                                           const StrToStrMap& arguments,
+                                           std::string& value) {
+    std::unique_ptr<DumpContext> dump;
+    auto type = arguments.find("type");
+    if (type == arguments.end() || type->second == "phosphor") {
+        dump = createPhosphorDump();
+    } else if (type->second == "sampled") {
+        dump = std::make_unique<SampledDumpContext>(sampled_tracer.toJSON());
+    }
+
+    if (!dump) {
         return ENGINE_EINVAL;
     }
 
@@ -76,7 +145,7 @@ ENGINE_ERROR_CODE ioctlGetTracingBeginDump(Connection*,
     cb::uuid::uuid_t uuid = cb::uuid::random();
     {
         std::lock_guard<std::mutex> lh(dumpsMutex);
-        dumps.emplace(uuid, std::make_unique<DumpContext>(std::move(context)));
+        dumps.emplace(uuid, std::move(dump));
     }
 
     // Return the textual form of the uuid back to the user with success
@@ -112,14 +181,13 @@ ENGINE_ERROR_CODE ioctlGetTracingDumpChunk(Connection*,
         // @todo make configurable
         const size_t chunk_size = 1024 * 1024;
 
-        if (dump->second->json_export.done()) {
+        if (dump->second->done()) {
             value = "";
         } else {
             // @todo generate on background thread
             // and add ewouldblock functionality
             value.resize(chunk_size);
-            size_t count = dump->second->json_export.read(&value[0],
-                                                          chunk_size);
+            size_t count = dump->second->read(&value[0], chunk_size);
             value.resize(count);
         }
     }
@@ -180,3 +248,10 @@ ENGINE_ERROR_CODE ioctlSetTracingStop(Connection*,
     PHOSPHOR_INSTANCE.stop();
     return ENGINE_SUCCESS;
 }
+
+ENGINE_ERROR_CODE ioctlSetTracingSampledClear(Connection*,
+                                              const StrToStrMap&,
+                                              const std::string&) {
+    sampled_tracer.clear();
+    return ENGINE_SUCCESS;
+}
@@ -43,6 +43,9 @@ ENGINE_ERROR_CODE ioctlGetTracingConfig(Connection* c,
 
 /**
  * IOCTL Get callback to create a new dump from the last trace
+ * @param arguments 'type' argument may be given to select what to dump:
+ *        "phosphor" (the default) for the last phosphor trace, or
+ *        "sampled" for the requests kept by the sampled tracing
  * @param[out] value The uuid of the newly created dump
  */
 ENGINE_ERROR_CODE ioctlGetTracingBeginDump(Connection*,
@@ -88,3 +91,10 @@ ENGINE_ERROR_CODE ioctlSetTracingStart(Connection* c,
 ENGINE_ERROR_CODE ioctlSetTracingStop(Connection* c,
                                       const StrToStrMap& arguments,
                                       const std::string& value);
+
+/**
+ * IOCTL Set callback to drop the requests kept by the sampled tracing
+ */
+ENGINE_ERROR_CODE ioctlSetTracingSampledClear(Connection* c,
+                                              const StrToStrMap& arguments,
+                                              const std::string& value);
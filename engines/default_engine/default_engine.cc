@@ -99,6 +99,14 @@ static ENGINE_ERROR_CODE default_store(ENGINE_HANDLE* handle,
                                        uint64_t *cas,
                                        ENGINE_STORE_OPERATION operation,
                                        DocumentState);
+static ENGINE_ERROR_CODE default_update(ENGINE_HANDLE* handle,
+                                        const void* cookie,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        DocStateFilter documentStateFilter,
+                                        engine_update_cb callback,
+                                        uint64_t* cas,
+                                        mutation_descr_t* mut_info);
 static ENGINE_ERROR_CODE default_flush(ENGINE_HANDLE* handle,
                                        const void* cookie);
 static ENGINE_ERROR_CODE initalize_configuration(struct default_engine *se,
@@ -161,6 +169,9 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
 
     cb_mutex_initialize(&engine->slabs.lock);
     cb_mutex_initialize(&engine->items.lock);
+    for (auto& lock : engine->items.update_locks) {
+        cb_mutex_initialize(&lock);
+    }
     cb_mutex_initialize(&engine->stats.lock);
     cb_mutex_initialize(&engine->scrubber.lock);
 
@@ -181,6 +192,7 @@ void default_engine_constructor(struct default_engine* engine, bucket_id_t id)
     engine->engine.get_stats = default_get_stats;
     engine->engine.reset_stats = default_reset_stats;
     engine->engine.store = default_store;
+    engine->engine.update = default_update;
     engine->engine.flush = default_flush;
     engine->engine.unknown_command = default_unknown_command;
     engine->engine.item_set_cas = item_set_cas;
@@ -276,6 +288,9 @@ void destroy_engine_instance(struct default_engine* engine) {
 
         /* Clean up the mutexes */
         cb_mutex_destroy(&engine->items.lock);
+        for (auto& lock : engine->items.update_locks) {
+            cb_mutex_destroy(&lock);
+        }
         cb_mutex_destroy(&engine->stats.lock);
         cb_mutex_destroy(&engine->slabs.lock);
         cb_mutex_destroy(&engine->scrubber.lock);
@@ -645,6 +660,40 @@ static ENGINE_ERROR_CODE default_store(ENGINE_HANDLE* handle,
                       cookie, document_state);
 }
 
+static ENGINE_ERROR_CODE default_update(ENGINE_HANDLE* handle,
+                                        const void* cookie,
+                                        const DocKey& key,
+                                        uint16_t vbucket,
+                                        DocStateFilter documentStateFilter,
+                                        engine_update_cb callback,
+                                        uint64_t* cas,
+                                        mutation_descr_t* mut_info) {
+    struct default_engine* engine = get_handle(handle);
+    VBUCKET_GUARD(engine, vbucket);
+
+    auto ret = item_modify(
+            engine,
+            cookie,
+            key.data(),
+            key.size(),
+            documentStateFilter,
+            [handle, cookie, &callback](hash_item* it, item_update& update) {
+                item_info info;
+                if (!get_item_info(handle, cookie, it, &info)) {
+                    return ENGINE_FAILED;
+                }
+                return callback(info, update);
+            },
+            cas);
+
+    // vbucket UUID / seqno arn't supported by default engine, so just return
+    // a hardcoded vbucket uuid, and zero for the sequence number.
+    mut_info->vbucket_uuid = DEFAULT_ENGINE_VBUCKET_UUID;
+    mut_info->seqno = 0;
+
+    return ret;
+}
+
 static ENGINE_ERROR_CODE default_flush(ENGINE_HANDLE* handle,
                                        const void* cookie) {
    item_flush_expired(get_handle(handle));
@@ -38,6 +38,14 @@ static int do_item_replace(struct default_engine* engine,
                            const void* cookie,
                            hash_item* it,
                            hash_item* new_it);
+static ENGINE_ERROR_CODE do_item_modify(
+        struct default_engine* engine,
+        const void* cookie,
+        const void* key,
+        const size_t nkey,
+        const DocStateFilter state,
+        std::function<ENGINE_ERROR_CODE(hash_item*, item_update&)>& callback,
+        uint64_t* cas);
 static void item_free(struct default_engine *engine, hash_item *it);
 
 static bool hash_key_create(hash_key* hkey,
@@ -794,6 +802,91 @@ ENGINE_ERROR_CODE store_item(struct default_engine *engine,
     return ret;
 }
 
+/*
+ * Replaces an item with the version provided by the callback. The fetch,
+ * the callback and the store all run under the update lock for the key so
+ * that concurrent updates of the same key are serialised without holding
+ * the cache lock while the callback runs. The new version is stored with
+ * the CAS of the version passed to the callback, so that it fails with
+ * ENGINE_KEY_EEXISTS if another kind of mutation changed the item in the
+ * meantime.
+ */
+ENGINE_ERROR_CODE item_modify(
+        struct default_engine* engine,
+        const void* cookie,
+        const void* key,
+        const size_t nkey,
+        const DocStateFilter state,
+        std::function<ENGINE_ERROR_CODE(hash_item*, item_update&)> callback,
+        uint64_t* cas) {
+    cb_mutex_t* lock = &engine->items.update_locks[
+            crc32c(static_cast<const uint8_t*>(key), nkey, 0) %
+            ITEM_UPDATE_LOCKS];
+    cb_mutex_enter(lock);
+    auto ret = do_item_modify(engine, cookie, key, nkey, state, callback, cas);
+    cb_mutex_exit(lock);
+    return ret;
+}
+
+static ENGINE_ERROR_CODE do_item_modify(
+        struct default_engine* engine,
+        const void* cookie,
+        const void* key,
+        const size_t nkey,
+        const DocStateFilter state,
+        std::function<ENGINE_ERROR_CODE(hash_item*, item_update&)>& callback,
+        uint64_t* cas) {
+    hash_item* it = item_get(engine, cookie, key, nkey, state);
+    if (it == nullptr) {
+        return ENGINE_KEY_ENOENT;
+    }
+
+    if (it->locktime != 0 &&
+        it->locktime > engine->server.core->get_current_time()) {
+        item_release(engine, it);
+        return ENGINE_LOCKED_TMPFAIL;
+    }
+
+    item_update update = {};
+    ENGINE_ERROR_CODE ret;
+    try {
+        ret = callback(it, update);
+    } catch (...) {
+        item_release(engine, it);
+        throw;
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        hash_item* new_it = nullptr;
+        if (update.value.size() > engine->config.item_size_max) {
+            ret = ENGINE_E2BIG;
+        } else {
+            new_it = item_alloc(engine, key, nkey, it->flags,
+                                engine->server.core->realtime(update.exptime),
+                                int(update.value.size()), cookie,
+                                update.datatype);
+            if (new_it == nullptr) {
+                ret = ENGINE_ENOMEM;
+            }
+        }
+
+        if (new_it != nullptr) {
+            std::memcpy(item_get_data(new_it), update.value.data(),
+                        update.value.size());
+            new_it->cas = it->cas;
+            ret = store_item(engine, new_it, cas, OPERATION_CAS, cookie,
+                             update.document_state);
+            if (ret == ENGINE_LOCKED) {
+                ret = ENGINE_LOCKED_TMPFAIL;
+            }
+            item_release(engine, new_it);
+        }
+    }
+
+    item_release(engine, it);
+    return ret;
+}
+
 ENGINE_ERROR_CODE do_item_get_locked(struct default_engine* engine,
                                      const void* cookie,
                                      hash_item** it,
@@ -149,6 +149,9 @@ typedef struct {
     unsigned int reclaimed;
 } itemstats_t;
 
+/* Number of locks used to serialise item_modify of the same key */
+#define ITEM_UPDATE_LOCKS 64
+
 struct items {
    hash_item *heads[POWER_LARGEST];
    hash_item *tails[POWER_LARGEST];
@@ -158,6 +161,10 @@ struct items {
     * serialise access to the items data
    */
    cb_mutex_t lock;
+   /*
+    * serialise item_modify of the same key (picked by the hash of the key)
+    */
+   cb_mutex_t update_locks[ITEM_UPDATE_LOCKS];
 };
 
 
@@ -326,6 +333,32 @@ ENGINE_ERROR_CODE store_item(struct default_engine *engine,
                              const void *cookie,
                              const DocumentState document_state);
 
+/**
+ * Replace an item with a new version computed from the current one. The
+ * callback is run while holding the update lock for the key (but not the
+ * cache lock), so concurrent item_modify calls for the same key are run
+ * one after another and don't conflict with each other. Other mutations
+ * aren't serialised by the update lock, and if one of them changed the
+ * item in between the new version isn't stored (ENGINE_KEY_EEXISTS).
+ * The callback must not call item_modify itself.
+ * @param engine handle to the storage engine
+ * @param cookie connection cookie
+ * @param key the key of the item to update
+ * @param nkey the number of bytes in the key
+ * @param state only update documents in this state
+ * @param callback provides the new version of the item
+ * @param cas the cas value of the new item (OUT)
+ * @return ENGINE_SUCCESS on success
+ */
+ENGINE_ERROR_CODE item_modify(
+        struct default_engine* engine,
+        const void* cookie,
+        const void* key,
+        const size_t nkey,
+        const DocStateFilter state,
+        std::function<ENGINE_ERROR_CODE(hash_item*, item_update&)> callback,
+        uint64_t* cas);
+
 /**
  * Run a single scrub loop for the engine.
  * @param engine handle to the storage engine
@@ -471,6 +471,27 @@ public:
         }
     }
 
+    static ENGINE_ERROR_CODE update(ENGINE_HANDLE* handle,
+                                    const void* cookie,
+                                    const DocKey& key,
+                                    uint16_t vbucket,
+                                    DocStateFilter documentStateFilter,
+                                    engine_update_cb callback,
+                                    uint64_t* cas,
+                                    mutation_descr_t* mut_info) {
+        EWB_Engine* ewb = to_engine(handle);
+        ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
+        if (ewb->real_engine->update == nullptr) {
+            return ENGINE_ENOTSUP;
+        } else if (ewb->should_inject_error(Cmd::CAS, cookie, err)) {
+            return err;
+        } else {
+            return ewb->real_engine->update(ewb->real_handle, cookie, key,
+                                            vbucket, documentStateFilter,
+                                            callback, cas, mut_info);
+        }
+    }
+
     static ENGINE_ERROR_CODE flush(ENGINE_HANDLE* handle, const void* cookie) {
         // Flush is a little different - it often returns EWOULDBLOCK, and
         // notify_io_complete() just tells the server it can issue it's *next*
@@ -1210,6 +1231,7 @@ EWB_Engine::EWB_Engine(GET_SERVER_API gsa_)
     ENGINE_HANDLE_V1::get_and_touch = get_and_touch;
     ENGINE_HANDLE_V1::unlock = unlock;
     ENGINE_HANDLE_V1::store = store;
+    ENGINE_HANDLE_V1::update = update;
     ENGINE_HANDLE_V1::flush = flush;
     ENGINE_HANDLE_V1::get_stats = get_stats;
     ENGINE_HANDLE_V1::reset_stats = reset_stats;
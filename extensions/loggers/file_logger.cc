@@ -8,12 +8,17 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <string.h>
 #include <strings.h>
 #include <stdlib.h>
 #include <time.h>
 #include <iostream>
+#include <vector>
 
 #ifdef WIN32
 #include <io.h>
@@ -28,7 +33,6 @@
 
 #include <memcached/extension.h>
 #include <memcached/engine.h>
-#include <memcached/syslog.h>
 #include <memcached/isotime.h>
 #include <platform/strerror.h>
 
@@ -55,146 +59,273 @@ static const EXTENSION_LOG_LEVEL stderr_output_level = EXTENSION_LOG_WARNING;
  */
 static size_t cyclesz = 100 * 1024 * 1024;
 
-/*
- * We're using two buffers for logging. We'll be inserting data into one,
- * while we're working on writing the other one to disk. Given that the disk
- * is way slower than our CPU, we might end up in a situation that we'll be
- * blocking the frontend threads if you're logging too much.
- */
-static struct logbuffer {
-    /* Pointer to beginning of the datasegment of this buffer */
-    char *data;
-    /* The current offset of the buffer */
-    size_t offset;
-} buffers[2];
-
-/* The index in the buffers where we're currently inserting more data */
-static int currbuffer = 0;
-
 /* Are we running in a unit test (don't print warnings to stderr) */
 static bool unit_test = false;
 
-/* The size of the buffers (this may be tuned by the buffersize configuration
- * parameter */
-static size_t buffersz = 2048 * 1024;
+/* The size of each thread's log buffer (this may be tuned by the buffersize
+ * configuration parameter). The buffer must be able to hold a few of the
+ * biggest messages, so smaller values are rounded up to MinBufferSize */
+static size_t buffersz = 256 * 1024;
+static const size_t MinBufferSize = 16 * 1024;
 
 /* The sleeptime between each forced flush of the buffer */
 static size_t sleeptime = 60;
 
-/* To avoid race condition we're protecting our shared resources with a
- * single mutex. */
-static cb_mutex_t mutex;
-
-/* The thread performing the disk IO will be waiting for the input buffers
- * to be filled by sleeping on the following condition variable. The
- * frontend threads will notify the condition variable when the buffer is
- * > 75% full
+/* Each thread may add ratelimit messages per second to the log (with bursts
+ * of up to ratelimit_burst messages). The messages above the limit are
+ * dropped, and the number of dropped messages is added to the log. FATAL
+ * messages are never dropped. Rate limiting is disabled unless ratelimit
+ * is set.
  */
-static cb_cond_t cond;
-
-/* In the "worst case scenarios" we're logging so much that the disk thread
- * can't keep up with the the frontend threads. In these rare situations
- * the frontend threads will block and wait for the flusher to free up log
- * space
+static const size_t DefaultRateLimit = 0;
+static const size_t DefaultRateLimitBurst = 10000;
+static size_t ratelimit = DefaultRateLimit;
+static size_t ratelimit_burst = DefaultRateLimitBurst;
+
+/* The mutex and condition variables are only used to put the logger thread
+ * to sleep while it waits for messages, and to put the frontend threads to
+ * sleep in the "worst case scenarios" where they're logging so much that the
+ * logger thread can't keep up and their buffer is full. The frontend
+ * threads notify the condition variable when their buffer is > 75% full
+ * (if the logger thread is waiting)
  */
+static cb_mutex_t mutex;
+static cb_cond_t cond;
 static cb_cond_t space_cond;
-
-static char hostname[256];
-static pid_t pid;
+static std::atomic<bool> logger_waiting;
 
 // mutex used to synchronize access to stderr
 std::mutex stderr_mutex;
 
-/* To avoid the logs beeing flooded by the same log messages we try to
- * de-duplicate the messages and instead print out:
- *   "message repeated xxx times"
+/* Statistics */
+static std::atomic<uint64_t> messages_logged;
+static std::atomic<uint64_t> messages_dropped;
+static std::atomic<uint64_t> messages_delayed;
+
+/*
+ * Each thread logging messages gets its own ring buffer. The thread copies
+ * the message text into the ring without taking any locks, and the logger
+ * thread adds the timestamp and severity when it writes the message to the
+ * file. The ring is a single producer / single consumer queue of variable
+ * sized records.
  */
-static struct {
-    /* The last message being added to the log */
-    char buffer[2048];
-    /* The number of times we've seen this message */
-    int count;
-    /* The offset into the buffer for where the text start (after the
-     * timestamp)
+class LogRing {
+public:
+    struct Record {
+        /* The number of bytes used by this record in the ring */
+        uint32_t size;
+        /* The length of the message following the record (or Wrap if
+         * the rest of the ring is unused) */
+        uint32_t length;
+        int32_t severity;
+        uint32_t usec;
+        int64_t sec;
+        uint64_t unused;
+    };
+    static_assert(sizeof(Record) == 32, "Record should be 32 bytes");
+
+    static const uint32_t Wrap = 0xffffffff;
+
+    explicit LogRing(size_t size)
+        : capacity(size / sizeof(Record) * sizeof(Record)),
+          storage(new Record[size / sizeof(Record)]),
+          tokens(double(ratelimit_burst)),
+          last_refill(0),
+          reported_suppressed(0),
+          head(0),
+          tail(0) {
+    }
+
+    /**
+     * Add a message to the ring (called by the owning thread)
+     *
+     * @return false if there isn't room for the message
      */
-    int offset;
-    /* The sec when the entry was added (used for flushing of the
-     * dedupe log)
-     */
-    time_t created;
-} lastlog;
+    bool push(EXTENSION_LOG_LEVEL severity, const struct timeval& tv,
+              const char* msg, size_t length) {
+        const size_t needed = align(sizeof(Record) + length);
+        size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_acquire);
+        size_t offset = t % capacity;
+        const size_t contiguous = capacity - offset;
+        const size_t total = contiguous < needed ? contiguous + needed
+                                                 : needed;
+        if (capacity - (t - h) < total) {
+            return false;
+        }
 
-static void do_add_log_entry(const char *msg, size_t size) {
-    /* wait until there is room in the current buffer */
-    while ((buffers[currbuffer].offset + size) >= buffersz) {
-        if (!unit_test) {
-            fprintf(stderr, "WARNING: waiting for log space to be available\n");
+        if (contiguous < needed) {
+            // The record has to be contiguous, skip the rest of the ring
+            auto* wrap = at(offset);
+            wrap->size = uint32_t(contiguous);
+            wrap->length = Wrap;
+            t += contiguous;
+            offset = 0;
         }
-        cb_cond_wait(&space_cond, &mutex);
+
+        auto* record = at(offset);
+        record->size = uint32_t(needed);
+        record->length = uint32_t(length);
+        record->severity = severity;
+        record->sec = tv.tv_sec;
+        record->usec = uint32_t(tv.tv_usec);
+        memcpy(record + 1, msg, length);
+        tail.store(t + needed, std::memory_order_release);
+        return true;
     }
 
-    /* We could have performed the memcpy outside the locked region,
-     * but then we would need to handle the situation where we're
-     * flipping the ownership of the buffer (otherwise we could be
-     * writing rubbish to the file) */
-    memcpy(buffers[currbuffer].data + buffers[currbuffer].offset,
-           msg, size);
-    buffers[currbuffer].offset += size;
-    if (buffers[currbuffer].offset > (buffersz * 0.75)) {
-        /* we're getting full.. time get the logger to start doing stuff! */
-        cb_cond_signal(&cond);
+    /**
+     * Remove all of the messages from the ring (called by the logger
+     * thread) and pass them to the callback
+     */
+    template <typename Callback>
+    void drain(Callback callback) {
+        size_t h = head.load(std::memory_order_relaxed);
+        const size_t t = tail.load(std::memory_order_acquire);
+        while (h != t) {
+            const auto* record = at(h % capacity);
+            if (record->length != Wrap) {
+                callback(*record, reinterpret_cast<const char*>(record + 1));
+            }
+            h += record->size;
+        }
+        head.store(h, std::memory_order_release);
     }
-}
 
-static void flush_last_log(bool timebased) {
-    if (lastlog.count > 1) {
-        ISOTime::ISO8601String timestamp;
-        ISOTime::generatetimestamp(timestamp);
+    bool isEmpty() const {
+        return tail.load() == head.load();
+    }
 
-        char buffer[512];
-        int offset = snprintf(buffer, sizeof(buffer),
-                              "%s Message repeated %u times\n",
-                              timestamp.data(), lastlog.count);
+    bool isAlmostFull() const {
+        return (tail.load() - head.load()) > (capacity / 4 * 3);
+    }
 
-        if (offset < 0 || offset >= int(sizeof(buffer))) {
-            // Failed to format... ignore for now..
-            return;
-        }
+    /* Set when the owning thread terminates (the logger thread deletes
+     * the ring when it is drained) */
+    bool orphaned = false;
+
+    /* The rate limiting state (only used by the owning thread) */
+    double tokens;
+    uint64_t last_refill;
+
+    /* The number of messages dropped by the rate limiting, and the
+     * number the logger thread has reported in the log */
+    std::atomic<uint64_t> suppressed{0};
+    uint64_t reported_suppressed;
+
+private:
+    Record* at(size_t offset) const {
+        return storage.get() + offset / sizeof(Record);
+    }
+
+    static size_t align(size_t size) {
+        return (size + sizeof(Record) - 1) / sizeof(Record) * sizeof(Record);
+    }
 
-        // Only try to flush if there is enough free space, otherwise
-        // we'll be causing a deadlock
-        if (timebased && ((buffers[currbuffer].offset + offset) >= buffersz)) {
-            return ;
+    const size_t capacity;
+    std::unique_ptr<Record[]> storage;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+/* All of the rings in use (protected by rings_mutex). The generation is
+ * bumped every time the rings are released, so that the threads know
+ * they need a new ring.
+ *
+ * The rings are shared with the threads owning them: a thread may still be
+ * adding a message to its ring when the rings are released (it checks the
+ * generation without holding the lock), so the ring is only deleted once
+ * the thread has let go of it as well.
+ */
+static std::mutex rings_mutex;
+static std::vector<std::shared_ptr<LogRing>> rings;
+static std::atomic<uint64_t> rings_generation;
+
+/* The calling thread's ring */
+static thread_local struct ThreadRing {
+    ~ThreadRing() {
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        if (ring && generation == rings_generation) {
+            ring->orphaned = true;
         }
+    }
 
-        do_add_log_entry(buffer, offset);
-        lastlog.buffer[0] = '\0';
-        lastlog.count = 0;
-        lastlog.offset = 0;
-        lastlog.created = 0;
+    std::shared_ptr<LogRing> ring;
+    uint64_t generation = 0;
+} thread_ring;
+
+static LogRing& get_thread_ring() {
+    if (!thread_ring.ring || thread_ring.generation != rings_generation) {
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        rings.emplace_back(std::make_shared<LogRing>(buffersz));
+        thread_ring.ring = rings.back();
+        thread_ring.generation = rings_generation;
     }
+    return *thread_ring.ring;
 }
 
-static void add_log_entry(time_t now, const char *msg, int prefixlen, size_t size)
-{
-    cb_mutex_enter(&mutex);
+static void release_rings() {
+    std::lock_guard<std::mutex> guard(rings_mutex);
+    rings.clear();
+    ++rings_generation;
+}
 
-    if (size < sizeof(lastlog.buffer)) {
-        if (memcmp(lastlog.buffer + lastlog.offset, msg + prefixlen, size-prefixlen) == 0) {
-            ++lastlog.count;
-        } else {
-            flush_last_log(false);
-            do_add_log_entry(msg, size);
-            memcpy(lastlog.buffer, msg, size);
-            lastlog.offset = prefixlen;
-            lastlog.created = now;
+/* Check if the thread has exceeded its rate limit (a token bucket
+ * refilled at ratelimit tokens per second) */
+static bool is_rate_limited(LogRing& ring, EXTENSION_LOG_LEVEL severity,
+                            const struct timeval& now) {
+    if (ratelimit == 0 || severity == EXTENSION_LOG_FATAL) {
+        return false;
+    }
+
+    const uint64_t usec = uint64_t(now.tv_sec) * 1000000 + now.tv_usec;
+    if (usec > ring.last_refill) {
+        ring.tokens += double(usec - ring.last_refill) * ratelimit / 1000000;
+        ring.tokens = std::min(ring.tokens, double(ratelimit_burst));
+        ring.last_refill = usec;
+    }
+
+    if (ring.tokens < 1) {
+        return true;
+    }
+    ring.tokens -= 1;
+    return false;
+}
+
+static volatile int run = 1;
+
+static void add_log_entry(LogRing& ring, EXTENSION_LOG_LEVEL severity,
+                          const struct timeval& now, const char* msg,
+                          size_t size) {
+    /* wait until there is room in the buffer */
+    bool delayed = false;
+    while (!ring.push(severity, now, msg, size)) {
+        if (!run) {
+            // Nobody is going to free up any space
+            ++messages_dropped;
+            return;
         }
-    } else {
-        flush_last_log(false);
-        do_add_log_entry(msg, size);
+        if (!delayed) {
+            delayed = true;
+            ++messages_delayed;
+            if (!unit_test) {
+                fprintf(stderr,
+                        "WARNING: waiting for log space to be available\n");
+            }
+        }
+        cb_mutex_enter(&mutex);
+        cb_cond_signal(&cond);
+        cb_cond_timedwait(&space_cond, &mutex, 10);
+        cb_mutex_exit(&mutex);
     }
+    ++messages_logged;
 
-    cb_mutex_exit(&mutex);
+    if (ring.isAlmostFull() && logger_waiting) {
+        /* we're getting full.. time get the logger to start doing stuff! */
+        cb_mutex_enter(&mutex);
+        cb_cond_signal(&cond);
+        cb_mutex_exit(&mutex);
+    }
 }
 
 static const char *severity2string(EXTENSION_LOG_LEVEL sev) {
@@ -252,72 +383,25 @@ static int format_log_entry(char* buffer, size_t buf_len, time_t time,
     return prefix_len;
 }
 
-/* Takes the syslog compliant event and calls the native logging functionality */
-static void syslog_event_receiver(SyslogEvent *event) {
-    uint8_t syslog_severity = event->prival & 7; /* Mask out all but 3 least-significant bits */
-    EXTENSION_LOG_LEVEL severity = EXTENSION_LOG_WARNING;
-
-    switch (syslog_severity) {
-    case SYSLOG_CRITICAL:
-        severity = EXTENSION_LOG_FATAL;
-        break;
-    case SYSLOG_WARNING:
-        severity = EXTENSION_LOG_WARNING;
-        break;
-    case SYSLOG_NOTICE:
-        severity = EXTENSION_LOG_NOTICE;
-        break;
-    case SYSLOG_INFORMATIONAL:
-        severity = EXTENSION_LOG_INFO;
-        break;
-    case SYSLOG_DEBUG:
-        severity = EXTENSION_LOG_DEBUG;
-        break;
-    default:
-        fprintf(stderr, "ERROR: Unknown syslog_severity\n");
-    }
-
-    char buffer[2048];
-    const int prefixlen = format_log_entry(buffer, sizeof(buffer),
-                                           event->time, event->time_secfrac,
-                                           severity, event->msg);
-
-    if (severity >= current_log_level || severity >= stderr_output_level) {
-        if (severity >= stderr_output_level) {
-            std::lock_guard<std::mutex> guard(stderr_mutex);
-            std::cerr << buffer;
-            std::cerr.flush();
-        }
-
-        if (severity >= current_log_level) {
-            add_log_entry(event->time, buffer, prefixlen, strlen(buffer));
-        }
-    }
-}
-
-
-/* Takes the current logging format and produces syslogd compliant event */
+/* Copies the message into the calling thread's log buffer (and formats it
+ * for stderr if the severity requires that). The logger thread adds the
+ * timestamp and severity when it writes the message to the file.
+ */
 static void logger_log_wrapper(EXTENSION_LOG_LEVEL severity,
                                const void* client_cookie,
                                const char *fmt, ...) {
     (void)client_cookie;
-    SyslogEvent event;
-    size_t avail_char_in_msg = sizeof(event.msg) - 1; /*space excluding terminating char */
-    struct timeval now;
+    if (severity < current_log_level && severity < stderr_output_level) {
+        return;
+    }
+
+    char msg[2048];
+    size_t avail_char_in_msg = sizeof(msg) - 1; /*space excluding terminating char */
     va_list ap;
     int len;
-    uint8_t facility = 16;  /* Facility - defaulting to local0 */
-    uint8_t syslog_severity;
-
-    /* RFC5424 uses version 1 of syslog protocol */
-    event.version = 1;
-    event.msgid = GENERIC_EVENT;
-    strcpy(event.app_name, "memcached");
-    strcpy(event.hostname, hostname);
-    event.procid = (uint64_t)pid;
 
     va_start(ap, fmt);
-    len = vsnprintf(event.msg, avail_char_in_msg, fmt, ap);
+    len = vsnprintf(msg, avail_char_in_msg, fmt, ap);
     va_end(ap);
 
     /* array indices start from zero, so need to offset length by minus one */
@@ -326,11 +410,12 @@ static void logger_log_wrapper(EXTENSION_LOG_LEVEL severity,
     if (len >= 0) {
         if (len < static_cast<int>(avail_char_in_msg)) {
             /* add a new line to the message if not already there */
-            if (event.msg[index] != '\n') {
-                event.msg[index + 1] = '\n';
-                event.msg[index + 2] = '\0';
+            if (len == 0 || msg[index] != '\n') {
+                msg[index + 1] = '\n';
+                msg[index + 2] = '\0';
+                ++len;
             } else {
-                event.msg[index + 1] = '\0';
+                msg[index + 1] = '\0';
             }
         } else {
             /* len is equal avail_char_in_msg */
@@ -339,63 +424,48 @@ static void logger_log_wrapper(EXTENSION_LOG_LEVEL severity,
              * (excluding terminating character)
              */
             index = avail_char_in_msg - 1;
-            if (event.msg[index] != '\n') {
+            if (msg[index] != '\n') {
                 std::lock_guard<std::mutex> guard(stderr_mutex);
-                std::cerr << "Syslog message being truncated... too big"
+                std::cerr << "Log message being truncated... too big"
                           << std::endl;
-                event.msg[index] = '\n';
+                msg[index] = '\n';
             }
-            event.msg[index + 1] = '\0';
+            msg[index + 1] = '\0';
+            len = int(avail_char_in_msg);
         }
     } else {
         std::lock_guard<std::mutex> guard(stderr_mutex);
-        std::cerr << "Syslog message dropped... too big" << std::endl;
+        std::cerr << "Log message dropped... too big" << std::endl;
         return;
     }
 
-    switch (severity) {
-    case EXTENSION_LOG_FATAL:
-        syslog_severity = SYSLOG_CRITICAL;
-        break;
-    case EXTENSION_LOG_WARNING:
-        syslog_severity = SYSLOG_WARNING;
-        break;
-    case EXTENSION_LOG_NOTICE:
-        syslog_severity = SYSLOG_NOTICE;
-        break;
-    case EXTENSION_LOG_INFO:
-        syslog_severity = SYSLOG_INFORMATIONAL;
-        break;
-    case EXTENSION_LOG_DEBUG:
-    case EXTENSION_LOG_DETAIL:
-        syslog_severity = SYSLOG_DEBUG;
-        break;
-    default: {
-            std::lock_guard<std::mutex> guard(stderr_mutex);
-            std::cerr << "Unknown severity: " << severity
-                      << " using SYSLOG_UNKNOWN" << std::endl;
-        }
-        syslog_severity = SYSLOG_UNKNOWN;
-    }
-
-    /*
-       To produce the priority_value multiply facility by 8
-       i.e. shift to left 3 places. Then add the syslog_severity
-     */
-    event.prival = (facility << 3) + syslog_severity;
-
-    /* Fill-in date structure */
-    if (cb_get_timeofday(&now) == 0) {
-        event.time = (time_t)now.tv_sec;
-        event.time_secfrac = (uint32_t)now.tv_usec;
-    } else {
+    struct timeval now;
+    if (cb_get_timeofday(&now) != 0) {
         std::lock_guard<std::mutex> guard(stderr_mutex);
         std::cerr << "gettimeofday failed in file_logger.cc: " << cb_strerror()
                   << std::endl;
         return;
     }
-    /* Send the syslog event */
-    syslog_event_receiver(&event);
+
+    auto& ring = get_thread_ring();
+    if (is_rate_limited(ring, severity, now)) {
+        ++ring.suppressed;
+        ++messages_dropped;
+        return;
+    }
+
+    if (severity >= stderr_output_level) {
+        char buffer[2048];
+        format_log_entry(buffer, sizeof(buffer), now.tv_sec,
+                         uint32_t(now.tv_usec), severity, msg);
+        std::lock_guard<std::mutex> guard(stderr_mutex);
+        std::cerr << buffer;
+        std::cerr.flush();
+    }
+
+    if (severity >= current_log_level) {
+        add_log_entry(ring, severity, now, msg, size_t(len));
+    }
 }
 
 static unsigned long next_file_id = 0;
@@ -468,130 +538,236 @@ static FILE *rotate_logfile(FILE *old, const char *fnm) {
     return new_log;
 }
 
-static size_t flush_pending_io(FILE *file, struct logbuffer *lb) {
-    size_t ret = 0;
-    if (lb->offset > 0) {
-        if (file) {
-            char *ptr = lb->data;
-            size_t towrite = ret = lb->offset;
-            while (towrite > 0) {
-                auto nw = fwrite(ptr, 1, towrite, file);
-                if (nw > 0) {
-                    ptr += nw;
-                    towrite -= nw;
-                }
+/* A message read from one of the threads' log buffers */
+struct LogEntry {
+    int64_t sec;
+    uint32_t usec;
+    EXTENSION_LOG_LEVEL severity;
+    std::string message;
+};
+
+/*
+ * Move all of the messages from the threads' log buffers into entries
+ * (sorted by the time they were logged), and release the buffers for the
+ * threads which have terminated. If force is set we don't try to grab the
+ * lock (other threads may never run again).
+ */
+static void collect_entries(std::vector<LogEntry>& entries, bool force) {
+    std::unique_lock<std::mutex> guard(rings_mutex, std::defer_lock);
+    if (!force) {
+        guard.lock();
+    }
+
+    for (auto& ring : rings) {
+        ring->drain([&entries](const LogRing::Record& record,
+                               const char* message) {
+            entries.push_back({record.sec, record.usec,
+                               EXTENSION_LOG_LEVEL(record.severity),
+                               std::string(message, record.length)});
+        });
+
+        const uint64_t suppressed = ring->suppressed;
+        if (suppressed != ring->reported_suppressed) {
+            struct timeval now;
+            cb_get_timeofday(&now);
+            entries.push_back({now.tv_sec, uint32_t(now.tv_usec),
+                               EXTENSION_LOG_WARNING,
+                               "Suppressed " +
+                               std::to_string(suppressed -
+                                              ring->reported_suppressed) +
+                               " log messages (rate limit exceeded)\n"});
+            ring->reported_suppressed = suppressed;
+        }
+    }
+
+    if (!force) {
+        rings.erase(std::remove_if(rings.begin(), rings.end(),
+                                   [](const std::shared_ptr<LogRing>& ring) {
+                                       return ring->orphaned && ring->isEmpty();
+                                   }),
+                    rings.end());
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const LogEntry& a, const LogEntry& b) {
+                         return a.sec < b.sec ||
+                                (a.sec == b.sec && a.usec < b.usec);
+                     });
+}
+
+static cb_thread_t tid;
+static FILE *fp;
+
+/* The logger thread's state for writing the log file. The messages are
+ * formatted into output, which is written to the file once all of the
+ * collected messages are formatted (or when it is time to rotate the file).
+ */
+static std::string logfile_name;
+static std::string output;
+static size_t currsize = 0;
+
+static void write_output() {
+    if (output.empty()) {
+        return;
+    }
+
+    if (fp) {
+        const char* ptr = output.data();
+        size_t towrite = output.size();
+        while (towrite > 0) {
+            auto nw = fwrite(ptr, 1, towrite, fp);
+            if (nw > 0) {
+                ptr += nw;
+                towrite -= nw;
             }
-            lb->offset = 0;
-            fflush(file);
-        } else {
-            // Cannot write as have no FD, however we also don't want
-            // to leave the logbuffer as-is as that would result in it
-            // filling up and producers being deadlocked. Therefore
-            // discard the logbuffer contents.
-            // Note that any message at output_level is always logged
-            // to stderr (for babysitter) so those messages will not
-            // be lost.
-            lb->offset = 0;
         }
+        fflush(fp);
+        currsize += output.size();
     }
+    // If we don't have a file we discard the messages (any message at
+    // stderr_output_level is always logged to stderr (for babysitter) so
+    // those messages will not be lost).
+    output.clear();
 
-    return ret;
+    if (currsize > cyclesz) {
+        fp = rotate_logfile(fp, logfile_name.c_str());
+        currsize = 0;
+    }
 }
 
-static void flush_all_buffers_to_file(FILE *file) {
-    while (buffers[currbuffer].offset) {
-        int curr  = currbuffer;
-        currbuffer = (currbuffer == 0) ? 1 : 0;
-        flush_pending_io(file, buffers + curr);
+static void append_output(int64_t sec, uint32_t usec,
+                          EXTENSION_LOG_LEVEL severity, const char* message) {
+    char buffer[2048];
+    format_log_entry(buffer, sizeof(buffer), time_t(sec), usec, severity,
+                     message);
+    const size_t len = strlen(buffer);
+    if (currsize + output.size() + len > cyclesz) {
+        write_output();
     }
+    output.append(buffer, len);
 }
 
-static volatile int run = 1;
-static cb_thread_t tid;
-static FILE *fp;
+/* To avoid flooding the log with the same message we keep track of the
+ * last message logged, and write "Message repeated" instead of the
+ * duplicates (only used by the logger thread) */
+static struct {
+    std::string message;
+    unsigned int count;
+    time_t created;
+} lastlog;
+
+static void flush_last_log() {
+    if (lastlog.count > 0) {
+        char message[80];
+        snprintf(message, sizeof(message), "Message repeated %u times\n",
+                 lastlog.count);
+        struct timeval now;
+        cb_get_timeofday(&now);
+        append_output(now.tv_sec, uint32_t(now.tv_usec), EXTENSION_LOG_NOTICE,
+                      message);
+        lastlog.count = 0;
+    }
+}
+
+static void write_entry(const LogEntry& entry) {
+    if (entry.message == lastlog.message) {
+        ++lastlog.count;
+        return;
+    }
+
+    flush_last_log();
+    lastlog.message = entry.message;
+    lastlog.created = time_t(entry.sec);
+    append_output(entry.sec, entry.usec, entry.severity,
+                  entry.message.c_str());
+}
 
 static void logger_thread_main(void* arg)
 {
-    size_t currsize = 0;
+    logfile_name.assign(reinterpret_cast<const char*>(arg));
+    cb_free(arg);
 
+    std::vector<LogEntry> entries;
     struct timeval tp;
-    cb_get_timeofday(&tp);
-    time_t next = (time_t)tp.tv_sec;
 
     cb_mutex_enter(&mutex);
     while (run) {
-        cb_get_timeofday(&tp);
-
-        while ((time_t)tp.tv_sec >= next  ||
-               buffers[currbuffer].offset > (buffersz * 0.75)) {
-            int curr  = currbuffer;
-            next = (time_t)tp.tv_sec + 1;
-            currbuffer = (currbuffer == 0) ? 1 : 0;
-            /* Let people who is blocked for space continue */
-            cb_cond_broadcast(&space_cond);
-
-            /* Perform file IO without the lock */
-            cb_mutex_exit(&mutex);
-
-            /* In case we failed to open the log file last time (e.g. EMFILE),
-               re-attempt now. */
-            if (fp == NULL) {
-                fp = open_logfile(reinterpret_cast<const char*>(arg));
-                if (fp != NULL) {
-                    // Record that the log is back online.
-                    struct timeval now;
-                    cb_get_timeofday(&now);
-                    char log_entry[1024];
-                    format_log_entry(log_entry, sizeof(log_entry),
-                                     now.tv_sec, now.tv_usec,
-                                     EXTENSION_LOG_NOTICE,
-                                     "Restarting file logging\n");
-
-                    fwrite(log_entry, 1, strlen(log_entry), fp);
-                    // Send to stderr for good measure.
-                    std::lock_guard<std::mutex> guard(stderr_mutex);
-                    std::cerr << log_entry;
-                }
+        logger_waiting = false;
+        /* Perform file IO without the lock */
+        cb_mutex_exit(&mutex);
+
+        collect_entries(entries, false);
+        /* Let people who is blocked for space continue */
+        cb_cond_broadcast(&space_cond);
+
+        /* In case we failed to open the log file last time (e.g. EMFILE),
+           re-attempt now. */
+        if (fp == NULL) {
+            fp = open_logfile(logfile_name.c_str());
+            if (fp != NULL) {
+                // Record that the log is back online.
+                struct timeval now;
+                cb_get_timeofday(&now);
+                char log_entry[1024];
+                format_log_entry(log_entry, sizeof(log_entry),
+                                 now.tv_sec, now.tv_usec,
+                                 EXTENSION_LOG_NOTICE,
+                                 "Restarting file logging\n");
+
+                fwrite(log_entry, 1, strlen(log_entry), fp);
+                // Send to stderr for good measure.
+                std::lock_guard<std::mutex> guard(stderr_mutex);
+                std::cerr << log_entry;
             }
+        }
 
-            currsize += flush_pending_io(fp, buffers + curr);
-            if (currsize > cyclesz) {
-                fp = rotate_logfile(fp, reinterpret_cast<const char*>(arg));
-                currsize = 0;
-            }
-            cb_mutex_enter(&mutex);
+        for (const auto& entry : entries) {
+            write_entry(entry);
         }
+        entries.clear();
 
         // Only run dedupe for ~5 seconds
+        cb_get_timeofday(&tp);
         if (lastlog.count > 0 && (lastlog.created + 4 < tp.tv_sec)) {
-            flush_last_log(true);
+            flush_last_log();
         }
+        write_output();
 
-        cb_get_timeofday(&tp);
-        next = (time_t)tp.tv_sec + (time_t)sleeptime;
-
+        cb_mutex_enter(&mutex);
+        if (!run) {
+            break;
+        }
+        logger_waiting = true;
         if (unit_test) {
             cb_cond_timedwait(&cond, &mutex, 100);
         } else {
             cb_cond_timedwait(&cond, &mutex, (unsigned int)(1000 * sleeptime));
         }
     }
+    logger_waiting = false;
+    cb_mutex_exit(&mutex);
+
+    /* Pick up whatever was logged while we were writing */
+    collect_entries(entries, false);
+    cb_cond_broadcast(&space_cond);
 
     /* The log file might not be open, however we may have
      * an event in the buffer that needs flushing to a file.
      */
-    if (buffers[currbuffer].offset != 0 && !fp) {
-        fp = open_logfile(reinterpret_cast<const char*>(arg));
+    if (!fp && (!entries.empty() || lastlog.count > 0)) {
+        fp = open_logfile(logfile_name.c_str());
+    }
+    for (const auto& entry : entries) {
+        write_entry(entry);
     }
+    flush_last_log();
+    write_output();
     if (fp) {
-        flush_all_buffers_to_file(fp);
         close_logfile(fp);
+        fp = NULL;
     }
 
-    cb_mutex_exit(&mutex);
-    cb_free(arg);
-    cb_free(buffers[0].data);
-    cb_free(buffers[1].data);
+    release_rings();
 }
 
 static void exit_handler(void) {
@@ -614,6 +790,17 @@ static const char *get_name(void) {
     return "file logger";
 }
 
+static void logger_get_stats(ADD_STAT add_stat, const void* cookie) {
+    auto add = [add_stat, cookie](const char* key, uint64_t value) {
+        const auto val = std::to_string(value);
+        add_stat(key, uint16_t(strlen(key)), val.data(), uint32_t(val.size()),
+                 cookie);
+    };
+    add("messages_logged", messages_logged);
+    add("messages_dropped", messages_dropped);
+    add("messages_delayed", messages_delayed);
+}
+
 static EXTENSION_LOGGER_DESCRIPTOR descriptor;
 
 static void on_log_level(const void *cookie, ENGINE_EVENT_TYPE type,
@@ -627,8 +814,14 @@ static void logger_shutdown(bool force) {
     if (force) {
         // Don't bother attempting to take any mutexes - other threads may
         // never run again. Just flush the buffers asap.
+        std::vector<LogEntry> entries;
+        collect_entries(entries, true);
         if (fp) {
-            flush_all_buffers_to_file(fp);
+            for (const auto& entry : entries) {
+                append_output(entry.sec, entry.usec, entry.severity,
+                              entry.message.c_str());
+            }
+            write_output();
             close_logfile(fp);
             fp = NULL;
         }
@@ -637,7 +830,6 @@ static void logger_shutdown(bool force) {
 
     int running;
     cb_mutex_enter(&mutex);
-    flush_last_log(false);
     running = run;
     run = 0;
     cb_cond_signal(&cond);
@@ -658,10 +850,18 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
      */
     run = 1;
     fp = nullptr;
-    lastlog.buffer[0] = '\0';
+    lastlog.message.clear();
     lastlog.count = 0;
-    lastlog.offset = 0;
     lastlog.created = 0;
+    output.clear();
+    currsize = 0;
+    logger_waiting = false;
+    messages_logged = 0;
+    messages_dropped = 0;
+    messages_delayed = 0;
+    ratelimit = DefaultRateLimit;
+    ratelimit_burst = DefaultRateLimitBurst;
+    release_rings();
 
     char *fname = NULL;
 
@@ -672,6 +872,7 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
     descriptor.get_name = get_name;
     descriptor.log = logger_log_wrapper;
     descriptor.shutdown = logger_shutdown;
+    descriptor.get_stats = logger_get_stats;
 
 #ifdef HAVE_TM_ZONE
     tzset();
@@ -682,16 +883,8 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
         return EXTENSION_FATAL;
     }
 
-    pid = (pid_t)cb_getpid();
-
-    if (gethostname(hostname, sizeof(hostname))) {
-        std::cerr << "Could not get the hostname: " << cb_strerror()
-                  << std::endl;
-        strcpy(hostname,"unknown");
-    }
-
     if (config != NULL) {
-        struct config_item items[6];
+        struct config_item items[8];
         int ii = 0;
         memset(&items, 0, sizeof(items));
 
@@ -720,9 +913,19 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
         items[ii].value.dt_bool = &unit_test;
         ++ii;
 
+        items[ii].key = "ratelimit";
+        items[ii].datatype = DT_SIZE;
+        items[ii].value.dt_size = &ratelimit;
+        ++ii;
+
+        items[ii].key = "ratelimit_burst";
+        items[ii].datatype = DT_SIZE;
+        items[ii].value.dt_size = &ratelimit_burst;
+        ++ii;
+
         items[ii].key = NULL;
         ++ii;
-        cb_assert(ii == 6);
+        cb_assert(ii == 8);
 
         if (sapi->core->parse_config(config, items, stderr) != ENGINE_SUCCESS) {
             return EXTENSION_FATAL;
@@ -738,21 +941,19 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
     }
 
     if (getenv("CB_MAXIMIZE_LOGGER_BUFFER_SIZE") != nullptr) {
-        buffersz = 8 * 1024 * 1024; // use two 8MB log buffers
+        buffersz = 1024 * 1024; // use 1MB log buffer per thread
+    }
+
+    if (buffersz < MinBufferSize) {
+        buffersz = MinBufferSize;
     }
 
     if (fname == NULL) {
         fname = cb_strdup("memcached");
     }
 
-    buffers[0].data = reinterpret_cast<char*>(cb_malloc(buffersz));
-    buffers[1].data = reinterpret_cast<char*>(cb_malloc(buffersz));
-
-    if (buffers[0].data == NULL || buffers[1].data == NULL || fname == NULL) {
+    if (fname == NULL) {
         std::cerr << "Failed to allocate memory for the logger" << std::endl;
-        cb_free(fname);
-        cb_free(buffers[0].data);
-        cb_free(buffers[1].data);
         return EXTENSION_FATAL;
     }
 
@@ -763,8 +964,6 @@ EXTENSION_ERROR_CODE memcached_extensions_initialize(const char *config,
         std::cerr << "Failed to create the logger backend thread: "
                   << cb_strerror() << std::endl;
         cb_free(fname);
-        cb_free(buffers[0].data);
-        cb_free(buffers[1].data);
         return EXTENSION_FATAL;
     }
     atexit(exit_handler);
@@ -275,6 +275,9 @@ enum class Opcode : uint8_t {
     /* Subdoc additions for Spock: */
     SubdocGetCount = 0xd2,
 
+    /* Run a multi-path command on a list of keys */
+    SubdocMultiKey = 0xd3,
+
     /* Scrub the data */
     Scrub = 0xf0,
     /* Refresh the ISASL data */
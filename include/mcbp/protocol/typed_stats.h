@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/sized_buffer.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace cb {
+namespace mcbp {
+namespace stats {
+
+/**
+ * When the client enabled the TYPED_STATS feature the server returns all
+ * of the stats for a STAT command in the value of a single response
+ * (instead of one response per stat terminated by an empty response).
+ * The value is a sequence of entries:
+ *
+ *     type    (1 byte, see Type)
+ *     keylen  (2 bytes, network byte order)
+ *     key     (keylen bytes)
+ *     value   String:   4 bytes length (network byte order) + the bytes
+ *             Unsigned: 8 bytes (network byte order)
+ *             Signed:   8 bytes (network byte order, two's complement)
+ *             Boolean:  1 byte (0 or 1)
+ */
+enum class Type : uint8_t { String = 0, Unsigned = 1, Signed = 2, Boolean = 3 };
+
+/// The size of the type and key length fields of an entry
+static const size_t EntryHeaderSize = 3;
+
+/**
+ * Get the number of bytes needed to encode a stat with a string value
+ */
+inline size_t getStringEntrySize(size_t keylen, size_t valuelen) {
+    return EntryHeaderSize + keylen + 4 + valuelen;
+}
+
+/**
+ * Get the (maximum) number of bytes needed to encode a stat with a
+ * numeric or boolean value
+ */
+inline size_t getNumericEntrySize(size_t keylen) {
+    return EntryHeaderSize + keylen + 8;
+}
+
+/*
+ * Encode a stat into the buffer pointed to by dest (which must be big
+ * enough to hold the entry). Returns the number of bytes written.
+ */
+size_t encodeString(char* dest,
+                    cb::const_char_buffer key,
+                    cb::const_char_buffer value);
+size_t encodeUnsigned(char* dest, cb::const_char_buffer key, uint64_t value);
+size_t encodeSigned(char* dest, cb::const_char_buffer key, int64_t value);
+size_t encodeBoolean(char* dest, cb::const_char_buffer key, bool value);
+
+/**
+ * A decoded value. Only the member matching the type is valid, and the
+ * string refers to the memory of the decoded payload.
+ */
+struct Value {
+    Type type;
+    cb::const_char_buffer string;
+    uint64_t unsigned_value;
+    int64_t signed_value;
+    bool boolean_value;
+
+    /// Get the textual representation (as the old ADD_STAT format)
+    std::string to_string() const;
+};
+
+/**
+ * Decode all of the stats in a typed stats payload
+ *
+ * @param payload the value of the response
+ * @param callback called for each of the stats in the order they appear
+ * @throws std::invalid_argument if the payload is malformed
+ */
+void decode(cb::const_char_buffer payload,
+            std::function<void(cb::const_char_buffer, const Value&)> callback);
+
+} // namespace stats
+} // namespace mcbp
+} // namespace cb
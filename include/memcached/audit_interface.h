@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <cJSON_utils.h>
 #include <memcached/extension.h>
 #include <memcached/visibility.h>
 #include <platform/platform.h>
@@ -113,6 +114,42 @@ AUDIT_ERROR_CODE put_audit_event(Audit* handle,
                                  const void* payload,
                                  const size_t length);
 
+/**
+ * Put an audit event into the audit trail. A timestamp is added to the
+ * event unless it already contains one.
+ *
+ * @param id The identifier for the event to insert
+ * @param event the event to insert to the audit trail
+ * @return AUDIT_SUCCESS if the event was successfully added to the audit
+ *                       queue (may be dropped at a later time)
+ *         AUDIT_FAILED if an error occured while trying to insert the
+ *                      event to the audit queue.
+ */
+MEMCACHED_PUBLIC_API
+AUDIT_ERROR_CODE put_json_audit_event(Audit* handle,
+                                      uint32_t id,
+                                      cJSON* event);
+
+/**
+ * Put an audit event into the audit trail. The event is formatted by the
+ * audit daemon's own thread (so that the caller doesn't have to convert
+ * it to text first).
+ *
+ * @param audit_eventid The identifier for the event to insert
+ * @param payload the event to insert to the audit trail. The ownership
+ *                of the object is transferred to the audit daemon if
+ *                the event was added to the queue. If AUDIT_FAILED is
+ *                returned payload still holds the event.
+ * @return AUDIT_SUCCESS if the event was successfully added to the audit
+ *                       queue (may be dropped at a later time)
+ *         AUDIT_FAILED if an error occured while trying to insert the
+ *                      event to the audit queue.
+ */
+MEMCACHED_PUBLIC_API
+AUDIT_ERROR_CODE put_json_audit_event(Audit* handle,
+                                      uint32_t audit_eventid,
+                                      unique_cJSON_ptr&& payload);
+
 /**
  * Shut down the audit daemon
  *
@@ -7,6 +7,7 @@
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <platform/sized_buffer.h>
 #include <sys/types.h>
 #include <utility>
 
@@ -205,6 +206,28 @@ typedef std::unique_ptr<item, ItemDeleter> unique_item_ptr;
 using EngineErrorItemPair = std::pair<cb::engine_errc, cb::unique_item_ptr>;
 }
 
+/**
+ * The new version of a document, as provided by the callback passed to
+ * ENGINE_HANDLE_V1::update. The flags are kept from the current version.
+ */
+struct item_update {
+    /** The new value (it is copied into the engine) */
+    cb::const_char_buffer value;
+    /** The datatype of the new value */
+    protocol_binary_datatype_t datatype;
+    /** The expiry time of the new version (as specified by the client) */
+    rel_time_t exptime;
+    /** The state of the new version */
+    DocumentState document_state;
+};
+
+/**
+ * Called by ENGINE_HANDLE_V1::update with the current version of the
+ * document (which is only valid during the call) to provide the new one.
+ */
+using engine_update_cb =
+        std::function<ENGINE_ERROR_CODE(const item_info&, item_update&)>;
+
 /**
  * Definition of the first version of the engine interface
  */
@@ -645,6 +668,45 @@ typedef struct engine_interface_v1 {
 
     collections_interface collections;
 
+    /**
+     * Optional (may be nullptr): Update a document with a new version
+     * computed from the current one. The engine calls the callback with
+     * the current version of the document and replaces the document with
+     * the version provided by the callback. Concurrent updates of the same
+     * document are run one after another (the engine holds a lock for the
+     * key, not for the whole cache, while the callback runs), so they
+     * don't fail because of each other. Other mutations aren't blocked,
+     * and if one of them changed the document in the meantime it isn't
+     * replaced (as for a store with CAS).
+     *
+     * The callback is called at most once, and must not call update
+     * itself. If it returns anything but ENGINE_SUCCESS the document is
+     * left unchanged and update returns the same error code. The engine
+     * may only return ENGINE_EWOULDBLOCK before calling the callback.
+     *
+     * @param handle the engine handle
+     * @param cookie The cookie provided by the frontend
+     * @param key the key of the document to update
+     * @param vbucket the virtual bucket id
+     * @param documentStateFilter the state(s) the document may be in
+     * @param callback provides the new version of the document
+     * @param cas where to store the CAS of the new version
+     * @param mut_info where to store the mutation info of the new version
+     *
+     * @return ENGINE_SUCCESS if the document was updated, ENGINE_KEY_ENOENT
+     *         if it doesn't exist, ENGINE_LOCKED_TMPFAIL if it is locked
+     *         and ENGINE_KEY_EEXISTS if another mutation changed it after
+     *         it was passed to the callback
+     */
+    ENGINE_ERROR_CODE (* update)(ENGINE_HANDLE* handle,
+                                 const void* cookie,
+                                 const DocKey& key,
+                                 uint16_t vbucket,
+                                 DocStateFilter documentStateFilter,
+                                 engine_update_cb callback,
+                                 uint64_t* cas,
+                                 mutation_descr_t* mut_info);
+
 } ENGINE_HANDLE_V1;
 
 namespace cb {
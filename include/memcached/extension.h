@@ -121,6 +121,11 @@ extern "C" {
          *              any pending log messages written before we die.
          */
         void (*shutdown)(bool force);
+        /**
+         * Add the logger's statistics (may be NULL if the logger
+         * doesn't keep any statistics)
+         */
+        void (*get_stats)(ADD_STAT add_stat, const void* cookie);
     } EXTENSION_LOGGER_DESCRIPTOR;
 
     typedef struct {
@@ -404,6 +404,8 @@ const uint8_t PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION =
         uint8_t(cb::mcbp::Opcode::SubdocMultiMutation);
 const uint8_t PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT =
         uint8_t(cb::mcbp::Opcode::SubdocGetCount);
+const uint8_t PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY =
+        uint8_t(cb::mcbp::Opcode::SubdocMultiKey);
 const uint8_t PROTOCOL_BINARY_CMD_SCRUB = uint8_t(cb::mcbp::Opcode::Scrub);
 const uint8_t PROTOCOL_BINARY_CMD_ISASL_REFRESH =
         uint8_t(cb::mcbp::Opcode::IsaslRefresh);
@@ -504,6 +506,23 @@ typedef union {
     uint8_t bytes[sizeof(protocol_binary_response_header) + 4];
 } protocol_binary_response_get;
 
+/**
+ * Definition of the packet returned from a successful get, getq, getk and
+ * getkq of a hot key when the client enabled the HOT_KEY_HINTS feature.
+ * The extras contains the number of milliseconds the client may cache the
+ * document (in network byte order) after the flags.
+ */
+typedef union {
+    struct {
+        protocol_binary_response_header header;
+        struct {
+            uint32_t flags;
+            uint32_t cache_ttl;
+        } body;
+    } message;
+    uint8_t bytes[sizeof(protocol_binary_response_header) + 8];
+} protocol_binary_response_get_hot_key;
+
 typedef protocol_binary_response_get protocol_binary_response_getq;
 typedef protocol_binary_response_get protocol_binary_response_getk;
 typedef protocol_binary_response_get protocol_binary_response_getkq;
@@ -1003,6 +1022,47 @@ typedef union {
     uint8_t bytes[sizeof(protocol_binary_response_header)];
 } protocol_binary_response_subdoc_multi_mutation;
 
+/**
+ * SUBDOC_MULTI_KEY runs the same MULTI_LOOKUP or MULTI_MUTATION on a list
+ * of keys, and returns the result for all of them in a single response.
+ *
+ *    Header:                24 @0:  <protocol_binary_request_header>
+ *                                   (keylen and CAS must be 0)
+ *    Extras:          variable @24: As for the multi-path command
+ *    Body:            variable @24 + extlen:
+ *                            1 @0 : Opcode of the multi-path command
+ *                                   (MULTI_LOOKUP or MULTI_MUTATION)
+ *                            2 @1 : Number of keys
+ *        1..MULTI_KEY_MAX_KEYS [Key]
+ *        1..MULTI_MAX_PATHS [Lookup or Mutation Operation Spec]
+ *
+ *        Key:
+ *                            2 @0 : vbucket
+ *                            2 @2 : Key Length
+ *                       keylen @4 : Key
+ *
+ * The response status is SUCCESS unless the request itself failed, and
+ * the body holds a result for each of the keys (in the order of the
+ * request):
+ *
+ *        Key Result:
+ *                            2 @0 : status
+ *                            8 @2 : CAS
+ *                            4 @10: resultlen
+ *                    resultlen @14: The body of the response to the
+ *                                   multi-path command for the key
+ *
+ * The CAS is only set (and the result only present) if the status is
+ * one of the statuses the multi-path command returns a body for. The
+ * mutation descriptor (MUTATION_SEQNO) isn't returned for the keys, and
+ * the CAS in the response header is 0.
+ *
+ * The status of a key is E2BIG if its result would make the response
+ * bigger than the maximum packet size (a mutation isn't applied to the
+ * key unless the largest result it may return fits).
+ */
+static const int PROTOCOL_BINARY_SUBDOC_MULTI_KEY_MAX_KEYS = 1024;
+
 /**
  * Definition of a request for a range operation.
  * See http://code.google.com/p/memcached/wiki/RangeOps
@@ -1289,7 +1349,9 @@ enum class Feature : uint16_t {
     SELECT_BUCKET = 0x08,
     COLLECTIONS = 0x09,
     SNAPPY = 0x0a,
-    JSON = 0x0b
+    JSON = 0x0b,
+    HOT_KEY_HINTS = 0x0c,
+    TYPED_STATS = 0x0d
 };
 }
 using protocol_binary_hello_features_t = mcbp::Feature;
@@ -2366,6 +2428,10 @@ inline std::string to_string(const Feature& feature) {
         return "COLLECTIONS";
     case Feature::SNAPPY:
         return "SNAPPY";
+    case Feature::HOT_KEY_HINTS:
+        return "HOT_KEY_HINTS";
+    case Feature::TYPED_STATS:
+        return "Typed stats";
     case Feature::Invalid:
         return "Invalid";
     }
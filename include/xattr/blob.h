@@ -20,6 +20,7 @@
 #include <cstddef>
 #include <memory>
 #include <platform/sized_buffer.h>
+#include <vector>
 #include <xattr/visibility.h>
 
 namespace cb {
@@ -28,6 +29,11 @@ namespace xattr {
 /**
  * The cb::xattr::Blob is a class that provides easy access to the
  * binary format of the blob.
+ *
+ * Blobs with many xattrs which are searched a number of times get an index
+ * of the kv-pairs (their offsets sorted by key), which is kept up to date
+ * by the following modifications, so that we don't have to scan the blob
+ * for every access. The encoded format is not affected by the index.
  */
 class XATTR_PUBLIC_API Blob {
 public:
@@ -72,7 +78,9 @@ public:
             size_t size = 0)
         : blob(buffer),
           allocator(allocator_),
-          alloc_size(size) {}
+          alloc_size(size),
+          indexed(false),
+          lookups(0) {}
 
     /**
      * You can't copy the blob
@@ -132,6 +140,9 @@ public:
         set(k, v);
     }
 
+    /**
+     * Remove all of the user xattrs (the keys not starting with '_')
+     */
     void prune_user_keys();
 
     /**
@@ -156,8 +167,61 @@ public:
      */
     unique_cJSON_ptr to_json() const;
 
+    /**
+     * Lookups which scan fewer kv-pairs than this are plain linear scans
+     * (we don't keep track of them), so small blobs are never indexed
+     */
+    static const size_t IndexThreshold = 32;
+
+    /**
+     * The number of lookups scanning at least IndexThreshold kv-pairs we
+     * do before building the index
+     */
+    static const uint32_t IndexLookups = 8;
+
 protected:
 
+    /**
+     * Locate the kv-pair for the given key
+     *
+     * @param key The key to look up
+     * @return the offset of the kv-pair (its length field) or 0 if the
+     *         key isn't in the blob
+     */
+    size_t find(const cb::const_byte_buffer& key) const;
+
+    /**
+     * Compare the key of the kv-pair at the given offset with the provided
+     * key (like memcmp)
+     */
+    int compare_key(size_t offset, const cb::const_byte_buffer& key) const;
+
+    /**
+     * Search the blob linearly for the given key
+     *
+     * @param visited set to the number of kv-pairs looked at
+     * @return the offset of the kv-pair or 0 if the key isn't in the blob
+     */
+    size_t scan(const cb::const_byte_buffer& key, size_t& visited) const;
+
+    /**
+     * Build the index of the kv-pairs
+     *
+     * @return true if the index was built, false if the blob is invalid
+     */
+    bool build_index() const;
+
+    /**
+     * Add the kv-pair at the given offset to the index (if built)
+     */
+    void index_insert(size_t offset, const cb::const_byte_buffer& key);
+
+    /**
+     * Update the index (if built) after the segment at the given offset
+     * (containing the kv-pair at offset, if any) was removed
+     */
+    void index_remove(size_t offset, size_t size);
+
     /**
      * Expand the buffer and write the kv-pair at the end of the buffer
      *
@@ -217,6 +281,16 @@ private:
     std::unique_ptr<uint8_t[]>& allocator;
     std::unique_ptr<uint8_t[]> default_allocator;
     size_t alloc_size;
+
+    /**
+     * The offsets of the kv-pairs sorted by their key (only valid if
+     * indexed is set)
+     */
+    mutable std::vector<uint32_t> index;
+    mutable bool indexed;
+    /// The number of lookups which scanned at least IndexThreshold
+    /// kv-pairs before we built the index
+    mutable uint32_t lookups;
 };
 
 
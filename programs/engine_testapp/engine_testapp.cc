@@ -375,6 +375,27 @@ static ENGINE_ERROR_CODE mock_store(ENGINE_HANDLE* handle,
     return ret;
 }
 
+static ENGINE_ERROR_CODE mock_update(ENGINE_HANDLE* handle,
+                                     const void* cookie,
+                                     const DocKey& key,
+                                     uint16_t vbucket,
+                                     DocStateFilter documentStateFilter,
+                                     engine_update_cb callback,
+                                     uint64_t* cas,
+                                     mutation_descr_t* mut_info) {
+    struct mock_connstruct *c = get_or_create_mock_connstruct(cookie);
+    auto engine_fn = std::bind(get_engine_v1_from_handle(handle)->update,
+                               get_engine_from_handle(handle),
+                               static_cast<const void*>(c),
+                               key, vbucket, documentStateFilter, callback,
+                               cas, mut_info);
+
+    ENGINE_ERROR_CODE ret = call_engine_and_handle_EWOULDBLOCK(handle, c, engine_fn);
+
+    check_and_destroy_mock_connstruct(c, cookie);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE mock_flush(ENGINE_HANDLE* handle,
                                     const void* cookie) {
     struct mock_connstruct *c = get_or_create_mock_connstruct(cookie);
@@ -886,6 +907,7 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         mock_engine->me.get_locked = mock_get_locked;
         mock_engine->me.unlock = mock_unlock;
         mock_engine->me.store = mock_store;
+        mock_engine->me.update = mock_update;
         mock_engine->me.flush = mock_flush;
         mock_engine->me.get_stats = mock_get_stats;
         mock_engine->me.reset_stats = mock_reset_stats;
@@ -923,6 +945,9 @@ static ENGINE_HANDLE_V1* create_bucket(bool initialize, const char* cfg) {
         if (mock_engine->the_engine->unknown_command == NULL) {
             mock_engine->me.unknown_command = NULL;
         }
+        if (mock_engine->the_engine->update == NULL) {
+            mock_engine->me.update = NULL;
+        }
         if (mock_engine->the_engine->tap_notify == NULL) {
             mock_engine->me.tap_notify = NULL;
         }
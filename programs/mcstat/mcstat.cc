@@ -184,6 +184,7 @@ int main(int argc, char** argv) {
         connection.hello("mcstat", MEMCACHED_VERSION,
                          "command line utility to fetch stats");
         connection.setXerrorSupport(true);
+        connection.setTypedStatsSupport(true);
 
         if (!user.empty()) {
             connection.authenticate(user, password,
@@ -18,62 +18,31 @@
 #include "config.h"
 #include "programs/hostname_utils.h"
 
-#include <array>
+#include <daemon/timing_histogram.h>
+
+#include <algorithm>
 #include <cJSON.h>
+#include <cinttypes>
 #include <cstdlib>
 #include <getopt.h>
 #include <iostream>
 #include <memcached/protocol_binary.h>
 #include <protocol/connection/client_mcbp_connection.h>
+#include <sstream>
 #include <stdexcept>
+#include <vector>
 
-static uint32_t getValue(cJSON *root, const char *key) {
-    cJSON *obj = cJSON_GetObjectItem(root, key);
-    if (obj == nullptr) {
-        std::string msg = "Fatal error: missing key \"";
-        msg += key;
-        msg += "\"";
-        throw std::runtime_error(msg);
-    }
-    return uint32_t(obj->valueint);
-}
-
-static cJSON *getArray(cJSON *root, const char *key) {
-    cJSON *obj = cJSON_GetObjectItem(root, key);
-    if (obj == nullptr) {
-        std::string msg = "Fatal error: missing key \"";
-        msg += key;
-        msg += "\"";
-        throw std::runtime_error(msg);
-    }
-    if (obj->type != cJSON_Array) {
-        std::string msg = "Fatal error: key \"";
-        msg += key;
-        msg += "\" is not an array";
-        throw std::runtime_error(msg);
-    }
-    return obj;
-}
-
-// A single bin of a histogram. Holds the raw count and cumulative total (to
-// allow percentile to be calculated).
-struct Bin {
-    uint32_t count;
-    uint64_t cumulative_count;
-};
+/// The percentiles to print unless the user specifies -l
+static std::vector<double> percentiles = {50.0, 90.0, 99.0, 99.9, 99.99};
+static bool print_percentiles = false;
 
 class Timings {
 public:
-    Timings(cJSON* json) : max(0), ns(Bin()), oldwayout(false) {
-        us.fill(Bin());
-        ms.fill(Bin());
-        halfsec.fill(Bin());
-        wayout.fill(Bin());
-        initialize(json);
+    Timings(cJSON* json) : histogram(parse(json)) {
     }
 
     uint64_t getTotal() const {
-        return total;
+        return histogram.get_total();
     }
 
     void dumpHistogram(const std::string &opcode)
@@ -81,46 +50,60 @@ public:
         std::cout << "The following data is collected for \""
                   << opcode << "\"" << std::endl;
 
-        int ii;
-
-        dump("ns", 0, 999, ns);
-        for (ii = 0; ii < 100; ++ii) {
-            dump("us", ii * 10, ((ii + 1) * 10 - 1), us[ii]);
+        const auto num = histogram.getNumBins();
+        uint64_t max = 0;
+        for (size_t ii = 0; ii < num; ++ii) {
+            max = std::max(max, histogram.getBinCount(ii));
         }
 
-        for (ii = 1; ii < 50; ++ii) {
-            dump("ms", ii, ii, ms[ii]);
-        }
-
-        dump("ms", 50, 499, halfsec[0]);
-        for (ii = 1; ii < 10; ++ii) {
-            dump("ms", ii * 500, ((ii + 1) * 500) - 1, halfsec[ii]);
-        }
+        // Determine how wide the max value would be, and pad all counts
+        // to that width.
+        const int max_width = snprintf(nullptr, 0, "%" PRIu64, max);
+        const int bound_width = snprintf(
+                nullptr, 0, "%" PRIu64,
+                histogram.getBinUpperBound(num - 1));
+
+        uint64_t cumulative = 0;
+        for (size_t ii = 0; ii < num; ++ii) {
+            const auto count = histogram.getBinCount(ii);
+            if (count == 0) {
+                continue;
+            }
+            cumulative += count;
 
-        if (oldwayout) {
-            dump("ms", (10 * 500), 0, wayout[0]);
-        } else {
-            dump("s ", 5, 9, wayout[0]);
-            dump("s ", 10, 19, wayout[1]);
-            dump("s ", 20, 39, wayout[2]);
-            dump("s ", 40, 79, wayout[3]);
-            dump("s ", 80, 0, wayout[4]);
+            char buffer[1024];
+            int offset = snprintf(buffer, sizeof(buffer),
+                                  "[%*" PRIu64 " - %*" PRIu64 "]us (%6.2f%%) "
+                                  " %*" PRIu64 " | ",
+                                  bound_width,
+                                  histogram.getBinLowerBound(ii),
+                                  bound_width,
+                                  histogram.getBinUpperBound(ii),
+                                  double(cumulative) * 100.0 / getTotal(),
+                                  max_width,
+                                  count);
+            int hashes = int(44.0 * double(count) / double(max));
+            for (int jj = 0; jj < hashes && offset < int(sizeof(buffer)) - 1;
+                 ++jj) {
+                buffer[offset++] = '#';
+            }
+            buffer[offset] = '\0';
+            std::cout << buffer << std::endl;
         }
-        std::cout << "Total: " << total << " operations" << std::endl;
+        std::cout << "Total: " << getTotal() << " operations" << std::endl;
     }
 
-private:
-
-    // Helper function for initialize
-    static void update_max_and_total(uint32_t& max, uint64_t& total, Bin& bin) {
-        total += bin.count;
-        bin.cumulative_count = total;
-        if (bin.count > max) {
-            max = bin.count;
+    void dumpPercentiles(const std::vector<double>& percentiles) {
+        std::cout << "Percentiles:";
+        for (const auto pct : percentiles) {
+            std::cout << " p" << pct << "="
+                      << histogram.getValueAtPercentile(pct) << "us";
         }
+        std::cout << std::endl;
     }
 
-    void initialize(cJSON *root) {
+private:
+    static TimingHistogram parse(cJSON* root) {
         auto *obj = cJSON_GetObjectItem(root, "error");
         if (obj != nullptr) {
             // The server responded with an error.. send that to the user
@@ -128,127 +111,10 @@ private:
             throw std::runtime_error(message);
         }
 
-        ns.count = getValue(root, "ns");
-        auto arr = getArray(root, "us");
-        int ii = 0;
-        cJSON* i = arr->child;
-        while (i) {
-            us[ii].count = i->valueint;
-            ++ii;
-            i = i->next;
-            if (ii == 100 && i != NULL) {
-                throw std::runtime_error(
-                    "Internal error.. too many \"us\" samples");
-            }
-        }
-
-        arr = getArray(root, "ms");
-        ii = 1;
-        i = arr->child;
-        while (i) {
-            ms[ii].count = i->valueint;
-            ++ii;
-            i = i->next;
-            if (ii == 50 && i != NULL) {
-                throw std::runtime_error(
-                    "Internal error.. too many \"ms\" samples");
-            }
-        }
-
-        arr = getArray(root, "500ms");
-        ii = 0;
-        i = arr->child;
-        while (i) {
-            halfsec[ii].count = i->valueint;
-            ++ii;
-            i = i->next;
-            if (ii == 10 && i != NULL) {
-                throw std::runtime_error(
-                    "Internal error.. too many \"halfsec\" samples\"");
-            }
-        }
-
-        try {
-            wayout[0].count = getValue(root, "5s-9s");
-            wayout[1].count = getValue(root, "10s-19s");
-            wayout[2].count = getValue(root, "20s-39s");
-            wayout[3].count = getValue(root, "40s-79s");
-            wayout[4].count = getValue(root, "80s-inf");
-        } catch (...) {
-            wayout[0].count = getValue(root, "wayout");
-            oldwayout = true;
-        }
-
-        // Calculate total and cumulative counts, and find the highest value.
-        max = total = 0;
-
-        update_max_and_total(max, total, ns);
-        for (auto &val : us) {
-            update_max_and_total(max, total, val);
-        }
-        for (auto &val : ms) {
-            update_max_and_total(max, total, val);
-        }
-        for (auto &val : halfsec) {
-            update_max_and_total(max, total, val);
-        }
-        for (auto &val : wayout) {
-            update_max_and_total(max, total, val);
-        }
-    }
-
-    void dump(const char *timeunit, uint32_t low, uint32_t high,
-              const Bin& value)
-    {
-        if (value.count > 0) {
-            char buffer[1024];
-            int offset;
-            if (low > 0 && high == 0) {
-                offset = sprintf(buffer, "[%4u - inf.]%s", low, timeunit);
-            } else {
-                offset = sprintf(buffer, "[%4u - %4u]%s", low, high, timeunit);
-            }
-            offset += sprintf(buffer + offset, " (%6.2f%%) ",
-                              double(value.cumulative_count) * 100.0 / total);
-
-            // Determine how wide the max value would be, and pad all counts
-            // to that width.
-            int max_width = snprintf(buffer, 0, "%u", max);
-            offset += sprintf(buffer + offset, " %*u", max_width, value.count);
-
-            int num = (int)(44.0 * (float) value.count / (float)max);
-            offset += sprintf(buffer + offset, " | ");
-            for (int ii = 0; ii < num; ++ii) {
-                offset += sprintf(buffer + offset, "#");
-            }
-
-            std::cout << buffer << std::endl;
-        }
+        return TimingHistogram::fromJSON(root);
     }
 
-    /**
-     * The highest value of all the samples (used to figure out the width
-     * used for each sample in the printout)
-     */
-    uint32_t max;
-
-    /* We collect timings for <=1 us */
-    Bin ns;
-
-    /* We collect timings per 10usec */
-    std::array<Bin, 100> us;
-
-    /* we collect timings from 0-49 ms (entry 0 is never used!) */
-    std::array<Bin, 50> ms;
-
-    std::array<Bin, 10> halfsec;
-
-    // [5-9], [10-19], [20-39], [40-79], [80-inf].
-    std::array<Bin, 5> wayout;
-
-    bool oldwayout;
-
-    uint64_t total;
+    TimingHistogram histogram;
 };
 
 std::string opcode2string(uint8_t opcode) {
@@ -318,6 +184,9 @@ static void request_cmd_timings(MemcachedBinprotConnection& connection,
                 std::cout << cmd << " " << timings.getTotal() << " operations"
                           << std::endl;
             }
+            if (verbose || print_percentiles) {
+                timings.dumpPercentiles(percentiles);
+            }
         }
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
@@ -325,13 +194,10 @@ static void request_cmd_timings(MemcachedBinprotConnection& connection,
     }
 }
 
-static void request_stat_timings(MemcachedBinprotConnection& connection,
-                                 const std::string& key,
-                                 bool verbose) {
-
-    std::map<std::string, std::string> map;
+static std::map<std::string, std::string> request_stats(
+        MemcachedBinprotConnection& connection, const std::string& key) {
     try {
-        map = connection.statsMap(key);
+        return connection.statsMap(key);
     } catch (const BinprotConnectionError& ex) {
         if (ex.isNotFound()) {
             std::cerr <<"Cannot find statistic: " << key << std::endl;
@@ -343,6 +209,13 @@ static void request_stat_timings(MemcachedBinprotConnection& connection,
 
         exit(EXIT_FAILURE);
     }
+}
+
+static void request_stat_timings(MemcachedBinprotConnection& connection,
+                                 const std::string& key,
+                                 bool verbose) {
+
+    auto map = request_stats(connection, key);
 
     // The return value from stats injects the result in a k-v pair, but
     // these responses (i.e. subdoc_execute) don't include a key,
@@ -371,18 +244,104 @@ static void request_stat_timings(MemcachedBinprotConnection& connection,
             std::cout << key << " " << timings.getTotal() << " operations"
                       << std::endl;
         }
+        if ((verbose || print_percentiles) && timings.getTotal() != 0) {
+            timings.dumpPercentiles(percentiles);
+        }
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
         exit(EXIT_FAILURE);
     }
 }
 
+/**
+ * Print the time spent in each phase of the given command (or all of the
+ * commands if opcode is empty)
+ */
+static void request_phase_timings(MemcachedBinprotConnection& connection,
+                                  const std::string& opcode,
+                                  bool verbose) {
+    std::string key{"phase_timings"};
+    if (!opcode.empty()) {
+        key.append(" ");
+        key.append(opcode);
+    }
+    auto map = request_stats(connection, key);
+
+    for (const auto* phase :
+         {"read", "parse", "engine", "ewouldblock", "write"}) {
+        const auto name = (opcode.empty() ? "all" : opcode) + " " + phase;
+        auto iter = map.find(phase);
+        if (iter == map.end()) {
+            std::cerr << "Failed to fetch phase timings for \"" << name
+                      << "\"" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        unique_cJSON_ptr json(cJSON_Parse(iter->second.c_str()));
+        if (!json) {
+            std::cerr << "Failed to fetch phase timings for \"" << name
+                      << "\". Not json" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        try {
+            Timings timings(json.get());
+            if (verbose) {
+                timings.dumpHistogram(name);
+            } else {
+                std::cout << name << " " << timings.getTotal()
+                          << " operations" << std::endl;
+            }
+            if ((verbose || print_percentiles) && timings.getTotal() != 0) {
+                timings.dumpPercentiles(percentiles);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Fatal error: " << e.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 void usage() {
     std::cerr << "Usage mctimings [-h host[:port]] [-p port] [-u user]"
-              << " [-P pass] [-b bucket] [-s] -v [opcode / stat_name]*" << std::endl
+              << " [-P pass] [-b bucket] [-s] [-l percentiles] [-d] -v"
+              << " [opcode / stat_name]*" << std::endl
+              << std::endl
+              << "    -d              Print the time spent in each phase of"
+              << " the commands" << std::endl
+              << "                    (requires phase_timings to be enabled)"
+              << std::endl
+              << "    -l percentiles  Print the given comma separated list of"
+              << " percentiles" << std::endl
+              << "                    (default: 50,90,99,99.9,99.99 with -v)"
+              << std::endl
               << std::endl
               << "Example:" << std::endl
-              << "    mctimings -h localhost:11210 -v GET SET";
+              << "    mctimings -h localhost:11210 -v GET SET" << std::endl
+              << "    mctimings -h localhost:11210 -l 50,99,99.9 GET"
+              << std::endl
+              << "    mctimings -h localhost:11210 -d -v GET";
+}
+
+static std::vector<double> parse_percentiles(const std::string& list) {
+    std::vector<double> ret;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::size_t pos;
+        double value;
+        try {
+            value = std::stod(item, &pos);
+        } catch (const std::exception&) {
+            pos = 0;
+        }
+        if (pos != item.size() || value < 0.0 || value > 100.0) {
+            throw std::invalid_argument("Invalid percentile: \"" + item +
+                                        "\"");
+        }
+        ret.push_back(value);
+    }
+    return ret;
 }
 
 int main(int argc, char** argv) {
@@ -395,11 +354,12 @@ int main(int argc, char** argv) {
     sa_family_t family = AF_UNSPEC;
     bool verbose = false;
     bool secure = false;
+    bool phases = false;
 
     /* Initialize the socket subsystem */
     cb_initialize_sockets();
 
-    while ((cmd = getopt(argc, argv, "46h:p:u:b:P:sv")) != EOF) {
+    while ((cmd = getopt(argc, argv, "46h:p:u:b:P:svl:d")) != EOF) {
         switch (cmd) {
         case '6' :
             family = AF_INET6;
@@ -428,6 +388,18 @@ int main(int argc, char** argv) {
         case 'v' :
             verbose = true;
             break;
+        case 'l':
+            try {
+                percentiles = parse_percentiles(optarg);
+            } catch (const std::invalid_argument& ex) {
+                std::cerr << ex.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            print_percentiles = true;
+            break;
+        case 'd':
+            phases = true;
+            break;
         default:
             usage();
             return EXIT_FAILURE;
@@ -454,6 +426,7 @@ int main(int argc, char** argv) {
                          MEMCACHED_VERSION,
                          "command line utitilty to fetch command timings");
         connection.setXerrorSupport(true);
+        connection.setTypedStatsSupport(true);
 
         if (!user.empty()) {
             connection.authenticate(user, password,
@@ -464,7 +437,14 @@ int main(int argc, char** argv) {
             connection.selectBucket(bucket);
         }
 
-        if (optind == argc) {
+        if (phases) {
+            if (optind == argc) {
+                request_phase_timings(connection, "", verbose);
+            }
+            for (; optind < argc; ++optind) {
+                request_phase_timings(connection, argv[optind], verbose);
+            }
+        } else if (optind == argc) {
             for (int ii = 0; ii < 256; ++ii) {
                 request_cmd_timings(connection, bucket, (uint8_t)ii, verbose,
                                     true);
@@ -231,6 +231,13 @@ uint32_t BinprotGetResponse::getDocumentFlags() const {
     return ntohl(*reinterpret_cast<const uint32_t*>(getPayload()));
 }
 
+uint32_t BinprotGetResponse::getHotKeyTtl() const {
+    if (!isSuccess() || getExtlen() < 8) {
+        return 0;
+    }
+    return ntohl(*(reinterpret_cast<const uint32_t*>(getPayload()) + 1));
+}
+
 BinprotMutationCommand& BinprotMutationCommand::setMutationType(
     MutationType type) {
     switch (type) {
@@ -856,6 +856,13 @@ protected:
 class BinprotGetResponse : public BinprotResponse {
 public:
     uint32_t getDocumentFlags() const;
+
+    /**
+     * Get the cache TTL (in milliseconds) the server attached to the
+     * response if it considers the key to be hot, or 0 if no hint was
+     * present.
+     */
+    uint32_t getHotKeyTtl() const;
 };
 
 using BinprotGetAndLockResponse = BinprotGetResponse;
@@ -22,6 +22,7 @@
 #include <iostream>
 #include <iterator>
 #include <mcbp/mcbp.h>
+#include <mcbp/protocol/typed_stats.h>
 #include <memcached/protocol_binary.h>
 #include <platform/strerror.h>
 #include <sstream>
@@ -403,6 +404,29 @@ std::map<std::string,std::string> MemcachedBinprotConnection::statsMap(
     std::map<std::string,std::string> ret;
     int counter = 0;
 
+    if (hasFeature(mcbp::Feature::TYPED_STATS)) {
+        // All of the stats is returned in a single response
+        BinprotResponse response;
+        recvResponse(response);
+
+        if (!response.isSuccess()) {
+            throw BinprotConnectionError("Stats failed", response);
+        }
+
+        const auto data = response.getData();
+        cb::mcbp::stats::decode(
+                {reinterpret_cast<const char*>(data.data()), data.size()},
+                [&ret, &counter](cb::const_char_buffer key,
+                                 const cb::mcbp::stats::Value& value) {
+                    std::string name{key.data(), key.size()};
+                    if (name.empty()) {
+                        name = std::to_string(counter++);
+                    }
+                    ret.insert(std::make_pair(name, value.to_string()));
+                });
+        return ret;
+    }
+
     while (true) {
         BinprotResponse response;
         recvResponse(response);
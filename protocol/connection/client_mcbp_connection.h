@@ -197,6 +197,14 @@ public:
         setFeature(mcbp::Feature::XERROR, enable);
     }
 
+    void setHotKeyHintsSupport(bool enable) {
+        setFeature(mcbp::Feature::HOT_KEY_HINTS, enable);
+    }
+
+    void setTypedStatsSupport(bool enable) {
+        setFeature(mcbp::Feature::TYPED_STATS, enable);
+    }
+
     std::string ioctl_get(const std::string& key) override;
 
     void ioctl_set(const std::string& key,
@@ -0,0 +1,158 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <mcbp/protocol/typed_stats.h>
+#include <platform/platform.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cb {
+namespace mcbp {
+namespace stats {
+
+static char* encodeHeader(char* dest, Type type, cb::const_char_buffer key) {
+    if (key.size() > UINT16_MAX) {
+        throw std::invalid_argument("cb::mcbp::stats: key too long");
+    }
+    *dest++ = char(type);
+    const uint16_t klen = htons(uint16_t(key.size()));
+    std::memcpy(dest, &klen, sizeof(klen));
+    dest += sizeof(klen);
+    if (!key.empty()) {
+        std::memcpy(dest, key.data(), key.size());
+    }
+    return dest + key.size();
+}
+
+static size_t encode64(char* dest,
+                       Type type,
+                       cb::const_char_buffer key,
+                       uint64_t value) {
+    char* ptr = encodeHeader(dest, type, key);
+    value = htonll(value);
+    std::memcpy(ptr, &value, sizeof(value));
+    return size_t(ptr - dest) + sizeof(value);
+}
+
+size_t encodeString(char* dest,
+                    cb::const_char_buffer key,
+                    cb::const_char_buffer value) {
+    char* ptr = encodeHeader(dest, Type::String, key);
+    const uint32_t vlen = htonl(uint32_t(value.size()));
+    std::memcpy(ptr, &vlen, sizeof(vlen));
+    ptr += sizeof(vlen);
+    if (!value.empty()) {
+        std::memcpy(ptr, value.data(), value.size());
+    }
+    return size_t(ptr - dest) + value.size();
+}
+
+size_t encodeUnsigned(char* dest, cb::const_char_buffer key, uint64_t value) {
+    return encode64(dest, Type::Unsigned, key, value);
+}
+
+size_t encodeSigned(char* dest, cb::const_char_buffer key, int64_t value) {
+    return encode64(dest, Type::Signed, key, uint64_t(value));
+}
+
+size_t encodeBoolean(char* dest, cb::const_char_buffer key, bool value) {
+    char* ptr = encodeHeader(dest, Type::Boolean, key);
+    *ptr = value ? 1 : 0;
+    return size_t(ptr - dest) + 1;
+}
+
+std::string Value::to_string() const {
+    switch (type) {
+    case Type::String:
+        return std::string{string.data(), string.size()};
+    case Type::Unsigned:
+        return std::to_string(unsigned_value);
+    case Type::Signed:
+        return std::to_string(signed_value);
+    case Type::Boolean:
+        return boolean_value ? "true" : "false";
+    }
+    throw std::invalid_argument("cb::mcbp::stats::Value::to_string: "
+                                "invalid type");
+}
+
+void decode(cb::const_char_buffer payload,
+            std::function<void(cb::const_char_buffer, const Value&)> callback) {
+    const char* ptr = payload.data();
+    const char* end = ptr + payload.size();
+
+    auto require = [&ptr, end](size_t bytes) {
+        if (size_t(end - ptr) < bytes) {
+            throw std::invalid_argument(
+                    "cb::mcbp::stats::decode: truncated payload");
+        }
+    };
+
+    while (ptr < end) {
+        require(EntryHeaderSize);
+        Value value{};
+        value.type = Type(*ptr);
+        uint16_t klen;
+        std::memcpy(&klen, ptr + 1, sizeof(klen));
+        klen = ntohs(klen);
+        ptr += EntryHeaderSize;
+        require(klen);
+        const cb::const_char_buffer key{ptr, klen};
+        ptr += klen;
+
+        switch (value.type) {
+        case Type::String: {
+            uint32_t vlen;
+            require(sizeof(vlen));
+            std::memcpy(&vlen, ptr, sizeof(vlen));
+            vlen = ntohl(vlen);
+            ptr += sizeof(vlen);
+            require(vlen);
+            value.string = {ptr, vlen};
+            ptr += vlen;
+            break;
+        }
+        case Type::Unsigned:
+        case Type::Signed: {
+            uint64_t raw;
+            require(sizeof(raw));
+            std::memcpy(&raw, ptr, sizeof(raw));
+            raw = ntohll(raw);
+            ptr += sizeof(raw);
+            value.unsigned_value = raw;
+            value.signed_value = int64_t(raw);
+            break;
+        }
+        case Type::Boolean:
+            require(1);
+            value.boolean_value = *ptr != 0;
+            ++ptr;
+            break;
+        default:
+            throw std::invalid_argument(
+                    "cb::mcbp::stats::decode: unknown type " +
+                    std::to_string(int(value.type)));
+        }
+
+        callback(key, value);
+    }
+}
+
+} // namespace stats
+} // namespace mcbp
+} // namespace cb
@@ -20,6 +20,7 @@
 #include <gtest/gtest.h>
 #include <cJSON_utils.h>
 #include <daemon/settings.h>
+#include <daemon/timing_histogram.h>
 #include <platform/dirutils.h>
 
 class SettingsTest : public ::testing::Test {
@@ -936,6 +937,249 @@ TEST_F(SettingsTest, XattrEnabled) {
     }
 }
 
+TEST_F(SettingsTest, DirectItemReadThreshold) {
+    nonNumericValuesShouldFail("direct_item_read_threshold");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "direct_item_read_threshold", 4096);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(4096, settings.getDirectItemReadThreshold());
+        EXPECT_TRUE(settings.has.direct_item_read_threshold);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, SslKtls) {
+    nonBooleanValuesShouldFail("ssl_ktls");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "ssl_ktls");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isSslKtlsEnabled());
+        EXPECT_TRUE(settings.has.ssl_ktls);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "ssl_ktls");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isSslKtlsEnabled());
+        EXPECT_TRUE(settings.has.ssl_ktls);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, PhaseTimings) {
+    nonBooleanValuesShouldFail("phase_timings");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddTrueToObject(obj.get(), "phase_timings");
+    try {
+        Settings settings(obj);
+        EXPECT_TRUE(settings.isPhaseTimingsEnabled());
+        EXPECT_TRUE(settings.has.phase_timings);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddFalseToObject(obj.get(), "phase_timings");
+    try {
+        Settings settings(obj);
+        EXPECT_FALSE(settings.isPhaseTimingsEnabled());
+        EXPECT_TRUE(settings.has.phase_timings);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+}
+
+TEST_F(SettingsTest, TraceSampleRate) {
+    nonNumericValuesShouldFail("trace_sample_rate");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "trace_sample_rate", 1000);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(1000, settings.getTraceSampleRate());
+        EXPECT_TRUE(settings.has.trace_sample_rate);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "trace_sample_rate", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, TraceSampleThresholdUsec) {
+    nonNumericValuesShouldFail("trace_sample_threshold_usec");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "trace_sample_threshold_usec", 5000);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(5000, settings.getTraceSampleThresholdUsec());
+        EXPECT_TRUE(settings.has.trace_sample_threshold_usec);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "trace_sample_threshold_usec", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, HotKeyThreshold) {
+    nonNumericValuesShouldFail("hot_key_threshold");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "hot_key_threshold", 100);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(100, settings.getHotKeyThreshold());
+        EXPECT_TRUE(settings.has.hot_key_threshold);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "hot_key_threshold", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, HotKeyTtlMs) {
+    nonNumericValuesShouldFail("hot_key_ttl_ms");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "hot_key_ttl_ms", 250);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(250, settings.getHotKeyTtlMs());
+        EXPECT_TRUE(settings.has.hot_key_ttl_ms);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "hot_key_ttl_ms", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, PrometheusPort) {
+    nonNumericValuesShouldFail("prometheus_port");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "prometheus_port", 9091);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(9091, settings.getPrometheusPort());
+        EXPECT_TRUE(settings.has.prometheus_port);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "prometheus_port", -1);
+    expectFail(obj);
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "prometheus_port", 65536);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, SubdocLookupCacheSize) {
+    nonNumericValuesShouldFail("subdoc_lookup_cache_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "subdoc_lookup_cache_size",
+                            64 * 1024 * 1024);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(64 * 1024 * 1024, settings.getSubdocLookupCacheSize());
+        EXPECT_TRUE(settings.has.subdoc_lookup_cache_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "subdoc_lookup_cache_size", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, TimingsPrecision) {
+    nonNumericValuesShouldFail("timings_precision");
+
+    Settings defaults;
+    EXPECT_EQ(uint8_t(TimingHistogram::DefaultPrecision),
+              defaults.getTimingsPrecision());
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "timings_precision", 5);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(5, settings.getTimingsPrecision());
+        EXPECT_TRUE(settings.has.timings_precision);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "timings_precision", 0);
+    expectFail(obj);
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "timings_precision",
+                            TimingHistogram::MaxPrecision + 1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, WorkerBusyPollUsec) {
+    nonNumericValuesShouldFail("worker_busy_poll_usec");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "worker_busy_poll_usec", 50);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(50, settings.getWorkerBusyPollUsec());
+        EXPECT_TRUE(settings.has.worker_busy_poll_usec);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj.get(), "worker_busy_poll_usec", -1);
+    expectFail(obj);
+}
+
+TEST_F(SettingsTest, WorkerCpuAffinity) {
+    nonArrayValuesShouldFail("worker_cpu_affinity");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    cJSON* array = cJSON_CreateArray();
+    cJSON_AddItemToArray(array, cJSON_CreateNumber(2));
+    cJSON_AddItemToArray(array, cJSON_CreateNumber(3));
+    cJSON_AddItemToObject(obj.get(), "worker_cpu_affinity", array);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(std::vector<int>({2, 3}), settings.getWorkerCpuAffinity());
+        EXPECT_TRUE(settings.has.worker_cpu_affinity);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    obj.reset(cJSON_CreateObject());
+    array = cJSON_CreateArray();
+    cJSON_AddItemToArray(array, cJSON_CreateString("0"));
+    cJSON_AddItemToObject(obj.get(), "worker_cpu_affinity", array);
+    expectFail(obj);
+}
+
 TEST(SettingsUpdateTest, EmptySettingsShouldWork) {
     Settings updated;
     Settings settings;
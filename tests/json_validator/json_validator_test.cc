@@ -0,0 +1,225 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Unit tests for the JsonValidator, and a benchmark comparing it to
+ * JSON_checker::Validator on generated documents resembling the ones
+ * stored by our users (10 and 100KB of nested objects, arrays, text with
+ * some non-ASCII characters and numbers). The time used by both is
+ * recorded (in usec) as properties in the GTest XML output.
+ *
+ * The benchmark is disabled so that it doesn't slow down the unit tests.
+ * Run it with:
+ *
+ *     memcached_json_validator_test --gtest_also_run_disabled_tests \
+ *         --gtest_filter=*PerfTest*
+ */
+#include "daemon/json_validator.h"
+
+#include <JSON_checker.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+class JsonValidatorTest : public ::testing::Test {
+protected:
+    bool validate(const std::string& doc) {
+        const bool ret = validator.validate(
+                reinterpret_cast<const uint8_t*>(doc.data()), doc.size());
+        // We should accept the same documents as the old validator
+        EXPECT_EQ(checker.validate(
+                          reinterpret_cast<const uint8_t*>(doc.data()),
+                          doc.size()),
+                  ret)
+                << doc;
+        return ret;
+    }
+
+    JsonValidator validator;
+    JSON_checker::Validator checker;
+};
+
+TEST_F(JsonValidatorTest, Values) {
+    EXPECT_TRUE(validate("{}"));
+    EXPECT_TRUE(validate("[]"));
+    EXPECT_TRUE(validate(" { \"a\" : [ 1 , -2.5e+3 , true , false , null ] }\n"));
+    EXPECT_TRUE(validate("\"string\""));
+    EXPECT_TRUE(validate("0"));
+    EXPECT_TRUE(validate("-0.5"));
+    EXPECT_TRUE(validate("1E9"));
+    EXPECT_TRUE(validate("true"));
+    EXPECT_TRUE(validate("null"));
+    EXPECT_TRUE(validate("[[[[{\"a\":{\"b\":[{}]}}]]]]"));
+}
+
+TEST_F(JsonValidatorTest, InvalidValues) {
+    EXPECT_FALSE(validate(""));
+    EXPECT_FALSE(validate("   "));
+    EXPECT_FALSE(validate("{"));
+    EXPECT_FALSE(validate("{]"));
+    EXPECT_FALSE(validate("[1,]"));
+    EXPECT_FALSE(validate("{\"a\":1,}"));
+    EXPECT_FALSE(validate("{\"a\" 1}"));
+    EXPECT_FALSE(validate("{1:1}"));
+    EXPECT_FALSE(validate("[1 2]"));
+    EXPECT_FALSE(validate("{}{}"));
+    EXPECT_FALSE(validate("01"));
+    EXPECT_FALSE(validate("1."));
+    EXPECT_FALSE(validate("-"));
+    EXPECT_FALSE(validate("1e"));
+    EXPECT_FALSE(validate("tru"));
+    EXPECT_FALSE(validate("trUe"));
+    EXPECT_FALSE(validate("nul"));
+    EXPECT_FALSE(validate("[True]"));
+    EXPECT_FALSE(validate("\"abc"));
+    EXPECT_FALSE(validate("abc"));
+}
+
+TEST_F(JsonValidatorTest, Strings) {
+    EXPECT_TRUE(validate("\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e5\""));
+    EXPECT_FALSE(validate("\"\\x\""));
+    EXPECT_FALSE(validate("\"\\u00g5\""));
+    EXPECT_FALSE(validate("\"\\u00\""));
+    EXPECT_FALSE(validate("\"tab\tinside\""));
+    EXPECT_FALSE(validate("\"newline\ninside\""));
+
+    // Make sure we hit the special characters at all of the positions
+    // within the SIMD blocks
+    for (size_t ii = 0; ii < 70; ++ii) {
+        const std::string prefix(ii, 'x');
+        EXPECT_TRUE(validate("\"" + prefix + "\""));
+        EXPECT_TRUE(validate("\"" + prefix + "\\n" + prefix + "\""));
+        EXPECT_TRUE(validate("\"" + prefix + "\xc3\xa5" + prefix + "\""));
+        EXPECT_FALSE(validate("\"" + prefix + "\x01" + prefix + "\""));
+        EXPECT_FALSE(validate("\"" + prefix + "\xff" + prefix + "\""));
+        EXPECT_FALSE(validate("\"" + prefix));
+    }
+}
+
+TEST_F(JsonValidatorTest, Utf8) {
+    EXPECT_TRUE(validate("\"\xc3\xa5\"")); // U+00E5
+    EXPECT_TRUE(validate("\"\xe6\x9d\xb1\xe4\xba\xac\"")); // U+6771 U+4EAC
+    EXPECT_TRUE(validate("\"\xf0\x9f\x98\x80\"")); // U+1F600
+    EXPECT_TRUE(validate("\"\xf4\x8f\xbf\xbf\"")); // U+10FFFF
+
+    EXPECT_FALSE(validate("\"\x80\"")); // continuation without lead
+    EXPECT_FALSE(validate("\"\xc3\"")); // truncated sequence
+    EXPECT_FALSE(validate("\"\xc0\xaf\"")); // overlong
+    EXPECT_FALSE(validate("\"\xe0\x80\xaf\"")); // overlong
+    EXPECT_FALSE(validate("\"\xf4\x90\x80\x80\"")); // above U+10FFFF
+    EXPECT_FALSE(validate("\"\xf8\x88\x80\x80\x80\"")); // 5 byte sequence
+    EXPECT_FALSE(validate("{\"\xc3\xa5\":\xc3\xa5}")); // outside string
+}
+
+TEST_F(JsonValidatorTest, Binary) {
+    std::mt19937 generator(0xdeadbeef);
+    std::string doc(1024, '\0');
+    for (int ii = 0; ii < 100; ++ii) {
+        for (auto& c : doc) {
+            c = char(generator());
+        }
+        EXPECT_FALSE(validate(doc));
+    }
+}
+
+/**
+ * Generate a document of (at least) the requested size looking like a
+ * typical application document: an object with some metadata and an
+ * array of nested records.
+ */
+static std::string generate_document(size_t size) {
+    std::mt19937 generator(size);
+    std::string doc =
+            "{\n  \"type\": \"order\",\n  \"version\": 3,\n"
+            "  \"customer\": {\"name\": \"Zo\xc3\xab Andr\xc3\xa9\", "
+            "\"city\": \"\xe6\x9d\xb1\xe4\xba\xac\", \"vip\": false},\n"
+            "  \"lines\": [\n";
+    for (size_t ii = 0; doc.size() < size; ++ii) {
+        if (ii > 0) {
+            doc.append(",\n");
+        }
+        doc.append("    {\"id\": " + std::to_string(ii) +
+                   ", \"sku\": \"SKU-" + std::to_string(generator()) +
+                   "\", \"description\": \"Lorem ipsum dolor sit amet, "
+                   "consectetur adipiscing elit, sed do eiusmod tempor "
+                   "incididunt ut labore et dolore magna aliqua.\", "
+                   "\"price\": " + std::to_string(generator() % 10000) +
+                   "." + std::to_string(generator() % 100) +
+                   ", \"discount\": -1.5e-2, \"tags\": [\"a\", \"b\\tc\", "
+                   "\"\\u00e5\"], \"gift\": " +
+                   (generator() % 2 ? "true" : "false") +
+                   ", \"note\": null}");
+    }
+    doc.append("\n  ]\n}\n");
+    return doc;
+}
+
+TEST_F(JsonValidatorTest, GeneratedDocument) {
+    const auto doc = generate_document(10 * 1024);
+    ASSERT_TRUE(validate(doc));
+
+    // Each prefix of the document (without the trailing newline and the
+    // closing brace) is invalid
+    for (size_t ii = 2; ii < 200; ++ii) {
+        EXPECT_FALSE(validate(doc.substr(0, doc.size() - ii)));
+    }
+}
+
+class JsonValidatorPerfTest : public ::testing::TestWithParam<size_t> {
+protected:
+    JsonValidator validator;
+    JSON_checker::Validator checker;
+};
+
+INSTANTIATE_TEST_CASE_P(DocumentSize,
+                        JsonValidatorPerfTest,
+                        ::testing::Values(10 * 1024, 100 * 1024),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(JsonValidatorPerfTest, DISABLED_Validate) {
+    const auto doc = generate_document(GetParam());
+    const auto* data = reinterpret_cast<const uint8_t*>(doc.data());
+    const int iterations = 1000;
+
+    ASSERT_TRUE(validator.validate(data, doc.size()));
+
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    for (int ii = 0; ii < iterations; ++ii) {
+        validator.validate(data, doc.size());
+    }
+    const auto validatorTime = steady_clock::now() - start;
+
+    start = steady_clock::now();
+    for (int ii = 0; ii < iterations; ++ii) {
+        checker.validate(data, doc.size());
+    }
+    const auto checkerTime = steady_clock::now() - start;
+
+    RecordProperty("scanner", JsonValidator::getScanner());
+    RecordProperty(
+            "json_validator_usec",
+            int(duration_cast<microseconds>(validatorTime).count() /
+                iterations));
+    RecordProperty(
+            "json_checker_usec",
+            int(duration_cast<microseconds>(checkerTime).count() /
+                iterations));
+}
@@ -23,6 +23,7 @@
 #include <cstring>
 #include <cstdio>
 #include <iostream>
+#include <map>
 #include <sstream>
 
 #include <gtest/gtest.h>
@@ -128,6 +129,61 @@ TEST_F(LoggerTest, Rotate) {
     remove_files(files);
 }
 
+static void add_logger_stat(const char* key, const uint16_t klen,
+                            const char* val, const uint32_t vlen,
+                            const void* cookie) {
+    auto* stats = reinterpret_cast<std::map<std::string, std::string>*>(
+            const_cast<void*>(cookie));
+    (*stats)[std::string(key, klen)] = std::string(val, vlen);
+}
+
+TEST_F(LoggerTest, RateLimit) {
+    logger->shutdown(false);
+    files = cb::io::findFilesWithPrefix("logger_test");
+    remove_files(files);
+
+    ret = memcached_extensions_initialize("unit_test=true;"
+              "cyclesize=1048576;buffersize=16384;sleeptime=1;"
+              "ratelimit=10;ratelimit_burst=10;filename=logger_test",
+              get_server_api);
+    ASSERT_EQ(EXTENSION_SUCCESS, ret);
+
+    for (auto ii = 0; ii < 100; ++ii) {
+        logger->log(EXTENSION_LOG_NOTICE, NULL, "Rate limited message %02u",
+                    ii);
+    }
+
+    // The burst should be let through, and the rest dropped (unless the
+    // test is so slow that the bucket gets refilled)
+    std::map<std::string, std::string> stats;
+    ASSERT_NE(nullptr, logger->get_stats);
+    logger->get_stats(add_logger_stat, &stats);
+    const auto dropped = std::stoul(stats["messages_dropped"]);
+    EXPECT_LE(80u, dropped);
+    EXPECT_EQ(100u, dropped + std::stoul(stats["messages_logged"]));
+
+    logger->shutdown(false);
+
+    files = cb::io::findFilesWithPrefix("logger_test");
+    ASSERT_EQ(1u, files.size());
+    FILE* fp = fopen(files[0].c_str(), "r");
+    ASSERT_NE(nullptr, fp);
+    char line[1024];
+    size_t messages = 0;
+    bool suppressed = false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strstr(line, "Rate limited message") != nullptr) {
+            ++messages;
+        } else if (strstr(line, "log messages (rate limit exceeded)")) {
+            suppressed = true;
+        }
+    }
+    fclose(fp);
+    EXPECT_EQ(100u - dropped, messages);
+    EXPECT_TRUE(suppressed);
+    remove_files(files);
+}
+
 static bool my_fgets(char *buffer, size_t buffsize, FILE *fp) {
     if (fgets(buffer, (int)buffsize, fp) != NULL) {
         char *end = strchr(buffer, '\n');
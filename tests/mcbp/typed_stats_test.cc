@@ -0,0 +1,107 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include <mcbp/protocol/typed_stats.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace cb::mcbp::stats;
+
+static std::vector<char> encodeAll() {
+    std::vector<char> payload(getStringEntrySize(3, 5) +
+                              getNumericEntrySize(4) * 3 +
+                              getStringEntrySize(0, 2));
+    char* ptr = payload.data();
+    ptr += encodeString(ptr, {"pid", 3}, {"12345", 5});
+    ptr += encodeUnsigned(ptr, {"uptm", 4}, UINT64_MAX);
+    ptr += encodeSigned(ptr, {"diff", 4}, -42);
+    ptr += encodeBoolean(ptr, {"flag", 4}, true);
+    ptr += encodeString(ptr, {}, {"{}", 2});
+    payload.resize(ptr - payload.data());
+    return payload;
+}
+
+TEST(TypedStats, Roundtrip) {
+    const auto payload = encodeAll();
+    std::vector<std::pair<std::string, Value>> stats;
+    decode({payload.data(), payload.size()},
+           [&stats](cb::const_char_buffer key, const Value& value) {
+               stats.emplace_back(std::string{key.data(), key.size()},
+                                  value);
+           });
+
+    ASSERT_EQ(5, stats.size());
+    EXPECT_EQ("pid", stats[0].first);
+    EXPECT_EQ(Type::String, stats[0].second.type);
+    EXPECT_EQ("12345", stats[0].second.to_string());
+
+    EXPECT_EQ("uptm", stats[1].first);
+    EXPECT_EQ(Type::Unsigned, stats[1].second.type);
+    EXPECT_EQ(UINT64_MAX, stats[1].second.unsigned_value);
+
+    EXPECT_EQ("diff", stats[2].first);
+    EXPECT_EQ(Type::Signed, stats[2].second.type);
+    EXPECT_EQ(-42, stats[2].second.signed_value);
+    EXPECT_EQ("-42", stats[2].second.to_string());
+
+    EXPECT_EQ("flag", stats[3].first);
+    EXPECT_EQ(Type::Boolean, stats[3].second.type);
+    EXPECT_EQ("true", stats[3].second.to_string());
+
+    EXPECT_TRUE(stats[4].first.empty());
+    EXPECT_EQ("{}", stats[4].second.to_string());
+}
+
+TEST(TypedStats, EmptyPayload) {
+    int count = 0;
+    decode({}, [&count](cb::const_char_buffer, const Value&) { ++count; });
+    EXPECT_EQ(0, count);
+}
+
+TEST(TypedStats, TruncatedPayload) {
+    const auto payload = encodeAll();
+    // Every prefix which doesn't end on an entry boundary is invalid
+    const std::vector<size_t> boundaries = {
+            getStringEntrySize(3, 5),
+            getStringEntrySize(3, 5) + getNumericEntrySize(4),
+            getStringEntrySize(3, 5) + getNumericEntrySize(4) * 2,
+            getStringEntrySize(3, 5) + getNumericEntrySize(4) * 2 +
+                    EntryHeaderSize + 4 + 1};
+    for (size_t len = 1; len < payload.size(); ++len) {
+        if (std::find(boundaries.begin(), boundaries.end(), len) !=
+            boundaries.end()) {
+            continue;
+        }
+        EXPECT_THROW(decode({payload.data(), len},
+                            [](cb::const_char_buffer, const Value&) {}),
+                     std::invalid_argument)
+                << "length: " << len;
+    }
+}
+
+TEST(TypedStats, UnknownType) {
+    std::vector<char> payload(getNumericEntrySize(1));
+    encodeUnsigned(payload.data(), {"a", 1}, 1);
+    payload[0] = char(0x7f);
+    EXPECT_THROW(decode({payload.data(), payload.size()},
+                        [](cb::const_char_buffer, const Value&) {}),
+                 std::invalid_argument);
+}
@@ -21,6 +21,9 @@
 
 #include "utilities/string_utilities.h"
 
+#include <chrono>
+#include <map>
+
 void validate(cb::byte_buffer buffer) {
     EXPECT_TRUE(cb::xattr::validate(
             {reinterpret_cast<const char*>(buffer.buf), buffer.len}));
@@ -177,3 +180,161 @@ TEST(XattrBlob, MB_22691) {
         EXPECT_FALSE(entry.empty()) << "Key: " << key << " is missing";
     }
 }
+
+/**
+ * Build a blob with the requested number of xattrs (every other one is a
+ * system xattr) and keep track of the expected content
+ */
+static void populate(cb::xattr::Blob& blob,
+                     std::map<std::string, std::string>& expected,
+                     int count) {
+    for (int ii = 0; ii < count; ++ii) {
+        const std::string key = (ii % 2 ? "_sys" : "user") + std::to_string(ii);
+        const std::string value = "{\"value\":" + std::to_string(ii) + "}";
+        blob.set(key, value);
+        expected[key] = value;
+    }
+}
+
+static void verify(cb::xattr::Blob& blob,
+                   const std::map<std::string, std::string>& expected) {
+    validate(blob.finalize());
+    for (const auto& entry : expected) {
+        EXPECT_EQ(entry.second, to_string(blob.get(entry.first)))
+                << "Key: " << entry.first;
+    }
+
+    // A fresh blob operating on the same buffer must agree
+    cb::xattr::Blob copy(blob.finalize());
+    for (const auto& entry : expected) {
+        EXPECT_EQ(entry.second, to_string(copy.get(entry.first)))
+                << "Key: " << entry.first;
+    }
+    EXPECT_EQ(0, copy.get(std::string("_missing")).len);
+}
+
+/**
+ * Verify that the index of the kv-pairs is kept up to date when we modify
+ * a blob with more xattrs than the binary search threshold
+ */
+TEST(XattrBlob, ManyKeys) {
+    cb::xattr::Blob blob;
+    std::map<std::string, std::string> expected;
+    populate(blob, expected, 64);
+    verify(blob, expected);
+
+    // In-place replacement
+    blob.set(std::string("_sys1"), std::string("{\"value\":7}"));
+    expected["_sys1"] = "{\"value\":7}";
+    verify(blob, expected);
+
+    // Grow and shrink values (moves the kv-pair to the end)
+    blob.set(std::string("user10"), std::string("{\"value\":\"longer\"}"));
+    expected["user10"] = "{\"value\":\"longer\"}";
+    blob.set(std::string("_sys11"), std::string("1"));
+    expected["_sys11"] = "1";
+    verify(blob, expected);
+
+    // Remove some from the front, middle and end
+    for (const auto& key : {"user0", "_sys31", "user10", "user62"}) {
+        blob.remove(to_const_byte_buffer(key));
+        expected.erase(key);
+        EXPECT_EQ(0, blob.get(std::string(key)).len);
+    }
+    verify(blob, expected);
+
+    // Remove all but a few (below the binary search threshold) and add
+    // them back again
+    auto iter = expected.begin();
+    while (expected.size() > 3) {
+        blob.remove(to_const_byte_buffer(iter->first.c_str()));
+        iter = expected.erase(iter);
+    }
+    verify(blob, expected);
+    populate(blob, expected, 20);
+    verify(blob, expected);
+}
+
+TEST(XattrBlob, PruneUserManyKeys) {
+    cb::xattr::Blob blob;
+    std::map<std::string, std::string> expected;
+    populate(blob, expected, 64);
+
+    // Search the entire blob enough times for the index to be built
+    // before we prune
+    for (uint32_t ii = 0; ii <= cb::xattr::Blob::IndexLookups; ++ii) {
+        EXPECT_EQ(0, blob.get(std::string("_missing")).len);
+    }
+    EXPECT_NE(0, blob.get(std::string("user2")).len);
+    blob.prune_user_keys();
+
+    for (auto iter = expected.begin(); iter != expected.end();) {
+        if (iter->first[0] != '_') {
+            EXPECT_EQ(0, blob.get(iter->first).len);
+            iter = expected.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    verify(blob, expected);
+    EXPECT_EQ(blob.finalize().len, blob.get_system_size());
+
+    // Pruning a blob without any user xattrs is a noop
+    const auto size = blob.finalize().len;
+    blob.prune_user_keys();
+    EXPECT_EQ(size, blob.finalize().len);
+    verify(blob, expected);
+}
+
+/**
+ * Microbenchmark of looking up and updating the xattrs of a blob with
+ * the given number of xattrs (the keys are accessed in a different
+ * order than they are stored in). A new Blob is used for every "command",
+ * as in the subdoc xattr phase.
+ *
+ * It is disabled so that it doesn't slow down the unit tests; run it with:
+ *
+ *     memcached_mcbp_test --gtest_also_run_disabled_tests \
+ *                         --gtest_filter=*PerfTest*
+ */
+class XattrBlobPerfTest : public ::testing::TestWithParam<int> {};
+
+INSTANTIATE_TEST_CASE_P(Keys,
+                        XattrBlobPerfTest,
+                        ::testing::Values(4, 16, 64),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(XattrBlobPerfTest, DISABLED_GetAndSet) {
+    cb::xattr::Blob blob;
+    std::map<std::string, std::string> expected;
+    populate(blob, expected, GetParam());
+    const auto buffer = blob.finalize();
+
+    std::vector<std::string> keys;
+    for (const auto& entry : expected) {
+        keys.push_back(entry.first);
+    }
+
+    const int iterations = 10000;
+    const std::string value("{\"value\":9}");
+    size_t found = 0;
+
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    for (int ii = 0; ii < iterations; ++ii) {
+        cb::xattr::Blob command(buffer);
+        for (const auto& key : keys) {
+            found += command.get(key).len;
+        }
+        // Same size, so this is an in-place update
+        command.set(keys[ii % keys.size()], value);
+    }
+    const auto elapsed = steady_clock::now() - start;
+    EXPECT_NE(0, found);
+
+    RecordProperty("keys", GetParam());
+    RecordProperty(
+            "nsec_per_lookup",
+            int(duration_cast<nanoseconds>(elapsed).count() /
+                (int64_t(iterations) * keys.size())));
+}
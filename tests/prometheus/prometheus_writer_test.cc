@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/prometheus_writer.h>
+#include <daemon/timing_histogram.h>
+
+#include <gtest/gtest.h>
+
+/// Add a sample of the given number of usec
+static void addUsec(TimingHistogram& histogram, uint64_t usec) {
+    histogram.add(usec * 1000);
+}
+
+TEST(PrometheusWriterTest, Empty) {
+    PrometheusWriter writer;
+    EXPECT_EQ("# EOF\n", writer.finish());
+}
+
+TEST(PrometheusWriterTest, Counter) {
+    PrometheusWriter writer;
+    writer.addFamily("cmd_get", "counter", "GET commands");
+    writer.addSample("cmd_get_total", {}, 0);
+    writer.addSample("cmd_get_total", {{"bucket", "default"}},
+                     18446744073709551615ull);
+    writer.addSample("cmd_get_total",
+                     {{"bucket", "default"}, {"opcode", "GET"}},
+                     1234567890);
+    EXPECT_EQ(
+            "# TYPE cmd_get counter\n"
+            "# HELP cmd_get GET commands\n"
+            "cmd_get_total 0\n"
+            "cmd_get_total{bucket=\"default\"} 18446744073709551615\n"
+            "cmd_get_total{bucket=\"default\",opcode=\"GET\"} 1234567890\n"
+            "# EOF\n",
+            writer.finish());
+}
+
+TEST(PrometheusWriterTest, LabelsAreEscaped) {
+    PrometheusWriter writer;
+    writer.addSample("foo", {{"bucket", "a\"b\\c\nd"}}, 1);
+    EXPECT_EQ("foo{bucket=\"a\\\"b\\\\c\\nd\"} 1\n# EOF\n", writer.finish());
+}
+
+TEST(PrometheusWriterTest, Reset) {
+    PrometheusWriter writer;
+    writer.addSample("foo", {}, 1);
+    writer.finish();
+    writer.reset();
+    writer.addSample("bar", {}, 2);
+    EXPECT_EQ("bar 2\n# EOF\n", writer.finish());
+}
+
+TEST(PrometheusWriterTest, Histogram) {
+    TimingHistogram histogram;
+    addUsec(histogram, 10);
+    addUsec(histogram, 40);
+    addUsec(histogram, 700);
+    addUsec(histogram, 700);
+    addUsec(histogram, 20000000);
+
+    PrometheusWriter writer;
+    writer.addHistogram("duration_seconds", {{"opcode", "GET"}}, histogram,
+                        20001450123456ull);
+    const auto& text = writer.finish();
+
+    auto expectLine = [&text](const std::string& line) {
+        EXPECT_NE(std::string::npos, text.find(line + "\n"))
+                << "Missing \"" << line << "\" in:" << std::endl
+                << text;
+    };
+
+    expectLine("duration_seconds_bucket{opcode=\"GET\",le=\"0.00005\"} 2");
+    expectLine("duration_seconds_bucket{opcode=\"GET\",le=\"0.0005\"} 2");
+    expectLine("duration_seconds_bucket{opcode=\"GET\",le=\"0.001\"} 4");
+    expectLine("duration_seconds_bucket{opcode=\"GET\",le=\"10.0\"} 4");
+    expectLine("duration_seconds_bucket{opcode=\"GET\",le=\"+Inf\"} 5");
+    expectLine("duration_seconds_count{opcode=\"GET\"} 5");
+    expectLine("duration_seconds_sum{opcode=\"GET\"} 20001.450123456");
+}
+
+TEST(PrometheusWriterTest, HistogramBucketsAreCumulative) {
+    TimingHistogram histogram;
+    for (uint64_t usec = 1; usec < 100000; usec *= 3) {
+        addUsec(histogram, usec);
+    }
+
+    PrometheusWriter writer;
+    writer.addHistogram("h", {}, histogram, 0);
+    const auto& text = writer.finish();
+
+    uint64_t previous = 0;
+    size_t buckets = 0;
+    size_t pos = 0;
+    while ((pos = text.find("h_bucket{", pos)) != std::string::npos) {
+        const auto end = text.find('\n', pos);
+        const auto value = std::stoull(
+                text.substr(text.rfind(' ', end) + 1, end));
+        EXPECT_LE(previous, value);
+        previous = value;
+        ++buckets;
+        pos = end;
+    }
+    EXPECT_EQ(18, buckets);
+    EXPECT_EQ(histogram.get_total(), previous);
+    EXPECT_NE(std::string::npos, text.find("h_sum 0.000000000\n"));
+}
@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "daemon/subdoc_lookup_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+static cb::const_char_buffer buf(const std::string& str) {
+    return {str.data(), str.size()};
+}
+
+static DocKey doc(const std::string& key,
+               DocNamespace ns = DocNamespace::DefaultCollection) {
+    return DocKey(key, ns);
+}
+
+class SubdocLookupCacheTest : public ::testing::Test {
+protected:
+    SubdocLookupCacheTest() : cache(1024 * 1024, 1) {
+    }
+
+    SubdocLookupCache cache;
+    SubdocLookupCache::Location location{};
+};
+
+TEST_F(SubdocLookupCacheTest, InsertAndLookup) {
+    const std::string key("doc");
+    EXPECT_FALSE(cache.lookup(doc(key), 1, buf("a.b"), location));
+
+    cache.insert(doc(key), 1, buf("a.b"),
+                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, 10, 5});
+    cache.insert(doc(key), 1, buf("c"),
+                 {PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, 0, 0});
+
+    ASSERT_TRUE(cache.lookup(doc(key), 1, buf("a.b"), location));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, location.status);
+    EXPECT_EQ(10, location.offset);
+    EXPECT_EQ(5, location.length);
+
+    ASSERT_TRUE(cache.lookup(doc(key), 1, buf("c"), location));
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, location.status);
+
+    EXPECT_FALSE(cache.lookup(doc(key), 1, buf("a"), location));
+    EXPECT_FALSE(cache.lookup(doc("other"), 1, buf("a.b"), location));
+
+    EXPECT_EQ(2, cache.getHits());
+    EXPECT_EQ(3, cache.getMisses());
+}
+
+TEST_F(SubdocLookupCacheTest, CasInvalidates) {
+    const std::string key("doc");
+    cache.insert(doc(key), 1, buf("a"),
+                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, 5, 1});
+
+    // A new version of the document
+    EXPECT_FALSE(cache.lookup(doc(key), 2, buf("a"), location));
+    cache.insert(doc(key), 2, buf("b"),
+                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, 7, 1});
+    EXPECT_TRUE(cache.lookup(doc(key), 2, buf("b"), location));
+
+    // The locations for the old version is gone
+    EXPECT_FALSE(cache.lookup(doc(key), 2, buf("a"), location));
+    EXPECT_FALSE(cache.lookup(doc(key), 1, buf("a"), location));
+}
+
+TEST_F(SubdocLookupCacheTest, MaxPathsPerDocument) {
+    const std::string key("doc");
+    for (size_t ii = 0; ii < SubdocLookupCache::MaxPathsPerDocument * 2;
+         ++ii) {
+        cache.insert(doc(key), 1, buf("path" + std::to_string(ii)),
+                     {PROTOCOL_BINARY_RESPONSE_SUCCESS, uint32_t(ii), 1});
+    }
+    EXPECT_TRUE(cache.lookup(doc(key), 1, buf("path0"), location));
+    EXPECT_FALSE(cache.lookup(
+            doc(key),
+            1,
+            buf("path" +
+                std::to_string(SubdocLookupCache::MaxPathsPerDocument)),
+            location));
+}
+
+TEST_F(SubdocLookupCacheTest, BoundedMemory) {
+    SubdocLookupCache small(16 * 1024, 4);
+    for (int ii = 0; ii < 10000; ++ii) {
+        small.insert(doc("key_" + std::to_string(ii)), 1, buf("path"),
+                     {PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, 1});
+    }
+    EXPECT_LE(small.getMemoryUsage(), 16 * 1024);
+    EXPECT_LT(0, small.getEvictions());
+
+    // The most recently inserted is still there, the first is evicted
+    EXPECT_TRUE(small.lookup(doc("key_9999"), 1, buf("path"), location));
+    EXPECT_FALSE(small.lookup(doc("key_0"), 1, buf("path"), location));
+}
+
+TEST_F(SubdocLookupCacheTest, LookupKeepsDocument) {
+    SubdocLookupCache small(2000, 1);
+    small.insert(doc("hot"), 1, buf("path"),
+                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, 1});
+    for (int ii = 0; ii < 100; ++ii) {
+        // Keep on reading the hot document while inserting others
+        EXPECT_TRUE(small.lookup(doc("hot"), 1, buf("path"), location));
+        small.insert(doc("key_" + std::to_string(ii)), 1, buf("path"),
+                     {PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, 1});
+    }
+    EXPECT_LT(0, small.getEvictions());
+}
+
+TEST_F(SubdocLookupCacheTest, NamespaceIsPartOfKey) {
+    const std::string key("doc");
+    cache.insert(doc(key), 1, buf("a"),
+                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, 5, 1});
+    EXPECT_TRUE(cache.lookup(doc(key), 1, buf("a"), location));
+    EXPECT_FALSE(cache.lookup(doc(key, DocNamespace::Collections), 1,
+                              buf("a"), location));
+    EXPECT_FALSE(
+            cache.lookup(doc(key, DocNamespace::System), 1, buf("a"), location));
+}
@@ -286,6 +286,9 @@ void store_object_w_datatype(const char *key, const void *data, size_t datalen,
 // Enables / disables the MUTATION_SEQNO feature.
 void set_mutation_seqno_feature(bool enable);
 
+// Enables / disables the XATTR feature.
+void set_xattr_feature(bool enable);
+
 /* Send the specified buffer+len to memcached. */
 void safe_send(const void* buf, size_t len, bool hickup);
 void safe_send(const BinprotCommand& cmd, bool hickup);
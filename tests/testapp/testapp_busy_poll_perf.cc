@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Latency tests for the worker thread busy polling mode.
+ *
+ * Each test runs a number of small GET requests one at a time (so the
+ * worker thread runs out of work between each request) and records the
+ * p50, p99 and p999 round trip times (in usec) as properties in the
+ * GTest XML output. The BusyPoll variant enables "worker_busy_poll_usec"
+ * before connecting.
+ */
+
+#include "testapp.h"
+#include "testapp_client_test.h"
+
+#include <protocol/connection/client_mcbp_connection.h>
+
+#include <algorithm>
+#include <chrono>
+
+static const int IterationCount = 20000;
+
+#ifdef THREAD_SANITIZER
+static const int ReductionFactor = 20;
+#else
+static const int ReductionFactor = 1;
+#endif
+
+class BusyPollPerfTest : public TestappClientTest {
+public:
+    void SetUp() {
+        TestappClientTest::SetUp();
+        // Performance test - disable ewouldblock_engine.
+        ewouldblock_engine_configure(ENGINE_EWOULDBLOCK, EWBEngineMode::Next_N,
+                                     0);
+        iterations = IterationCount / ReductionFactor;
+    }
+
+    void TearDown() {
+        if (busyPollEnabled) {
+            setBusyPoll(0);
+        }
+        TestappClientTest::TearDown();
+    }
+
+protected:
+    void setBusyPoll(int usec) {
+        cJSON_DeleteItemFromObject(memcached_cfg.get(),
+                                   "worker_busy_poll_usec");
+        cJSON_AddNumberToObject(memcached_cfg.get(), "worker_busy_poll_usec",
+                                usec);
+        reconfigure();
+        busyPollEnabled = usec != 0;
+    }
+
+    void runLatencyTest() {
+        auto& conn = getConnection();
+        Document doc;
+        doc.info.cas = mcbp::cas::Wildcard;
+        doc.info.datatype = cb::mcbp::Datatype::Raw;
+        doc.info.flags = 0;
+        doc.info.id = name;
+        doc.value.resize(64, 'a');
+        conn.mutate(doc, 0, MutationType::Set);
+
+        std::vector<uint64_t> samples;
+        samples.reserve(iterations);
+        for (size_t ii = 0; ii < iterations; ++ii) {
+            const auto start = std::chrono::steady_clock::now();
+            conn.get(name, 0);
+            const auto end = std::chrono::steady_clock::now();
+            samples.push_back(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                            end - start).count());
+        }
+        conn.remove(name, 0);
+
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&samples](double pct) {
+            auto idx = size_t(pct / 100.0 * (samples.size() - 1));
+            return int(samples[idx]);
+        };
+        RecordProperty("p50_usec", percentile(50.0));
+        RecordProperty("p99_usec", percentile(99.0));
+        RecordProperty("p999_usec", percentile(99.9));
+    }
+
+    size_t iterations;
+    bool busyPollEnabled = false;
+};
+
+INSTANTIATE_TEST_CASE_P(TransportProtocols,
+                        BusyPollPerfTest,
+                        ::testing::Values(TransportProtocols::McbpPlain),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(BusyPollPerfTest, Latency) {
+    runLatencyTest();
+}
+
+TEST_P(BusyPollPerfTest, LatencyBusyPoll) {
+    setBusyPoll(100);
+    runLatencyTest();
+}
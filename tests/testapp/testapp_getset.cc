@@ -681,3 +681,43 @@ TEST_P(GetSetTest, TestPrepepndCompressedSourceAndData) {
     memset(expected.data() + input.size(), 'a', append.size());
     EXPECT_EQ(expected, stored.value);
 }
+
+TEST_P(GetSetTest, TestHotKeyHints) {
+    auto& conn = dynamic_cast<MemcachedBinprotConnection&>(getConnection());
+    conn.mutate(document, 0, MutationType::Set);
+
+    auto setThreshold = [](int threshold) {
+        cJSON_DeleteItemFromObject(memcached_cfg.get(), "hot_key_threshold");
+        cJSON_AddNumberToObject(memcached_cfg.get(), "hot_key_threshold",
+                                threshold);
+        reconfigure();
+    };
+
+    auto get = [&conn, this]() {
+        BinprotGetCommand cmd;
+        cmd.setKey(name);
+        cmd.setVBucket(0);
+        BinprotGetResponse resp;
+        conn.executeCommand(cmd, resp);
+        EXPECT_TRUE(resp.isSuccess());
+        EXPECT_EQ(document.info.flags, resp.getDocumentFlags());
+        return resp.getHotKeyTtl();
+    };
+
+    setThreshold(5);
+
+    // Clients which didn't ask for the hints should never see them
+    for (int ii = 0; ii < 10; ++ii) {
+        EXPECT_EQ(0, get());
+    }
+
+    conn.setHotKeyHintsSupport(true);
+    uint32_t ttl = 0;
+    for (int ii = 0; ii < 10 && ttl == 0; ++ii) {
+        ttl = get();
+    }
+    EXPECT_EQ(1000, ttl);
+
+    conn.setHotKeyHintsSupport(false);
+    setThreshold(0);
+}
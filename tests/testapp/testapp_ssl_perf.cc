@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Throughput tests comparing plain and SSL connections.
+ *
+ * Each test moves the same amount of data (IterationCount documents of
+ * DocumentSize bytes) over the connection, so the test times reported in
+ * the GTest XML output may be compared directly between the transports.
+ * The Ktls variants enable "ssl_ktls" before connecting, so that the
+ * server hands the session over to the kernel when supported.
+ */
+
+#include "testapp.h"
+#include "testapp_client_test.h"
+
+#include <protocol/connection/client_mcbp_connection.h>
+
+static const int IterationCount = 500;
+static const size_t DocumentSize = 1024 * 1024;
+
+#ifdef THREAD_SANITIZER
+static const int ReductionFactor = 20;
+#else
+static const int ReductionFactor = 1;
+#endif
+
+class SslPerfTest : public TestappClientTest {
+public:
+    void SetUp() {
+        TestappClientTest::SetUp();
+        // Performance test - disable ewouldblock_engine.
+        ewouldblock_engine_configure(ENGINE_EWOULDBLOCK, EWBEngineMode::Next_N,
+                                     0);
+        iterations = IterationCount / ReductionFactor;
+
+        document.info.cas = mcbp::cas::Wildcard;
+        document.info.datatype = cb::mcbp::Datatype::Raw;
+        document.info.flags = 0;
+        document.info.id = name;
+        document.value.resize(DocumentSize, 'a');
+    }
+
+    void TearDown() {
+        if (ktlsEnabled) {
+            setKtls(false);
+        }
+        TestappClientTest::TearDown();
+    }
+
+protected:
+    void setKtls(bool enable) {
+        cJSON_DeleteItemFromObject(memcached_cfg.get(), "ssl_ktls");
+        cJSON_AddItemToObject(memcached_cfg.get(), "ssl_ktls",
+                              enable ? cJSON_CreateTrue() : cJSON_CreateFalse());
+        reconfigure();
+        ktlsEnabled = enable;
+    }
+
+    void runGetTest() {
+        auto& conn = getConnection();
+        conn.mutate(document, 0, MutationType::Set);
+        for (size_t ii = 0; ii < iterations; ++ii) {
+            const auto doc = conn.get(name, 0);
+            ASSERT_EQ(DocumentSize, doc.value.size());
+        }
+        conn.remove(name, 0);
+    }
+
+    void runSetTest() {
+        auto& conn = getConnection();
+        for (size_t ii = 0; ii < iterations; ++ii) {
+            conn.mutate(document, 0, MutationType::Set);
+        }
+        conn.remove(name, 0);
+    }
+
+    size_t iterations;
+    Document document;
+    bool ktlsEnabled = false;
+};
+
+INSTANTIATE_TEST_CASE_P(TransportProtocols,
+                        SslPerfTest,
+                        ::testing::Values(TransportProtocols::McbpPlain,
+                                          TransportProtocols::McbpSsl),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(SslPerfTest, Get) {
+    runGetTest();
+}
+
+TEST_P(SslPerfTest, Set) {
+    runSetTest();
+}
+
+/*
+ * kTLS only applies to SSL connections, so the Ktls variants are only
+ * run over SSL.
+ */
+class KtlsPerfTest : public SslPerfTest {};
+
+INSTANTIATE_TEST_CASE_P(TransportProtocols,
+                        KtlsPerfTest,
+                        ::testing::Values(TransportProtocols::McbpSsl),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(KtlsPerfTest, GetKtls) {
+    setKtls(true);
+    runGetTest();
+}
+
+TEST_P(KtlsPerfTest, SetKtls) {
+    setKtls(true);
+    runSetTest();
+}
@@ -184,7 +184,7 @@ TEST_P(StatsTest, TestAudit) {
     unique_cJSON_ptr stats;
     stats = conn.stats("audit");
     EXPECT_NE(nullptr, stats.get());
-    EXPECT_EQ(2, cJSON_GetArraySize(stats.get()));
+    EXPECT_EQ(6, cJSON_GetArraySize(stats.get()));
 
     auto* enabled = cJSON_GetObjectItem(stats.get(), "enabled");
     EXPECT_NE(nullptr, enabled) << "Missing field \"enabled\"";
@@ -195,6 +195,13 @@ TEST_P(StatsTest, TestAudit) {
     EXPECT_EQ(cJSON_Number, dropped->type);
     EXPECT_EQ(0, dropped->valueint);
 
+    for (const auto* key : {"queue_depth", "processed_events",
+                            "avg_latency_usec", "max_latency_usec"}) {
+        auto* stat = cJSON_GetObjectItem(stats.get(), key);
+        ASSERT_NE(nullptr, stat) << "Missing field \"" << key << "\"";
+        EXPECT_EQ(cJSON_Number, stat->type);
+    }
+
     conn.reconnect();
 }
 
@@ -303,6 +310,33 @@ TEST_P(StatsTest, TestConnectionsInvalidNumber) {
     }
 }
 
+TEST_P(StatsTest, TestTypedStats) {
+    auto& conn = dynamic_cast<MemcachedBinprotConnection&>(getConnection());
+    conn.setTypedStatsSupport(true);
+
+    // The numeric stats should be decoded to the same textual
+    // representation as the ADD_STAT format
+    auto stats = conn.stats("");
+    auto* pid = cJSON_GetObjectItem(stats.get(), "pid");
+    ASSERT_NE(nullptr, pid);
+    EXPECT_EQ(cJSON_Number, pid->type);
+
+    stats = conn.stats("settings");
+    EXPECT_NE(nullptr, cJSON_GetObjectItem(stats.get(), "maxconns"));
+
+    // The connection stats is generated by a background task
+    stats = conn.stats("connections");
+    ASSERT_NE(nullptr, stats.get());
+    EXPECT_LE(1, cJSON_GetArraySize(stats.get()));
+    for (auto* c = stats.get()->child; c != nullptr; c = c->next) {
+        unique_cJSON_ptr json(cJSON_Parse(c->valuestring));
+        ASSERT_NE(nullptr, json.get());
+        EXPECT_NE(nullptr, cJSON_GetObjectItem(json.get(), "connection"));
+    }
+
+    conn.setTypedStatsSupport(false);
+}
+
 TEST_P(StatsTest, TestTopkeys) {
     MemcachedConnection& conn = getConnection();
 
@@ -373,6 +407,54 @@ TEST_P(StatsTest, TestSubdocExecute) {
     EXPECT_EQ(0, value.find("{\"ns\":"));
 }
 
+TEST_P(StatsTest, TestPhaseTimings) {
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "phase_timings");
+    cJSON_AddTrueToObject(memcached_cfg.get(), "phase_timings");
+    reconfigure();
+
+    MemcachedConnection& conn = getConnection();
+    // Only the phases a command goes through are recorded, so let the
+    // commands block once to get them through the ewouldblock phase
+    conn.configureEwouldBlockEngine(EWBEngineMode::First);
+    Document doc;
+    doc.info.cas = mcbp::cas::Wildcard;
+    doc.info.datatype = cb::mcbp::Datatype::Raw;
+    doc.info.flags = 0;
+    doc.info.id = name;
+    doc.value.resize(1024, 'a');
+    conn.mutate(doc, 0, MutationType::Set);
+    conn.get(name, 0);
+    conn.disableEwouldBlockEngine();
+
+    // The phase timings cover all buckets and require the stats privilege
+    conn.authenticate("@admin", "password", "PLAIN");
+    for (const auto* key : {"phase_timings", "phase_timings GET"}) {
+        auto stats = conn.stats(key);
+        for (const auto* phase :
+             {"read", "parse", "engine", "ewouldblock", "write"}) {
+            auto* elem = cJSON_GetObjectItem(stats.get(), phase);
+            ASSERT_NE(nullptr, elem) << key << ": " << phase;
+            unique_cJSON_ptr value(cJSON_Parse(elem->valuestring));
+            ASSERT_NE(nullptr, value.get());
+            auto* total = cJSON_GetObjectItem(value.get(), "total");
+            ASSERT_NE(nullptr, total);
+            EXPECT_LE(1, total->valueint) << key << ": " << phase;
+        }
+    }
+
+    try {
+        conn.stats("phase_timings NOT_AN_OPCODE");
+        FAIL() << "Expected phase_timings to fail for an unknown opcode";
+    } catch (ConnectionError& error) {
+        EXPECT_TRUE(error.isInvalidArguments());
+    }
+
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "phase_timings");
+    cJSON_AddFalseToObject(memcached_cfg.get(), "phase_timings");
+    reconfigure();
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "phase_timings");
+}
+
 TEST_P(StatsTest, TestResponseStats) {
     int successCount = getResponseCount(PROTOCOL_BINARY_RESPONSE_SUCCESS);
     // 2 successes expected:
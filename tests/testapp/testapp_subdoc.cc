@@ -312,6 +312,59 @@ uint64_t expect_subdoc_cmd(const SubdocMultiMutationCmd& cmd,
                                 expected_results);
 }
 
+std::vector<SubdocMultiKeyResult> send_subdoc_cmd(
+        const SubdocMultiKeyCmd& cmd,
+        protocol_binary_response_status expected_status) {
+    std::vector<char> payload = cmd.encode();
+    safe_send(payload.data(), payload.size(), false);
+
+    std::vector<uint8_t> packet;
+    safe_recv_packet(packet);
+    auto* header =
+            reinterpret_cast<protocol_binary_response_no_extras*>(packet.data());
+    mcbp_validate_response_header(
+            header, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY, expected_status);
+
+    std::vector<SubdocMultiKeyResult> results;
+    if (expected_status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        return results;
+    }
+
+    // The CAS of each key is in its result
+    EXPECT_EQ(0u, header->message.header.response.cas);
+
+    const size_t result_header_len =
+            sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t);
+    const char* ptr = reinterpret_cast<const char*>(packet.data()) +
+                      sizeof(header->message.header);
+    const char* end = ptr + header->message.header.response.bodylen;
+    while (ptr < end) {
+        if (size_t(end - ptr) < result_header_len) {
+            ADD_FAILURE() << "Remaining value length too short for result header";
+            break;
+        }
+        uint16_t status;
+        uint64_t cas;
+        uint32_t length;
+        std::memcpy(&status, ptr, sizeof(status));
+        std::memcpy(&cas, ptr + sizeof(status), sizeof(cas));
+        std::memcpy(&length, ptr + sizeof(status) + sizeof(cas),
+                    sizeof(length));
+        ptr += result_header_len;
+        length = ntohl(length);
+        if (size_t(end - ptr) < length) {
+            ADD_FAILURE() << "Remaining value length too short for result value";
+            break;
+        }
+        results.push_back({protocol_binary_response_status(ntohs(status)),
+                           ntohll(cas),
+                           std::string(ptr, length)});
+        ptr += length;
+    }
+
+    return results;
+}
+
 void store_object(const std::string& key,
                   const std::string& value,
                   bool JSON, bool compress) {
@@ -1812,6 +1865,36 @@ TEST_P(McdTestappTest, SubdocCASAutoRetry)
     delete_object("a");
 }
 
+// After a CAS conflict the retry should be executed through the engine's
+// update instead of fetching and storing the document once more.
+TEST_P(McdTestappTest, SubdocCASConflictUpdatesInEngine) {
+    store_object("a", "{}");
+
+    auto stats = request_stats();
+    const auto conflicts_before =
+            extract_single_stat(stats, "subdoc_cas_conflicts");
+    const auto retries_before = extract_single_stat(stats, "subdoc_retries");
+    const auto updates_before =
+            extract_single_stat(stats, "subdoc_engine_updates");
+
+    ewouldblock_engine_configure(ENGINE_SUCCESS, // not used for this mode
+                                 EWBEngineMode::CasMismatch,
+                                 1);
+    EXPECT_SD_OK(BinprotSubdocCommand(PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD,
+                                      "a", "key1", "1"));
+
+    stats = request_stats();
+    EXPECT_EQ(1u, extract_single_stat(stats, "subdoc_cas_conflicts") -
+                         conflicts_before);
+    EXPECT_EQ(1u, extract_single_stat(stats, "subdoc_retries") -
+                         retries_before);
+    EXPECT_EQ(1u, extract_single_stat(stats, "subdoc_engine_updates") -
+                         updates_before);
+
+    validate_object("a", "{\"key1\":1}");
+    delete_object("a");
+}
+
 TEST_P(McdTestappTest, SubdocMkdoc_Array)
 {
     // Create new document (array)
@@ -2180,6 +2263,42 @@ TEST_P(McdTestappTest, SubdocStatsCounter) {
                                result.size(), fragment.size());
 }
 
+// Mutating a compressed document should inflate it, and store the new
+// document compressed.
+TEST_P(McdTestappTest, SubdocStatsCompressedDocument) {
+    std::string input("{\"foo\":\"" + std::string(1024, 'x') + "\"}");
+    store_object("doc", input, /*JSON*/true, /*compress*/true);
+
+    auto stats = request_stats();
+    const auto inflated_before =
+            extract_single_stat(stats, "bytes_subdoc_inflated");
+    const auto deflated_before =
+            extract_single_stat(stats, "bytes_subdoc_deflated");
+
+    EXPECT_SD_OK(BinprotSubdocCommand(PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                                      "doc", "bar", "1"));
+    std::string result(input);
+    result.insert(result.size() - 1, ",\"bar\":1");
+
+    stats = request_stats();
+    EXPECT_EQ(input.size(),
+              extract_single_stat(stats, "bytes_subdoc_inflated") -
+                      inflated_before);
+    EXPECT_EQ(result.size(),
+              extract_single_stat(stats, "bytes_subdoc_deflated") -
+                      deflated_before);
+
+    // The new document is still compressed (so it's inflated once more)
+    EXPECT_SD_GET("doc", "bar", "1");
+    stats = request_stats();
+    EXPECT_EQ(input.size() + result.size(),
+              extract_single_stat(stats, "bytes_subdoc_inflated") -
+                      inflated_before);
+
+    validate_object("doc", result);
+    delete_object("doc");
+}
+
 TEST_P(McdTestappTest, SubdocUTF8PathTest) {
     // Check that using UTF8 characters in the path works, which it should
 
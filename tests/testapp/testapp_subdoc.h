@@ -137,6 +137,23 @@ uint64_t expect_subdoc_cmd(const SubdocMultiMutationCmd& cmd,
                            protocol_binary_response_status expected_status,
                            const std::vector<SubdocMultiMutationResult>& expected_results);
 
+/* The result for one of the keys of a multi-key command. The value is the
+ * body of the response to the multi-path command for the key.
+ */
+struct SubdocMultiKeyResult {
+    protocol_binary_response_status status;
+    uint64_t cas;
+    std::string value;
+};
+
+/* Sends the multi-key command `cmd`, checks that the status of the response
+ * matches `expected_status` and returns the result for each of the keys.
+ */
+std::vector<SubdocMultiKeyResult> send_subdoc_cmd(
+        const SubdocMultiKeyCmd& cmd,
+        protocol_binary_response_status expected_status =
+                PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
 
 void store_object(const std::string& key,
                   const std::string& value,
@@ -176,6 +176,46 @@ TEST_P(McdTestappTest, SubdocMultiLookup_ExistsMulti)
     delete_object("dict");
 }
 
+// Test multi-path lookup of large values, which are sent straight from
+// the document (with MSG_ZEROCOPY if the socket supports it) interleaved
+// with the small per-spec headers.
+TEST_P(McdTestappTest, SubdocMultiLookup_LargeValues) {
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "zerocopy_threshold");
+    cJSON_AddNumberToObject(memcached_cfg.get(), "zerocopy_threshold", 16384);
+    reconfigure();
+
+    const std::string big1(128 * 1024, 'a');
+    const std::string big2(64 * 1024, 'b');
+    const std::string doc("{\"big1\":\"" + big1 + "\",\"small\":1,"
+                          "\"big2\":\"" + big2 + "\"}");
+    store_object("dict", doc.c_str());
+
+    SubdocMultiLookupCmd lookup;
+    lookup.key = "dict";
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "big1"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_EXISTS,
+                            SUBDOC_FLAG_NONE, "small"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "missing"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "big2"});
+    std::vector<SubdocMultiLookupResult> expected{
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"" + big1 + "\""},
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, ""},
+            {PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, ""},
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"" + big2 + "\""}};
+    expect_subdoc_cmd(lookup,
+                      PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+                      expected);
+
+    delete_object("dict");
+
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "zerocopy_threshold");
+    cJSON_AddNumberToObject(memcached_cfg.get(), "zerocopy_threshold", 0);
+    reconfigure();
+}
+
 /******************* Multi-path mutation tests *******************************/
 
 // Test multi-path mutation command - simple single SUBDOC_DICT_ADD
@@ -400,6 +440,101 @@ TEST_P(McdTestappTest, SubdocMultiMutation_DictAddDelete_MutationSeqno) {
     set_mutation_seqno_feature(false);
 }
 
+// Test multi-path mutation command where the first mutations modify
+// separate parts of the document (and are applied in a single pass) and
+// the last one depends on one of the previous ones.
+TEST_P(McdTestappTest, SubdocMultiMutation_DisjointPaths) {
+    store_object("dict",
+                 "{\"a\":1,\"b\":{\"c\":2},\"d\":[1,2],\"e\":\"x\"}");
+
+    SubdocMultiMutationCmd mutation;
+    mutation.key = "dict";
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_REPLACE,
+                              SUBDOC_FLAG_NONE, "a", "10"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_COUNTER,
+                              SUBDOC_FLAG_NONE, "b.c", "1"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST,
+                              SUBDOC_FLAG_NONE, "d", "3"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DELETE,
+                              SUBDOC_FLAG_NONE, "e", ""});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                              SUBDOC_FLAG_NONE, "b.f", "true"});
+    expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                      {{1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "3"}});
+
+    validate_object("dict",
+                    "{\"a\":10,\"b\":{\"c\":3,\"f\":true},\"d\":[1,2,3]}");
+
+    // A mutation depending on the content modified by a previous one
+    // must see the result of it.
+    store_object("dict", "{\"arr\":[2]}");
+    mutation.specs.clear();
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST,
+                              SUBDOC_FLAG_NONE, "arr", "1"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE,
+                              SUBDOC_FLAG_NONE, "arr", "1"});
+    expect_subdoc_cmd(mutation,
+                      PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+                      {{1, PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EEXISTS}});
+    validate_object("dict", "{\"arr\":[2]}");
+
+    delete_object("dict");
+}
+
+// Test multi-path mutation command where the mutations replace disjoint
+// parts of the document, but add and remove members of the same
+// dictionary (so the separating commas depend on both).
+TEST_P(McdTestappTest, SubdocMultiMutation_DisjointPathsSameParent) {
+    store_object("dict", "{\"x\":1 }");
+
+    SubdocMultiMutationCmd mutation;
+    mutation.key = "dict";
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DELETE,
+                              SUBDOC_FLAG_NONE, "x", ""});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                              SUBDOC_FLAG_NONE, "y", "2"});
+    expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_SUCCESS, {});
+
+    // subjson decides how much whitespace to keep, so look at the
+    // members rather than the exact document.
+    SubdocMultiLookupCmd lookup;
+    lookup.key = "dict";
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET,
+                            SUBDOC_FLAG_NONE, "y"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_EXISTS,
+                            SUBDOC_FLAG_NONE, "x"});
+    expect_subdoc_cmd(lookup,
+                      PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "2"},
+                       {PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, ""}});
+
+    // Members added to different dictionaries are still fine
+    store_object("dict", "{\"a\":{\"x\":1 },\"b\":{ }}");
+    mutation.specs.clear();
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DELETE,
+                              SUBDOC_FLAG_NONE, "a.x", ""});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD,
+                              SUBDOC_FLAG_NONE, "b.y", "2"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD,
+                              SUBDOC_FLAG_NONE, "`a`.z", "3"});
+    expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_SUCCESS, {});
+
+    lookup.specs.clear();
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET,
+                            SUBDOC_FLAG_NONE, "a.z"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET,
+                            SUBDOC_FLAG_NONE, "b.y"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_EXISTS,
+                            SUBDOC_FLAG_NONE, "a.x"});
+    expect_subdoc_cmd(lookup,
+                      PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "3"},
+                       {PROTOCOL_BINARY_RESPONSE_SUCCESS, "2"},
+                       {PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, ""}});
+
+    delete_object("dict");
+}
+
 // Test support for expiration on multi-path commands.
 TEST_P(McdTestappTest, SubdocMultiMutation_Expiry) {
     // Create two documents; one to be used for an exlicit 1s expiry and one
@@ -608,3 +743,174 @@ TEST_P(McdTestappTest, SubdocMultiMutation_AddDocFlagInavlidCas) {
                               "56"});
     expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_EINVAL, {});
 }
+
+// Encode the body of a multi-lookup response with the given results
+static std::string encode_lookup_results(
+        const std::vector<SubdocMultiLookupResult>& results) {
+    std::string encoded;
+    for (const auto& result : results) {
+        const uint16_t status = htons(result.first);
+        const uint32_t length = htonl(uint32_t(result.second.size()));
+        encoded.append(reinterpret_cast<const char*>(&status), sizeof(status));
+        encoded.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        encoded.append(result.second);
+    }
+    return encoded;
+}
+
+// Test multi-key lookup; the same lookup on a list of keys, where one of
+// them doesn't exist.
+TEST_P(McdTestappTest, SubdocMultiKey_Lookup) {
+    store_object("mk_0", "{\"name\":\"zero\",\"value\":0}");
+    store_object("mk_1", "{\"name\":\"one\"}");
+    store_object("mk_2", "{\"name\":\"two\",\"value\":2}");
+
+    SubdocMultiLookupCmd lookup;
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "name"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "value"});
+
+    SubdocMultiKeyCmd multikey(lookup);
+    multikey.keys = {"mk_0", "mk_missing", "mk_1", "mk_2"};
+    const auto results = send_subdoc_cmd(multikey);
+    ASSERT_EQ(4u, results.size());
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, results[0].status);
+    EXPECT_NE(0u, results[0].cas);
+    EXPECT_EQ(encode_lookup_results(
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"zero\""},
+                       {PROTOCOL_BINARY_RESPONSE_SUCCESS, "0"}}),
+              results[0].value);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, results[1].status);
+    EXPECT_EQ(0u, results[1].cas);
+    EXPECT_EQ("", results[1].value);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+              results[2].status);
+    EXPECT_EQ(encode_lookup_results(
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"one\""},
+                       {PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, ""}}),
+              results[2].value);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, results[3].status);
+    EXPECT_EQ(encode_lookup_results(
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"two\""},
+                       {PROTOCOL_BINARY_RESPONSE_SUCCESS, "2"}}),
+              results[3].value);
+
+    // The CAS is the one of the document
+    SubdocMultiLookupCmd single(lookup);
+    single.key = "mk_2";
+    EXPECT_EQ(results[3].cas,
+              expect_subdoc_cmd(single,
+                                PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                                {{PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"two\""},
+                                 {PROTOCOL_BINARY_RESPONSE_SUCCESS, "2"}}));
+
+    delete_object("mk_0");
+    delete_object("mk_1");
+    delete_object("mk_2");
+}
+
+// Test multi-key mutation; the same mutation applied to a list of keys,
+// where it fails for one of them.
+TEST_P(McdTestappTest, SubdocMultiKey_Mutation) {
+    store_object("mk_0", "{\"count\":0}");
+    store_object("mk_1", "[]");
+    store_object("mk_2", "{\"count\":41}");
+
+    SubdocMultiMutationCmd mutation;
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_COUNTER,
+                              SUBDOC_FLAG_NONE, "count", "1"});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                              SUBDOC_FLAG_NONE, "updated", "true"});
+
+    SubdocMultiKeyCmd multikey(mutation);
+    multikey.keys = {"mk_0", "mk_1", "mk_2", "mk_missing"};
+    const auto results = send_subdoc_cmd(multikey);
+    ASSERT_EQ(4u, results.size());
+
+    // index 0, status SUCCESS, length 1, value
+    const std::string counter_one("\x00\x00\x00\x00\x00\x00\x01" "1", 8);
+    const std::string counter_42("\x00\x00\x00\x00\x00\x00\x02" "42", 9);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, results[0].status);
+    EXPECT_NE(0u, results[0].cas);
+    EXPECT_EQ(counter_one, results[0].value);
+
+    // index 0 failed with PATH_MISMATCH; the document isn't modified
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE,
+              results[1].status);
+    EXPECT_EQ(std::string("\x00\x00\xc1", 3), results[1].value);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, results[2].status);
+    EXPECT_NE(0u, results[2].cas);
+    EXPECT_NE(results[0].cas, results[2].cas);
+    EXPECT_EQ(counter_42, results[2].value);
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, results[3].status);
+
+    validate_object("mk_0", "{\"count\":1,\"updated\":true}");
+    validate_object("mk_1", "[]");
+    validate_object("mk_2", "{\"count\":42,\"updated\":true}");
+
+    delete_object("mk_0");
+    delete_object("mk_1");
+    delete_object("mk_2");
+}
+
+// Test that the results of a multi-key lookup which doesn't fit in a
+// response are replaced with E2BIG.
+TEST_P(McdTestappTest, SubdocMultiKey_LookupE2BIG) {
+    const std::string value(900 * 1024, 'x');
+    store_object("mk_big", "{\"v\":\"" + value + "\"}", /*JSON*/ true,
+                 /*compress*/ false);
+
+    SubdocMultiLookupCmd lookup;
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "v"});
+
+    // 40 copies of the value is more than the maximum packet size (30MB)
+    SubdocMultiKeyCmd multikey(lookup);
+    multikey.keys.assign(40, "mk_big");
+    const auto results = send_subdoc_cmd(multikey);
+    ASSERT_EQ(40u, results.size());
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, results.front().status);
+    EXPECT_EQ(encode_lookup_results(
+                      {{PROTOCOL_BINARY_RESPONSE_SUCCESS, '"' + value + '"'}}),
+              results.front().value);
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_E2BIG, results.back().status);
+    EXPECT_EQ(0u, results.back().cas);
+    EXPECT_EQ("", results.back().value);
+
+    delete_object("mk_big");
+}
+
+// Test that malformed multi-key commands are rejected
+TEST_P(McdTestappTest, SubdocMultiKey_Invalid) {
+    SubdocMultiLookupCmd lookup;
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET, SUBDOC_FLAG_NONE,
+                            "name"});
+
+    // No keys
+    SubdocMultiKeyCmd multikey(lookup);
+    send_subdoc_cmd(multikey, PROTOCOL_BINARY_RESPONSE_EINVAL);
+    reconnect_to_server();
+
+    // A CAS can't be used for all of the keys
+    lookup.cas = 0xdeadbeef;
+    multikey.keys = {"mk_0"};
+    send_subdoc_cmd(multikey, PROTOCOL_BINARY_RESPONSE_EINVAL);
+    reconnect_to_server();
+
+    // Mutations can't be mixed with lookups
+    lookup.cas = 0;
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                            SUBDOC_FLAG_NONE, "name"});
+    send_subdoc_cmd(multikey, PROTOCOL_BINARY_RESPONSE_SUBDOC_INVALID_COMBO);
+    reconnect_to_server();
+}
+
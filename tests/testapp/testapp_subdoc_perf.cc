@@ -26,6 +26,12 @@
  *
  * - Dict: As per Array, except start with an empty dictionary and add
  *         K/V pairs of the form <num>: value_<num>.
+ *
+ * - Multipath: As above, but using the multi-path commands with the
+ *              maximum number of paths per command.
+ *
+ * - Xattr: Expand macros in, and look up the virtual attributes of, the
+ *          extended attributes of a document.
  */
 
 #include "testapp_subdoc.h"
@@ -395,6 +401,90 @@ TEST_F(SubdocPerfTest, Dict_Add_Multipath) {
 }
 
 
+// Replace values spread out over a ~50KB document, the maximum number of
+// paths at the time. The mutations don't overlap, so they are applied
+// to the document in a single pass.
+TEST_F(SubdocPerfTest, Dict_Replace_Multipath_LargeDoc) {
+    const size_t elements = 2800;
+    subdoc_create_dict("dict", elements);
+
+    SubdocMultiMutationCmd mutation;
+    mutation.key = "dict";
+    const size_t stride = elements / PROTOCOL_BINARY_SUBDOC_MULTI_MAX_PATHS;
+    for (size_t i = 0; i < iterations; i++) {
+        mutation.specs.clear();
+        for (size_t jj = 0; jj < PROTOCOL_BINARY_SUBDOC_MULTI_MAX_PATHS;
+             jj++) {
+            std::string key(std::to_string(jj * stride + i % stride));
+            mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_REPLACE,
+                                      SUBDOC_FLAG_NONE, key,
+                                      std::to_string(i)});
+        }
+        expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_SUCCESS, {});
+    }
+
+    delete_object("dict");
+}
+
+/*****************************************************************************
+ * Extended attribute Performance Tests
+ *
+ * These test the handling of the macros and the virtual attributes of the
+ * document in the extended attributes.
+ ****************************************************************************/
+
+// Stamp the CAS and seqno of every mutation in an xattr (as a client
+// tracking the revisions of the document would do).
+TEST_F(SubdocPerfTest, Xattr_MacroExpansion) {
+    set_xattr_feature(true);
+    store_object("dict", "{\"value\":0}");
+
+    const auto flags = SUBDOC_FLAG_XATTR_PATH | SUBDOC_FLAG_MKDIR_P |
+                       SUBDOC_FLAG_EXPAND_MACROS;
+    SubdocMultiMutationCmd mutation;
+    mutation.key = "dict";
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT, flags,
+                              "_rev.cas", "\"${Mutation.CAS}\""});
+    mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT, flags,
+                              "_rev.seqno", "\"${Mutation.seqno}\""});
+    for (size_t i = 0; i < iterations; i++) {
+        mutation.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                                  SUBDOC_FLAG_NONE, "value",
+                                  std::to_string(i)});
+        expect_subdoc_cmd(mutation, PROTOCOL_BINARY_RESPONSE_SUCCESS, {});
+        mutation.specs.pop_back();
+    }
+
+    delete_object("dict");
+    set_xattr_feature(false);
+}
+
+// Look up the virtual attributes of the document.
+TEST_F(SubdocPerfTest, Xattr_DocumentVattr) {
+    set_xattr_feature(true);
+    const std::string value("{\"value\":0}");
+    store_object("dict", value.c_str());
+
+    SubdocMultiLookupCmd lookup;
+    lookup.key = "dict";
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_EXISTS,
+                            SUBDOC_FLAG_XATTR_PATH, "$document.CAS"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET,
+                            SUBDOC_FLAG_XATTR_PATH, "$document.value_bytes"});
+    lookup.specs.push_back({PROTOCOL_BINARY_CMD_SUBDOC_GET,
+                            SUBDOC_FLAG_XATTR_PATH, "$document.deleted"});
+    const std::vector<SubdocMultiLookupResult> expected{
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, ""},
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, std::to_string(value.size())},
+            {PROTOCOL_BINARY_RESPONSE_SUCCESS, "false"}};
+    for (size_t i = 0; i < iterations; i++) {
+        expect_subdoc_cmd(lookup, PROTOCOL_BINARY_RESPONSE_SUCCESS, expected);
+    }
+
+    delete_object("dict");
+    set_xattr_feature(false);
+}
+
 /*****************************************************************************
  * 'Fulldoc' Performance Tests
  *
@@ -1028,6 +1028,62 @@ TEST_P(McdTestappTest, IOCTL_Tracing) {
     EXPECT_EQ(cJSON_Array, events->type);
 }
 
+TEST_P(McdTestappTest, IOCTL_SampledTracing) {
+    // Sample every request and keep all of them
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "trace_sample_rate");
+    cJSON_AddNumberToObject(memcached_cfg.get(), "trace_sample_rate", 1);
+    reconfigure();
+
+    auto& conn = connectionMap.getConnection(Protocol::Memcached,
+                                             sock_is_ssl(),
+                                             AF_INET);
+    conn.authenticate("@admin", "password", "PLAIN");
+    conn.ioctl_set("trace.sampled.clear", {});
+    conn.selectBucket("default");
+
+    Document doc;
+    doc.info.cas = mcbp::cas::Wildcard;
+    doc.info.datatype = cb::mcbp::Datatype::Raw;
+    doc.info.flags = 0;
+    doc.info.id = "IOCTL_SampledTracing";
+    doc.value = "value";
+    conn.mutate(doc, 0, MutationType::Set);
+    conn.get(doc.info.id, 0);
+    conn.remove(doc.info.id, 0);
+
+    auto uuid = conn.ioctl_get("trace.dump.begin?type=sampled");
+
+    const std::string chunk_key = "trace.dump.chunk?id=" + uuid;
+    std::string dump;
+    std::string chunk;
+
+    do {
+        chunk = conn.ioctl_get(chunk_key);
+        dump += chunk;
+    } while (chunk.size() > 0);
+
+    conn.ioctl_set("trace.dump.clear", uuid);
+    conn.ioctl_set("trace.sampled.clear", {});
+
+    unique_cJSON_ptr json = unique_cJSON_ptr(cJSON_Parse(dump.c_str()));
+    ASSERT_NE(nullptr, json);
+    EXPECT_EQ(cJSON_Object, json->type);
+
+    auto* events = cJSON_GetObjectItem(json.get(), "traceEvents");
+    ASSERT_NE(nullptr, events);
+    EXPECT_EQ(cJSON_Array, events->type);
+    EXPECT_LT(0, cJSON_GetArraySize(events));
+
+    // Unknown dump types should be rejected
+    EXPECT_THROW(conn.ioctl_get("trace.dump.begin?type=unknown"),
+                 ConnectionError);
+
+    cJSON_ReplaceItemInObject(memcached_cfg.get(), "trace_sample_rate",
+                              cJSON_CreateNumber(0));
+    reconfigure();
+    cJSON_DeleteItemFromObject(memcached_cfg.get(), "trace_sample_rate");
+}
+
 TEST_P(McdTestappTest, Config_ValidateCurrentConfig) {
     union {
         protocol_binary_request_no_extras request;
@@ -2295,6 +2351,122 @@ TEST_P(McdTestappTest, PipelineHuge) {
                        1023 * 1024);
 }
 
+/*
+ * Values of at least direct_item_read_threshold bytes (64k by default)
+ * are received directly into the item instead of the input buffer.
+ * The following tests store such a value and verify that we read back
+ * exactly what we sent.
+ */
+static std::vector<uint8_t> make_large_value() {
+    std::vector<uint8_t> value(256 * 1024);
+    for (size_t ii = 0; ii < value.size(); ++ii) {
+        value[ii] = uint8_t(ii % 251);
+    }
+    return value;
+}
+
+static void recv_large_set_response() {
+    std::vector<uint8_t> blob;
+    ASSERT_TRUE(safe_recv_packet(blob));
+    mcbp_validate_response_header(
+        reinterpret_cast<protocol_binary_response_no_extras*>(blob.data()),
+        PROTOCOL_BINARY_CMD_SET, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+}
+
+static void recv_large_get_response(const std::vector<uint8_t>& value) {
+    std::vector<uint8_t> blob;
+    ASSERT_TRUE(safe_recv_packet(blob));
+    auto* rsp = reinterpret_cast<protocol_binary_response_get*>(blob.data());
+    mcbp_validate_response_header(
+        reinterpret_cast<protocol_binary_response_no_extras*>(rsp),
+        PROTOCOL_BINARY_CMD_GET, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    ASSERT_EQ(sizeof(rsp->bytes) + value.size(), blob.size());
+    EXPECT_TRUE(std::equal(value.begin(), value.end(),
+                           blob.begin() + sizeof(rsp->bytes)));
+}
+
+static void send_large_get(const std::string& key) {
+    Frame frame;
+    mcbp_raw_command(frame, PROTOCOL_BINARY_CMD_GET,
+                     key.data(), key.size(), nullptr, 0);
+    safe_send(frame.payload.data(), frame.payload.size(), false);
+}
+
+/*
+ * Send the header, extras, key and the first part of the value in one
+ * chunk so that the server has part of the value in its input buffer
+ * when it allocates the item, then send the rest of the value.
+ */
+static void send_large_set_split(const std::string& key,
+                                 const std::vector<uint8_t>& value) {
+    Frame frame;
+    mcbp_storage_command(frame, PROTOCOL_BINARY_CMD_SET, key, value, 0, 0);
+    const size_t first = sizeof(protocol_binary_request_set) + key.size() +
+                         1000;
+    safe_send(frame.payload.data(), first, false);
+#ifdef WIN32
+    Sleep(1);
+#else
+    usleep(250);
+#endif
+    safe_send(frame.payload.data() + first, frame.payload.size() - first,
+              false);
+}
+
+TEST_P(McdTestappTest, SetLargeValuePartlyInFirstRead) {
+    // The default ewouldblock mode would fail the allocation and make
+    // us fall back to read the value into the input buffer
+    ewouldblock_engine_disable();
+
+    const std::string key = "SetLargeValuePartlyInFirstRead";
+    const auto value = make_large_value();
+    send_large_set_split(key, value);
+    recv_large_set_response();
+    send_large_get(key);
+    recv_large_get_response(value);
+}
+
+TEST_P(McdTestappTest, SetLargeValuePipelined) {
+    ewouldblock_engine_disable();
+
+    // Send a NOOP, the SET and the GET in one go so that the SET starts
+    // in the middle of the input buffer
+    const std::string key = "SetLargeValuePipelined";
+    const auto value = make_large_value();
+    Frame frame;
+    mcbp_raw_command(frame, PROTOCOL_BINARY_CMD_NOOP, nullptr, 0, nullptr, 0);
+    std::vector<uint8_t> stream = frame.payload;
+    mcbp_storage_command(frame, PROTOCOL_BINARY_CMD_SET, key, value, 0, 0);
+    stream.insert(stream.end(), frame.payload.begin(), frame.payload.end());
+    mcbp_raw_command(frame, PROTOCOL_BINARY_CMD_GET,
+                     key.data(), key.size(), nullptr, 0);
+    stream.insert(stream.end(), frame.payload.begin(), frame.payload.end());
+    safe_send(stream.data(), stream.size(), false);
+
+    std::vector<uint8_t> blob;
+    ASSERT_TRUE(safe_recv_packet(blob));
+    mcbp_validate_response_header(
+        reinterpret_cast<protocol_binary_response_no_extras*>(blob.data()),
+        PROTOCOL_BINARY_CMD_NOOP, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    recv_large_set_response();
+    recv_large_get_response(value);
+}
+
+TEST_P(McdTestappTest, SetLargeValueEWouldBlock) {
+    // Let the allocation of the item succeed and every other engine
+    // call block the first time it is called, so the mutation is
+    // resumed after the value is read into the item
+    ewouldblock_engine_configure(ENGINE_EWOULDBLOCK, EWBEngineMode::Sequence,
+                                 0xaaaaaaaa);
+
+    const std::string key = "SetLargeValueEWouldBlock";
+    const auto value = make_large_value();
+    send_large_set_split(key, value);
+    recv_large_set_response();
+    send_large_get(key);
+    recv_large_get_response(value);
+}
+
 #ifndef THREAD_SANITIZER
 // These tests are disabled under valgrind as they take a lot
 // of time and don't really expose any new features in the server
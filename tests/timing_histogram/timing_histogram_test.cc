@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <daemon/timing_histogram.h>
+
+#include <cJSON.h>
+#include <cJSON_utils.h>
+#include <gtest/gtest.h>
+
+/// Add a sample of the given number of usec
+static void addUsec(TimingHistogram& histogram, uint64_t usec) {
+    histogram.add(usec * 1000);
+}
+
+TEST(TimingHistogramTest, InvalidPrecision) {
+    EXPECT_THROW(TimingHistogram(0), std::invalid_argument);
+    EXPECT_THROW(TimingHistogram(TimingHistogram::MaxPrecision + 1),
+                 std::invalid_argument);
+    EXPECT_NO_THROW(TimingHistogram(TimingHistogram::MaxPrecision));
+}
+
+TEST(TimingHistogramTest, Empty) {
+    TimingHistogram histogram;
+    EXPECT_EQ(0, histogram.get_total());
+    EXPECT_EQ(0, histogram.getValueAtPercentile(99.0));
+    for (size_t ii = 0; ii < histogram.getNumBins(); ++ii) {
+        EXPECT_EQ(0, histogram.getBinCount(ii));
+    }
+    EXPECT_THROW(histogram.getBinCount(histogram.getNumBins()),
+                 std::out_of_range);
+}
+
+TEST(TimingHistogramTest, BinsAreContiguous) {
+    for (uint8_t precision = 1; precision <= TimingHistogram::MaxPrecision;
+         ++precision) {
+        TimingHistogram histogram(precision);
+        EXPECT_EQ(0, histogram.getBinLowerBound(0));
+        for (size_t ii = 1; ii < histogram.getNumBins(); ++ii) {
+            ASSERT_EQ(histogram.getBinUpperBound(ii - 1) + 1,
+                      histogram.getBinLowerBound(ii))
+                << "precision: " << int(precision) << " bin: " << ii;
+        }
+        EXPECT_EQ(TimingHistogram::MaxValue,
+                  histogram.getBinUpperBound(histogram.getNumBins() - 1));
+    }
+}
+
+TEST(TimingHistogramTest, RelativeError) {
+    TimingHistogram histogram;
+    const double maxError = 1.0 / (1 << histogram.getPrecision());
+    for (size_t ii = 1; ii < histogram.getNumBins(); ++ii) {
+        const auto lower = histogram.getBinLowerBound(ii);
+        const auto upper = histogram.getBinUpperBound(ii);
+        EXPECT_LE(double(upper - lower) / lower, maxError) << "bin: " << ii;
+    }
+}
+
+TEST(TimingHistogramTest, SamplesEndUpInTheRightBin) {
+    TimingHistogram histogram;
+    for (uint64_t usec : {0, 1, 15, 16, 17, 100, 1000, 123456, 10000000}) {
+        histogram.reset();
+        addUsec(histogram, usec);
+        size_t found = 0;
+        for (size_t ii = 0; ii < histogram.getNumBins(); ++ii) {
+            if (histogram.getBinCount(ii) != 0) {
+                EXPECT_LE(histogram.getBinLowerBound(ii), usec);
+                EXPECT_GE(histogram.getBinUpperBound(ii), usec);
+                ++found;
+            }
+        }
+        EXPECT_EQ(1, found) << "usec: " << usec;
+        EXPECT_EQ(1, histogram.get_total());
+    }
+}
+
+TEST(TimingHistogramTest, Overflow) {
+    TimingHistogram histogram;
+    addUsec(histogram, TimingHistogram::MaxValue * 2);
+    EXPECT_EQ(1, histogram.getBinCount(histogram.getNumBins() - 1));
+}
+
+TEST(TimingHistogramTest, Percentiles) {
+    TimingHistogram histogram;
+    for (uint64_t usec = 1; usec <= 1000; ++usec) {
+        addUsec(histogram, usec);
+    }
+    EXPECT_EQ(1000, histogram.get_total());
+    EXPECT_EQ(1, histogram.getValueAtPercentile(0.0));
+
+    const double maxError = 1.0 / (1 << histogram.getPrecision());
+    // The default precision keeps the error below 1%
+    EXPECT_LT(maxError, 0.01);
+    for (double pct : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+        const auto expected = pct * 10;
+        const auto value = histogram.getValueAtPercentile(pct);
+        EXPECT_GE(value, expected) << "pct: " << pct;
+        EXPECT_LE(value, expected * (1 + maxError)) << "pct: " << pct;
+    }
+}
+
+TEST(TimingHistogramTest, Merge) {
+    TimingHistogram a;
+    TimingHistogram b;
+    addUsec(a, 10);
+    addUsec(b, 10);
+    addUsec(b, 5000);
+
+    a += b;
+    EXPECT_EQ(3, a.get_total());
+    EXPECT_EQ(2, a.getBinCount(10));
+    EXPECT_GE(a.getValueAtPercentile(100.0), 5000);
+    EXPECT_LE(a.getValueAtPercentile(100.0), 5000 * 1.0625);
+
+    TimingHistogram other(TimingHistogram::DefaultPrecision + 1);
+    EXPECT_THROW(a += other, std::invalid_argument);
+}
+
+TEST(TimingHistogramTest, Copy) {
+    TimingHistogram a(6);
+    addUsec(a, 1000);
+
+    TimingHistogram b;
+    b = a;
+    EXPECT_EQ(6, b.getPrecision());
+    EXPECT_EQ(1, b.get_total());
+    EXPECT_EQ(a.getValueAtPercentile(50.0), b.getValueAtPercentile(50.0));
+
+    TimingHistogram c(a);
+    EXPECT_EQ(a.to_string(), c.to_string());
+
+    // The copy must be independent of the original
+    a.reset();
+    EXPECT_EQ(0, a.get_total());
+    EXPECT_EQ(1, c.get_total());
+}
+
+TEST(TimingHistogramTest, JsonRoundTrip) {
+    TimingHistogram histogram;
+    for (uint64_t usec : {1, 1, 20, 300, 4000, 50000, 600000}) {
+        addUsec(histogram, usec);
+    }
+
+    const auto text = histogram.to_string();
+    EXPECT_NE(std::string::npos,
+              text.find("\"precision\":7,\"unit\":\"us\",\"total\":7,"));
+
+    unique_cJSON_ptr json(cJSON_Parse(text.c_str()));
+    ASSERT_NE(nullptr, json.get());
+    const auto parsed = TimingHistogram::fromJSON(json.get());
+    EXPECT_EQ(histogram.getPrecision(), parsed.getPrecision());
+    EXPECT_EQ(histogram.get_total(), parsed.get_total());
+    for (size_t ii = 0; ii < histogram.getNumBins(); ++ii) {
+        EXPECT_EQ(histogram.getBinCount(ii), parsed.getBinCount(ii));
+    }
+    EXPECT_EQ(text, parsed.to_string());
+}
+
+TEST(TimingHistogramTest, JsonLegacyBuckets) {
+    // The bin bounds below are for a precision of 4
+    TimingHistogram histogram(4);
+    for (uint64_t usec : {0, 1, 1, 20, 300, 4000, 50000, 600000, 100000000}) {
+        addUsec(histogram, usec);
+    }
+
+    unique_cJSON_ptr json(cJSON_Parse(histogram.to_string().c_str()));
+    ASSERT_NE(nullptr, json.get());
+    auto* root = json.get();
+
+    auto getNumber = [root](const char* key) {
+        auto* obj = cJSON_GetObjectItem(root, key);
+        EXPECT_NE(nullptr, obj) << key;
+        return obj == nullptr ? -1 : obj->valueint;
+    };
+    auto getElement = [root](const char* key, int index) {
+        auto* obj = cJSON_GetObjectItem(root, key);
+        EXPECT_NE(nullptr, obj) << key;
+        obj = obj == nullptr ? nullptr : cJSON_GetArrayItem(obj, index);
+        EXPECT_NE(nullptr, obj) << key << "[" << index << "]";
+        return obj == nullptr ? -1 : obj->valueint;
+    };
+
+    EXPECT_EQ(1, getNumber("ns"));
+    EXPECT_EQ(100, cJSON_GetArraySize(cJSON_GetObjectItem(root, "us")));
+    EXPECT_EQ(2, getElement("us", 0));
+    EXPECT_EQ(1, getElement("us", 2));
+    // 300us is in the bin [288, 303]
+    EXPECT_EQ(1, getElement("us", 28));
+    // "ms" starts at 1ms. 4000us is in the bin [3968, 4095]
+    EXPECT_EQ(49, cJSON_GetArraySize(cJSON_GetObjectItem(root, "ms")));
+    EXPECT_EQ(1, getElement("ms", 2));
+    // 50000us is in the bin [49152, 51199]
+    EXPECT_EQ(1, getElement("ms", 48));
+    EXPECT_EQ(1, getElement("500ms", 1));
+    EXPECT_EQ(1, getNumber("80s-inf"));
+    EXPECT_EQ(1, getNumber("wayout"));
+}
+
+TEST(TimingHistogramTest, InvalidJson) {
+    for (const auto* text : {"[]",
+                             "{}",
+                             "{\"precision\":4}",
+                             "{\"precision\":0,\"bins\":[]}",
+                             "{\"precision\":4,\"bins\":{}}",
+                             "{\"precision\":4,\"bins\":[[1]]}",
+                             "{\"precision\":4,\"bins\":[[\"1\",1]]}",
+                             "{\"precision\":4,\"bins\":[[100000,1]]}"}) {
+        unique_cJSON_ptr json(cJSON_Parse(text));
+        ASSERT_NE(nullptr, json.get()) << text;
+        EXPECT_THROW(TimingHistogram::fromJSON(json.get()),
+                     std::invalid_argument)
+            << text;
+    }
+}
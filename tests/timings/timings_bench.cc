@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Microbenchmark for the command timing collection.
+ *
+ * A number of threads record samples for the same opcode (like all of the
+ * worker threads do for a hot opcode) while the main thread generates the
+ * stats. The time used to collect the samples and to generate the stats
+ * is recorded (in usec) as properties in the GTest XML output so that the
+ * cost may be compared as the number of threads grow.
+ *
+ * It is disabled so that it doesn't slow down the unit tests; run it with:
+ *
+ *     memcached_timings_bench --gtest_also_run_disabled_tests \
+ *                             --gtest_filter=*PerfTest*
+ */
+#include "daemon/timings.h"
+
+#include <memcached/protocol_binary.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const size_t SamplesPerThread = 1000000;
+
+class TimingsPerfTest : public ::testing::TestWithParam<size_t> {
+protected:
+    void SetUp() {
+        timings.setNumThreads(GetParam());
+    }
+
+    Timings timings;
+};
+
+INSTANTIATE_TEST_CASE_P(Threads,
+                        TimingsPerfTest,
+                        ::testing::Values(1, 2, 4, 8, 16),
+                        ::testing::PrintToStringParamName());
+
+TEST_P(TimingsPerfTest, DISABLED_Collect) {
+    const size_t numThreads = GetParam();
+    std::atomic<bool> done{false};
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < numThreads; ++ii) {
+        threads.emplace_back([this, ii]() {
+            for (size_t jj = 0; jj < SamplesPerThread; ++jj) {
+                timings.collect(ii, PROTOCOL_BINARY_CMD_GET, (jj % 1000) * 100);
+            }
+        });
+    }
+
+    // Request the stats while the samples are being collected
+    size_t generated = 0;
+    std::chrono::steady_clock::duration generateTime{};
+    std::thread stats([this, &done, &generated, &generateTime]() {
+        while (!done) {
+            const auto begin = std::chrono::steady_clock::now();
+            timings.generate(PROTOCOL_BINARY_CMD_GET);
+            timings.get_aggregated_retrival_stats();
+            generateTime += std::chrono::steady_clock::now() - begin;
+            ++generated;
+        }
+    });
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const auto collectTime = std::chrono::steady_clock::now() - start;
+    done = true;
+    stats.join();
+
+    EXPECT_EQ(numThreads * SamplesPerThread,
+              timings.get_aggregated_retrival_stats());
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    RecordProperty("collect_usec",
+                   int(duration_cast<microseconds>(collectTime).count()));
+    RecordProperty("ns_per_sample",
+                   int(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               collectTime)
+                               .count() /
+                       SamplesPerThread));
+    if (generated > 0) {
+        RecordProperty(
+                "generate_usec",
+                int(duration_cast<microseconds>(generateTime).count() /
+                    generated));
+    }
+}
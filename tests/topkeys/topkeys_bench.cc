@@ -16,8 +16,11 @@
  */
 #include "daemon/topkeys.h"
 
+#include <cJSON_utils.h>
+
 #include <gtest/gtest.h>
 #include <memory>
+#include <string>
 
 
 class TopKeysTest : public ::testing::Test {
@@ -46,7 +49,7 @@ TEST_F(TopKeysTest, Basic) {
     // loop inserting keys
     for (int jj = 0; jj < 20000; jj++) {
         for (auto& key : keys) {
-            topkeys->updateKey(key.c_str(), key.size(), jj);
+            topkeys->updateKey(0, key.c_str(), key.size(), jj);
         }
     }
 
@@ -55,3 +58,120 @@ TEST_F(TopKeysTest, Basic) {
     topkeys->stats(&count, 0, dump_key);
     EXPECT_EQ(80, count);
 }
+
+static std::vector<std::string> get_keys(cJSON* object) {
+    std::vector<std::string> ret;
+    auto* array = cJSON_GetObjectItem(object, "topkeys");
+    for (auto* it = array->child; it != nullptr; it = it->next) {
+        ret.emplace_back(cJSON_GetObjectItem(it, "key")->valuestring);
+    }
+    return ret;
+}
+
+TEST_F(TopKeysTest, HeavyHitters) {
+    // 5 hot keys hidden among a long tail of keys only accessed once
+    for (int jj = 0; jj < 100000; jj++) {
+        if (jj % 10 == 0) {
+            const auto key = "hot_" + std::to_string((jj / 10) % 5);
+            topkeys->updateKey(0, key.c_str(), key.size(), 0);
+        } else {
+            const auto key = "cold_" + std::to_string(jj);
+            topkeys->updateKey(0, key.c_str(), key.size(), 0);
+        }
+    }
+
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    topkeys->json_stats(json.get(), 0);
+    const auto keys = get_keys(json.get());
+    ASSERT_EQ(80, keys.size());
+    for (int ii = 0; ii < 5; ++ii) {
+        EXPECT_EQ(0, keys[ii].find("hot_")) << keys[ii];
+    }
+
+    // The real count (2000) must be within the reported error bounds
+    auto* item = cJSON_GetArrayItem(cJSON_GetObjectItem(json.get(), "topkeys"),
+                                    0);
+    const auto count = cJSON_GetObjectItem(item, "access_count")->valueint;
+    const auto error = cJSON_GetObjectItem(item, "error")->valueint;
+    EXPECT_GE(count, 2000);
+    EXPECT_LE(count - error, 2000);
+}
+
+TEST_F(TopKeysTest, OrderByBytes) {
+    const std::string reader("reader");
+    const std::string writer("writer");
+    for (int jj = 0; jj < 100; jj++) {
+        topkeys->updateKey(0, reader.c_str(), reader.size(), 0, 100, 0);
+        topkeys->updateKey(0, writer.c_str(), writer.size(), 0, 0, 1000);
+    }
+    // Make sure the writer is the first when ordered by ops
+    topkeys->updateKey(0, writer.c_str(), writer.size(), 0);
+
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    topkeys->json_stats(json.get(), 0, TopKeys::Order::Ops);
+    EXPECT_EQ(writer, get_keys(json.get()).front());
+
+    json.reset(cJSON_CreateObject());
+    topkeys->json_stats(json.get(), 0, TopKeys::Order::BytesRead);
+    EXPECT_EQ(reader, get_keys(json.get()).front());
+
+    json.reset(cJSON_CreateObject());
+    topkeys->json_stats(json.get(), 0, TopKeys::Order::BytesWritten);
+    EXPECT_EQ(writer, get_keys(json.get()).front());
+}
+
+TEST_F(TopKeysTest, SlidingWindow) {
+    topkeys.reset(new TopKeys(10, 1, 60));
+    const std::string key("old_key");
+    topkeys->updateKey(0, key.c_str(), key.size(), 100);
+
+    // Still reported in the next window
+    size_t count = 0;
+    topkeys->stats(&count, 170, dump_key);
+    EXPECT_EQ(1, count);
+
+    // But not after two windows without any access
+    count = 0;
+    topkeys->stats(&count, 300, dump_key);
+    EXPECT_EQ(0, count);
+}
+
+TEST_F(TopKeysTest, MultipleThreads) {
+    topkeys.reset(new TopKeys(10, 4));
+    const std::string key("shared_key");
+    for (size_t thread = 0; thread < 4; ++thread) {
+        for (int jj = 0; jj < 10; jj++) {
+            topkeys->updateKey(thread, key.c_str(), key.size(), 0);
+        }
+    }
+
+    // The counts from each thread's sketch are merged
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    topkeys->json_stats(json.get(), 0);
+    auto* array = cJSON_GetObjectItem(json.get(), "topkeys");
+    ASSERT_EQ(1, cJSON_GetArraySize(array));
+    auto* item = cJSON_GetArrayItem(array, 0);
+    EXPECT_EQ(40, cJSON_GetObjectItem(item, "access_count")->valueint);
+}
+
+TEST_F(TopKeysTest, RatePerBucket) {
+    topkeys.reset(new TopKeys(10, 4));
+    const std::string key("hot_key");
+
+    // The rate is only counted when asked for
+    EXPECT_EQ(0u, topkeys->updateKey(0, key.c_str(), key.size(), 10));
+
+    // The accesses from all of the threads are counted
+    uint32_t rate = 0;
+    for (size_t thread = 0; thread < 4; ++thread) {
+        for (int jj = 0; jj < 10; jj++) {
+            rate = topkeys->updateKey(thread, key.c_str(), key.size(), 10,
+                                      0, 0, true);
+        }
+    }
+    EXPECT_EQ(40u, rate);
+
+    // And start from zero the next second
+    EXPECT_EQ(1u,
+              topkeys->updateKey(2, key.c_str(), key.size(), 11, 0, 0, true));
+}
@@ -26,6 +26,8 @@
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <string>
+#include <thread>
 
 struct test_harness test_harness;
 
@@ -356,6 +358,168 @@ static enum test_result remove_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     return SUCCESS;
 }
 
+/*
+ * Make sure that update replaces the item with the version provided by the
+ * callback, and that the item is left alone if the callback fails
+ */
+static enum test_result update_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
+    if (h1->update == nullptr) {
+        return SKIPPED;
+    }
+
+    item *test_item = NULL;
+    DocKey key("update_test_key", test_harness.doc_namespace);
+    uint64_t cas = 0;
+    uint64_t new_cas = 0;
+    mutation_descr_t mut_info;
+    item_info ii;
+
+    cb_assert(h1->allocate(h, NULL, &test_item, key, 1, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES, 0) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, test_item, &ii) == true);
+    memcpy(ii.value[0].iov_base, "1", 1);
+    cb_assert(h1->store(h, NULL, test_item, &cas,
+                        OPERATION_SET, DocumentState::Alive) == ENGINE_SUCCESS);
+    h1->release(h, NULL, test_item);
+
+    const std::string value("12");
+    cb_assert(h1->update(h, NULL, key, 0, DocStateFilter::Alive,
+                         [cas, &value](const item_info& info,
+                                       item_update& update) {
+                             assert_equal(cas, info.cas);
+                             assert_equal(1u, info.nbytes);
+                             update.value = {value.data(), value.size()};
+                             update.datatype = PROTOCOL_BINARY_RAW_BYTES;
+                             update.exptime = 0;
+                             update.document_state = DocumentState::Alive;
+                             return ENGINE_SUCCESS;
+                         },
+                         &new_cas, &mut_info) == ENGINE_SUCCESS);
+    cb_assert(new_cas != 0);
+    cb_assert(new_cas != cas);
+
+    cb_assert(h1->get(h, NULL, &test_item, key, 0,
+                      DocStateFilter::Alive) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, test_item, &ii) == true);
+    assert_equal(new_cas, ii.cas);
+    assert_equal(2u, ii.nbytes);
+    cb_assert(memcmp(ii.value[0].iov_base, "12", 2) == 0);
+    h1->release(h, NULL, test_item);
+
+    // The error from the callback is returned, and the item is unchanged
+    cb_assert(h1->update(h, NULL, key, 0, DocStateFilter::Alive,
+                         [](const item_info&, item_update&) {
+                             return ENGINE_NOT_STORED;
+                         },
+                         &cas, &mut_info) == ENGINE_NOT_STORED);
+    cb_assert(h1->get(h, NULL, &test_item, key, 0,
+                      DocStateFilter::Alive) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, test_item, &ii) == true);
+    assert_equal(new_cas, ii.cas);
+    h1->release(h, NULL, test_item);
+
+    // The item isn't replaced if someone else changed it while the
+    // callback was running
+    cb_assert(h1->update(h, NULL, key, 0, DocStateFilter::Alive,
+                         [h, h1, &key, &value](const item_info&,
+                                               item_update& update) {
+                             item* it = NULL;
+                             item_info info;
+                             uint64_t store_cas = 0;
+                             cb_assert(h1->allocate(h, NULL, &it, key, 1, 0, 0,
+                                                    PROTOCOL_BINARY_RAW_BYTES,
+                                                    0) == ENGINE_SUCCESS);
+                             cb_assert(h1->get_item_info(h, NULL, it, &info));
+                             memcpy(info.value[0].iov_base, "5", 1);
+                             cb_assert(h1->store(h, NULL, it, &store_cas,
+                                                 OPERATION_SET,
+                                                 DocumentState::Alive) ==
+                                       ENGINE_SUCCESS);
+                             h1->release(h, NULL, it);
+
+                             update.value = {value.data(), value.size()};
+                             update.datatype = PROTOCOL_BINARY_RAW_BYTES;
+                             update.exptime = 0;
+                             update.document_state = DocumentState::Alive;
+                             return ENGINE_SUCCESS;
+                         },
+                         &cas, &mut_info) == ENGINE_KEY_EEXISTS);
+    cb_assert(h1->get(h, NULL, &test_item, key, 0,
+                      DocStateFilter::Alive) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, test_item, &ii) == true);
+    assert_equal(1u, ii.nbytes);
+    cb_assert(memcmp(ii.value[0].iov_base, "5", 1) == 0);
+    h1->release(h, NULL, test_item);
+
+    // Missing items aren't created
+    DocKey missing("update_test_missing_key", test_harness.doc_namespace);
+    cb_assert(h1->update(h, NULL, missing, 0, DocStateFilter::Alive,
+                         [](const item_info&, item_update&) {
+                             abort();
+                             return ENGINE_FAILED;
+                         },
+                         &cas, &mut_info) == ENGINE_KEY_ENOENT);
+    return SUCCESS;
+}
+
+/*
+ * Concurrent updates of the same item are serialised by the engine, so
+ * none of them should fail because of the others.
+ */
+static enum test_result update_concurrent_test(ENGINE_HANDLE *h,
+                                               ENGINE_HANDLE_V1 *h1) {
+    item *test_item = NULL;
+    DocKey key("update_concurrent_test_key", test_harness.doc_namespace);
+    uint64_t cas = 0;
+    item_info ii;
+
+    cb_assert(h1->allocate(h, NULL, &test_item, key, 0, 0, 0,
+                           PROTOCOL_BINARY_RAW_BYTES, 0) == ENGINE_SUCCESS);
+    cb_assert(h1->store(h, NULL, test_item, &cas,
+                        OPERATION_SET, DocumentState::Alive) == ENGINE_SUCCESS);
+    h1->release(h, NULL, test_item);
+
+    const int num_threads = 4;
+    const int num_updates = 100;
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < num_threads; ++ii) {
+        threads.emplace_back([h, h1, &key]() {
+            for (int jj = 0; jj < num_updates; ++jj) {
+                uint64_t new_cas = 0;
+                mutation_descr_t mut_info;
+                std::string value;
+                cb_assert(h1->update(h, NULL, key, 0, DocStateFilter::Alive,
+                                     [&value](const item_info& info,
+                                              item_update& update) {
+                                         value.assign(static_cast<const char*>(
+                                                 info.value[0].iov_base),
+                                                      info.nbytes);
+                                         value.push_back('x');
+                                         update.value = {value.data(),
+                                                         value.size()};
+                                         update.datatype =
+                                                 PROTOCOL_BINARY_RAW_BYTES;
+                                         update.exptime = 0;
+                                         update.document_state =
+                                                 DocumentState::Alive;
+                                         return ENGINE_SUCCESS;
+                                     },
+                                     &new_cas, &mut_info) == ENGINE_SUCCESS);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    cb_assert(h1->get(h, NULL, &test_item, key, 0,
+                      DocStateFilter::Alive) == ENGINE_SUCCESS);
+    cb_assert(h1->get_item_info(h, NULL, test_item, &ii) == true);
+    assert_equal(uint32_t(num_threads * num_updates), ii.nbytes);
+    h1->release(h, NULL, test_item);
+    return SUCCESS;
+}
+
 /*
  * Make sure we can successfully perform a flush operation and that any item
  * stored before the flush can not be retrieved
@@ -641,6 +805,9 @@ engine_test_t* get_tests(void) {
         TEST_CASE("get deleted test", get_deleted_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("expiry test", expiry_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("remove test", remove_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("update test", update_test, NULL, NULL, NULL, NULL, NULL),
+        TEST_CASE("update concurrent test", update_concurrent_test, NULL, NULL,
+                  NULL, NULL, NULL),
         TEST_CASE("release test", release_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("flush test", flush_test, NULL, NULL, NULL, NULL, NULL),
         TEST_CASE("get item info test", get_item_info_test, NULL, NULL, NULL, NULL, NULL),
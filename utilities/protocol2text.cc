@@ -160,6 +160,7 @@ static const std::map<uint8_t, std::string> commandmap {
     {PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP,"SUBDOC_MULTI_LOOKUP"},
     {PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION,"SUBDOC_MULTI_MUTATION"},
     {PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT, "SUBDOC_GET_COUNT"},
+    {PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY, "SUBDOC_MULTI_KEY"},
     {PROTOCOL_BINARY_CMD_SCRUB,"SCRUB"},
     {PROTOCOL_BINARY_CMD_ISASL_REFRESH,"ISASL_REFRESH"},
     {PROTOCOL_BINARY_CMD_SSL_CERTS_REFRESH,"SSL_CERTS_REFRESH"},
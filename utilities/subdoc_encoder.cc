@@ -85,6 +85,48 @@ std::vector<char> SubdocMultiMutationCmd::encode() const {
     return request;
 }
 
+std::vector<char> SubdocMultiKeyCmd::encode() const {
+    // Encode the multi-path command, and move its extras and specs into
+    // the new packet.
+    const std::vector<char> inner = command.encode();
+    const auto* inner_header =
+            reinterpret_cast<const protocol_binary_request_header*>(
+                    inner.data());
+    const size_t extras_end =
+            sizeof(*inner_header) + inner_header->request.extlen;
+    const size_t specs_begin =
+            extras_end + ntohs(inner_header->request.keylen);
+
+    std::vector<char> request(inner.begin(), inner.begin() + extras_end);
+    request.push_back(char(command.command));
+    const uint16_t nkeys = htons(uint16_t(keys.size()));
+    std::copy(reinterpret_cast<const char*>(&nkeys),
+              reinterpret_cast<const char*>(&nkeys) + sizeof(nkeys),
+              back_inserter(request));
+    for (const auto& key : keys) {
+        const uint16_t vbucket = 0;
+        const uint16_t keylen = htons(uint16_t(key.size()));
+        std::copy(reinterpret_cast<const char*>(&vbucket),
+                  reinterpret_cast<const char*>(&vbucket) + sizeof(vbucket),
+                  back_inserter(request));
+        std::copy(reinterpret_cast<const char*>(&keylen),
+                  reinterpret_cast<const char*>(&keylen) + sizeof(keylen),
+                  back_inserter(request));
+        std::copy(key.begin(), key.end(), back_inserter(request));
+    }
+    std::copy(inner.begin() + specs_begin, inner.end(),
+              back_inserter(request));
+
+    // Populate the header.
+    auto* header = reinterpret_cast<protocol_binary_request_header*>
+        (request.data());
+    header->request.opcode = PROTOCOL_BINARY_CMD_SUBDOC_MULTI_KEY;
+    header->request.keylen = 0;
+    header->request.bodylen = htonl(request.size() - sizeof(*header));
+
+    return request;
+}
+
 std::vector<char> SubdocMultiCmd::encode_common() const {
     std::vector<char> request;
 
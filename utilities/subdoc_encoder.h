@@ -101,3 +101,20 @@ struct SubdocMultiMutationCmd : public SubdocMultiCmd {
      */
     std::vector<char> encode() const;
 };
+
+/* Sub-document API MULTI_KEY command; runs a MULTI_LOOKUP or
+ * MULTI_MUTATION on a list of keys (the key of the command is ignored).
+ */
+struct SubdocMultiKeyCmd {
+
+    SubdocMultiKeyCmd(const SubdocMultiCmd& command_)
+        : command(command_) {}
+
+    const SubdocMultiCmd& command;
+    std::vector<std::string> keys;
+
+    /* Takes the current state of object and encodes a SUBDOC_MULTI_KEY
+     * packet in network order.
+     */
+    std::vector<char> encode() const;
+};
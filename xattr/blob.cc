@@ -17,6 +17,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <xattr/blob.h>
 
@@ -24,48 +25,171 @@ namespace cb {
 namespace xattr {
 
 cb::byte_buffer Blob::get(const cb::const_byte_buffer& key) const {
+    const auto offset = find(key);
+    if (offset == 0) {
+        // Not found!
+        return {nullptr, 0};
+    }
+
+    auto* value = blob.buf + offset + 4 + key.len + 1;
+    return {value, strlen(reinterpret_cast<char*>(value))};
+}
+
+int Blob::compare_key(size_t offset, const cb::const_byte_buffer& key) const {
+    // The stored key is zero terminated and followed by the value, so we
+    // can compare the key.len bytes (the terminator sorts the shorter key
+    // first) as long as they're within the kv-pair
+    const auto size = read_length(offset);
+    const auto* stored = blob.buf + offset + 4;
+    if (key.len < size) {
+        const int ret = std::memcmp(stored, key.buf, key.len);
+        if (ret != 0) {
+            return ret;
+        }
+        return stored[key.len] == '\0' ? 0 : 1;
+    }
+    const int ret = std::memcmp(stored, key.buf, size);
+    return ret != 0 ? ret : -1;
+}
+
+size_t Blob::scan(const cb::const_byte_buffer& key, size_t& visited) const {
+    visited = 0;
     try {
         size_t current = 4;
         while (current < blob.len) {
+            ++visited;
             // Get the length of the next kv-pair
             const auto size = read_length(current);
-            current += 4;
-            if (size > key.len) {
-                // This may be the next key
-                if (blob.buf[current + key.len] == '\0' &&
-                    std::memcmp(blob.buf + current, key.buf, key.len) == 0) {
-                    // Yay this is the key!!!
-                    auto* value = blob.buf + current + key.len + 1;
-                    return {value, strlen(reinterpret_cast<char*>(value))};
-                } else {
-                    // jump to the next key!!
-                    current += size;
-                }
-            } else {
-                current += size;
+            // Check the terminator first as it rejects most of the keys
+            if (size > key.len && blob.buf[current + 4 + key.len] == '\0' &&
+                std::memcmp(blob.buf + current + 4, key.buf, key.len) == 0) {
+                return current;
             }
+            current += 4 + size;
         }
     } catch (const std::out_of_range& ex) {
     }
+    return 0;
+}
+
+bool Blob::build_index() const {
+    size_t count = 0;
+    try {
+        size_t current = 4;
+        while (current < blob.len) {
+            ++count;
+            current += 4 + read_length(current);
+        }
+    } catch (const std::out_of_range& ex) {
+        return false;
+    }
+
+    index.clear();
+    index.reserve(count);
+    for (size_t current = 4; current < blob.len;
+         current += 4 + read_length(current)) {
+        index.push_back(uint32_t(current));
+    }
+
+    const auto* buf = blob.buf;
+    std::sort(index.begin(), index.end(), [buf](uint32_t a, uint32_t b) {
+        return strcmp(reinterpret_cast<const char*>(buf + a + 4),
+                      reinterpret_cast<const char*>(buf + b + 4)) < 0;
+    });
+    indexed = true;
+    return true;
+}
+
+size_t Blob::find(const cb::const_byte_buffer& key) const {
+    if (!indexed) {
+        size_t visited;
+        const auto offset = scan(key, visited);
+        // Building the index costs more than a few scans, so don't do
+        // it unless the blob is big and searched a number of times
+        if (visited >= IndexThreshold && ++lookups > IndexLookups) {
+            build_index();
+        }
+        return offset;
+    }
 
-    // Not found!
-    return {nullptr, 0};
+    auto iter = std::lower_bound(index.begin(), index.end(), key,
+                                 [this](uint32_t offset,
+                                        const cb::const_byte_buffer& k) {
+                                     return compare_key(offset, k) < 0;
+                                 });
+    if (iter != index.end() && compare_key(*iter, key) == 0) {
+        return *iter;
+    }
+    return 0;
+}
+
+void Blob::index_insert(size_t offset, const cb::const_byte_buffer& key) {
+    if (!indexed) {
+        return;
+    }
+
+    auto iter = std::lower_bound(index.begin(), index.end(), key,
+                                 [this](uint32_t o,
+                                        const cb::const_byte_buffer& k) {
+                                     return compare_key(o, k) < 0;
+                                 });
+    index.insert(iter, uint32_t(offset));
+}
+
+void Blob::index_remove(size_t offset, size_t size) {
+    if (!indexed) {
+        return;
+    }
+
+    auto iter = std::find(index.begin(), index.end(), uint32_t(offset));
+    if (iter != index.end()) {
+        index.erase(iter);
+    }
+    for (auto& entry : index) {
+        if (entry > offset) {
+            entry -= uint32_t(size);
+        }
+    }
 }
 
 void Blob::prune_user_keys() {
+    // Move all of the system xattrs to the front of the blob in a single
+    // pass instead of removing the user xattrs one by one
+    size_t current = 4;
+    size_t write = 4;
     try {
-        size_t current = 4;
         while (current < blob.len) {
             // Get the length of the next kv-pair
-            const auto size = read_length(current);
+            const auto size = 4 + read_length(current);
 
-            if (blob.buf[current + 4] != '_') {
-                remove_segment(current, size + 4);
-            } else {
-                current += 4 + size;
+            if (blob.buf[current + 4] == '_') {
+                if (write != current) {
+                    std::memmove(blob.buf + write, blob.buf + current, size);
+                }
+                write += size;
             }
+            current += size;
         }
     } catch (const std::out_of_range& ex) {
+        // Keep the (invalid) tail as it is
+        if (write == current) {
+            return;
+        }
+        std::memmove(blob.buf + write, blob.buf + current,
+                     blob.len - current);
+        write += blob.len - current;
+    }
+
+    if (write == current) {
+        // There wasn't any user xattrs
+        return;
+    }
+
+    indexed = false;
+    index.clear();
+    blob.len = write == 4 ? 0 : write;
+    if (blob.len > 0) {
+        write_length(0, uint32_t(blob.len - 4));
     }
 }
 
@@ -117,6 +241,7 @@ void Blob::set(const cb::const_byte_buffer& key,
             // Skip the old value and copy the rest
             std::copy(blob.buf + old_offset + old_kv_size,
                       blob.buf + blob.len, temp.get() + old_offset);
+            index_remove(old_offset, old_kv_size);
             allocator.swap(temp);
             blob = {allocator.get(), newsize - 4 - key.len - 1 - value.len - 1};
             alloc_size = newsize;
@@ -169,9 +294,12 @@ void Blob::append_kvpair(const cb::const_byte_buffer& key,
 
     grow_buffer(needed);
     write_kvpair(offset, key, value);
+    index_insert(offset, key);
 }
 
 void Blob::remove_segment(const size_t offset, const size_t size) {
+    index_remove(offset, size);
+
     if (offset + size == blob.len) {
         // No need to do anyting as this was the last thing in our blob..
         // just change the length